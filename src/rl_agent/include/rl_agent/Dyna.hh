@@ -7,10 +7,25 @@
 
 #include <rl_common/Random.h>
 #include <rl_common/core.hh>
+#include <rl_agent/QTable.hh>
 
-#include <map>
-#include <set>
 #include <vector>
+#include <pthread.h>
+
+/** Most experiences kept for planning. Once full, the oldest ones are replaced. */
+#define DYNA_REPLAY_SIZE 100000
+
+/** Plan on a separate thread instead of doing k updates before each action */
+#define DYNA_BACKGROUND_PLANNING false
+
+/** # of planning updates the background thread does each time it takes the lock */
+#define DYNA_PLAN_BATCH 10
+
+/** Added to the TD error of an experience to get its priority, so every experience can be sampled */
+#define DYNA_MIN_PRIORITY 0.01
+
+/** Thread that continually does planning updates from the replay experiences. */
+void* dynaPlanningStart(void* arg);
 
 /** Agent that uses straight Q-learning, with no generalization and
     epsilon-greedy exploration. */
@@ -47,18 +62,29 @@ public:
   void printState(const std::vector<float> &s);
   float getValue(std::vector<float> state);
   
-  std::vector<float>::iterator random_max_element(
-						   std::vector<float>::iterator start,
-						   std::vector<float>::iterator end);
+  float* random_max_element(float* start, float* end);
 
   void logValues(ofstream *of, int xmin, int xmax, int ymin, int ymax);
   float epsilon;
 
+  /** Start or stop planning on a separate thread. While it is on, the
+      thread continually updates Q from replay experiences sampled in
+      proportion to their last TD error, and actions are chosen
+      without doing any planning first.  */
+  void setBackgroundPlanning(bool background);
+
+  /** Do a batch of planning updates on the planning thread. Returns
+      false once the thread should stop. */
+  bool backgroundPlanning();
+
+  /** # of planning updates done by the planning thread */
+  long getNumPlanningUpdates();
+
 protected:
-  /** The implementation maps all sensations to a set of canonical
-      pointers, which serve as the internal representation of
-      environment state. */
-  typedef const std::vector<float> *state_t;
+  /** The implementation maps all sensations to dense integer ids,
+      which serve as the internal representation of environment
+      state. */
+  typedef int state_t;
 
   struct dynaExperience {
     state_t s;
@@ -69,25 +95,58 @@ protected:
   };
   void addExperience(float r, state_t s, bool term);
 
+  /** Set the priority of replay experience i */
+  void setPriority(int i, float p);
+
+  /** Sample a replay experience in proportion to its priority */
+  int samplePriority();
+
+  /** Update Q from replay experience i, returning the TD error */
+  float planningUpdate(int i);
+
   /** Produces a canonical representation of the given sensation.
       \param s The current sensation from the environment.
-      \return A pointer to an equivalent state in statespace. */
+      \return The id of an equivalent state in Q. */
   state_t canonicalize(const std::vector<float> &s);
 
 private:
-  /** Set of all distinct sensations seen.  Pointers to elements of
-      this set serve as the internal representation of the environment
-      state. */
-  std::set<std::vector<float> > statespace;
-
   /** The primary data structure of the learning algorithm, the value
-      function Q.  For state_t s and int a, Q[s][a] gives the
+      function Q.  For state_t s and int a, Q.row(s)[a] gives the
       learned maximum expected future discounted reward conditional on
       executing action a in state s. */
-  std::map<state_t, std::vector<float> > Q;
+  QTable Q;
 
+  /** Ring buffer of up to DYNA_REPLAY_SIZE experiences */
   std::vector<dynaExperience> experiences;
 
+  /** Where the next experience goes once the ring buffer is full */
+  int nextExp;
+
+  /** Sum tree of the priorities of the experiences, used when planning
+      in the background. The leaves start at priorityLeaves, and each
+      node holds the sum of its two children. */
+  std::vector<float> priorities;
+  int priorityLeaves;
+
+  /** Priority given to new experiences, the highest seen so far */
+  float maxPriority;
+
+  /** Guards Q and the experiences against the planning thread. The
+      acting thread takes it to change Q or copy a state's values. */
+  pthread_mutex_t dyna_mutex;
+
+  /** Signalled when an experience is added or planning is stopping */
+  pthread_cond_t replay_cond;
+
+  pthread_t planThread;
+  bool background;
+  bool stopPlanning;
+  long nPlanUpdates;
+
+  /** Copy of the action values of the current state, which the
+      planning thread may be changing as we choose an action */
+  std::vector<float> actionValues;
+
   const int numactions;
   const float gamma;
 
@@ -96,7 +155,12 @@ private:
   const int k;
 
   Random rng;
-  float *currentq;
+
+  /** Random number generator for the planning thread */
+  Random planRng;
+
+  /** Position in Q of the value to update on the next step, -1 if none */
+  int currentq;
   state_t laststate;
   int lastact;
 
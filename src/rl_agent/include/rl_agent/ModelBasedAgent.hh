@@ -41,6 +41,8 @@ public:
       \param featPct pct of feature to remove from set used for each split in tree
       \param stoch is the domain stochastic?
       \param episodic is the domain episodic?
+      \param compress should the trees keep repeated experiences as one weighted experience?
+      \param expCap most experiences each tree keeps, sampled from all it has seen (0 for no limit)
       \param rng Initial state of the random number generator to use */
   ModelBasedAgent(int numactions, float gamma, float rmax, float rrange, 
                   int modelType, int exploreType, 
@@ -50,7 +52,8 @@ public:
                   const std::vector<float> &featmax,
                   int statesPerDim, int history, float v, float n,
                   bool depTrans, bool relTrans, float featPct,
-                  bool stoch, bool episodic, Random rng = Random());
+                  bool stoch, bool episodic, bool compress, int expCap,
+                  Random rng = Random());
 
   /** Standard constructor 
       \param numactions The number of possible actions
@@ -76,6 +79,8 @@ public:
       \param featPct pct of feature to remove from set used for each split in tree
       \param stoch is the domain stochastic?
       \param episodic is the domain episodic?
+      \param compress should the trees keep repeated experiences as one weighted experience?
+      \param expCap most experiences each tree keeps, sampled from all it has seen (0 for no limit)
       \param rng Initial state of the random number generator to use*/
   ModelBasedAgent(int numactions, float gamma, float rmax, float rrange, 
                   int modelType, int exploreType, 
@@ -85,7 +90,8 @@ public:
                   const std::vector<float> &featmax,
                   std::vector<int> statesPerDim, int history, float v, float n,
                   bool depTrans, bool relTrans, float featPct,
-                  bool stoch, bool episodic, Random rng = Random());
+                  bool stoch, bool episodic, bool compress, int expCap,
+                  Random rng = Random());
   
   /** Init params for both constructors */
   void initParams();
@@ -106,6 +112,26 @@ public:
   /** Output value function to a file */
   void logValues(ofstream *of, int xmin, int xmax, int ymin, int ymax);
 
+  /** Set the environment the agent is acting in and a simulator of it,
+      for the planners that roll out on the true domain
+      (UCT_WITH_ENV and ET_UCT_WITH_ENV).  Must be called before the
+      first action. */
+  void setSimulator(Environment* env, Environment* sim);
+
+  /** Start from the trees of a model file written by FactoredModel::saveModel
+      (e.g. by the model_pretrain tool) instead of an untrained model.  The
+      file is loaded when the model is made, before any seeding. */
+  void setModelFile(const char* filename);
+
+  /** Limit the tree model's predictions to the maxOutcomes most likely
+      next states (0 for no limit), pruning next states less likely than
+      minProb.  Must be called before the first action. */
+  void setOutcomeLimits(int maxOutcomes, float minProb);
+
+  /** Keep up to size predictions in the tree model's prediction cache
+      (0 turns it off).  Must be called before the first action. */
+  void setCacheSize(int size);
+
   bool AGENTDEBUG;
   bool POLICYDEBUG; //= false; //true;
   bool ACTDEBUG;
@@ -169,6 +195,20 @@ private:
 
   int BATCH_FREQ;
 
+  /** Real environment and simulator for planning on the true domain */
+  Environment* env;
+  Environment* sim;
+
+  /** Model file to load the trees from, or NULL */
+  const char* modelFile;
+
+  /** Most next states kept for a prediction, and least likely one kept */
+  int maxOutcomes;
+  float minOutcomeProb;
+
+  /** # of predictions the tree model caches */
+  int cacheSize;
+
   bool modelChanged;
 
   const int numactions;
@@ -197,6 +237,8 @@ private:
   const float featPct;
   const bool stoch;
   const bool episodic;
+  const bool compress;
+  const int expCap;
 
   Random rng;
 
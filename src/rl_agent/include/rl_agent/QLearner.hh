@@ -7,9 +7,8 @@
 
 #include <rl_common/Random.h>
 #include <rl_common/core.hh>
+#include <rl_agent/QTable.hh>
 
-#include <map>
-#include <set>
 #include <vector>
 
 /** Agent that uses straight Q-learning, with no generalization and
@@ -44,35 +43,28 @@ public:
   void printState(const std::vector<float> &s);
   float getValue(std::vector<float> state);
   
-  std::vector<float>::iterator random_max_element(
-						   std::vector<float>::iterator start,
-						   std::vector<float>::iterator end);
+  float* random_max_element(float* start, float* end);
 
   void logValues(ofstream *of, int xmin, int xmax, int ymin, int ymax);
   float epsilon;
 
 protected:
-  /** The implementation maps all sensations to a set of canonical
-      pointers, which serve as the internal representation of
-      environment state. */
-  typedef const std::vector<float> *state_t;
+  /** The implementation maps all sensations to dense integer ids,
+      which serve as the internal representation of environment
+      state. */
+  typedef int state_t;
 
   /** Produces a canonical representation of the given sensation.
       \param s The current sensation from the environment.
-      \return A pointer to an equivalent state in statespace. */
+      \return The id of an equivalent state in Q. */
   state_t canonicalize(const std::vector<float> &s);
 
 private:
-  /** Set of all distinct sensations seen.  Pointers to elements of
-      this set serve as the internal representation of the environment
-      state. */
-  std::set<std::vector<float> > statespace;
-
   /** The primary data structure of the learning algorithm, the value
-      function Q.  For state_t s and int a, Q[s][a] gives the
+      function Q.  For state_t s and int a, Q.row(s)[a] gives the
       learned maximum expected future discounted reward conditional on
       executing action a in state s. */
-  std::map<state_t, std::vector<float> > Q;
+  QTable Q;
 
   const int numactions;
   const float gamma;
@@ -81,7 +73,9 @@ private:
   const float alpha;
 
   Random rng;
-  float *currentq;
+
+  /** Position in Q of the value to update on the next step, -1 if none */
+  int currentq;
 
   bool ACTDEBUG;
 };
@@ -0,0 +1,80 @@
+/** \file
+    Interface for the tabular value function shared by the model free
+    agents. */
+
+#ifndef _QTABLE_HH_
+#define _QTABLE_HH_
+
+#include <vector>
+
+/** Initial # of slots in the state hash table (a power of 2) */
+#define QTABLE_INITIAL_SLOTS 64
+
+/** Table of Q(s,a) for every state seen. States are given dense
+    integer ids through an open-addressed hash over the bits of their
+    features, and the values of each state are kept in one contiguous
+    row of numactions floats. */
+class QTable {
+public:
+  /** Standard constructor
+      \param numactions The number of possible actions
+      \param initialvalue The initial value of each Q(s,a) */
+  QTable(int numactions, float initialvalue);
+
+  ~QTable();
+
+  /** Get the id of the given state, adding it with every action at
+      the initial value if it is new. */
+  int getStateId(const std::vector<float> &s);
+
+  /** Q values of the state with the given id, one per action. The
+      pointer is only valid until the next state is added. */
+  float* row(int id) { return &Q[id * numactions]; }
+
+  /** Position of Q(id,a) in the table. Unlike a pointer, it stays
+      valid as the table grows. */
+  int index(int id, int a) const { return id * numactions + a; }
+
+  /** Value at a position given by index() */
+  float& value(int i) { return Q[i]; }
+
+  /** Features of the state with the given id */
+  std::vector<float> getState(int id) const;
+
+  /** # of states in the table */
+  int size() const { return nstates; }
+
+private:
+
+  /** Hash the features of a state */
+  unsigned hashState(const std::vector<float> &s) const;
+
+  /** Check if the state with the given id has these features */
+  bool sameState(int id, const std::vector<float> &s) const;
+
+  /** Double the size of the hash table and re-insert every state */
+  void growTable();
+
+  /** Open-addressed table of state ids, hashed on the state features.
+      -1 for empty slots. */
+  std::vector<int> table;
+
+  /** Features of all the states, one after the other */
+  std::vector<float> stateFeats;
+
+  /** Where each state's features start in stateFeats. The entry after
+      the last state is the end. */
+  std::vector<int> stateStart;
+
+  /** Hash of each state, so the table can grow without re-hashing */
+  std::vector<unsigned> stateHash;
+
+  /** Q values, numactions per state, indexed by id * numactions + action */
+  std::vector<float> Q;
+
+  int nstates;
+  const int numactions;
+  const float initialvalue;
+};
+
+#endif
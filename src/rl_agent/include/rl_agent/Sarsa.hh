@@ -7,11 +7,19 @@
 
 #include <rl_common/Random.h>
 #include <rl_common/core.hh>
+#include <rl_agent/QTable.hh>
 
-#include <map>
-#include <set>
 #include <vector>
 
+/** Eligibility traces that decay below this are dropped */
+#define SARSA_MIN_TRACE 0.01
+
+/** Most eligibility traces kept at once, 0 for no limit */
+#define SARSA_MAX_TRACES 0
+
+/** Set the trace of the action taken to 1 (true), or add 1 to it (false) */
+#define SARSA_REPLACING_TRACES true
+
 /** Agent that uses straight Sarsa Lambda, with no generalization and
     epsilon-greedy exploration. */
 class Sarsa: public Agent {
@@ -43,35 +51,52 @@ public:
   void printState(const std::vector<float> &s);
   float getValue(std::vector<float> state);
   
-  std::vector<float>::iterator random_max_element(
-						   std::vector<float>::iterator start,
-						   std::vector<float>::iterator end);
+  float* random_max_element(float* start, float* end);
 
   void logValues(ofstream *of, int xmin, int xmax, int ymin, int ymax);
 
+  /** Change how eligibility traces are kept.
+      \param minTrace Traces that decay below this are dropped
+      \param maxTraces Most traces kept at once (dropping the smallest), 0 for no limit
+      \param replacing Set the trace of the action taken to 1, rather than adding 1 to it */
+  void setTraceOptions(float minTrace, int maxTraces, bool replacing);
+
 protected:
-  /** The implementation maps all sensations to a set of canonical
-      pointers, which serve as the internal representation of
-      environment state. */
-  typedef const std::vector<float> *state_t;
+  /** The implementation maps all sensations to dense integer ids,
+      which serve as the internal representation of environment
+      state. */
+  typedef int state_t;
 
   /** Produces a canonical representation of the given sensation.
       \param s The current sensation from the environment.
-      \return A pointer to an equivalent state in statespace. */
+      \return The id of an equivalent state in Q. */
   state_t canonicalize(const std::vector<float> &s);
 
 private:
-  /** Set of all distinct sensations seen.  Pointers to elements of
-      this set serve as the internal representation of the environment
-      state. */
-  std::set<std::vector<float> > statespace;
-
   /** The primary data structure of the learning algorithm, the value
-      function Q.  For state_t s and int a, Q[s][a] gives the
+      function Q.  For state_t s and int a, Q.row(s)[a] gives the
       learned maximum expected future discounted reward conditional on
       executing action a in state s. */
-  std::map<state_t, std::vector<float> > Q;
-  std::map<state_t, std::vector<float> > eligibility;
+  QTable Q;
+
+  /** Eligibility trace of a Q(s,a) */
+  struct trace {
+    /** Position of Q(s,a) in Q */
+    int q;
+    float elig;
+  };
+
+  /** Add a trace for the value at position q, dropping the smallest
+      trace first if there are already maxTraces */
+  void addTrace(int q, float elig);
+
+  /** The state-actions with a non-negligible eligibility trace. All
+      other traces are 0. */
+  std::vector<trace> eligibility;
+
+  float minTrace;
+  int maxTraces;
+  bool replacing;
 
   const int numactions;
   const float gamma;
@@ -0,0 +1,132 @@
+/** \file
+    Interface for a linear Sarsa(lambda) or Q(lambda) agent over hashed
+    tile coding features, for domains with continuous features. */
+
+#ifndef _TILECODINGAGENT_HH_
+#define _TILECODINGAGENT_HH_
+
+#include <rl_common/Random.h>
+#include <rl_common/core.hh>
+
+#include <vector>
+
+/** Default # of weights the tiles are hashed into */
+#define TILE_MEMORY_SIZE 1048576
+
+/** Default # of tilings, each offset from the others */
+#define TILE_NUM_TILINGS 8
+
+/** Eligibility traces that decay below this are dropped */
+#define TILE_MIN_TRACE 0.01
+
+
+/** Agent that learns a linear value function over tile coding
+    features. Each of the tilings splits every feature into tiles of
+    the same width, offset a bit differently from the other tilings, so
+    each state is in one tile of each tiling. The tiles (with the
+    action) are hashed into a fixed-size array of weights, and Q(s,a)
+    is the sum of the weights of the tiles of s and a. Memory does not
+    grow with the # of features or the resolution. */
+class TileCodingAgent: public Agent {
+public:
+  /** Standard constructor
+      \param numactions The number of possible actions
+      \param gamma The discount factor
+      \param initialvalue The initial value of each Q(s,a)
+      \param alpha The learning rate, which is split among the tilings
+      \param epsilon The probability of taking a random action
+      \param lambda The eligibility trace decay
+      \param tilesPerDim # of tiles each tiling has across each feature
+      \param numTilings # of tilings
+      \param memorySize # of weights the tiles are hashed into
+      \param qlearning Learn Q(lambda) rather than Sarsa(lambda)
+      \param featmin Minimum value of each feature
+      \param featmax Maximum value of each feature
+      \param rng Initial state of the random number generator to use */
+  TileCodingAgent(int numactions, float gamma,
+                  float initialvalue, float alpha, float epsilon, float lambda,
+                  int tilesPerDim, int numTilings, int memorySize, bool qlearning,
+                  std::vector<float> featmin, std::vector<float> featmax,
+                  Random rng = Random());
+
+  /** Unimplemented copy constructor: internal state cannot be simply
+      copied. */
+  TileCodingAgent(const TileCodingAgent &);
+
+  virtual ~TileCodingAgent();
+
+  virtual int first_action(const std::vector<float> &s);
+  virtual int next_action(float r, const std::vector<float> &s);
+  virtual void last_action(float r);
+  virtual void setDebug(bool d);
+  virtual void seedExp(std::vector<experience> &seeds);
+
+  void printState(const std::vector<float> &s);
+
+protected:
+
+  /** Find the weights of every action's tiles for the given state.
+      The ones for action a are at tiles[a*numTilings]. */
+  void getTiles(const std::vector<float> &s, std::vector<int> *tiles);
+
+  /** Sum the weights of the given tiles */
+  float getQ(const int *tiles);
+
+  /** Compute Q for every action of the state whose tiles are given */
+  void getQs(const std::vector<int> &tiles, std::vector<float> *Q);
+
+  /** Choose an epsilon-greedy action from the values, setting greedy if
+      it is one of the best */
+  int chooseAction(const std::vector<float> &Q, bool *greedy);
+
+  /** Add alpha * delta * trace to the weight of every active trace,
+      then decay the traces by decay, dropping the ones that decay away. */
+  void updateWeights(float delta, float decay);
+
+  /** Set the traces of the given tiles to 1 */
+  void setTraces(const int *tiles);
+
+  /** Drop all the traces */
+  void clearTraces();
+
+private:
+  /** Weights of the hashed tiles */
+  std::vector<float> weights;
+
+  /** Indices of the weights with an active trace, and their traces */
+  std::vector<int> traceWeights;
+  std::vector<float> traces;
+
+  /** Where each weight's trace is in traces, -1 if it has none */
+  std::vector<int> traceSlot;
+
+  /** Tiles and values of the current state */
+  std::vector<int> tiles;
+  std::vector<float> Q;
+
+  /** Value of the action taken in the current state */
+  float lastQ;
+
+  /** Scaled features of the current state, numTilings units per tile */
+  std::vector<int> scaled;
+
+  const int numactions;
+  const float gamma;
+  const float alpha;
+  const float epsilon;
+  const float lambda;
+
+  const int tilesPerDim;
+  const int numTilings;
+  const int memorySize;
+  const bool qlearning;
+
+  std::vector<float> featmin;
+  std::vector<float> featmax;
+
+  Random rng;
+
+  bool ACTDEBUG;
+};
+
+#endif
@@ -1,24 +1,45 @@
 #include <rl_agent/Dyna.hh>
 #include <algorithm>
 
+#include <math.h>
+#include <sched.h>
 #include <sys/time.h>
 
 
 Dyna::Dyna(int numactions, float gamma,
            float initialvalue, float alpha, int k, float ep,
 		   Random rng):
+  Q(numactions, initialvalue),
   numactions(numactions), gamma(gamma),
   initialvalue(initialvalue), alpha(alpha), k(k),
-  rng(rng), currentq(NULL), laststate(NULL), lastact(0)
+  rng(rng), planRng(rng), currentq(-1), laststate(-1), lastact(0)
 {
 
   epsilon = ep;
   ACTDEBUG = false; //true; //false;
   cout << "Dyna agent with k:" << k << endl;
 
+  nextExp = 0;
+  priorityLeaves = 0;
+  maxPriority = 1.0;
+  background = false;
+  stopPlanning = false;
+  nPlanUpdates = 0;
+  actionValues.resize(numactions);
+
+  pthread_mutex_init(&dyna_mutex, NULL);
+  pthread_cond_init(&replay_cond, NULL);
+
+  if (DYNA_BACKGROUND_PLANNING)
+    setBackgroundPlanning(true);
+
 }
 
-Dyna::~Dyna() {}
+Dyna::~Dyna() {
+  setBackgroundPlanning(false);
+  pthread_cond_destroy(&replay_cond);
+  pthread_mutex_destroy(&dyna_mutex);
+}
 
 int Dyna::first_action(const std::vector<float> &s) {
 
@@ -36,7 +57,8 @@ int Dyna::getBestAction(const std::vector<float> &s){
   //cout << "get best action" << endl;
 
   // for some amount of time, update based on randomly sampled experiences
-  int numExp = (int)experiences.size();
+  // (unless the planning thread is already doing it)
+  int numExp = background ? 0 : (int)experiences.size();
   for (int i = 0; i < k && numExp > 0; i++){
     
     // update from randoml sampled action
@@ -47,13 +69,12 @@ int Dyna::getBestAction(const std::vector<float> &s){
 
     dynaExperience e = experiences[exp];
 
-    std::vector<float> &Q_s = Q[e.s];
+    float *Q_s = Q.row(e.s);
     if (e.term){
       Q_s[e.a] += alpha * (e.r - Q_s[e.a]);
     } else {
-      std::vector<float> &Q_next = Q[e.next];
-      const std::vector<float>::iterator max =
-        random_max_element(Q_next.begin(), Q_next.end());
+      float *Q_next = Q.row(e.next);
+      float *max = random_max_element(Q_next, Q_next + numactions);
       Q_s[e.a] += alpha * (e.r + (gamma * *max) - Q_s[e.a]);
     }
 
@@ -63,31 +84,34 @@ int Dyna::getBestAction(const std::vector<float> &s){
   // then do normal action selection
   // Get action values
   state_t st = canonicalize(s);
-  std::vector<float> &Q_s = Q[st];
+  float *Q_s = &(actionValues[0]);
+  pthread_mutex_lock(&dyna_mutex);
+  std::copy(Q.row(st), Q.row(st) + numactions, Q_s);
+  pthread_mutex_unlock(&dyna_mutex);
 
   // Choose an action
-  const std::vector<float>::iterator a =
+  float *a =
     rng.uniform() < epsilon
-    ? Q_s.begin() + rng.uniformDiscrete(0, numactions - 1) // Choose randomly
-    : random_max_element(Q_s.begin(), Q_s.end()); // Choose maximum
+    ? Q_s + rng.uniformDiscrete(0, numactions - 1) // Choose randomly
+    : random_max_element(Q_s, Q_s + numactions); // Choose maximum
 
   // Store location to update value later
-  currentq = &*a;
+  currentq = Q.index(st, a - Q_s);
   laststate = st;
-  lastact = a - Q_s.begin();
+  lastact = a - Q_s;
 
   if (ACTDEBUG){
-    cout << " act: " << (a-Q_s.begin()) << " val: " << *a << endl;
+    cout << " act: " << (a-Q_s) << " val: " << *a << endl;
     for (int iAct = 0; iAct < numactions; iAct++){
       cout << " Action: " << iAct 
 	   << " val: " << Q_s[iAct] << endl;
     }
-    cout << "Took action " << (a-Q_s.begin()) << " from state ";
+    cout << "Took action " << (a-Q_s) << " from state ";
     printState(s);
     cout << endl;
   }
 
-  return a - Q_s.begin();
+  return a - Q_s;
 }
 
 void Dyna::addExperience(float r, state_t s, bool term){
@@ -99,7 +123,26 @@ void Dyna::addExperience(float r, state_t s, bool term){
   e.r = r;
   e.term = term;
 
-  experiences.push_back(e);
+  pthread_mutex_lock(&dyna_mutex);
+
+  // replace the oldest experience once the buffer is full
+  int i;
+  if ((int)experiences.size() < DYNA_REPLAY_SIZE){
+    i = experiences.size();
+    experiences.push_back(e);
+  } else {
+    i = nextExp;
+    experiences[i] = e;
+    nextExp = (nextExp + 1) % DYNA_REPLAY_SIZE;
+  }
+
+  // make sure it gets sampled soon
+  if (background){
+    setPriority(i, maxPriority);
+    pthread_cond_signal(&replay_cond);
+  }
+
+  pthread_mutex_unlock(&dyna_mutex);
 
 }
 
@@ -116,12 +159,17 @@ int Dyna::next_action(float r, const std::vector<float> &s) {
   addExperience(r,st,false);
 
   // Get action values
-  std::vector<float> &Q_s = Q[st];
-  const std::vector<float>::iterator max =
-    random_max_element(Q_s.begin(), Q_s.end());
+  float *Q_s = &(actionValues[0]);
+  pthread_mutex_lock(&dyna_mutex);
+  std::copy(Q.row(st), Q.row(st) + numactions, Q_s);
+  pthread_mutex_unlock(&dyna_mutex);
+  float *max = random_max_element(Q_s, Q_s + numactions);
 
   // Update value of action just executed
-  *currentq += alpha * (r + gamma * (*max) - *currentq);
+  pthread_mutex_lock(&dyna_mutex);
+  float &q = Q.value(currentq);
+  q += alpha * (r + gamma * (*max) - q);
+  pthread_mutex_unlock(&dyna_mutex);
 
   return getBestAction(s);
 
@@ -136,33 +184,159 @@ void Dyna::last_action(float r) {
     cout << "Last: got reward " << r << endl;
   }
 
-  addExperience(r,NULL,true);
+  addExperience(r,-1,true);
 
-  *currentq += alpha * (r - *currentq);
-  currentq = NULL;
-  laststate = NULL;
+  pthread_mutex_lock(&dyna_mutex);
+  float &q = Q.value(currentq);
+  q += alpha * (r - q);
+  pthread_mutex_unlock(&dyna_mutex);
+  currentq = -1;
+  laststate = -1;
 }
 
 Dyna::state_t Dyna::canonicalize(const std::vector<float> &s) {
-  const std::pair<std::set<std::vector<float> >::iterator, bool> result =
-    statespace.insert(s);
-  state_t retval = &*result.first; // Dereference iterator then get pointer 
-  if (result.second) { // s is new, so initialize Q(s,a) for all a
-    std::vector<float> &Q_s = Q[retval];
-    Q_s.resize(numactions,initialvalue);
+  // new states get Q(s,a) = initialvalue for all a, which can move
+  // the table, so the planning thread has to be out of it
+  pthread_mutex_lock(&dyna_mutex);
+  state_t retval = Q.getStateId(s);
+  pthread_mutex_unlock(&dyna_mutex);
+  return retval;
+}
+
+
+void Dyna::setBackgroundPlanning(bool b){
+
+  if (b == background) return;
+
+  if (b){
+    // every experience so far starts at the same priority
+    priorityLeaves = 1;
+    while (priorityLeaves < DYNA_REPLAY_SIZE)
+      priorityLeaves *= 2;
+    priorities.assign(2 * priorityLeaves, 0.0);
+    for (unsigned i = 0; i < experiences.size(); i++)
+      setPriority(i, maxPriority);
+
+    planRng = Random(1 + rng.uniformDiscrete(0, 1000000));
+    stopPlanning = false;
+    background = true;
+    pthread_create(&planThread, NULL, dynaPlanningStart, this);
+  }
+
+  else {
+    pthread_mutex_lock(&dyna_mutex);
+    stopPlanning = true;
+    pthread_cond_broadcast(&replay_cond);
+    pthread_mutex_unlock(&dyna_mutex);
+
+    pthread_join(planThread, NULL);
+    background = false;
+  }
+
+}
+
+
+void* dynaPlanningStart(void* arg){
+  Dyna* d = reinterpret_cast<Dyna*>(arg);
+  while (d->backgroundPlanning());
+  return NULL;
+}
+
+
+bool Dyna::backgroundPlanning(){
+
+  pthread_mutex_lock(&dyna_mutex);
+
+  // wait for something to plan with
+  while (!stopPlanning && experiences.size() == 0){
+    pthread_cond_wait(&replay_cond, &dyna_mutex);
+  }
+
+  if (stopPlanning){
+    pthread_mutex_unlock(&dyna_mutex);
+    return false;
+  }
+
+  for (int i = 0; i < DYNA_PLAN_BATCH; i++){
+    int exp = samplePriority();
+    float err = planningUpdate(exp);
+    setPriority(exp, fabs(err) + DYNA_MIN_PRIORITY);
+  }
+  nPlanUpdates += DYNA_PLAN_BATCH;
+
+  pthread_mutex_unlock(&dyna_mutex);
+
+  // give the acting thread a chance at the lock
+  sched_yield();
+
+  return true;
+}
+
+
+float Dyna::planningUpdate(int i){
+
+  dynaExperience &e = experiences[i];
+  float *Q_s = Q.row(e.s);
+
+  float target = e.r;
+  if (!e.term){
+    // ties don't matter here, only the max value
+    float *Q_next = Q.row(e.next);
+    target += gamma * *std::max_element(Q_next, Q_next + numactions);
+  }
+
+  float err = target - Q_s[e.a];
+  Q_s[e.a] += alpha * err;
+  return err;
+}
+
+
+void Dyna::setPriority(int i, float p){
+  if (p > maxPriority) maxPriority = p;
+
+  // set the leaf, then the sums above it
+  int node = priorityLeaves + i;
+  priorities[node] = p;
+  for (node /= 2; node > 0; node /= 2){
+    priorities[node] = priorities[2*node] + priorities[2*node+1];
   }
-  return retval; 
 }
 
 
+int Dyna::samplePriority(){
+
+  // walk down to the leaf whose range of the total holds u
+  float u = planRng.uniform(0, priorities[1]);
+  int node = 1;
+  while (node < priorityLeaves){
+    if (u < priorities[2*node]){
+      node = 2*node;
+    } else {
+      u -= priorities[2*node];
+      node = 2*node + 1;
+    }
+  }
+
+  // rounding can walk off the end into empty leaves
+  int i = node - priorityLeaves;
+  if (i >= (int)experiences.size())
+    i = experiences.size() - 1;
+  return i;
+}
 
-  std::vector<float>::iterator
-Dyna::random_max_element(
-			     std::vector<float>::iterator start,
-			     std::vector<float>::iterator end) {
 
-  std::vector<float>::iterator max =
-    std::max_element(start, end);
+long Dyna::getNumPlanningUpdates(){
+  pthread_mutex_lock(&dyna_mutex);
+  long n = nPlanUpdates;
+  pthread_mutex_unlock(&dyna_mutex);
+  return n;
+}
+
+
+
+float* Dyna::random_max_element(float* start, float* end) {
+
+  float *max = std::max_element(start, end);
   int n = std::count(max, end, *max);
   if (n > 1) {
     n = rng.uniformDiscrete(1, n);
@@ -199,26 +373,27 @@ void Dyna::seedExp(std::vector<experience> &seeds){
     laststate = canonicalize(e.s);
     lastact = e.act;
     state_t st = canonicalize(e.next);
-    std::vector<float> &Q_s = Q[laststate];
-    std::vector<float> &Q_next = Q[st];
     
     // add experience
     addExperience(e.reward,st,e.terminal);
 
+    pthread_mutex_lock(&dyna_mutex);
+
     // Get q value for action taken
-    const std::vector<float>::iterator a = Q_s.begin() + e.act;
-    currentq = &*a;
+    currentq = Q.index(laststate, e.act);
+    float &q = Q.value(currentq);
 
     // Update value of action just executed
     if (e.terminal){
-      *currentq += alpha * (e.reward - *currentq);
+      q += alpha * (e.reward - q);
     } else {
       // get max value of next state
-      const std::vector<float>::iterator max =
-        random_max_element(Q_next.begin(), Q_next.end());
-      *currentq += alpha * (e.reward + gamma * (*max) - *currentq);
+      float *Q_next = Q.row(st);
+      float *max = random_max_element(Q_next, Q_next + numactions);
+      q += alpha * (e.reward + gamma * (*max) - q);
     }
 
+    pthread_mutex_unlock(&dyna_mutex);
  
     /*
     cout << "Seeding with experience " << i << endl;
@@ -227,7 +402,7 @@ void Dyna::seedExp(std::vector<experience> &seeds){
     cout << "act: " << e.act << " r: " << e.reward << endl;
     cout << "next: " << (e.next)[0] << ", " << (e.next)[1] << ", " 
 	 << (e.next)[2] << ", " << e.terminal << endl;
-    cout << "Q: " << *currentq << " max: " << *max << endl;
+    cout << "Q: " << q << " max: " << *max << endl;
     */
 
   }
@@ -242,9 +417,8 @@ void Dyna::logValues(ofstream *of, int xmin, int xmax, int ymin, int ymax){
     for (int j = ymin; j < ymax; j++){
       s[0] = j;
       s[1] = i;
-      std::vector<float> &Q_s = Q[canonicalize(s)];
-      const std::vector<float>::iterator max =
-        random_max_element(Q_s.begin(), Q_s.end());
+      float *Q_s = Q.row(canonicalize(s));
+      float *max = random_max_element(Q_s, Q_s + numactions);
       *of << (*max) << ",";
     }
   }
@@ -256,23 +430,19 @@ float Dyna::getValue(std::vector<float> state){
   state_t s = canonicalize(state);
 
   // Get Q values
-  std::vector<float> &Q_s = Q[s];
+  float *Q_s = Q.row(s);
 
   // Choose an action
-  const std::vector<float>::iterator a =
-    random_max_element(Q_s.begin(), Q_s.end()); // Choose maximum
+  float *a = random_max_element(Q_s, Q_s + numactions); // Choose maximum
 
   // Get avg value
   float valSum = 0.0;
   float cnt = 0;
-  for (std::set<std::vector<float> >::iterator i = statespace.begin();
-       i != statespace.end(); i++){
-
-    state_t s = canonicalize(*i);
+  for (state_t s = 0; s < Q.size(); s++){
 
     // get state's info
-    std::vector<float> &Q_s = Q[s];
-      
+    float *Q_s = Q.row(s);
+
     for (int j = 0; j < numactions; j++){
       valSum += Q_s[j];
       cnt++;
@@ -287,29 +457,27 @@ float Dyna::getValue(std::vector<float> state){
 
 void Dyna::savePolicy(const char* filename){
 
-  if (statespace.empty()) return;
+  if (Q.size() == 0) return;
   ofstream policyFile(filename, ios::out | ios::binary | ios::trunc);
 
   // first part, save the vector size
-  std::set< std::vector<float> >::iterator i = statespace.begin();
-  int fsize = (*i).size();
+  int fsize = Q.getState(0).size();
   policyFile.write((char*)&fsize, sizeof(int));
 
   // save numactions
   policyFile.write((char*)&numactions, sizeof(int));
 
   // go through all states, and save Q values
-  for (std::set< std::vector<float> >::iterator i = statespace.begin();
-       i != statespace.end(); i++){
+  for (state_t s = 0; s < Q.size(); s++){
 
-    state_t s = canonicalize(*i);
-    std::vector<float> *Q_s = &(Q[s]);
+    std::vector<float> state = Q.getState(s);
+    float *Q_s = Q.row(s);
 
     // save state
-    policyFile.write((char*)&((*i)[0]), sizeof(float)*fsize);
+    policyFile.write((char*)&(state[0]), sizeof(float)*fsize);
 
     // save q-values
-    policyFile.write((char*)&((*Q_s)[0]), sizeof(float)*numactions);
+    policyFile.write((char*)Q_s, sizeof(float)*numactions);
 
   }
 
@@ -17,6 +17,7 @@
 #include "../Planners/PO_ETUCT.hh"
 #include "../Planners/PO_ParallelETUCT.hh"
 #include "../Planners/MBS.hh"
+#include "../Planners/EnvUCT.hh"
 
 // models
 #include "../Models/RMaxModel.hh"
@@ -32,7 +33,7 @@ ModelBasedAgent::ModelBasedAgent(int numactions, float gamma,
                                  const std::vector<float> &featmax, 
                                  std::vector<int> nstatesPerDim, int history, float v, float n,
                                  bool depTrans, bool relTrans, float featPct, bool stoch, bool episodic,
-                                 Random rng):
+                                 bool compress, int expCap, Random rng):
   featmin(featmin), featmax(featmax),
   numactions(numactions), gamma(gamma), rmax(rmax), rrange(rrange),
   qmax(rmax/(1.0-gamma)), 
@@ -41,7 +42,8 @@ ModelBasedAgent::ModelBasedAgent(int numactions, float gamma,
   epsilon(epsilon), lambda(lambda), MAX_TIME(MAX_TIME),
   M(m), statesPerDim(nstatesPerDim), history(history), v(v), n(n),
   depTrans(depTrans), relTrans(relTrans), featPct(featPct),
-  stoch(stoch), episodic(episodic), rng(rng)
+  stoch(stoch), episodic(episodic), compress(compress), expCap(expCap),
+  rng(rng)
 {
 
   if (statesPerDim[0] > 0){
@@ -63,7 +65,8 @@ ModelBasedAgent::ModelBasedAgent(int numactions, float gamma,
                                  const std::vector<float> &featmax, 
                                  int nstatesPerDim, int history, float v, float n,
                                  bool depTrans, bool relTrans, float featPct,
-				 bool stoch, bool episodic, Random rng):
+				 bool stoch, bool episodic, bool compress, int expCap,
+                                 Random rng):
   featmin(featmin), featmax(featmax),
   numactions(numactions), gamma(gamma), rmax(rmax), rrange(rrange),
   qmax(rmax/(1.0-gamma)), 
@@ -72,7 +75,8 @@ ModelBasedAgent::ModelBasedAgent(int numactions, float gamma,
   epsilon(epsilon), lambda(lambda), MAX_TIME(MAX_TIME),
   M(m), statesPerDim(featmin.size(),nstatesPerDim),  history(history), v(v), n(n),
   depTrans(depTrans), relTrans(relTrans), featPct(featPct),
-  stoch(stoch), episodic(episodic), rng(rng)
+  stoch(stoch), episodic(episodic), compress(compress), expCap(expCap),
+  rng(rng)
 {
 
   if (statesPerDim[0] > 0){
@@ -92,6 +96,13 @@ void ModelBasedAgent::initParams(){
   model = NULL;
   planner = NULL;
 
+  env = NULL;
+  sim = NULL;
+  modelFile = NULL;
+  maxOutcomes = MAX_OUTCOMES;
+  minOutcomeProb = MIN_OUTCOME_PROB;
+  cacheSize = PRED_CACHE_SIZE;
+
   modelUpdateTime = 0.0;
   planningTime = 0.0;
   actionTime = 0.0;
@@ -129,7 +140,11 @@ void ModelBasedAgent::initParams(){
 
 ModelBasedAgent::~ModelBasedAgent() {
   delete planner;
-  delete model;
+  // the parallel planners replace the model with their updated copies and
+  // delete the one they were given, so only delete it for the others
+  if (plannerType != PARALLEL_ET_UCT && plannerType != PAR_ETUCT_ACTUAL &&
+      plannerType != POMDP_PAR_ETUCT)
+    delete model;
   featmin.clear();
   featmax.clear();
   prevstate.clear();
@@ -243,6 +258,11 @@ void ModelBasedAgent::initModel(int nfactors){
     rng.uniform(0, 1);
   }
   
+  if (modelFile != NULL && modelType == RMAX){
+    std::cerr << "ERROR: Model files can only be loaded into tree models" << endl;
+    exit(-1);
+  }
+
   // 0 - traditional rmax model (unknown until m visits, then ML)
   if (modelType == RMAX) {
     model = new RMaxModel(M, numactions, rng);
@@ -256,7 +276,16 @@ void ModelBasedAgent::initModel(int nfactors){
            modelType == LSTMULTI || modelType == LSTSINGLE ||
            modelType == GPREGRESS || modelType == GPTREE){
 
-    model = new FactoredModel(0,numactions, M, modelType, predType, nModels, treeRangePct, featRange, rrange, needConf, depTrans, relTrans, featPct, stoch, episodic, rng);
+    FactoredModel* trees = new FactoredModel(0,numactions, M, modelType, predType, nModels, treeRangePct, featRange, rrange, needConf, depTrans, relTrans, featPct, stoch, episodic, compress, expCap, rng);
+
+    // start from pre-trained trees rather than replaying their experiences
+    if (modelFile != NULL && !trees->loadModel(modelFile)){
+      std::cerr << "ERROR: Could not load model file " << modelFile << endl;
+      exit(-1);
+    }
+    trees->setOutcomeLimits(maxOutcomes, minOutcomeProb);
+    trees->setCacheSize(cacheSize);
+    model = trees;
   }
   
   /*
@@ -279,6 +308,10 @@ void ModelBasedAgent::initModel(int nfactors){
   initPlanner();
   planner->setModel(model);
 
+  // plan on the loaded trees, as after seeding
+  if (modelFile != NULL)
+    planner->planOnNewModel();
+
 }
 
 void ModelBasedAgent::initPlanner(){
@@ -323,6 +356,12 @@ void ModelBasedAgent::initPlanner(){
   else if (plannerType == ET_UCT_L1){
     planner = new ETUCT(numactions, gamma, rrange, 1.0, 500000, MAX_TIME, max_path, modelType, featmax, featmin, statesPerDim, false, history, rng);
   }
+  else if (plannerType == UCT_WITH_ENV){
+    planner = new EnvUCT(numactions, gamma, rrange, 1.0, 500000, MAX_TIME, max_path, featmax, featmin, statesPerDim, env, sim, rng);
+  }
+  else if (plannerType == ET_UCT_WITH_ENV){
+    planner = new EnvUCT(numactions, gamma, rrange, lambda, 500000, MAX_TIME, max_path, featmax, featmin, statesPerDim, env, sim, rng);
+  }
   else {
     std::cerr << "ERROR: invalid planner type: " << plannerType << endl;
     exit(-1);
@@ -482,6 +521,24 @@ void ModelBasedAgent::seedExp(std::vector<experience> &seeds){
    AGENTDEBUG = d;
  }
 
+void ModelBasedAgent::setSimulator(Environment* e, Environment* s){
+  env = e;
+  sim = s;
+}
+
+void ModelBasedAgent::setModelFile(const char* filename){
+  modelFile = filename;
+}
+
+void ModelBasedAgent::setOutcomeLimits(int max, float minProb){
+  maxOutcomes = max;
+  minOutcomeProb = minProb;
+}
+
+void ModelBasedAgent::setCacheSize(int size){
+  cacheSize = size;
+}
+
 void ModelBasedAgent::savePolicy(const char* filename){
   planner->savePolicy(filename);
 }
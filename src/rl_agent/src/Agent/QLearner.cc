@@ -4,9 +4,10 @@
 QLearner::QLearner(int numactions, float gamma,
                    float initialvalue, float alpha, float ep,
                    Random rng):
+  Q(numactions, initialvalue),
   numactions(numactions), gamma(gamma),
   initialvalue(initialvalue), alpha(alpha),
-  rng(rng), currentq(NULL)
+  rng(rng), currentq(-1)
 {
 
   epsilon = ep;
@@ -25,29 +26,30 @@ int QLearner::first_action(const std::vector<float> &s) {
   }
 
   // Get action values
-  std::vector<float> &Q_s = Q[canonicalize(s)];
+  state_t st = canonicalize(s);
+  float *Q_s = Q.row(st);
 
   // Choose an action
-  const std::vector<float>::iterator a =
+  float *a =
     rng.uniform() < epsilon
-    ? Q_s.begin() + rng.uniformDiscrete(0, numactions - 1) // Choose randomly
-    : random_max_element(Q_s.begin(), Q_s.end()); // Choose maximum
+    ? Q_s + rng.uniformDiscrete(0, numactions - 1) // Choose randomly
+    : random_max_element(Q_s, Q_s + numactions); // Choose maximum
 
   // Store location to update value later
-  currentq = &*a;
+  currentq = Q.index(st, a - Q_s);
 
   if (ACTDEBUG){
-    cout << " act: " << (a-Q_s.begin()) << " val: " << *a << endl;
+    cout << " act: " << (a-Q_s) << " val: " << *a << endl;
     for (int iAct = 0; iAct < numactions; iAct++){
       cout << " Action: " << iAct
            << " val: " << Q_s[iAct] << endl;
     }
-    cout << "Took action " << (a-Q_s.begin()) << " from state ";
+    cout << "Took action " << (a-Q_s) << " from state ";
     printState(s);
     cout << endl;
   }
 
-  return a - Q_s.begin();
+  return a - Q_s;
 }
 
 int QLearner::next_action(float r, const std::vector<float> &s) {
@@ -59,34 +61,35 @@ int QLearner::next_action(float r, const std::vector<float> &s) {
   }
 
   // Get action values
-  std::vector<float> &Q_s = Q[canonicalize(s)];
-  const std::vector<float>::iterator max =
-    random_max_element(Q_s.begin(), Q_s.end());
+  state_t st = canonicalize(s);
+  float *Q_s = Q.row(st);
+  float *max = random_max_element(Q_s, Q_s + numactions);
 
   // Update value of action just executed
-  *currentq += alpha * (r + gamma * (*max) - *currentq);
+  float &q = Q.value(currentq);
+  q += alpha * (r + gamma * (*max) - q);
 
   // Choose an action
-  const std::vector<float>::iterator a =
+  float *a =
     rng.uniform() < epsilon
-    ? Q_s.begin() + rng.uniformDiscrete(0, numactions - 1)
+    ? Q_s + rng.uniformDiscrete(0, numactions - 1)
     : max;
 
   // Store location to update value later
-  currentq = &*a;
+  currentq = Q.index(st, a - Q_s);
 
   if (ACTDEBUG){
-    cout << " act: " << (a-Q_s.begin()) << " val: " << *a << endl;
+    cout << " act: " << (a-Q_s) << " val: " << *a << endl;
     for (int iAct = 0; iAct < numactions; iAct++){
       cout << " Action: " << iAct
            << " val: " << Q_s[iAct] << endl;
     }
-    cout << "Took action " << (a-Q_s.begin()) << " from state ";
+    cout << "Took action " << (a-Q_s) << " from state ";
     printState(s);
     cout << endl;
   }
 
-  return a - Q_s.begin();
+  return a - Q_s;
 }
 
 void QLearner::last_action(float r) {
@@ -95,30 +98,21 @@ void QLearner::last_action(float r) {
     cout << "Last: got reward " << r << endl;
   }
 
-  *currentq += alpha * (r - *currentq);
-  currentq = NULL;
+  float &q = Q.value(currentq);
+  q += alpha * (r - q);
+  currentq = -1;
 }
 
 QLearner::state_t QLearner::canonicalize(const std::vector<float> &s) {
-  const std::pair<std::set<std::vector<float> >::iterator, bool> result =
-    statespace.insert(s);
-  state_t retval = &*result.first; // Dereference iterator then get pointer
-  if (result.second) { // s is new, so initialize Q(s,a) for all a
-    std::vector<float> &Q_s = Q[retval];
-    Q_s.resize(numactions,initialvalue);
-  }
-  return retval;
+  // new states get Q(s,a) = initialvalue for all a
+  return Q.getStateId(s);
 }
 
 
 
-std::vector<float>::iterator
-QLearner::random_max_element(
-                             std::vector<float>::iterator start,
-                             std::vector<float>::iterator end) {
+float* QLearner::random_max_element(float* start, float* end) {
 
-  std::vector<float>::iterator max =
-    std::max_element(start, end);
+  float *max = std::max_element(start, end);
   int n = std::count(max, end, *max);
   if (n > 1) {
     n = rng.uniformDiscrete(1, n);
@@ -152,21 +146,21 @@ void QLearner::seedExp(std::vector<experience> &seeds){
   for (unsigned i = 0; i < seeds.size(); i++){
     experience e = seeds[i];
 
-    std::vector<float> &Q_s = Q[canonicalize(e.s)];
-    std::vector<float> &Q_next = Q[canonicalize(e.next)];
+    state_t st = canonicalize(e.s);
+    state_t next = canonicalize(e.next);
 
     // Get q value for action taken
-    const std::vector<float>::iterator a = Q_s.begin() + e.act;
-    currentq = &*a;
+    currentq = Q.index(st, e.act);
+    float &q = Q.value(currentq);
 
     // Update value of action just executed
     if (e.terminal){
-      *currentq += alpha * (e.reward - *currentq);
+      q += alpha * (e.reward - q);
     } else {
       // get max value of next state
-      const std::vector<float>::iterator max =
-        random_max_element(Q_next.begin(), Q_next.end());
-      *currentq += alpha * (e.reward + gamma * (*max) - *currentq);
+      float *Q_next = Q.row(next);
+      float *max = random_max_element(Q_next, Q_next + numactions);
+      q += alpha * (e.reward + gamma * (*max) - q);
     }
 
 
@@ -177,7 +171,7 @@ void QLearner::seedExp(std::vector<experience> &seeds){
       cout << "act: " << e.act << " r: " << e.reward << endl;
       cout << "next: " << (e.next)[0] << ", " << (e.next)[1] << ", "
       << (e.next)[2] << ", " << e.terminal << endl;
-      cout << "Q: " << *currentq << " max: " << *max << endl;
+      cout << "Q: " << q << " max: " << *max << endl;
     */
 
   }
@@ -192,9 +186,8 @@ void QLearner::logValues(ofstream *of, int xmin, int xmax, int ymin, int ymax){
     for (int j = ymin; j < ymax; j++){
       s[0] = j;
       s[1] = i;
-      std::vector<float> &Q_s = Q[canonicalize(s)];
-      const std::vector<float>::iterator max =
-        random_max_element(Q_s.begin(), Q_s.end());
+      float *Q_s = Q.row(canonicalize(s));
+      float *max = random_max_element(Q_s, Q_s + numactions);
       *of << (*max) << ",";
     }
   }
@@ -206,22 +199,18 @@ float QLearner::getValue(std::vector<float> state){
   state_t s = canonicalize(state);
 
   // Get Q values
-  std::vector<float> &Q_s = Q[s];
+  float *Q_s = Q.row(s);
 
   // Choose an action
-  const std::vector<float>::iterator a =
-    random_max_element(Q_s.begin(), Q_s.end()); // Choose maximum
+  float *a = random_max_element(Q_s, Q_s + numactions); // Choose maximum
 
   // Get avg value
   float valSum = 0.0;
   float cnt = 0;
-  for (std::set<std::vector<float> >::iterator i = statespace.begin();
-       i != statespace.end(); i++){
-
-    state_t s = canonicalize(*i);
+  for (state_t s = 0; s < Q.size(); s++){
 
     // get state's info
-    std::vector<float> &Q_s = Q[s];
+    float *Q_s = Q.row(s);
 
     for (int j = 0; j < numactions; j++){
       valSum += Q_s[j];
@@ -237,29 +226,27 @@ float QLearner::getValue(std::vector<float> state){
 
 void QLearner::savePolicy(const char* filename){
 
-  if (statespace.empty()) return;
+  if (Q.size() == 0) return;
   ofstream policyFile(filename, ios::out | ios::binary | ios::trunc);
 
   // first part, save the vector size
-  std::set< std::vector<float> >::iterator i = statespace.begin();
-  int fsize = (*i).size();
+  int fsize = Q.getState(0).size();
   policyFile.write((char*)&fsize, sizeof(int));
 
   // save numactions
   policyFile.write((char*)&numactions, sizeof(int));
 
   // go through all states, and save Q values
-  for (std::set< std::vector<float> >::iterator i = statespace.begin();
-       i != statespace.end(); i++){
+  for (state_t s = 0; s < Q.size(); s++){
 
-    state_t s = canonicalize(*i);
-    std::vector<float> *Q_s = &(Q[s]);
+    std::vector<float> state = Q.getState(s);
+    float *Q_s = Q.row(s);
 
     // save state
-    policyFile.write((char*)&((*i)[0]), sizeof(float)*fsize);
+    policyFile.write((char*)&(state[0]), sizeof(float)*fsize);
 
     // save q-values
-    policyFile.write((char*)&((*Q_s)[0]), sizeof(float)*numactions);
+    policyFile.write((char*)Q_s, sizeof(float)*numactions);
 
   }
 
@@ -302,17 +289,17 @@ void QLearner::loadPolicy(const char* filename){
     }
 
     state_t s = canonicalize(state);
-    std::vector<float> *Q_s = &(Q[s]);
+    float *Q_s = Q.row(s);
 
     if (policyFile.eof()) break;
 
     // load q values
-    policyFile.read((char*)&((*Q_s)[0]), sizeof(float)*numactions);
+    policyFile.read((char*)Q_s, sizeof(float)*numactions);
 
     if (LOADDEBUG){
       cout << "Q values: " << endl;
       for (int iAct = 0; iAct < numactions; iAct++){
-        cout << " Action: " << iAct << " val: " << (*Q_s)[iAct] << endl;
+        cout << " Action: " << iAct << " val: " << Q_s[iAct] << endl;
       }
     }
   }
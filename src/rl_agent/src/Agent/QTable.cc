@@ -0,0 +1,90 @@
+#include <rl_agent/QTable.hh>
+#include <string.h>
+
+QTable::QTable(int numactions, float initialvalue):
+  table(QTABLE_INITIAL_SLOTS, -1), nstates(0),
+  numactions(numactions), initialvalue(initialvalue)
+{
+  stateStart.push_back(0);
+}
+
+QTable::~QTable() {}
+
+
+int QTable::getStateId(const std::vector<float> &s){
+
+  // linear probing from the state's hash
+  unsigned h = hashState(s);
+  unsigned mask = table.size() - 1;
+  unsigned i = h & mask;
+  while (table[i] != -1){
+    int id = table[i];
+    if (stateHash[id] == h && sameState(id, s))
+      return id;
+    i = (i + 1) & mask;
+  }
+
+  // s is new, so initialize Q(s,a) for all a
+  int id = nstates++;
+  table[i] = id;
+  stateHash.push_back(h);
+  stateFeats.insert(stateFeats.end(), s.begin(), s.end());
+  stateStart.push_back(stateFeats.size());
+  Q.resize(nstates * numactions, initialvalue);
+
+  // keep the table at most half full
+  if (2 * nstates > (int)table.size())
+    growTable();
+
+  return id;
+}
+
+
+std::vector<float> QTable::getState(int id) const {
+  return std::vector<float>(stateFeats.begin() + stateStart[id],
+                            stateFeats.begin() + stateStart[id+1]);
+}
+
+
+unsigned QTable::hashState(const std::vector<float> &s) const {
+
+  // FNV-1a over the bits of each feature
+  unsigned h = 2166136261u;
+  for (unsigned i = 0; i < s.size(); i++){
+    // -0 and 0 are the same state
+    float f = (s[i] == 0) ? 0.0 : s[i];
+    unsigned bits;
+    memcpy(&bits, &f, sizeof(bits));
+    for (int b = 0; b < 4; b++){
+      h ^= (bits >> (8*b)) & 0xff;
+      h *= 16777619u;
+    }
+  }
+  return h;
+}
+
+
+bool QTable::sameState(int id, const std::vector<float> &s) const {
+  int start = stateStart[id];
+  if (stateStart[id+1] - start != (int)s.size())
+    return false;
+  for (unsigned i = 0; i < s.size(); i++){
+    if (stateFeats[start + i] != s[i])
+      return false;
+  }
+  return true;
+}
+
+
+void QTable::growTable(){
+
+  table.assign(table.size() * 2, -1);
+  unsigned mask = table.size() - 1;
+
+  for (int id = 0; id < nstates; id++){
+    unsigned i = stateHash[id] & mask;
+    while (table[i] != -1)
+      i = (i + 1) & mask;
+    table[i] = id;
+  }
+}
@@ -4,6 +4,7 @@
 Sarsa::Sarsa(int numactions, float gamma,
              float initialvalue, float alpha, float ep, float lambda,
              Random rng):
+  Q(numactions, initialvalue),
   numactions(numactions), gamma(gamma),
   initialvalue(initialvalue), alpha(alpha),
   epsilon(ep), lambda(lambda),
@@ -11,6 +12,9 @@ Sarsa::Sarsa(int numactions, float gamma,
 {
 
   currentq = NULL;
+  minTrace = SARSA_MIN_TRACE;
+  maxTraces = SARSA_MAX_TRACES;
+  replacing = SARSA_REPLACING_TRACES;
   ACTDEBUG = false; //true; //false;
   ELIGDEBUG = false;
 
@@ -27,41 +31,33 @@ int Sarsa::first_action(const std::vector<float> &s) {
   }
 
   // clear all eligibility traces
-  for (std::map<state_t, std::vector<float> >::iterator i = eligibility.begin();
-       i != eligibility.end(); i++){
-
-    std::vector<float> & elig_s = (*i).second;
-    for (int j = 0; j < numactions; j++){
-      elig_s[j] = 0.0;
-    }
-  }
+  eligibility.clear();
 
   // Get action values
   state_t si = canonicalize(s);
-  std::vector<float> &Q_s = Q[si];
+  float *Q_s = Q.row(si);
 
   // Choose an action
-  const std::vector<float>::iterator a =
+  float *a =
     rng.uniform() < epsilon
-    ? Q_s.begin() + rng.uniformDiscrete(0, numactions - 1) // Choose randomly
-    : random_max_element(Q_s.begin(), Q_s.end()); // Choose maximum
+    ? Q_s + rng.uniformDiscrete(0, numactions - 1) // Choose randomly
+    : random_max_element(Q_s, Q_s + numactions); // Choose maximum
 
   // set eligiblity to 1
-  std::vector<float> &elig_s = eligibility[si];
-  elig_s[a-Q_s.begin()] = 1.0;
+  addTrace(Q.index(si, a-Q_s), 1.0);
 
   if (ACTDEBUG){
-    cout << " act: " << (a-Q_s.begin()) << " val: " << *a << endl;
+    cout << " act: " << (a-Q_s) << " val: " << *a << endl;
     for (int iAct = 0; iAct < numactions; iAct++){
       cout << " Action: " << iAct 
 	   << " val: " << Q_s[iAct] << endl;
     }
-    cout << "Took action " << (a-Q_s.begin()) << " from state ";
+    cout << "Took action " << (a-Q_s) << " from state ";
     printState(s);
     cout << endl;
   }
 
-  return a - Q_s.begin();
+  return a - Q_s;
 }
 
 int Sarsa::next_action(float r, const std::vector<float> &s) {
@@ -74,50 +70,55 @@ int Sarsa::next_action(float r, const std::vector<float> &s) {
 
   // Get action values
   state_t st = canonicalize(s);
-  std::vector<float> &Q_s = Q[st];
-  const std::vector<float>::iterator max =
-    random_max_element(Q_s.begin(), Q_s.end());
+  float *Q_s = Q.row(st);
+  float *max = random_max_element(Q_s, Q_s + numactions);
 
   // Choose an action
-  const std::vector<float>::iterator a =
+  float *a =
     rng.uniform() < epsilon
-    ? Q_s.begin() + rng.uniformDiscrete(0, numactions - 1)
+    ? Q_s + rng.uniformDiscrete(0, numactions - 1)
     : max;
 
   // Update value for all with positive eligibility
-  for (std::map<state_t, std::vector<float> >::iterator i = eligibility.begin();
-       i != eligibility.end(); i++){
-
-    state_t si = (*i).first;
-    std::vector<float> & elig_s = (*i).second;
-    for (int j = 0; j < numactions; j++){
-      if (elig_s[j] > 0.0){
-        if (ELIGDEBUG) {
-          cout << "updating state " << (*((*i).first))[0] << ", " << (*((*i).first))[1] << " act: " << j << " with elig: " << elig_s[j] << endl;
-        }
-        // update
-        Q[si][j] += alpha * elig_s[j] * (r + gamma * (*a) - Q[si][j]);
-        elig_s[j] *= lambda;
-      }
+  int qa = Q.index(st, a-Q_s);
+  float elig_a = 0.0;
+  unsigned i = 0;
+  while (i < eligibility.size()){
+    trace &t = eligibility[i];
+    if (ELIGDEBUG) {
+      std::vector<float> si = Q.getState(t.q / numactions);
+      cout << "updating state " << si[0] << ", " << si[1] << " act: " << (t.q % numactions) << " with elig: " << t.elig << endl;
+    }
+    // update
+    float &q = Q.value(t.q);
+    q += alpha * t.elig * (r + gamma * (*a) - q);
+    t.elig *= lambda;
+
+    // the action taken gets a new trace below, and decayed ones are dropped
+    if (t.q == qa || t.elig < minTrace){
+      if (t.q == qa) elig_a = t.elig;
+      t = eligibility.back();
+      eligibility.pop_back();
+    } else {
+      i++;
     }
-        
   }
 
   // Set elig to 1
-  eligibility[st][a-Q_s.begin()] = 1.0;
+  addTrace(qa, replacing ? 1.0 : elig_a + 1.0);
 
   if (ACTDEBUG){
-    cout << " act: " << (a-Q_s.begin()) << " val: " << *a << endl;
+    cout << " act: " << (a-Q_s) << " val: " << *a << endl;
     for (int iAct = 0; iAct < numactions; iAct++){
       cout << " Action: " << iAct 
 	   << " val: " << Q_s[iAct] << endl;
     }
-    cout << "Took action " << (a-Q_s.begin()) << " from state ";
+    cout << "Took action " << (a-Q_s) << " from state ";
     printState(s);
     cout << endl;
   }
 
-  return a - Q_s.begin();
+  return a - Q_s;
 }
 
 void Sarsa::last_action(float r) {
@@ -127,47 +128,57 @@ void Sarsa::last_action(float r) {
   }
 
   // Update value for all with positive eligibility
-  for (std::map<state_t, std::vector<float> >::iterator i = eligibility.begin();
-       i != eligibility.end(); i++){
-    
-    state_t si = (*i).first;
-    std::vector<float> & elig_s = (*i).second;
-    for (int j = 0; j < numactions; j++){
-      if (elig_s[j] > 0.0){
-        if (ELIGDEBUG){
-          cout << "updating state " << (*((*i).first))[0] << ", " << (*((*i).first))[1] << " act: " << j << " with elig: " << elig_s[j] << endl;
-        }
-        // update
-        Q[si][j] += alpha * elig_s[j] * (r - Q[si][j]);
-        elig_s[j] = 0.0;
-      }
-    }  
+  for (unsigned i = 0; i < eligibility.size(); i++){
+    trace &t = eligibility[i];
+    if (ELIGDEBUG){
+      std::vector<float> si = Q.getState(t.q / numactions);
+      cout << "updating state " << si[0] << ", " << si[1] << " act: " << (t.q % numactions) << " with elig: " << t.elig << endl;
+    }
+    // update
+    float &q = Q.value(t.q);
+    q += alpha * t.elig * (r - q);
   }
+  eligibility.clear();
   
 }
 
 Sarsa::state_t Sarsa::canonicalize(const std::vector<float> &s) {
-  const std::pair<std::set<std::vector<float> >::iterator, bool> result =
-    statespace.insert(s);
-  state_t retval = &*result.first; // Dereference iterator then get pointer 
-  if (result.second) { // s is new, so initialize Q(s,a) for all a
-    std::vector<float> &Q_s = Q[retval];
-    Q_s.resize(numactions,initialvalue);
-    std::vector<float> &elig = eligibility[retval];
-    elig.resize(numactions,0);
+  // new states get Q(s,a) = initialvalue for all a
+  return Q.getStateId(s);
+}
+
+
+void Sarsa::addTrace(int q, float elig){
+
+  // make room by dropping the smallest trace
+  if (maxTraces > 0 && (int)eligibility.size() >= maxTraces){
+    unsigned smallest = 0;
+    for (unsigned i = 1; i < eligibility.size(); i++){
+      if (eligibility[i].elig < eligibility[smallest].elig)
+        smallest = i;
+    }
+    eligibility[smallest] = eligibility.back();
+    eligibility.pop_back();
   }
-  return retval; 
+
+  trace t;
+  t.q = q;
+  t.elig = elig;
+  eligibility.push_back(t);
+}
+
+
+void Sarsa::setTraceOptions(float min, int max, bool replace){
+  minTrace = min;
+  maxTraces = max;
+  replacing = replace;
 }
 
 
 
-  std::vector<float>::iterator
-Sarsa::random_max_element(
-			     std::vector<float>::iterator start,
-			     std::vector<float>::iterator end) {
+float* Sarsa::random_max_element(float* start, float* end) {
 
-  std::vector<float>::iterator max =
-    std::max_element(start, end);
+  float *max = std::max_element(start, end);
   int n = std::count(max, end, *max);
   if (n > 1) {
     n = rng.uniformDiscrete(1, n);
@@ -201,12 +212,13 @@ void Sarsa::seedExp(std::vector<experience> &seeds){
   for (unsigned i = 0; i < seeds.size(); i++){
     experience e = seeds[i];
 
-    std::vector<float> &Q_s = Q[canonicalize(e.s)];
-    std::vector<float> &Q_next = Q[canonicalize(e.next)];
+    state_t st = canonicalize(e.s);
+    state_t next = canonicalize(e.next);
+    float *Q_s = Q.row(st);
+    float *Q_next = Q.row(next);
 
     // Get max value of next state
-    const std::vector<float>::iterator max =
-      random_max_element(Q_next.begin(), Q_next.end());
+    float *max = random_max_element(Q_next, Q_next + numactions);
 
     // Update value of action just executed
     if (e.terminal){
@@ -238,9 +250,8 @@ void Sarsa::logValues(ofstream *of, int xmin, int xmax, int ymin, int ymax){
     for (int j = ymin; j < ymax; j++){
       s[0] = j;
       s[1] = i;
-      std::vector<float> &Q_s = Q[canonicalize(s)];
-      const std::vector<float>::iterator max =
-        random_max_element(Q_s.begin(), Q_s.end());
+      float *Q_s = Q.row(canonicalize(s));
+      float *max = random_max_element(Q_s, Q_s + numactions);
       *of << (*max) << ",";
     }
   }
@@ -252,23 +263,19 @@ float Sarsa::getValue(std::vector<float> state){
   state_t s = canonicalize(state);
 
   // Get Q values
-  std::vector<float> &Q_s = Q[s];
+  float *Q_s = Q.row(s);
 
   // Choose an action
-  const std::vector<float>::iterator a =
-    random_max_element(Q_s.begin(), Q_s.end()); // Choose maximum
+  float *a = random_max_element(Q_s, Q_s + numactions); // Choose maximum
 
   // Get avg value
   float valSum = 0.0;
   float cnt = 0;
-  for (std::set<std::vector<float> >::iterator i = statespace.begin();
-       i != statespace.end(); i++){
-
-    state_t s = canonicalize(*i);
+  for (state_t s = 0; s < Q.size(); s++){
 
     // get state's info
-    std::vector<float> &Q_s = Q[s];
-      
+    float *Q_s = Q.row(s);
+
     for (int j = 0; j < numactions; j++){
       valSum += Q_s[j];
       cnt++;
@@ -283,29 +290,27 @@ float Sarsa::getValue(std::vector<float> state){
 
 void Sarsa::savePolicy(const char* filename){
 
-  if (statespace.empty()) return;
+  if (Q.size() == 0) return;
   ofstream policyFile(filename, ios::out | ios::binary | ios::trunc);
 
   // first part, save the vector size
-  std::set< std::vector<float> >::iterator i = statespace.begin();
-  int fsize = (*i).size();
+  int fsize = Q.getState(0).size();
   policyFile.write((char*)&fsize, sizeof(int));
 
   // save numactions
   policyFile.write((char*)&numactions, sizeof(int));
 
   // go through all states, and save Q values
-  for (std::set< std::vector<float> >::iterator i = statespace.begin();
-       i != statespace.end(); i++){
+  for (state_t s = 0; s < Q.size(); s++){
 
-    state_t s = canonicalize(*i);
-    std::vector<float> *Q_s = &(Q[s]);
+    std::vector<float> state = Q.getState(s);
+    float *Q_s = Q.row(s);
 
     // save state
-    policyFile.write((char*)&((*i)[0]), sizeof(float)*fsize);
+    policyFile.write((char*)&(state[0]), sizeof(float)*fsize);
 
     // save q-values
-    policyFile.write((char*)&((*Q_s)[0]), sizeof(float)*numactions);
+    policyFile.write((char*)Q_s, sizeof(float)*numactions);
 
   }
 
@@ -0,0 +1,280 @@
+#include <rl_agent/TileCodingAgent.hh>
+#include <algorithm>
+#include <math.h>
+
+TileCodingAgent::TileCodingAgent(int numactions, float gamma,
+                                 float initialvalue, float alpha,
+                                 float epsilon, float lambda,
+                                 int tilesPerDim, int numTilings,
+                                 int memorySize, bool qlearning,
+                                 std::vector<float> featmin,
+                                 std::vector<float> featmax,
+                                 Random rng):
+  numactions(numactions), gamma(gamma), alpha(alpha),
+  epsilon(epsilon), lambda(lambda),
+  tilesPerDim(tilesPerDim), numTilings(numTilings),
+  memorySize(memorySize), qlearning(qlearning),
+  featmin(featmin), featmax(featmax), rng(rng)
+{
+
+  ACTDEBUG = false;
+
+  // all the memory is set up front, with Q(s,a) = initialvalue everywhere
+  weights.resize(memorySize, initialvalue / numTilings);
+  traceSlot.resize(memorySize, -1);
+  tiles.resize(numactions * numTilings);
+  Q.resize(numactions);
+  scaled.resize(featmin.size());
+  lastQ = 0;
+
+  cout << "Tile coding agent with " << numTilings << " tilings of "
+       << tilesPerDim << " tiles per feature, hashed into "
+       << memorySize << " weights" << endl;
+
+}
+
+TileCodingAgent::~TileCodingAgent() {}
+
+
+int TileCodingAgent::first_action(const std::vector<float> &s) {
+
+  if (ACTDEBUG){
+    cout << "First - in state: ";
+    printState(s);
+    cout << endl;
+  }
+
+  clearTraces();
+
+  // Get action values
+  getTiles(s, &tiles);
+  getQs(tiles, &Q);
+
+  // Choose an action
+  bool greedy;
+  int a = chooseAction(Q, &greedy);
+
+  setTraces(&tiles[a * numTilings]);
+  lastQ = Q[a];
+
+  if (ACTDEBUG){
+    cout << "Took action " << a << " val: " << lastQ << endl;
+  }
+
+  return a;
+}
+
+
+int TileCodingAgent::next_action(float r, const std::vector<float> &s) {
+
+  if (ACTDEBUG){
+    cout << "Next: got reward " << r << " in state: ";
+    printState(s);
+    cout << endl;
+  }
+
+  // Get action values
+  getTiles(s, &tiles);
+  getQs(tiles, &Q);
+
+  // Choose an action
+  bool greedy;
+  int a = chooseAction(Q, &greedy);
+
+  // Update towards the value of the next action (or the best one)
+  float next = qlearning ? *std::max_element(Q.begin(), Q.end()) : Q[a];
+  updateWeights(r + gamma * next - lastQ, gamma * lambda);
+
+  // traces only follow the greedy policy for Q(lambda)
+  if (qlearning && !greedy)
+    clearTraces();
+
+  setTraces(&tiles[a * numTilings]);
+
+  // the update may have changed the value of the action we take
+  lastQ = getQ(&tiles[a * numTilings]);
+
+  if (ACTDEBUG){
+    cout << "Took action " << a << " val: " << lastQ << endl;
+  }
+
+  return a;
+}
+
+
+void TileCodingAgent::last_action(float r) {
+
+  if (ACTDEBUG){
+    cout << "Last: got reward " << r << endl;
+  }
+
+  updateWeights(r - lastQ, 0.0);
+  clearTraces();
+}
+
+
+void TileCodingAgent::getTiles(const std::vector<float> &s,
+                               std::vector<int> *tiles){
+
+  if (s.size() != featmin.size()){
+    std::cerr << "ERROR: state has " << s.size() << " features but the tile coding was set up for "
+              << featmin.size() << endl;
+    exit(-1);
+  }
+
+  // scale each feature so a tile is numTilings units wide
+  for (unsigned i = 0; i < s.size(); i++){
+    float range = featmax[i] - featmin[i];
+    float x = 0;
+    if (range > 0)
+      x = (s[i] - featmin[i]) / range * tilesPerDim;
+    scaled[i] = (int)floor(x * numTilings);
+  }
+
+  for (int t = 0; t < numTilings; t++){
+
+    // FNV-1a over the tiling and the tile's coordinates
+    unsigned h = 2166136261u;
+    h = (h ^ t) * 16777619u;
+    for (unsigned i = 0; i < s.size(); i++){
+      // each tiling is offset by a different amount on each feature
+      int c = scaled[i] + t * (1 + 2*i);
+      int coord = (c >= 0) ? c / numTilings : -((numTilings - 1 - c) / numTilings);
+      h = (h ^ (unsigned)coord) * 16777619u;
+    }
+
+    // then the action
+    for (int a = 0; a < numactions; a++){
+      (*tiles)[a * numTilings + t] = ((h ^ a) * 16777619u) % memorySize;
+    }
+  }
+}
+
+
+float TileCodingAgent::getQ(const int *tiles){
+  float q = 0;
+  for (int t = 0; t < numTilings; t++){
+    q += weights[tiles[t]];
+  }
+  return q;
+}
+
+
+void TileCodingAgent::getQs(const std::vector<int> &tiles,
+                            std::vector<float> *Q){
+  for (int a = 0; a < numactions; a++){
+    (*Q)[a] = getQ(&tiles[a * numTilings]);
+  }
+}
+
+
+int TileCodingAgent::chooseAction(const std::vector<float> &Q, bool *greedy){
+
+  float max = *std::max_element(Q.begin(), Q.end());
+
+  int a;
+  if (rng.uniform() < epsilon){
+    a = rng.uniformDiscrete(0, numactions - 1);
+  } else {
+    // break ties randomly
+    int n = std::count(Q.begin(), Q.end(), max);
+    if (n > 1)
+      n = rng.uniformDiscrete(1, n);
+    for (a = 0; a < numactions; a++){
+      if (Q[a] == max && --n == 0) break;
+    }
+  }
+
+  *greedy = (Q[a] == max);
+  return a;
+}
+
+
+void TileCodingAgent::updateWeights(float delta, float decay){
+
+  float step = alpha / numTilings * delta;
+
+  for (unsigned i = 0; i < traces.size(); i++){
+    weights[traceWeights[i]] += step * traces[i];
+    traces[i] *= decay;
+  }
+
+  // drop the traces that decayed away
+  unsigned i = 0;
+  while (i < traces.size()){
+    if (traces[i] < TILE_MIN_TRACE){
+      traceSlot[traceWeights[i]] = -1;
+      traces[i] = traces.back();
+      traceWeights[i] = traceWeights.back();
+      traces.pop_back();
+      traceWeights.pop_back();
+      if (i < traces.size())
+        traceSlot[traceWeights[i]] = i;
+    } else {
+      i++;
+    }
+  }
+}
+
+
+void TileCodingAgent::setTraces(const int *tiles){
+  for (int t = 0; t < numTilings; t++){
+    int w = tiles[t];
+    if (traceSlot[w] >= 0){
+      traces[traceSlot[w]] = 1.0;
+    } else {
+      traceSlot[w] = traces.size();
+      traceWeights.push_back(w);
+      traces.push_back(1.0);
+    }
+  }
+}
+
+
+void TileCodingAgent::clearTraces(){
+  for (unsigned i = 0; i < traceWeights.size(); i++){
+    traceSlot[traceWeights[i]] = -1;
+  }
+  traceWeights.clear();
+  traces.clear();
+}
+
+
+void TileCodingAgent::setDebug(bool d){
+  ACTDEBUG = d;
+}
+
+
+void TileCodingAgent::printState(const std::vector<float> &s){
+  for (unsigned j = 0; j < s.size(); j++){
+    cout << s[j] << ", ";
+  }
+}
+
+
+void TileCodingAgent::seedExp(std::vector<experience> &seeds){
+
+  std::vector<int> nextTiles(numactions * numTilings);
+  std::vector<float> nextQ(numactions);
+
+  // for each seeding experience, do a one step update
+  for (unsigned i = 0; i < seeds.size(); i++){
+    experience e = seeds[i];
+
+    getTiles(e.s, &tiles);
+    const int *saTiles = &tiles[e.act * numTilings];
+    float target = e.reward;
+
+    if (!e.terminal){
+      getTiles(e.next, &nextTiles);
+      getQs(nextTiles, &nextQ);
+      target += gamma * *std::max_element(nextQ.begin(), nextQ.end());
+    }
+
+    float step = alpha / numTilings * (target - getQ(saTiles));
+    for (int t = 0; t < numTilings; t++){
+      weights[saTiles[t]] += step;
+    }
+  }
+
+}
@@ -10,17 +10,35 @@
 
 
 C45Tree::C45Tree(int id, int trainMode, int trainFreq, int m,
-                 float featPct, Random rng):
+                 float featPct, Random rng, ExperienceStore* store):
   id(id), mode(trainMode), freq(trainFreq), M(m),
-  featPct(featPct), ALLOW_ONLY_SPLITS(true), rng(rng)
+  featPct(featPct), ALLOW_ONLY_SPLITS(true), rng(rng), store(store)
 {
 
   nnodes = 0;
+  lastLeaf = -1;
   nOutput = 0;
   nExperiences = 0;
+  nUnique = 0;
+  compress = COMPRESS_DUPLICATES;
+  cap = 0;
+  replaced = false;
   hadError = false;
-  maxnodes = N_C45_NODES;
+  maxnodes = 0;
   totalnodes = 0;
+  nfeat = 0;
+
+  experiences = new exp_list;
+  experiences->refs = 1;
+
+  // share the given experience store, or keep our own
+  if (store == NULL)
+    this->store = new ExperienceStore();
+  else
+    store->retain();
+
+  if (TREE_EXPERIENCE_CAP > 0)
+    setExperienceCap(TREE_EXPERIENCE_CAP);
 
   // how close a split has to be to be randomly selected
   SPLIT_MARGIN = 0.0; //0.02; //5; //01; //0.05; //0.2; //0.05;
@@ -41,23 +59,32 @@ C45Tree::C45Tree(int id, int trainMode, int trainFreq, int m,
     cout << " mode: " << mode << " freq: " << freq << endl;
   }
 
-  initNodes();
   initTree();
 
 }
 
 C45Tree::C45Tree(const C45Tree &t):
   id(t.id), mode(t.mode), freq(t.freq), M(t.M),
-  featPct(t.featPct), ALLOW_ONLY_SPLITS(t.ALLOW_ONLY_SPLITS), rng(t.rng)
+  featPct(t.featPct), ALLOW_ONLY_SPLITS(t.ALLOW_ONLY_SPLITS), rng(t.rng),
+  store(t.store)
 {
   COPYDEBUG = t.COPYDEBUG;
   if (COPYDEBUG) cout << "  C4.5 tree copy constructor id " << id << endl;
-  nnodes = 0;
+  nnodes = t.nnodes;
   nOutput = t.nOutput;
   nExperiences = t.nExperiences;
+  nUnique = t.nUnique;
+  compress = t.compress;
+  cap = t.cap;
+  replaced = t.replaced;
   hadError = t.hadError;
   maxnodes = t.maxnodes;
-  totalnodes = 0;
+  totalnodes = t.totalnodes;
+  nfeat = t.nfeat;
+  pendingWeights = t.pendingWeights;
+
+  // inputs are append-only, so the copy can share them
+  store->retain();
 
   SPLIT_MARGIN = t.SPLIT_MARGIN;
   MIN_GAIN_RATIO = t.MIN_GAIN_RATIO;
@@ -68,29 +95,16 @@ C45Tree::C45Tree(const C45Tree &t):
   NODEDEBUG = t.NODEDEBUG;
   
   
-  if (COPYDEBUG) cout << "   C4.5 copy nodes, experiences, root, etc" << endl;
-  // copy all experiences
-  for (int i = 0; i < N_C45_EXP; i++){
-    allExp[i] = t.allExp[i];
-  }
-  if (COPYDEBUG) cout << "   C4.5 copied exp array" << endl;
+  // share experiences and nodes, each tree copies what it changes
+  if (COPYDEBUG) cout << "   C4.5 share experiences, root, etc" << endl;
+  experiences = t.experiences;
+  experiences->refs++;
+  root = t.root;
+  root->refs++;
+  compiled = t.compiled;
+  compiled->refs++;
+  lastLeaf = -1;
 
-  // set experience pointers
-  experiences.resize(t.experiences.size());
-  for (unsigned i = 0; i < t.experiences.size(); i++){
-    experiences[i] = &(allExp[i]);
-  }
-  if (COPYDEBUG) cout << "   C4.5 set experience pointers" << endl;
-
-  // now the tricky part, set the pointers inside the tree nodes correctly
-  initNodes();
-
-  if (COPYDEBUG) cout << "   C4.5 copy tree " << endl;
-  root = allocateNode();
-  lastNode = root;
-  copyTree(root, t.root);
-  if (COPYDEBUG) cout << "   C4.5 tree copy done" << endl;
-   
   if (COPYDEBUG) {
     cout << endl << "New tree: " << endl;
     printTree(root, 0);
@@ -101,50 +115,22 @@ C45Tree::C45Tree(const C45Tree &t):
 }
 
 C45Tree* C45Tree::getCopy(){
+
+  // while nobody else has our experiences, add the weights that were
+  // waiting for them, so the copy doesn't carry them on
+  if (experiences->refs == 1)
+    addPendingWeights();
   
   C45Tree* copy = new C45Tree(*this);
   return copy;
 
 }
 
-void C45Tree::copyTree(tree_node* newNode, tree_node* origNode){
-
-  int nodeId = newNode->id;
-
-  if (COPYDEBUG) {
-    cout << "    Copy node " << newNode->id << " from node " << origNode->id << endl;
-    cout << "    NewAddy " << newNode << ", old: " << origNode << endl;
-  }
-
-  // copy node from t
-  *newNode = *origNode;
-  newNode->id = nodeId;
-
-  // if it has children, allocate and copy them too
-  if (origNode->l != NULL && !newNode->leaf){
-    newNode->l = allocateNode();
-    if (COPYDEBUG) cout << "     Copy left node " << newNode->l->id << " from " << origNode->l->id << endl;
-    copyTree(newNode->l, origNode->l);
-  } else {
-    newNode->l = NULL;
-  }
-
-  if (origNode->r != NULL && !newNode->leaf){
-    newNode->r = allocateNode();
-    if (COPYDEBUG) cout << "     Copy right node " << newNode->r->id << " from " << origNode->r->id << endl;
-    copyTree(newNode->r, origNode->r);
-  } else {
-    newNode->r = NULL;
-  }
-}
-
-
 C45Tree::~C45Tree() {
-  deleteTree(root);
-  for (unsigned i = N_C45_EXP; i < experiences.size(); i++){
-    delete experiences[i];
-  }
-  experiences.clear();
+  releaseNode(root);
+  releaseCompiled(compiled);
+  releaseExperiences(experiences);
+  store->release();
 }
 
 // here the target output will be a single value
@@ -155,31 +141,23 @@ bool C45Tree::trainInstance(classPair &instance){
   bool modelChanged = false;
 
   // simply add this instance to the set of experiences
+  if ((int)instance.in.size() > nfeat)
+    nfeat = instance.in.size();
 
-  // take from static array until we run out
-  tree_experience *e;
-  if (nExperiences < N_C45_EXP){
-    // from statically created set of experiences
-    e = &(allExp[nExperiences]);
+  // inputs go in the experience store, unless already placed there for us
+  tree_experience *e = addExperience(instance.in, instance.row, instance.out);
 
-  } else {
-    // dynamically create experience
-    e = new tree_experience;
-  }
-
-
-  e->input = instance.in;
-  e->output = instance.out;
-  experiences.push_back(e);
-  nExperiences++;
+  // left out of the sample
+  if (e == NULL)
+    return false;
 
   if (nExperiences == 1000000){
     cout << "Reached limit of # experiences allowed." << endl;
     return false;
   }
 
-  if (nExperiences != (int)experiences.size())
-    cout << "ERROR: experience size mismatch: " << nExperiences << ", " << experiences.size() << endl;
+  if (nUnique != (int)experiences->ptrs.size())
+    cout << "ERROR: experience size mismatch: " << nUnique << ", " << experiences->ptrs.size() << endl;
 
   //cout << nExperiences << endl << flush;
   //if (nExperiences == 503 && id == 10){
@@ -196,8 +174,8 @@ bool C45Tree::trainInstance(classPair &instance){
     cout << endl << " Original output: " << instance.out << endl;
     cout << "Added exp id: " << nExperiences << " output: " << e->output << endl;
     cout << "Address: " << e << " Input : ";
-    for (unsigned i = 0; i < e->input.size(); i++){
-      cout << e->input[i] << ", ";
+    for (int i = 0; i < nfeat; i++){
+      cout << store->get(e->row, i) << ", ";
     }
     cout << endl << " Now have " << nExperiences << " experiences." << endl;
   }
@@ -215,9 +193,11 @@ bool C45Tree::trainInstance(classPair &instance){
     // build on misclassification
     // check for misclassify
     // get leaf
-    tree_node* leaf = traverseTree(root, e->input);
-    // find probability for this output
-    float count = (float)leaf->outputs[e->output];
+    tree_node* leaf = traverseTree(root, instance.in);
+    // find probability for this output (the leaf may be shared with a
+    // copy of the tree, so look it up without adding it)
+    std::map<float, int>::const_iterator it = leaf->outputs.find(e->output);
+    float count = (it == leaf->outputs.end()) ? 0.0 : (float)it->second;
     float outputProb = count / (float)leaf->nInstances;
 
     if (outputProb < 0.75){
@@ -272,31 +252,23 @@ bool C45Tree::trainInstances(std::vector<classPair> &instances){
     classPair instance = instances[a];
 
     // simply add this instance to the set of experiences
+    if ((int)instance.in.size() > nfeat)
+      nfeat = instance.in.size();
 
-    // take from static array until we run out
-    tree_experience *e;
-    if (nExperiences < N_C45_EXP){
-      // from statically created set of experiences
-      e = &(allExp[nExperiences]);
+    // inputs go in the experience store, unless already placed there for us
+    tree_experience *e = addExperience(instance.in, instance.row, instance.out);
 
-    } else {
-      // dynamically create experience
-      e = new tree_experience;
-    }
-
-
-    e->input = instance.in;
-    e->output = instance.out;
-    experiences.push_back(e);
-    nExperiences++;
+    // left out of the sample
+    if (e == NULL)
+      continue;
 
     if (nExperiences == 1000000){
       cout << "Reached limit of # experiences allowed." << endl;
       return false;
     }
 
-    if (nExperiences != (int)experiences.size())
-      cout << "ERROR: experience size mismatch: " << nExperiences << ", " << experiences.size() << endl;
+    if (nUnique != (int)experiences->ptrs.size())
+      cout << "ERROR: experience size mismatch: " << nUnique << ", " << experiences->ptrs.size() << endl;
 
     if (DTDEBUG) {
       cout << "Original input: ";
@@ -306,8 +278,8 @@ bool C45Tree::trainInstances(std::vector<classPair> &instances){
       cout << endl << " Original output: " << instance.out << endl;
       cout << "Added exp id: " << nExperiences << " output: " << e->output << endl;
       cout << "Address: " << e << " Input : ";
-      for (unsigned i = 0; i < e->input.size(); i++){
-        cout << e->input[i] << ", ";
+      for (int i = 0; i < nfeat; i++){
+        cout << store->get(e->row, i) << ", ";
       }
       cout << endl << " Now have " << nExperiences << " experiences." << endl;
     }
@@ -328,9 +300,11 @@ bool C45Tree::trainInstances(std::vector<classPair> &instances){
       // build on misclassification
       // check for misclassify
       // get leaf
-      tree_node* leaf = traverseTree(root, e->input);
-      // find probability for this output
-      float count = (float)leaf->outputs[e->output];
+      tree_node* leaf = traverseTree(root, instance.in);
+      // find probability for this output (the leaf may be shared with a
+      // copy of the tree, so look it up without adding it)
+      std::map<float, int>::const_iterator it = leaf->outputs.find(e->output);
+      float count = (it == leaf->outputs.end()) ? 0.0 : (float)it->second;
       float outputProb = count / (float)leaf->nInstances;
 
       if (outputProb < 0.75){
@@ -371,7 +345,15 @@ bool C45Tree::trainInstances(std::vector<classPair> &instances){
 
 
 bool C45Tree::rebuildTree(){
-  return buildTree(root, experiences, false);
+  addPendingWeights();
+  root = unshareNode(root);
+  // replaced experiences can change any part of the tree
+  bool changed = buildTree(root, experiences->ptrs, replaced);
+  replaced = false;
+
+  // predictions now use the new tree
+  compileTree();
+  return changed;
 }
 
 
@@ -382,17 +364,17 @@ void C45Tree::testInstance(const std::vector<float> &input, std::map<float, floa
   retval->clear();
 
   // in case the tree is empty
-  if (experiences.size() == 0){
+  if (nExperiences == 0){
     (*retval)[0.0] = 1.0;
     return;
   }
 
-  // follow through tree to leaf
-  tree_node* leaf = traverseTree(root, input);
-  lastNode = leaf;
+  // follow through compiled tree to leaf
+  int leaf = traverseCompiled(input);
+  lastLeaf = leaf;
 
   // and return mapping of outputs and their probabilities
-  outputProbabilities(leaf, retval);
+  compiledPrediction(leaf, input, retval);
 
 }
 
@@ -400,7 +382,11 @@ float C45Tree::getConf(const std::vector<float> &input){
   if (DTDEBUG) cout << "numVisits" << endl;
 
   // in case the tree is empty
-  if (experiences.size() == 0){
+  if (nExperiences == 0){
+    return 0;
+  }
+
+  if (lastLeaf < 0){
     return 0;
   }
 
@@ -408,14 +394,178 @@ float C45Tree::getConf(const std::vector<float> &input){
   //tree_node* leaf = traverseTree(root, input);
 
   // and return # in this leaf
-  float conf = (float)lastNode->nInstances / (float)(2.0*M);
-  if (conf > 1.0)
-    return 1.0;
-  else
-    return conf;
+  return compiledConf(lastLeaf);
+
+}
+
+
+void C45Tree::testInstances(const std::vector<std::vector<float> > &inputs,
+                            std::vector<std::map<float, float> >* retval,
+                            std::vector<float>* confs){
+  if (DTDEBUG) cout << "testInstances: " << inputs.size() << endl;
+
+  retval->resize(inputs.size());
+  if (confs != NULL) confs->resize(inputs.size());
+
+  // in case the tree is empty
+  if (nExperiences == 0){
+    for (unsigned j = 0; j < inputs.size(); j++){
+      (*retval)[j].clear();
+      (*retval)[j][0.0] = 1.0;
+      if (confs != NULL) (*confs)[j] = 0;
+    }
+    return;
+  }
+
+  // follow all the inputs through the compiled tree together
+  traverseCompiled(inputs, &batchLeaves);
+
+  for (unsigned j = 0; j < inputs.size(); j++){
+    (*retval)[j].clear();
+    compiledPrediction(batchLeaves[j], inputs[j], &((*retval)[j]));
+    if (confs != NULL) (*confs)[j] = compiledConf(batchLeaves[j]);
+  }
+
+  if (inputs.size() > 0)
+    lastLeaf = batchLeaves.back();
+}
+
+bool C45Tree::saveModel(std::ostream &out){
+
+  // sampled inputs are in a store of our own, which isn't saved
+  if (cap > 0)
+    return false;
+
+  addPendingWeights();
+
+  int header[4] = { nfeat, nExperiences, nUnique, compress };
+  out.write((char*)header, sizeof(header));
+
+  // just the part of a shared list that is ours
+  for (int i = 0; i < nUnique; i++){
+    tree_experience* e = experiences->ptrs[i];
+    out.write((char*)&(e->row), sizeof(int));
+    out.write((char*)&(e->output), sizeof(float));
+    out.write((char*)&(e->weight), sizeof(int));
+  }
+
+  saveNode(out, root);
+
+  return out.good();
+}
+
+void C45Tree::saveNode(std::ostream &out, tree_node* node){
+  char leaf = node->leaf;
+  int nOutputs = node->outputs.size();
+  out.write(&leaf, sizeof(char));
+  out.write((char*)&(node->dim), sizeof(int));
+  out.write((char*)&(node->val), sizeof(float));
+  out.write((char*)&(node->type), sizeof(int));
+  out.write((char*)&(node->nInstances), sizeof(int));
+  out.write((char*)&nOutputs, sizeof(int));
+  for (std::map<float, int>::iterator it = node->outputs.begin();
+       it != node->outputs.end(); it++){
+    out.write((char*)&((*it).first), sizeof(float));
+    out.write((char*)&((*it).second), sizeof(int));
+  }
 
+  if (!node->leaf){
+    saveNode(out, node->l);
+    saveNode(out, node->r);
+  }
 }
 
+bool C45Tree::loadModel(std::istream &in){
+
+  if (cap > 0 || nExperiences > 0){
+    cout << "C4.5 tree " << id << " can only load into an empty tree" << endl;
+    return false;
+  }
+
+  int header[4];
+  in.read((char*)header, sizeof(header));
+  if (!in.good() || header[2] < 0 || header[2] > header[1])
+    return false;
+  nfeat = header[0];
+  nExperiences = header[1];
+  nUnique = header[2];
+  compress = header[3];
+
+  // experiences point into the store, which already has their rows
+  std::vector<float> key;
+  for (int i = 0; i < nUnique; i++){
+    tree_experience e;
+    in.read((char*)&(e.row), sizeof(int));
+    in.read((char*)&(e.output), sizeof(float));
+    in.read((char*)&(e.weight), sizeof(int));
+    if (!in.good() || e.row < 0 || e.row >= store->size()){
+      cout << "C4.5 tree " << id << " has an experience outside the store" << endl;
+      return false;
+    }
+    experiences->exps.push_back(e);
+    experiences->ptrs.push_back(&(experiences->exps.back()));
+    if (compress){
+      store->getRow(e.row, nfeat, &key);
+      key.push_back(e.output);
+      experiences->index[key] = i;
+    }
+  }
+
+  tree_node* node = loadNode(in);
+  if (node == NULL)
+    return false;
+  releaseNode(root);
+  root = node;
+
+  compileTree();
+
+  if (DTDEBUG){
+    cout << "DT " << id << " loaded with " << nExperiences << " experiences" << endl;
+    printTree(root, 0);
+  }
+
+  return true;
+}
+
+C45Tree::tree_node* C45Tree::loadNode(std::istream &in){
+  char leaf;
+  int nOutputs;
+  tree_node* node = allocateNode();
+  in.read(&leaf, sizeof(char));
+  in.read((char*)&(node->dim), sizeof(int));
+  in.read((char*)&(node->val), sizeof(float));
+  in.read((char*)&(node->type), sizeof(int));
+  in.read((char*)&(node->nInstances), sizeof(int));
+  in.read((char*)&nOutputs, sizeof(int));
+  node->leaf = leaf;
+
+  for (int i = 0; i < nOutputs && in.good(); i++){
+    float val;
+    int count;
+    in.read((char*)&val, sizeof(float));
+    in.read((char*)&count, sizeof(int));
+    node->outputs[val] = count;
+  }
+
+  if (!in.good()){
+    releaseNode(node);
+    return NULL;
+  }
+
+  if (!node->leaf){
+    node->l = loadNode(in);
+    if (node->l != NULL)
+      node->r = loadNode(in);
+    if (node->r == NULL){
+      releaseNode(node);
+      return NULL;
+    }
+  }
+
+  return node;
+}
+
+
 // check to see if this state is one we should explore
 // to get more info on potential splits
 
@@ -424,6 +574,8 @@ float C45Tree::getConf(const std::vector<float> &input){
 void C45Tree::initTree(){
   if (DTDEBUG) cout << "initTree()" << endl;
   root = allocateNode();
+  compiled = NULL;
+  compileTree();
 
   if (DTDEBUG) cout << "   root id = " << root->id << endl;
 
@@ -463,41 +615,49 @@ void C45Tree::initTreeNode(tree_node* node){
   node->r = NULL;
 
   node->leaf = true;
+  node->refs = 1;
 
 }
 
-void C45Tree::deleteTree(tree_node* node){
+void C45Tree::releaseNode(tree_node* node){
   if (node==NULL)
     return;
 
-  if (DTDEBUG) cout << "deleteTree, node=" << node->id << endl;
+  node->refs--;
+  if (node->refs > 0)
+    return;
+
+  if (DTDEBUG) cout << "releaseNode, node=" << node->id << endl;
 
   totalnodes--;
 
-  node->nInstances = 0;
-  node->outputs.clear();
+  // children lose this reference
+  releaseNode(node->l);
+  releaseNode(node->r);
 
-  //recursively call deleteTree on children
-  // then delete them
-  if (!node->leaf){
-    // left child
-    if (node->l != NULL){
-      deleteTree(node->l);
-      deallocateNode(node->l);
-      node->l = NULL;
-    }
+  delete node;
+}
 
-    // right child
-    if (node->r != NULL){
-      deleteTree(node->r);
-      deallocateNode(node->r);
-      node->r = NULL;
-    }
-  }
 
-  node->leaf = true;
-  node->dim = -1;
+C45Tree::tree_node* C45Tree::unshareNode(tree_node* node){
+  if (node->refs == 1)
+    return node;
+
+  // copy the node, the copy shares the same children
+  tree_node* copy = new tree_node(*node);
+  copy->id = nnodes++;
+  copy->refs = 1;
+  if (copy->l != NULL) copy->l->refs++;
+  if (copy->r != NULL) copy->r->refs++;
+  if (COPYDEBUG) cout << id << " copy shared node " << node->id << " to " << copy->id << endl;
+
+  totalnodes++;
+  if (totalnodes > maxnodes){
+    maxnodes = totalnodes;
+  }
 
+  node->refs--;
+  return copy;
 }
 
 
@@ -547,6 +707,28 @@ bool C45Tree::passTest(int dim, float val, bool type, const std::vector<float> &
 }
 
 
+bool C45Tree::passTest(int dim, float val, bool type, const tree_experience* e){
+  float input = store->get(e->row, dim);
+  if (DTDEBUG) cout << "passTest, dim=" << dim << ",val=" << val << ",type=" << type
+                    << ",input["<<dim<<"]=" << input <<endl;
+
+  if (type == CUT){
+    if (input > val)
+      return false;
+    else
+      return true;
+  } else if (type == ONLY){
+    if (input == val)
+      return false;
+    else
+      return true;
+  } else {
+    return false;
+  }
+
+}
+
+
 bool C45Tree::buildTree(tree_node *node,
                         const std::vector<tree_experience*> &instances,
                         bool changed){
@@ -564,12 +746,12 @@ bool C45Tree::buildTree(tree_node *node,
   //std::vector<float> chiSquare = calcChiSquare(instances);
 
   // first, add instances to tree
-  node->nInstances = instances.size();
+  node->nInstances = totalWeight(instances);
 
   // add each output to this node
   node->outputs.clear();
   for (unsigned i = 0; i < instances.size(); i++){
-    node->outputs[instances[i]->output]++;
+    node->outputs[instances[i]->output] += instances[i]->weight;
   }
 
   // see if they're all the same
@@ -600,7 +782,13 @@ bool C45Tree::buildTree(tree_node *node,
 
     testPossibleSplits(instances, &bestGainRatio, &bestDim, &bestVal, &bestType, &bestLeft, &bestRight);
 
-    return implementSplit(node, bestGainRatio, bestDim, bestVal, bestType, bestLeft, bestRight, changed);
+    bool change = implementSplit(node, bestGainRatio, bestDim, bestVal, bestType, bestLeft, bestRight, changed);
+
+    // only leaves need their outputs
+    if (!node->leaf)
+      node->outputs.clear();
+
+    return change;
 
   }
 
@@ -611,14 +799,12 @@ bool C45Tree::makeLeaf(tree_node* node){
 
   // check on children
   if (node->l != NULL){
-    deleteTree(node->l);
-    deallocateNode(node->l);
+    releaseNode(node->l);
     node->l = NULL;
   }
 
   if (node->r != NULL){
-    deleteTree(node->r);
-    deallocateNode(node->r);
+    releaseNode(node->r);
     node->r = NULL;
   }
 
@@ -665,15 +851,17 @@ bool C45Tree::implementSplit(tree_node* node, float bestGainRatio, int bestDim,
     bool changeR = false;
 
     // see which leaf changed
-    if (bestLeft.size() > (unsigned)node->l->nInstances){
+    if (totalWeight(bestLeft) > node->l->nInstances){
       // redo left side
       if (DTDEBUG) cout << "Rebuild left side of tree" << endl;
+      node->l = unshareNode(node->l);
       changeL = buildTree(node->l, bestLeft, changed);
     }
 
-    if (bestRight.size() > (unsigned)node->r->nInstances){
+    if (totalWeight(bestRight) > node->r->nInstances){
       // redo right side
       if (DTDEBUG) cout << "Rebuild right side of tree" << endl;
+      node->r = unshareNode(node->r);
       changeR = buildTree(node->r, bestRight, changed);
     }
 
@@ -717,6 +905,8 @@ bool C45Tree::implementSplit(tree_node* node, float bestGainRatio, int bestDim,
     if (DTDEBUG) cout << "Init new right tree nodes " << endl;
     node->r = allocateNode();
   }
+  node->l = unshareNode(node->l);
+  node->r = unshareNode(node->r);
 
   // recursively build the sub-trees to this one
   if (DTDEBUG) cout << "Building left tree for node " << node->id << endl;
@@ -746,7 +936,7 @@ void C45Tree::testPossibleSplits(const std::vector<tree_experience*> &instances,
   int nties = 0;
 
   // for each possible split, calc gain ratio
-  for (unsigned idim = 0; idim < instances[0]->input.size(); idim++){
+  for (int idim = 0; idim < nfeat; idim++){
 
     //float* sorted = sortOnDim(idim, instances);
     float minVal, maxVal;
@@ -887,23 +1077,27 @@ float C45Tree::calcGainRatio(int dim, float val, bool type,
   float GainRatio;
 
   // see where the instances would go with this split
+  int leftWeight = 0;
+  int rightWeight = 0;
   for (unsigned i = 0; i < instances.size(); i++){
     if (DTDEBUG) cout << "calcGainRatio - Classify instance " << i 
                       << " on new split " << endl;
 
-    if (passTest(dim, val, type, instances[i]->input)){
+    if (passTest(dim, val, type, instances[i])){
       left.push_back(instances[i]);
+      leftWeight += instances[i]->weight;
     }
     else{
       right.push_back(instances[i]);
+      rightWeight += instances[i]->weight;
     }
   }
 
   if (DTDEBUG) cout << "Left has " << left.size()
                     << ", right has " << right.size() << endl;
 
-  D[0] = (float)left.size() / (float)instances.size();
-  D[1] = (float)right.size() / (float)instances.size();
+  D[0] = (float)leftWeight / (float)(leftWeight + rightWeight);
+  D[1] = (float)rightWeight / (float)(leftWeight + rightWeight);
   float leftInfo = calcIforSet(left);
   float rightInfo = calcIforSet(right);
   Info = D[0] * leftInfo + D[1] * rightInfo;
@@ -941,17 +1135,19 @@ float C45Tree::calcIforSet(const std::vector<tree_experience*> &instances){
   std::map<float, int> classes;
 
   // go through instances and figure count of each type
+  int total = 0;
   for (unsigned i = 0; i < instances.size(); i++){
     // increment count for this value
     float val = instances[i]->output;
-    classes[val]++;
+    classes[val] += instances[i]->weight;
+    total += instances[i]->weight;
   }
 
   // now calculate P
   float Pval;
   float I = 0;
   for (std::map<float, int>::iterator i = classes.begin(); i != classes.end(); i++){
-    Pval = (float)(*i).second / (float)instances.size();
+    Pval = (float)(*i).second / (float)total;
     // calc I of P
     I -= Pval * log(Pval);
   }
@@ -964,14 +1160,16 @@ std::set<float> C45Tree::getUniques(int dim, const std::vector<tree_experience*>
   if (DTDEBUG) cout << "getUniques,dim = " << dim;
 
   std::set<float> uniques;
+  const std::vector<float> &featVals = store->column(dim);
 
   for (int i = 0; i < (int)instances.size(); i++){
-    if (i == 0 || instances[i]->input[dim] < minVal)
-      minVal = instances[i]->input[dim];
-    if (i == 0 || instances[i]->input[dim] > maxVal)
-      maxVal = instances[i]->input[dim];
+    float val = featVals[instances[i]->row];
+    if (i == 0 || val < minVal)
+      minVal = val;
+    if (i == 0 || val > maxVal)
+      maxVal = val;
 
-    uniques.insert(instances[i]->input[dim]);
+    uniques.insert(val);
   }
 
   if (DTDEBUG) cout << " #: " << uniques.size() << endl;
@@ -983,11 +1181,12 @@ float* C45Tree::sortOnDim(int dim, const std::vector<tree_experience*> &instance
   if (DTDEBUG) cout << "sortOnDim,dim = " << dim << endl;
 
   float* values = new float[instances.size()];
+  const std::vector<float> &featVals = store->column(dim);
 
   for (int i = 0; i < (int)instances.size(); i++){
     //cout << "Instance " << i << endl;
 
-    float val = instances[i]->input[dim];
+    float val = featVals[instances[i]->row];
     //cout << " val: " << val << endl;
 
     // find where this should go
@@ -1092,50 +1291,302 @@ void C45Tree::outputProbabilities(tree_node* leaf, std::map<float, float>* retva
 }
 
 
-void C45Tree::initNodes(){
+C45Tree::tree_node* C45Tree::allocateNode(){
+  tree_node* newNode = new tree_node;
+  initTreeNode(newNode);
+  if (NODEDEBUG) 
+    cout << id << " allocate node " << newNode->id << endl;
+  return newNode;
+}
+
 
-  for (int i = 0; i < N_C45_NODES; i++){
-    initTreeNode(&(allNodes[i]));
-    freeNodes.push_back(i);
-    if (NODEDEBUG) 
-      cout << "init node " << i << " with id " << allNodes[i].id 
-           << ", now " << freeNodes.size() << " free nodes." << endl;
+C45Tree::tree_experience* C45Tree::addExperience(const std::vector<float> &input, int row, float output){
+
+  // see if we already have this pair
+  std::vector<float> key;
+  if (compress){
+    key = input;
+    key.push_back(output);
+    std::map<std::vector<float>, int>::iterator it = experiences->index.find(key);
+    if (it != experiences->index.end() && it->second < nUnique){
+      // copies of the tree must not see the weight change, so while the
+      // list is shared it waits until we next build the tree
+      tree_experience *e = experiences->ptrs[it->second];
+      if (experiences->refs > 1)
+        pendingWeights.push_back(it->second);
+      else
+        e->weight++;
+      nExperiences++;
+      return e;
+    }
   }
 
+  // once full, keep it with probability cap / # seen, in place of a random one
+  if (cap > 0 && nUnique >= cap){
+    nExperiences++;
+    int slot = rng.uniformDiscrete(0, nExperiences-1);
+    if (slot >= cap)
+      return NULL;
+
+    // copies of the tree must not see the replacement
+    if (experiences->refs > 1 || (int)experiences->ptrs.size() != nUnique)
+      copyExperiences();
+    else
+      addPendingWeights();
+
+    tree_experience *e = experiences->ptrs[slot];
+    if (compress){
+      std::vector<float> oldKey;
+      store->getRow(e->row, nfeat, &oldKey);
+      oldKey.push_back(e->output);
+      experiences->index.erase(oldKey);
+      experiences->index[key] = slot;
+    }
+    e->row = store->append(input);
+    e->output = output;
+    e->weight = 1;
+    replaced = true;
+
+    // drop the inputs of replaced experiences
+    if (store->size() >= 2 * cap)
+      compactStore();
+
+    return e;
+  }
+
+  // someone else has added to our list, so copy the part that is ours
+  if ((int)experiences->ptrs.size() != nUnique){
+    copyExperiences();
+  }
+
+  // inputs go in our own store when sampling
+  if (row < 0 || cap > 0)
+    row = store->append(input);
+
+  experiences->exps.push_back(tree_experience());
+  tree_experience *e = &(experiences->exps.back());
+  e->row = row;
+  e->output = output;
+  e->weight = 1;
+  experiences->ptrs.push_back(e);
+  if (compress)
+    experiences->index[key] = nUnique;
+  nUnique++;
+  nExperiences++;
+
+  return e;
 }
 
-C45Tree::tree_node* C45Tree::allocateNode(){
-  if (freeNodes.empty()){
-    tree_node* newNode = new tree_node;
-    initTreeNode(newNode);
-    if (NODEDEBUG) 
-      cout << id << " PROBLEM: No more pre-allocated nodes!!!" << endl
-           << "return new node " << newNode->id 
-           << ", now " << freeNodes.size() << " free nodes." << endl;
-    return newNode;
-  }
-
-  int i = freeNodes.back();
-  freeNodes.pop_back();
-  if (NODEDEBUG) 
-    cout << id << " allocate node " << i << " with id " << allNodes[i].id 
-         << ", now " << freeNodes.size() << " free nodes." << endl;
-  return &(allNodes[i]);
+void C45Tree::copyExperiences(){
+  if (COPYDEBUG) cout << id << " copy experience list of size " << nUnique << endl;
+
+  exp_list* list = new exp_list;
+  list->refs = 1;
+  list->exps.insert(list->exps.end(), experiences->exps.begin(),
+                    experiences->exps.begin() + nUnique);
+  list->ptrs.resize(nUnique);
+  for (int i = 0; i < nUnique; i++){
+    list->ptrs[i] = &(list->exps[i]);
+  }
+
+  // re-index the part we kept
+  if (compress){
+    std::vector<float> key;
+    for (int i = 0; i < nUnique; i++){
+      store->getRow(list->exps[i].row, nfeat, &key);
+      key.push_back(list->exps[i].output);
+      list->index[key] = i;
+    }
+  }
+
+  // the new list is ours alone
+  for (unsigned i = 0; i < pendingWeights.size(); i++){
+    list->ptrs[pendingWeights[i]]->weight++;
+  }
+  pendingWeights.clear();
+
+  releaseExperiences(experiences);
+  experiences = list;
 }
 
-void C45Tree::deallocateNode(tree_node* node){
+void C45Tree::addPendingWeights(){
+  if (pendingWeights.size() == 0)
+    return;
 
-  if (node->id >= N_C45_NODES){
-    if (NODEDEBUG) 
-      cout << id << " dealloc extra node id " << node->id 
-           << ", now " << freeNodes.size() << " free nodes." << endl;
-    delete node;
+  if (experiences->refs > 1 || (int)experiences->ptrs.size() != nUnique){
+    copyExperiences();
     return;
   }
 
-  freeNodes.push_back(node->id);
-  if (NODEDEBUG) 
-    cout << id << " dealloc node " << node->id 
-         << ", now " << freeNodes.size() << " free nodes." << endl;
+  for (unsigned i = 0; i < pendingWeights.size(); i++){
+    experiences->ptrs[pendingWeights[i]]->weight++;
+  }
+  pendingWeights.clear();
+}
+
+void C45Tree::setCompressDuplicates(bool compress){
+  this->compress = compress;
+}
+
+void C45Tree::setExperienceCap(int cap){
+  this->cap = cap;
+
+  // inputs we replace can't be dropped from a store other trees use
+  if (cap > 0){
+    store->release();
+    store = new ExperienceStore();
+  }
+}
+
+int C45Tree::getStoreSize(){
+  return store->size();
+}
+
+void C45Tree::compactStore(){
+  if (DTDEBUG) cout << id << " compact store of " << store->size() << " rows to " << nUnique << endl;
+
+  // rows are about to change
+  if (experiences->refs > 1)
+    copyExperiences();
+  else
+    addPendingWeights();
+
+  ExperienceStore* compact = new ExperienceStore();
+  std::vector<float> input;
+  for (int i = 0; i < nUnique; i++){
+    store->getRow(experiences->ptrs[i]->row, nfeat, &input);
+    experiences->ptrs[i]->row = compact->append(input);
+  }
+
+  // copies of the tree keep the old store
+  store->release();
+  store = compact;
+}
+
+int C45Tree::totalWeight(const std::vector<tree_experience*> &instances){
+  int total = 0;
+  for (unsigned i = 0; i < instances.size(); i++){
+    total += instances[i]->weight;
+  }
+  return total;
+}
+
+void C45Tree::releaseExperiences(exp_list* list){
+  list->refs--;
+  if (list->refs == 0)
+    delete list;
+}
+
+
+void C45Tree::compileTree(){
+  flat_tree* flat = new flat_tree;
+  flat->refs = 1;
+
+  // breadth-first, so node i of the queue becomes compiled node i
+  std::vector<tree_node*> queue;
+  queue.push_back(root);
+  for (unsigned i = 0; i < queue.size(); i++){
+    tree_node* node = queue[i];
+    flat_node f;
+    f.val = node->val;
+    f.type = node->type;
+    if (node->leaf){
+      f.dim = -1;
+      f.next = flat->leaves.size();
+      flat_leaf fl;
+      fl.start = flat->outputs.size();
+      fl.nOutputs = 0;
+      fl.nInstances = node->nInstances;
+      for (std::map<float, int>::iterator it = node->outputs.begin();
+           it != node->outputs.end(); it++){
+        float count = (float)(*it).second;
+        if (count > 0){
+          flat->outputs.push_back((*it).first);
+          flat->outputs.push_back(count / (float)node->nInstances);
+          fl.nOutputs++;
+        }
+      }
+      flat->leaves.push_back(fl);
+    } else {
+      f.dim = node->dim;
+      f.next = queue.size();
+      queue.push_back(node->l);
+      queue.push_back(node->r);
+    }
+    flat->nodes.push_back(f);
+  }
+
+  if (compiled != NULL)
+    releaseCompiled(compiled);
+  compiled = flat;
+  lastLeaf = -1;
+}
+
+
+int C45Tree::traverseCompiled(const std::vector<float> &input){
+  const flat_node* nodes = &(compiled->nodes[0]);
+
+  int i = 0;
+  while (nodes[i].dim >= 0){
+    if (passTest(nodes[i].dim, nodes[i].val, nodes[i].type, input))
+      i = nodes[i].next;
+    else
+      i = nodes[i].next + 1;
+  }
+
+  return nodes[i].next;
+}
+
+
+void C45Tree::traverseCompiled(const std::vector<std::vector<float> > &inputs, std::vector<int> *leaves){
+  const flat_node* nodes = &(compiled->nodes[0]);
+  leaves->assign(inputs.size(), 0);
+
+  // move every input down one level per pass, so each pass reads
+  // one level of nodes, which are next to each other
+  bool moved = true;
+  while (moved){
+    moved = false;
+    for (unsigned j = 0; j < inputs.size(); j++){
+      int i = (*leaves)[j];
+      if (nodes[i].dim < 0)
+        continue;
+      if (passTest(nodes[i].dim, nodes[i].val, nodes[i].type, inputs[j]))
+        (*leaves)[j] = nodes[i].next;
+      else
+        (*leaves)[j] = nodes[i].next + 1;
+      moved = true;
+    }
+  }
+
+  // index of the leaf each input reached
+  for (unsigned j = 0; j < inputs.size(); j++){
+    (*leaves)[j] = nodes[(*leaves)[j]].next;
+  }
+}
+
+
+void C45Tree::compiledPrediction(int leaf, const std::vector<float> &input, std::map<float, float>* retval){
+  // go through all output values at this leaf
+  const flat_leaf &fl = compiled->leaves[leaf];
+  for (int i = fl.start; i < fl.start + 2*fl.nOutputs; i += 2){
+    retval->insert(retval->end(), std::pair<float,float>(compiled->outputs[i], compiled->outputs[i+1]));
+  }
+}
+
+
+float C45Tree::compiledConf(int leaf){
+  float conf = (float)compiled->leaves[leaf].nInstances / (float)(2.0*M);
+  if (conf > 1.0)
+    return 1.0;
+  else
+    return conf;
+}
+
+
+void C45Tree::releaseCompiled(flat_tree* tree){
+  tree->refs--;
+  if (tree->refs == 0)
+    delete tree;
 }
 
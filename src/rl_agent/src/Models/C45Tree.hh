@@ -11,12 +11,11 @@
 
 #include <rl_common/Random.h>
 #include <rl_common/core.hh>
+#include "ExperienceStore.hh"
 #include <vector>
 #include <set>
 #include <map>
-
-#define N_C45_EXP 200000
-#define N_C45_NODES 2500
+#include <deque>
 
 #define BUILD_EVERY 0
 #define BUILD_ON_ERROR 1
@@ -24,6 +23,12 @@
 #define BUILD_ON_TERMINAL 3
 #define BUILD_ON_TERMINAL_AND_ERROR 4
 
+/** Default for whether trees keep repeated (input, output) pairs as one weighted experience */
+#define COMPRESS_DUPLICATES false
+
+/** Default most distinct experiences a tree keeps, sampling from all it has seen (0 for no limit) */
+#define TREE_EXPERIENCE_CAP 0
+
 
 /** C4.5 decision tree class. */
 class C45Tree: public Classifier {
@@ -37,11 +42,12 @@ public:
       \param m # of visits for a given state-action to be considered known
       \param featPct pct of features to remove from set used for each tree split
       \param rng Random Number Generator 
+      \param store shared store of training inputs (the tree makes its own if NULL)
   */
   C45Tree(int id, int trainMode, int trainFreq, int m, 
-	  float featPct, Random rng);
+	  float featPct, Random rng, ExperienceStore* store = NULL);
 
-  /** Copy constructor */
+  /** Copy constructor. The copy shares its nodes and experiences with the original, so this is O(1); either tree copies a node or the experience list before it changes it. */
   C45Tree(const C45Tree&);
 
   ~C45Tree();
@@ -49,9 +55,8 @@ public:
   // structs to be defined
   struct tree_node;
   struct tree_experience;
-  
-  /** Make a copy of the subtree from origNode to newNode */
-  void copyTree(tree_node* newNode, tree_node* origNode);
+  struct exp_list;
+  struct flat_tree;
 
   virtual C45Tree* getCopy();
 
@@ -73,12 +78,47 @@ public:
     tree_node *r;
 
     bool leaf;
+
+    // # of trees (or parent nodes) pointing at this node
+    int refs;
   };
 
-  /** Experiences the tree is trained on. A vector of inputs and one float output to predict */
+  /** Experiences the tree is trained on. The row of the inputs in the experience store, one float output to predict, and the # of times this pair was seen (always 1 unless duplicates are compressed) */
   struct tree_experience {
-    std::vector<float> input;
+    int row;
     float output;
+    int weight;
+  };
+
+  /** Experiences shared by a tree and its copies. It is append-only: a tree uses the first nUnique, and may append in place as long as no other tree has appended past that. When compressing duplicates, index maps each input (with the output appended) to its place in exps. */
+  struct exp_list {
+    std::deque<tree_experience> exps;
+    std::vector<tree_experience*> ptrs;
+    std::map<std::vector<float>, int> index;
+    int refs;
+  };
+
+  /** Node of the compiled tree. Nodes are stored breadth-first. For a decision node, next is the index of the child that passes the test, with the other child right after it. Leaves have dim -1 and next is the index of their flat_leaf. */
+  struct flat_node {
+    int dim;
+    float val;
+    int type;
+    int next;
+  };
+
+  /** Leaf of the compiled tree: nOutputs (value, probability) pairs starting at start in the outputs block. */
+  struct flat_leaf {
+    int start;
+    int nOutputs;
+    int nInstances;
+  };
+
+  /** The tree compiled into contiguous arrays for fast predictions, with the leaf outputs kept apart from the nodes. It is replaced after each build and shared with copies of the tree. */
+  struct flat_tree {
+    std::vector<flat_node> nodes;
+    std::vector<flat_leaf> leaves;
+    std::vector<float> outputs;
+    int refs;
   };
   
   /** The types of splits. Split on ONLY meaning is input == x, or CUT meaning is input > x */
@@ -91,6 +131,21 @@ public:
   virtual bool trainInstances(std::vector<classPair> &instances);
   virtual void testInstance(const std::vector<float> &input, std::map<float, float>* retval);
   virtual float getConf(const std::vector<float> &input);
+  virtual void testInstances(const std::vector<std::vector<float> > &inputs,
+                             std::vector<std::map<float, float> >* retval,
+                             std::vector<float>* confs);
+
+  /** Write the experiences (as rows of the store) and the nodes of the tree. Not possible when capped, as the tree then keeps its own store. */
+  virtual bool saveModel(std::ostream &out);
+
+  /** Read a tree written by saveModel. Its store must already hold the rows the experiences refer to. */
+  virtual bool loadModel(std::istream &in);
+
+  /** Write the given node and the subtree below it, depth first */
+  void saveNode(std::ostream &out, tree_node* node);
+
+  /** Read a node and the subtree below it written by saveNode, or NULL on a bad file */
+  tree_node* loadNode(std::istream &in);
 
   /** Build the tree with the given instances from the given tree node */
   bool buildTree(tree_node* node, const std::vector<tree_experience*> &instances,  bool changed);
@@ -114,6 +169,9 @@ public:
   /** Determine if the input passes the test defined by dim, val, type */
   bool passTest(int dim, float val, bool type, const std::vector<float> &input);
 
+  /** Determine if the stored input of an experience passes the test defined by dim, val, type */
+  bool passTest(int dim, float val, bool type, const tree_experience* e);
+
   /** Calculate the gain ratio for the given split of instances */
   float calcGainRatio(int dim, float val, bool type,
 		       const std::vector<tree_experience*> &instances, float I,
@@ -126,8 +184,56 @@ public:
   /** Get all the unique values of the features on dimension dim */
   std::set<float> getUniques(int dim, const std::vector<tree_experience*> &instances, float & minVal, float& maxVal);
 
-  /** Delete this tree node and all nodes below it in the tree. */
-  void deleteTree(tree_node* node);
+  /** Drop a reference to this tree node, deleting it and releasing its children when it has none left. */
+  void releaseNode(tree_node* node);
+
+  /** Return a node only this tree points at, copying the given one if it is shared. The caller must store the result in place of the node. */
+  tree_node* unshareNode(tree_node* node);
+
+  /** Add an experience to the end of our experience list, first copying the list if another tree has appended to it. The input is appended to the store if row is -1. When compressing duplicates, a pair we already have just gets its weight increased. */
+  tree_experience* addExperience(const std::vector<float> &input, int row, float output);
+
+  /** Replace our experience list with a copy of the part of it we use, which only we point at, with the pending weights added */
+  void copyExperiences();
+
+  /** Add the weights of duplicates seen while our experience list was shared, copying the list if it still is */
+  void addPendingWeights();
+
+  /** Keep repeated (input, output) pairs as a single experience with a weight, so builds scale with the # of distinct experiences. Must be set before training. */
+  virtual void setCompressDuplicates(bool compress);
+
+  /** Sum of the weights of the given experiences */
+  int totalWeight(const std::vector<tree_experience*> &instances);
+
+  /** Keep at most cap distinct experiences (0 for no limit). Once full, each new experience replaces a random one with probability cap / # seen (reservoir sampling), so the tree is trained on a uniform sample of everything it has seen. The tree then keeps its own experience store, which is compacted as it fills up with replaced inputs. Must be set before training. */
+  virtual void setExperienceCap(int cap);
+
+  /** # of input rows in the experience store the tree reads from */
+  int getStoreSize();
+
+  /** Copy the inputs of our experiences into a new store, dropping the ones that were replaced */
+  void compactStore();
+
+  /** Drop a reference to an experience list, deleting it when it has none left. */
+  void releaseExperiences(exp_list* list);
+
+  /** Compile the tree into breadth-first arrays used for predictions */
+  void compileTree();
+
+  /** Follow the compiled tree to a leaf for the given input, returning the index of the leaf */
+  int traverseCompiled(const std::vector<float> &input);
+
+  /** Follow a batch of inputs through the compiled tree together, one level at a time, filling in the index of the leaf each one reaches */
+  void traverseCompiled(const std::vector<std::vector<float> > &inputs, std::vector<int> *leaves);
+
+  /** Get the prediction of the given compiled leaf for this input */
+  void compiledPrediction(int leaf, const std::vector<float> &input, std::map<float, float>* retval);
+
+  /** Get the confidence of the given compiled leaf */
+  float compiledConf(int leaf);
+
+  /** Drop a reference to a compiled tree, deleting it when it has none left. */
+  void releaseCompiled(flat_tree* tree);
 
   /** Calculate I(P) */
   float calcIofP(float* P, int size);
@@ -164,15 +270,9 @@ public:
   /** Make the given node into a leaf node. */
   bool makeLeaf(tree_node* node);
 
-  /** Allocate a new node from our pre-allocated store of tree nodes */
+  /** Allocate and initialize a new tree node */
   tree_node* allocateNode();
 
-  /** Return tree node back to store of nodes */
-  void deallocateNode(tree_node* node);
-
-  /** Initialize our store of tree nodes */
-  void initNodes();
-
 
   bool INCDEBUG;
   bool DTDEBUG;
@@ -203,21 +303,42 @@ private:
   int maxnodes;
   int totalnodes;
 
-  /** Vector of all experiences used to train the tree */
-  std::vector<tree_experience*> experiences;
+  /** All experiences used to train the tree, possibly shared with copies of the tree */
+  exp_list* experiences;
+
+  /** # of experiences in the list that are ours (less than nExperiences if duplicates are compressed) */
+  int nUnique;
+
+  /** Keep duplicates as weighted experiences */
+  bool compress;
 
-  /** Pre-allocated array of experiences to be filled during training. */
-  tree_experience allExp[N_C45_EXP];
+  /** Indices of experiences seen again while the list was shared with a copy of the tree. Their weights are added when the tree is next built, rather than copying the list for each one. */
+  std::vector<int> pendingWeights;
 
-  /** Pre-allocated array of tree nodes to be used for tree */
-  tree_node allNodes[N_C45_NODES];
-  std::vector<int> freeNodes;
+  /** Most distinct experiences to keep, or 0 */
+  int cap;
+
+  /** Whether an experience was replaced since the last build, so the whole tree must be rebuilt */
+  bool replaced;
+
+  /** Store holding the inputs of our experiences. */
+  ExperienceStore* store;
+
+  /** # of input features */
+  int nfeat;
 
   // TREE
   /** Pointer to root node of tree. */
   tree_node* root;
-  /** Pointer to last node of tree used (leaf used in last prediction made). */
-  tree_node* lastNode;
+
+  /** Compiled form of the tree, used for predictions. */
+  flat_tree* compiled;
+
+  /** Index of the compiled leaf used in the last prediction made, or -1. */
+  int lastLeaf;
+
+  /** Leaves reached by the last batch of inputs. */
+  std::vector<int> batchLeaves;
 
 };
 
@@ -0,0 +1,97 @@
+/** \file ExperienceStore.cc
+    Implements the ExperienceStore class.
+*/
+
+#include "ExperienceStore.hh"
+
+
+ExperienceStore::ExperienceStore():
+  nrows(0), refs(1)
+{
+  pthread_mutex_init(&ref_mutex, NULL);
+}
+
+ExperienceStore::~ExperienceStore() {
+  columns.clear();
+  pthread_mutex_destroy(&ref_mutex);
+}
+
+
+int ExperienceStore::append(const std::vector<float> &input){
+
+  // a wider input than we've seen so far adds columns, zero for older rows
+  if (input.size() > columns.size()){
+    columns.resize(input.size(), std::vector<float>(nrows, 0.0));
+  }
+
+  for (unsigned i = 0; i < columns.size(); i++){
+    if (i < input.size())
+      columns[i].push_back(input[i]);
+    else
+      columns[i].push_back(0.0);
+  }
+
+  return nrows++;
+}
+
+
+void ExperienceStore::getRow(int row, int n, std::vector<float> *input) const {
+  input->resize(n);
+  for (int i = 0; i < n; i++){
+    (*input)[i] = columns[i][row];
+  }
+}
+
+
+bool ExperienceStore::save(std::ostream &out) const {
+  int size[2] = { nrows, (int)columns.size() };
+  out.write((char*)size, sizeof(size));
+  for (unsigned i = 0; i < columns.size(); i++){
+    if (nrows > 0)
+      out.write((char*)&(columns[i][0]), sizeof(float)*nrows);
+  }
+  return out.good();
+}
+
+
+bool ExperienceStore::load(std::istream &in){
+  int size[2];
+  in.read((char*)size, sizeof(size));
+  if (!in.good() || size[0] < 0 || size[1] < 0)
+    return false;
+
+  // read column by column, then append row by row
+  std::vector<std::vector<float> > cols(size[1], std::vector<float>(size[0]));
+  for (int i = 0; i < size[1]; i++){
+    if (size[0] > 0)
+      in.read((char*)&(cols[i][0]), sizeof(float)*size[0]);
+  }
+  if (!in.good())
+    return false;
+
+  std::vector<float> input(size[1]);
+  for (int r = 0; r < size[0]; r++){
+    for (int i = 0; i < size[1]; i++){
+      input[i] = cols[i][r];
+    }
+    append(input);
+  }
+  return true;
+}
+
+
+void ExperienceStore::retain(){
+  pthread_mutex_lock(&ref_mutex);
+  refs++;
+  pthread_mutex_unlock(&ref_mutex);
+}
+
+
+void ExperienceStore::release(){
+  pthread_mutex_lock(&ref_mutex);
+  int left = --refs;
+  pthread_mutex_unlock(&ref_mutex);
+
+  if (left == 0)
+    delete this;
+}
@@ -0,0 +1,76 @@
+/** \file ExperienceStore.hh
+    Defines the ExperienceStore class, an append-only, column-major store of
+    training inputs that can be shared by all the trees of a model.
+*/
+
+#ifndef _EXPERIENCESTORE_HH_
+#define _EXPERIENCESTORE_HH_
+
+#include <vector>
+#include <iostream>
+#include <pthread.h>
+
+/** Append-only store of training inputs. Each input vector is stored once as a row and referred to by its row index. Features are kept column-major, so that scanning one feature over many experiences (as the tree split tests do) touches a single contiguous array. Memory grows with the number of rows actually appended. The store is reference counted so that several trees (and copies of them) can share it. Rows are never modified once appended, so sharers can never see each other's rows change. */
+class ExperienceStore {
+
+public:
+
+  /** Create an empty store, with a reference count of 1. */
+  ExperienceStore();
+
+  ~ExperienceStore();
+
+  /** Append an input vector as a new row.
+      \return the row index of the new input. */
+  int append(const std::vector<float> &input);
+
+  /** Get feature dim of the given row. */
+  float get(int row, int dim) const {
+    return columns[dim][row];
+  }
+
+  /** Get the whole column for feature dim. */
+  const std::vector<float>& column(int dim) const {
+    return columns[dim];
+  }
+
+  /** Fill in the first n features of the given row. */
+  void getRow(int row, int n, std::vector<float> *input) const;
+
+  /** Number of rows in the store. */
+  int size() const { return nrows; }
+
+  /** Number of features (columns) in the store. */
+  int width() const { return (int)columns.size(); }
+
+  /** Write the # of rows and columns, then each column. */
+  bool save(std::ostream &out) const;
+
+  /** Append the rows written by save to the store.
+      \return false if the file ended early. */
+  bool load(std::istream &in);
+
+  /** Add a reference to this store. */
+  void retain();
+
+  /** Remove a reference to this store, deleting it when none are left. */
+  void release();
+
+private:
+
+  /** Unimplemented: stores are shared with retain() rather than copied. */
+  ExperienceStore(const ExperienceStore&);
+  ExperienceStore& operator=(const ExperienceStore&);
+
+  /** One vector of values per feature. */
+  std::vector<std::vector<float> > columns;
+
+  int nrows;
+  int refs;
+
+  /** Mutex around the reference count. */
+  pthread_mutex_t ref_mutex;
+
+};
+
+#endif
@@ -46,6 +46,7 @@ nfactors(em.nfactors), v(em.v), n(em.n), rng(em.rng)
   featmax = em.featmax;
   featmin = em.featmin;
   statespace = em.statespace;
+  visitedIndex = em.visitedIndex;
 }
 
 ExplorationModel* ExplorationModel::getCopy(){
@@ -117,6 +118,44 @@ float ExplorationModel::getStateActionInfo(const std::vector<float> &state, int
 
   float conf = model->getStateActionInfo(state, act, retval);
 
+  return addExplorationBonus(state, act, conf, retval);
+
+}
+
+
+void ExplorationModel::getStateActionInfos(const std::vector<const std::vector<float>*> &states,
+                                           const std::vector<int> &actions,
+                                           const std::vector<StateActionInfo*> &retval,
+                                           std::vector<float>* confs){
+
+  // predict them all from the underlying model, then add bonuses
+  model->getStateActionInfos(states, actions, retval, confs);
+
+  for (unsigned k = 0; k < states.size(); k++){
+    (*confs)[k] = addExplorationBonus(*(states[k]), actions[k], (*confs)[k], retval[k]);
+  }
+
+}
+
+
+int ExplorationModel::getNumMembers(){
+  return model->getNumMembers();
+}
+
+
+float ExplorationModel::getMemberStateActionInfo(const std::vector<float> &state, int act, int member, StateActionInfo* retval){
+
+  retval->transitionProbs.clear();
+
+  float conf = model->getMemberStateActionInfo(state, act, member, retval);
+
+  return addExplorationBonus(state, act, conf, retval);
+
+}
+
+
+float ExplorationModel::addExplorationBonus(const std::vector<float> &state, int act,
+                                            float conf, StateActionInfo* retval){
 
   //cout << "state: " << state[0] << " act: " << act;
 
@@ -285,10 +324,95 @@ float ExplorationModel::getStateActionInfo(const std::vector<float> &state, int
 bool ExplorationModel::addStateToSet(const std::vector<float> &s){
   std::pair<std::set<std::vector<float> >::iterator, bool> retval;
   retval = statespace.insert(s);
+
+  // index new state-actions for finding the nearest one
+  if (retval.second && (exploreType == NOVEL_STATE_BONUS || exploreType == DIFF_AND_NOVEL_BONUS))
+    addToIndex(s);
+
   return retval.second;
 }
 
 
+void ExplorationModel::addToIndex(const std::vector<float> &s){
+
+  unsigned nfeats = s.size()-1;
+  if (nfeats == 0)
+    return;
+
+  kd_tree &tree = visitedIndex[s[nfeats]];
+
+  kd_node node;
+  node.point = tree.points.size();
+  node.left = -1;
+  node.right = -1;
+  tree.points.insert(tree.points.end(), s.begin(), s.begin() + nfeats);
+
+  int newIndex = tree.nodes.size();
+
+  // go down to an empty spot, splitting on each feature in turn
+  int depth = 0;
+  if (newIndex > 0){
+    int i = 0;
+    while (true){
+      kd_node &parent = tree.nodes[i];
+      depth++;
+      int* child = (s[parent.dim] < tree.points[parent.point + parent.dim]) ? &(parent.left) : &(parent.right);
+      if (*child == -1){
+        *child = newIndex;
+        break;
+      }
+      i = *child;
+    }
+  }
+
+  node.dim = depth % nfeats;
+  tree.nodes.push_back(node);
+}
+
+
+void ExplorationModel::nearestVisited(const kd_tree &tree, const std::vector<float> &s,
+                                      const std::vector<float> &featRange, float* minDist){
+
+  unsigned nfeats = featRange.size();
+
+  searchStack.clear();
+  searchStack.push_back(std::make_pair(0, 0.0f));
+
+  while (searchStack.size() > 0){
+    int i = searchStack.back().first;
+    float bound = searchStack.back().second;
+    searchStack.pop_back();
+
+    // can't be any closer in here
+    if (bound >= *minDist)
+      continue;
+
+    const kd_node &node = tree.nodes[i];
+    const float* p = &(tree.points[node.point]);
+
+    // sum all features that are different, as in the full search
+    float count = 0;
+    for (unsigned j = 0; j < nfeats; j++){
+      if (featRange[j] > 0)
+        count += fabs(s[j] - p[j]) / featRange[j];
+    }
+    if (count < *minDist) *minDist = count;
+
+    // the far side is at least this split's distance away on its feature
+    float diff = s[node.dim] - p[node.dim];
+    int nearChild = (diff < 0) ? node.left : node.right;
+    int farChild = (diff < 0) ? node.right : node.left;
+    float farBound = (featRange[node.dim] > 0) ? fabs(diff) / featRange[node.dim] : 0.0;
+
+    // near side goes on top, to be searched first
+    if (farChild != -1)
+      searchStack.push_back(std::make_pair(farChild, farBound));
+    if (nearChild != -1)
+      searchStack.push_back(std::make_pair(nearChild, 0.0f));
+  }
+}
+
+
 // check if state is in set (so we know if we've visited it)
 bool ExplorationModel::checkForState(const std::vector<float> &s){
   return (statespace.count(s) == 1);
@@ -316,20 +440,12 @@ float ExplorationModel::getFeatDistToVisitedSA(const std::vector<float> &s){
   float minDist = maxDist;//nfeats;
   unsigned actionIndex = nfeats;
 
-  for (std::set<std::vector<float> >::iterator i = statespace.begin(); i != statespace.end(); i++){
-    // ignore if not the same action
-    if (s[actionIndex] != (*i)[actionIndex]) continue;
-
-    // otherwise, sum all features that are different
-    float count = 0;
-    for (unsigned j = 0; j < nfeats; j++){
-      // distance based on magnitude of feature difference
-      // normalize by feature range
-      if (featRange[j] > 0)
-        count += fabs(s[j] - (*i)[j]) / featRange[j];
-    }
-    if (count < minDist) minDist = count;
-
+  // search the states visited with the same action
+  // distance based on magnitude of each feature difference,
+  // normalized by feature range
+  std::map<float, kd_tree>::iterator it = visitedIndex.find(s[actionIndex]);
+  if (it != visitedIndex.end() && it->second.nodes.size() > 0){
+    nearestVisited(it->second, s, featRange, &minDist);
   }
 
   return (float)minDist/(float)nfeats;
@@ -57,6 +57,16 @@ public:
   virtual bool updateWithExperiences(std::vector<experience> &instances);
   virtual bool updateWithExperience(experience &e);
   virtual float getStateActionInfo(const std::vector<float> &state, int act, StateActionInfo* retval);
+  virtual void getStateActionInfos(const std::vector<const std::vector<float>*> &states,
+                                   const std::vector<int> &actions,
+                                   const std::vector<StateActionInfo*> &retval,
+                                   std::vector<float>* confs);
+  virtual int getNumMembers();
+  virtual float getMemberStateActionInfo(const std::vector<float> &state, int act, int member, StateActionInfo* retval);
+
+  /** Add the exploration bonus to the model's prediction for this state-action, returning the confidence */
+  float addExplorationBonus(const std::vector<float> &state, int act,
+                            float conf, StateActionInfo* retval);
 
   /** Add state to a set of visited states */
   bool addStateToSet(const std::vector<float> &s);
@@ -67,6 +77,27 @@ public:
   /** Find distance in feature space to nearest visited state-action */
   float getFeatDistToVisitedSA(const std::vector<float> &s);
 
+  /** Node of a k-d tree of visited states. Points with a lower value than this one on dim go left, the rest go right. */
+  struct kd_node {
+    int point;
+    int dim;
+    int left;
+    int right;
+  };
+
+  /** k-d tree of the states visited with one action, kept in flat arrays. Each point takes nfeats floats. */
+  struct kd_tree {
+    std::vector<float> points;
+    std::vector<kd_node> nodes;
+  };
+
+  /** Add a visited state-action (the state with the action appended) to the index for its action */
+  void addToIndex(const std::vector<float> &s);
+
+  /** Search the tree for the visited state nearest to s, lowering minDist to its normalized distance if closer */
+  void nearestVisited(const kd_tree &tree, const std::vector<float> &s,
+                      const std::vector<float> &featRange, float* minDist);
+
 
   bool MODEL_DEBUG;
 
@@ -80,6 +111,12 @@ private:
       This way we can know what we've visited. */
   std::set<std::vector<float> > statespace;
 
+  /** Index of the visited state-actions for each action, for the novelty bonuses. */
+  std::map<float, kd_tree> visitedIndex;
+
+  /** Nodes still to be searched, with a lower bound on their distance. */
+  std::vector<std::pair<int, float> > searchStack;
+
   /** Underlying MDP model that we've wrapped and that we add bonus rewards onto. */
   MDPModel* model;
 
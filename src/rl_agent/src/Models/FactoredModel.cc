@@ -6,19 +6,24 @@
 
 #include "FactoredModel.hh"
 
+#include <string.h>
+
 
 FactoredModel::FactoredModel(int id, int numactions, int M, int modelType,
                  int predType, int nModels, float treeThreshold,
                  const std::vector<float> &featRange, float rRange,
                  bool needConf, bool dep, bool relTrans, float featPct, 
-		 bool stoch, bool episodic, Random rng):
-  rewardModel(NULL), terminalModel(NULL), 
+		 bool stoch, bool episodic, bool compress, int expCap,
+                 Random rng):
+  rewardModel(NULL), terminalModel(NULL), store(NULL),
   id(id), nact(numactions), M(M), modelType(modelType),
   predType(predType), nModels(nModels),
   treeBuildType(BUILD_ON_ERROR), // build tree after prediction error
   treeThresh(treeThreshold), featRange(featRange), rRange(rRange),
   needConf(needConf), dep(dep), relTrans(relTrans), FEAT_PCT(featPct), 
-  stoch(stoch), episodic(episodic), rng(rng)
+  stoch(stoch), episodic(episodic), compress(compress), expCap(expCap),
+  rng(rng),
+  pool(ThreadPool::shared())
 {
 
   //cout << "MDP Tree explore type: " << predType << endl;
@@ -28,6 +33,14 @@ FactoredModel::FactoredModel(int id, int numactions, int M, int modelType,
   // percent of experiences to use for each model
   EXP_PCT = 0.55;//6; //0.4;
 
+  maxOutcomes = MAX_OUTCOMES;
+  minOutcomeProb = MIN_OUTCOME_PROB;
+
+  cacheSize = PRED_CACHE_SIZE;
+  cacheHits = 0;
+  cacheRefreshes = 0;
+  cacheMisses = 0;
+
   // just to ensure the diff models are on different random values
   for (int i = 0; i < id; i++){
     rng.uniform(0, 1);
@@ -37,13 +50,15 @@ FactoredModel::FactoredModel(int id, int numactions, int M, int modelType,
 
 
 FactoredModel::FactoredModel(const FactoredModel & m):
-  rewardModel(NULL), terminalModel(NULL), 
+  rewardModel(NULL), terminalModel(NULL), store(m.store),
   id(m.id), nact(m.nact), M(m.M), modelType(m.modelType),
   predType(m.predType), nModels(m.nModels),
   treeBuildType(m.treeBuildType),
   treeThresh(m.treeThresh), featRange(m.featRange), rRange(m.rRange),
   needConf(m.needConf), dep(m.dep), relTrans(m.relTrans), FEAT_PCT(m.FEAT_PCT),
-  stoch(m.stoch), episodic(m.episodic), rng(m.rng)
+  stoch(m.stoch), episodic(m.episodic), compress(m.compress),
+  expCap(m.expCap), rng(m.rng),
+  pool(m.pool)
 {
   COPYDEBUG = m.COPYDEBUG;
 
@@ -51,7 +66,25 @@ FactoredModel::FactoredModel(const FactoredModel & m):
   MODEL_DEBUG = m.MODEL_DEBUG;
   EXP_PCT = m.EXP_PCT;
   nfactors = m.nfactors;
+  maxOutcomes = m.maxOutcomes;
+  minOutcomeProb = m.minOutcomeProb;
+
+  // copy the cache in the same lru order. the copy's trees start at the
+  // same versions, so its entries stay valid until they change
+  cacheSize = m.cacheSize;
+  cacheHits = m.cacheHits;
+  cacheRefreshes = m.cacheRefreshes;
+  cacheMisses = m.cacheMisses;
+  modelVersions = m.modelVersions;
+  predCache = m.predCache;
+  for (std::list<pred_cache::iterator>::const_iterator it = m.cacheOrder.begin();
+       it != m.cacheOrder.end(); it++){
+    cacheOrder.push_back(predCache.find((*it)->first));
+    cacheOrder.back()->second.lru = --cacheOrder.end();
+  }
 
+  // rows are never changed once added, so the copy can share them
+  if (store != NULL) store->retain();
 
   if (m.outputModels.size() > 0){
     if (COPYDEBUG) cout << " FactoredModel copy trees" << endl;
@@ -82,6 +115,7 @@ FactoredModel::~FactoredModel() {
     delete outputModels[i];
   }
   outputModels.clear();
+  if (store != NULL) store->release();
 }
 
 
@@ -91,6 +125,9 @@ bool FactoredModel::initMDPModel(int nfactors){
   if (MODEL_DEBUG) cout << "Init trees for each state factor and reward" << endl;
 
   outputModels.resize(nfactors);
+  modelVersions.assign(nfactors + 2, 0);
+
+  store = new ExperienceStore();
 
   bool simpleRegress = false;
   if (modelType == M5SINGLE || modelType == M5ALLSINGLE || modelType == LSTSINGLE)
@@ -99,38 +136,38 @@ bool FactoredModel::initMDPModel(int nfactors){
   // institute a model for each state factor, depending on model type
   for (int i = 0; i < nfactors; i++){
     if (modelType == C45TREE && nModels == 1){
-      outputModels[i] = new C45Tree((id * (nfactors+1)) + i, treeBuildType, 5, M, 0, rng);
+      outputModels[i] = new C45Tree((id * (nfactors+1)) + i, treeBuildType, 5, M, 0, rng, store);
       if (i == 0){
-        rewardModel = new C45Tree((id*(nfactors+1))+nfactors, treeBuildType,5, M, 0, rng);
-        if (episodic) terminalModel = new C45Tree((id*(nfactors+1))+nfactors+1, treeBuildType,5, M, 0, rng);
+        rewardModel = new C45Tree((id*(nfactors+1))+nfactors, treeBuildType,5, M, 0, rng, store);
+        if (episodic) terminalModel = new C45Tree((id*(nfactors+1))+nfactors+1, treeBuildType,5, M, 0, rng, store);
       }
     }
     else if ((modelType == M5MULTI || modelType == M5SINGLE) && nModels == 1){
-      outputModels[i] = new M5Tree((id * (nfactors+1)) + i, treeBuildType, 5, M, 0, simpleRegress, false, treeThresh *featRange[i], rng);
+      outputModels[i] = new M5Tree((id * (nfactors+1)) + i, treeBuildType, 5, M, 0, simpleRegress, false, treeThresh *featRange[i], rng, store);
       if (i == 0){
-        rewardModel = new M5Tree((id * (nfactors+1)) + nfactors, treeBuildType, 5, M, 0, simpleRegress, false, treeThresh *rRange, rng);
-        if (episodic) terminalModel = new M5Tree((id * (nfactors+1)) + 1+nfactors, treeBuildType, 5, M, 0, simpleRegress, false, treeThresh, rng);
+        rewardModel = new M5Tree((id * (nfactors+1)) + nfactors, treeBuildType, 5, M, 0, simpleRegress, false, treeThresh *rRange, rng, store);
+        if (episodic) terminalModel = new M5Tree((id * (nfactors+1)) + 1+nfactors, treeBuildType, 5, M, 0, simpleRegress, false, treeThresh, rng, store);
       }
     }
     else if ((modelType == M5ALLMULTI || modelType == M5ALLSINGLE) && nModels == 1){
-      outputModels[i] = new M5Tree((id * (nfactors+1)) + i, treeBuildType, 5, M, 0, simpleRegress, true, treeThresh *featRange[i], rng);
+      outputModels[i] = new M5Tree((id * (nfactors+1)) + i, treeBuildType, 5, M, 0, simpleRegress, true, treeThresh *featRange[i], rng, store);
       if (i == 0){
-        rewardModel = new M5Tree((id * (nfactors+1)) + nfactors, treeBuildType, 5, M, 0, simpleRegress, true, treeThresh *rRange, rng);
-        if (episodic) terminalModel = new M5Tree((id * (nfactors+1)) + 1+nfactors, treeBuildType, 5, M, 0, simpleRegress, true, treeThresh, rng);
+        rewardModel = new M5Tree((id * (nfactors+1)) + nfactors, treeBuildType, 5, M, 0, simpleRegress, true, treeThresh *rRange, rng, store);
+        if (episodic) terminalModel = new M5Tree((id * (nfactors+1)) + 1+nfactors, treeBuildType, 5, M, 0, simpleRegress, true, treeThresh, rng, store);
       }
     }
     else if ((modelType == LSTMULTI || modelType == LSTSINGLE) && nModels == 1){
-      outputModels[i] = new LinearSplitsTree((id * (nfactors+1)) + i, treeBuildType, 5, M, 0, simpleRegress, treeThresh *featRange[i], rng);
+      outputModels[i] = new LinearSplitsTree((id * (nfactors+1)) + i, treeBuildType, 5, M, 0, simpleRegress, treeThresh *featRange[i], rng, store);
       if (i == 0){
-        rewardModel = new LinearSplitsTree((id * (nfactors+1)) + nfactors, treeBuildType, 5, M, 0, simpleRegress, treeThresh *rRange, rng);
-        if (episodic) terminalModel = new LinearSplitsTree((id * (nfactors+1)) + 1+nfactors, treeBuildType, 5, M, 0, simpleRegress, treeThresh, rng);
+        rewardModel = new LinearSplitsTree((id * (nfactors+1)) + nfactors, treeBuildType, 5, M, 0, simpleRegress, treeThresh *rRange, rng, store);
+        if (episodic) terminalModel = new LinearSplitsTree((id * (nfactors+1)) + 1+nfactors, treeBuildType, 5, M, 0, simpleRegress, treeThresh, rng, store);
       }
     }
     else if (modelType == STUMP && nModels == 1){
-      outputModels[i] = new Stump((id * (nfactors+1)) + i, 1, 5, M, 0, rng);
+      outputModels[i] = new Stump((id * (nfactors+1)) + i, 1, 5, M, 0, rng, store);
       if (i == 0){
-        rewardModel = new Stump((id * (nfactors+1)) + nfactors, 1, 5, M, 0, rng);
-        if (episodic) terminalModel = new Stump((id * (nfactors+1)) +1+ nfactors, 1, 5, M, 0, rng);
+        rewardModel = new Stump((id * (nfactors+1)) + nfactors, 1, 5, M, 0, rng, store);
+        if (episodic) terminalModel = new Stump((id * (nfactors+1)) +1+ nfactors, 1, 5, M, 0, rng, store);
       }
     }
     else if (predType == SEPARATE && nModels > 1){
@@ -139,19 +176,19 @@ bool FactoredModel::initMDPModel(int nfactors){
                                           nModels, treeBuildType, 5,
                                           FEAT_PCT,
                                           EXP_PCT,
-                                           treeThresh *featRange[i], stoch, featRange[i], rng);
+                                           treeThresh *featRange[i], stoch, featRange[i], rng, store);
       if (i == 0){
         rewardModel = new SepPlanExplore((id * (nfactors+1)) + nfactors,
                                         modelType, predType,
                                         nModels, treeBuildType, 5,
                                         FEAT_PCT, // remove this pct of feats
-                                         EXP_PCT, treeThresh *rRange, stoch, rRange, rng);
+                                         EXP_PCT, treeThresh *rRange, stoch, rRange, rng, store);
 	if (episodic){
 	  terminalModel = new SepPlanExplore((id * (nfactors+1)) +1+ nfactors,
                                        modelType, predType,
                                        nModels, treeBuildType, 5,
                                        FEAT_PCT, // remove this pct of feats
-                                       EXP_PCT, treeThresh, stoch, 1.0, rng);
+                                       EXP_PCT, treeThresh, stoch, 1.0, rng, store);
 	}
       }
     }
@@ -161,19 +198,19 @@ bool FactoredModel::initMDPModel(int nfactors){
                                                nModels, treeBuildType, 5,
                                                FEAT_PCT,
                                                EXP_PCT,
-                                                treeThresh *featRange[i], stoch, featRange[i], rng);
+                                                treeThresh *featRange[i], stoch, featRange[i], rng, store);
       if (i == 0){
         rewardModel = new MultipleClassifiers((id * (nfactors+1)) + nfactors,
                                              modelType, predType,
                                              nModels, treeBuildType, 5,
                                              FEAT_PCT, // remove this pct of feats
-                                              EXP_PCT, treeThresh *rRange, stoch, rRange, rng);
+                                              EXP_PCT, treeThresh *rRange, stoch, rRange, rng, store);
 	if (episodic){
 	  terminalModel = new MultipleClassifiers((id * (nfactors+1)) +1+ nfactors,
                                             modelType, predType,
                                             nModels, treeBuildType, 5,
                                             FEAT_PCT, // remove this pct of feats
-                                            EXP_PCT, treeThresh, stoch, 1.0, rng);
+                                            EXP_PCT, treeThresh, stoch, 1.0, rng, store);
 	}
       }
     } else {
@@ -183,6 +220,23 @@ bool FactoredModel::initMDPModel(int nfactors){
 
   }
 
+  // options of the trees that must be set before they are trained
+  for (int i = 0; i < nfactors; i++){
+    outputModels[i]->setCompressDuplicates(compress);
+  }
+  rewardModel->setCompressDuplicates(compress);
+  if (terminalModel != NULL)
+    terminalModel->setCompressDuplicates(compress);
+
+  if (expCap > 0){
+    for (int i = 0; i < nfactors; i++){
+      outputModels[i]->setExperienceCap(expCap);
+    }
+    rewardModel->setExperienceCap(expCap);
+    if (terminalModel != NULL)
+      terminalModel->setExperienceCap(expCap);
+  }
+
   return true;
 
 }
@@ -207,9 +261,13 @@ bool FactoredModel::updateWithExperiences(std::vector<experience> &instances){
   }
 
   // separate these experience instances into classPairs
-  std::vector<std::vector<classPair> > stateData(outputModels.size());
-  std::vector<classPair> rewardData(instances.size());
-  std::vector<classPair> termData(instances.size());
+  // for each factor, then reward and termination
+  std::vector<std::vector<classPair> > data(nfactors + 2);
+  std::vector<std::vector<classPair> >::iterator factorEnd = data.begin() + nfactors;
+  std::vector<classPair> &rewardData = data[nfactors];
+  std::vector<classPair> &termData = data[nfactors+1];
+  rewardData.resize(instances.size());
+  if (episodic) termData.resize(instances.size());
 
   // count non-terminal experiences
   int nonTerm = 0;
@@ -217,8 +275,8 @@ bool FactoredModel::updateWithExperiences(std::vector<experience> &instances){
     if (!instances[i].terminal)
       nonTerm++;
   }
-  for (unsigned i = 0; i < outputModels.size(); i++){
-    stateData[i].resize(nonTerm);
+  for (std::vector<std::vector<classPair> >::iterator it = data.begin(); it != factorEnd; it++){
+    it->resize(nonTerm);
   }
   int nonTermIndex = 0;
 
@@ -242,25 +300,32 @@ bool FactoredModel::updateWithExperiences(std::vector<experience> &instances){
     if (relTrans)
       e.next = subVec(e.next, e.s);
 
+    // store the inputs once, along with the targets dep trees take as input
+    int row = appendToStore(inputs, e);
+
     // reward and terminal models
     classPair cp;
     cp.in = inputs;
+    cp.row = row;
     cp.out = e.reward;
     rewardData[i] = cp;
 
-    cp.out = e.terminal;
-    termData[i] = cp;
+    if (episodic){
+      cp.out = e.terminal;
+      termData[i] = cp;
+    }
 
     // add to each vector
     if (!e.terminal){
       for (unsigned j = 0; j < outputModels.size(); j++){
         classPair cp;
         cp.in = inputs;
+        cp.row = row;
 
         // split the outcome and rewards up
         // into each vector
         cp.out = e.next[j];
-        stateData[j][nonTermIndex] = cp;
+        data[j][nonTermIndex] = cp;
 
         // for dep trees, add this models target to next model's input
         if (dep){
@@ -273,20 +338,7 @@ bool FactoredModel::updateWithExperiences(std::vector<experience> &instances){
   }
 
   // build trees on all data
-  for (unsigned k = 0; k < stateData.size(); k++){
-    if (stateData[k].size() > 0){
-      bool singleChange = outputModels[k]->trainInstances(stateData[k]);
-      changed = changed || singleChange;
-    }
-  }
-
-  bool singleChange = rewardModel->trainInstances(rewardData);
-  changed = changed || singleChange;
-
-  if (episodic){
-    singleChange = terminalModel->trainInstances(termData);
-    changed = changed || singleChange;
-  }
+  changed = trainModels(data, false);
 
   return changed;
 }
@@ -341,21 +393,24 @@ bool FactoredModel::updateWithExperience(experience &e){
   if (relTrans)
     e.next = subVec(e.next, e.s);
 
+  // store the inputs once, along with the targets dep trees take as input
+  int row = appendToStore(inputs, e);
+
   // split the outcome and rewards up
-  // and train the trees
+  // for each tree to train on
+  std::vector<std::vector<classPair> > data(nfactors + 2);
   classPair cp;
   cp.in = inputs;
+  cp.row = row;
 
   // reward model
   cp.out = e.reward;
-  bool singleChange = rewardModel->trainInstance(cp);
-  changed = changed || singleChange;
+  data[nfactors].push_back(cp);
 
   // termination model
   if (episodic){
     cp.out = e.terminal;
-    singleChange = terminalModel->trainInstance(cp);
-    changed = changed || singleChange;
+    data[nfactors+1].push_back(cp);
   }
 
   // if not a terminal transition
@@ -363,9 +418,7 @@ bool FactoredModel::updateWithExperience(experience &e){
     for (unsigned i = 0; i < e.next.size(); i++){
       cp.in = inputs;
       cp.out = e.next[i];
-
-      bool singleChange = outputModels[i]->trainInstance(cp);
-      changed = changed || singleChange;
+      data[i].push_back(cp);
 
       // add this model's target to input for next model
       if (dep){
@@ -374,12 +427,167 @@ bool FactoredModel::updateWithExperience(experience &e){
     }
   }
 
+  changed = trainModels(data, true);
+
   if (MODEL_DEBUG) cout << "Model updated, changed: " << changed << endl;
   return changed;
 
 }
 
 
+int FactoredModel::appendToStore(const std::vector<float> &inputs, const experience &e){
+
+  // capped trees keep the inputs of the experiences they sample themselves
+  if (expCap > 0)
+    return -1;
+
+  if (!dep || e.terminal)
+    return store->append(inputs);
+
+  // dep trees for later factors also take the earlier targets as input
+  std::vector<float> row(inputs);
+  row.insert(row.end(), e.next.begin(), e.next.end());
+  return store->append(row);
+}
+
+
+int FactoredModel::getStoreSize(){
+  if (store == NULL)
+    return 0;
+  return store->size();
+}
+
+
+bool FactoredModel::saveModel(const char* filename){
+
+  if (outputModels.size() == 0){
+    cout << "No trained model to save" << endl;
+    return false;
+  }
+
+  if (expCap > 0){
+    cout << "Trees with capped experiences can't be saved" << endl;
+    return false;
+  }
+
+  ofstream modelFile(filename, ios::out | ios::binary | ios::trunc);
+  if (!modelFile.is_open()){
+    cout << "Could not write model file " << filename << endl;
+    return false;
+  }
+
+  // configuration the model has to be loaded with
+  const char magic[8] = "RLMODEL";
+  int config[11] = { MODEL_FILE_VERSION, nfactors, nact, modelType, predType,
+                     nModels, dep, relTrans, episodic, M, compress };
+  float featPct = FEAT_PCT;
+  modelFile.write(magic, sizeof(magic));
+  modelFile.write((char*)config, sizeof(config));
+  modelFile.write((char*)&featPct, sizeof(float));
+
+  // inputs are stored once for all the trees
+  store->save(modelFile);
+
+  // factors, then reward and termination
+  bool saved = true;
+  for (unsigned i = 0; i < outputModels.size() && saved; i++){
+    saved = outputModels[i]->saveModel(modelFile);
+  }
+  if (saved) saved = rewardModel->saveModel(modelFile);
+  if (saved && terminalModel != NULL) saved = terminalModel->saveModel(modelFile);
+
+  if (!saved){
+    cout << "Can't save trees of model type " << modelType << endl;
+    return false;
+  }
+
+  modelFile.close();
+  return !modelFile.fail();
+}
+
+
+bool FactoredModel::loadModel(const char* filename){
+
+  if (outputModels.size() != 0){
+    cout << "Can only load a model file into an untrained model" << endl;
+    return false;
+  }
+
+  if (expCap > 0){
+    cout << "Can't load a model file into trees with capped experiences" << endl;
+    return false;
+  }
+
+  ifstream modelFile(filename, ios::in | ios::binary);
+  if (!modelFile.is_open()){
+    cout << "Could not read model file " << filename << endl;
+    return false;
+  }
+
+  char magic[8];
+  int config[11];
+  float featPct;
+  modelFile.read(magic, sizeof(magic));
+  modelFile.read((char*)config, sizeof(int));
+  if (!modelFile.good() || memcmp(magic, "RLMODEL", 8) != 0){
+    cout << filename << " is not a model file" << endl;
+    return false;
+  }
+  if (config[0] != MODEL_FILE_VERSION){
+    cout << "Model file " << filename << " is version " << config[0]
+         << ", not " << MODEL_FILE_VERSION << endl;
+    return false;
+  }
+  modelFile.read((char*)(config+1), sizeof(config) - sizeof(int));
+  modelFile.read((char*)&featPct, sizeof(float));
+  if (!modelFile.good()){
+    cout << "Model file " << filename << " is truncated or corrupt" << endl;
+    return false;
+  }
+
+  // the trees have to be the ones we would have trained
+  // (feature pct only matters to ensembles, which pick features with it)
+  if (config[2] != nact || config[3] != modelType ||
+      config[5] != nModels || (nModels > 1 && config[4] != predType) ||
+      config[6] != dep || config[7] != relTrans || config[8] != episodic ||
+      config[9] != M || config[10] != compress ||
+      (nModels > 1 && fabs(featPct - FEAT_PCT) > 1e-6)){
+    cout << "Model file " << filename << " was trained with " << config[2]
+         << " actions, model type " << config[3] << ", prediction type "
+         << config[4] << ", " << config[5] << " models, dep " << config[6]
+         << ", relTrans " << config[7] << ", episodic " << config[8]
+         << ", M " << config[9] << ", compress " << config[10]
+         << ", feature pct " << featPct << endl;
+    cout << "This model has " << nact << " actions, model type " << modelType
+         << ", prediction type " << predType << ", " << nModels
+         << " models, dep " << dep << ", relTrans " << relTrans
+         << ", episodic " << episodic << ", M " << M << ", compress "
+         << compress << ", feature pct " << FEAT_PCT << endl;
+    return false;
+  }
+
+  nfactors = config[1];
+  initMDPModel(nfactors);
+
+  bool loaded = store->load(modelFile);
+  for (unsigned i = 0; i < outputModels.size() && loaded; i++){
+    loaded = outputModels[i]->loadModel(modelFile);
+  }
+  if (loaded) loaded = rewardModel->loadModel(modelFile);
+  if (loaded && terminalModel != NULL) loaded = terminalModel->loadModel(modelFile);
+
+  if (!loaded){
+    cout << "Model file " << filename << " is truncated or corrupt" << endl;
+    return false;
+  }
+
+  cout << "Loaded model with " << store->size() << " experiences from "
+       << filename << endl;
+
+  return true;
+}
+
+
 float FactoredModel::getSingleSAInfo(const std::vector<float> &state, int act, StateActionInfo* retval){
 
   retval->transitionProbs.clear();
@@ -490,8 +698,18 @@ float FactoredModel::getSingleSAInfo(const std::vector<float> &state, int act, S
 }
 
 
-// fill in StateActionInfo struct and return it
 float FactoredModel::getStateActionInfo(const std::vector<float> &state, int act, StateActionInfo* retval){
+
+  if (cacheSize > 0 && outputModels.size() > 0)
+    return cachedStateActionInfo(state, act, retval);
+
+  return predictStateActionInfo(state, act, retval);
+
+}
+
+
+// fill in StateActionInfo struct and return it
+float FactoredModel::predictStateActionInfo(const std::vector<float> &state, int act, StateActionInfo* retval){
   if (MODEL_DEBUG) cout << "getStateActionInfo, " << &state <<  ", " << act << endl;
 
 
@@ -530,30 +748,71 @@ float FactoredModel::getStateActionInfo(const std::vector<float> &state, int act
   }
 
 
-  // get the separate predictions for each outcome variable from the respective trees
-  // combine together for outcome predictions
+  // get the separate predictions for each outcome variable from the
+  // respective trees (with dep, the factors are tested as they are combined)
+  int nmodels = nfactors + 2;
+  std::vector< std::map<float,float> > preds(nmodels);
+  std::vector<float> confs(nmodels, 1.0);
+  for (int i = 0; i < nmodels; i++){
+    if (i < nfactors && dep)
+      continue;
+    testModel(i, inputs, &(preds[i]), &(confs[i]));
+  }
 
   // combine together and put into StateActionInfo struct
+  return combinePredictions(inputs, state.size(), preds, confs, retval);
+
+}
+
+
+void FactoredModel::testModel(int i, const std::vector<float> &inputs,
+                              std::map<float, float>* preds, float* conf){
+
+  Classifier* m = terminalModel;
+  if (i < nfactors)
+    m = outputModels[i];
+  else if (i == nfactors)
+    m = rewardModel;
+
+  preds->clear();
+  if (m == NULL){
+    // not episodic
+    (*preds)[0.0] = 1.0;
+    return;
+  }
+  m->testInstance(inputs, preds);
+  if (needConf) *conf = m->getConf(inputs);
+
+}
+
+
+float FactoredModel::combinePredictions(std::vector<float> &inputs, int nfeats,
+                                        const std::vector< std::map<float,float> > &preds,
+                                        const std::vector<float> &confs,
+                                        StateActionInfo* retval){
+
+  retval->transitionProbs.clear();
   retval->known = true;
   float confSum = 0.0;
 
-  if (nModels == 1 &&
-      (modelType == M5MULTI || modelType == M5SINGLE ||
-       modelType == M5ALLMULTI || modelType == M5ALLSINGLE ||
-       modelType == LSTMULTI || modelType == LSTSINGLE ||
-       modelType == ALLM5TYPES)){
+  if (singleOutcome()){
     //cout << "mdptree, combine deterministic outputs for each feature" << endl;
     ///////////////////////////////////////////
     // alternate version -> assuming one model that gives one prediction
     ///////////////////////////////////////////
     std::vector<float> MLnext(nfactors);
-    std::vector<float> inputCopy = inputs;
+    std::vector<float> inputCopy;
+    if (dep) inputCopy = inputs;
     for (int i = 0; i < nfactors; i++){
       // get single outcome for this factor
-      std::map<float, float> outputPreds;
-      outputModels[i]->testInstance(inputCopy, &outputPreds);
-      if (needConf && dep) confSum += outputModels[i]->getConf(inputCopy);
-      float val = outputPreds.begin()->first;
+      const std::map<float, float>* outputPreds = &(preds[i]);
+      std::map<float, float> depPred;
+      if (dep){
+        outputModels[i]->testInstance(inputCopy, &depPred);
+        if (needConf) confSum += outputModels[i]->getConf(inputCopy);
+        outputPreds = &depPred;
+      }
+      float val = outputPreds->begin()->first;
       if (relTrans) val = val + inputs[i];
       MLnext[i] = val;
       if (dep){
@@ -577,30 +836,38 @@ float FactoredModel::getStateActionInfo(const std::vector<float> &state, int act
     //////////////////////////////////////////////////////////////////////
     // Full version: assume possibly stochastic prediction for each model
     //////////////////////////////////////////////////////////////////////
-    // grab predicted transition probs just once
-    std::vector< std::map<float,float> > predictions(nfactors);
-    if (!dep){
-      for (int i = 0; i < nfactors; i++){
-        outputModels[i]->testInstance(inputs, &(predictions[i]));
-      }
-    }
-
-    ///////////////////////////////////////
     // get probability of each transition
-    float* probs = new float[nfactors];
-    std::vector<float> next(nfactors, 0);
-    addFactorProb(probs, &next, inputs, retval, 0, predictions, &confSum);
-    delete[] probs;
+    combineFactorProbs(inputs, retval, preds, &confSum);
+  }
 
-    /////////////////////////////////////////////////
+  // and confidences if we need them
+  float rConf = 0.0;
+  float tConf = 1.0;
+  std::vector<float> featConfs;
+  if (needConf){
+    rConf = confs[nfactors];
+    if (episodic)
+      tConf = confs[nfactors+1];
+    if (!dep)
+      featConfs.assign(confs.begin(), confs.begin() + nfactors);
   }
 
+  return finishStateActionInfo(nfeats, preds[nfactors], preds[nfactors+1],
+                               confSum, rConf, tConf, featConfs, retval);
+
+}
+
+
+float FactoredModel::finishStateActionInfo(int nfeats,
+                                           const std::map<float, float> &rewardPreds,
+                                           const std::map<float, float> &termProbs,
+                                           float confSum, float rConf, float tConf,
+                                           const std::vector<float> &featConfs,
+                                           StateActionInfo* retval){
+
   // calculate expected reward
   float rewardSum = 0.0;
   // each value
-  std::map<float, float> rewardPreds;
-  rewardModel->testInstance(inputs, &rewardPreds);
-
   if (rewardPreds.size() == 0){
     //cout << "FactoredModel setting state known false" << endl;
     retval->known = false;
@@ -608,7 +875,7 @@ float FactoredModel::getStateActionInfo(const std::vector<float> &state, int act
   }
 
   float totalVisits = 0.0;
-  for (std::map<float, float>::iterator it = rewardPreds.begin(); it != rewardPreds.end(); it++){
+  for (std::map<float, float>::const_iterator it = rewardPreds.begin(); it != rewardPreds.end(); it++){
     // get key from iterator
     float val = (*it).first;
     float prob = (*it).second;
@@ -626,18 +893,12 @@ float FactoredModel::getStateActionInfo(const std::vector<float> &state, int act
 
 
   // get termination prob
-  std::map<float, float> termProbs;
-  if (!episodic){
-    termProbs[0.0] = 1.0;
-  } else {
-    terminalModel->testInstance(inputs, &termProbs);
-  }
   // this needs to be a weighted sum.
   // discrete trees will give some probabilty of termination (outcome 1)
   // where continuous ones will give some value between 0 and 1
   float termSum = 0;
   float probSum = 0;
-  for (std::map<float, float>::iterator it = termProbs.begin(); it != termProbs.end(); it++){
+  for (std::map<float, float>::const_iterator it = termProbs.begin(); it != termProbs.end(); it++){
     // get key from iterator
     float val = (*it).first;
     if (val > 1.0) val = 1.0;
@@ -657,23 +918,18 @@ float FactoredModel::getStateActionInfo(const std::vector<float> &state, int act
   // if we need confidence measure
   if (needConf){
     // conf is avg of each variable's model's confidence
-    float rConf = rewardModel->getConf(inputs);
-    float tConf = 1.0;
-    if (episodic)
-      tConf = terminalModel->getConf(inputs);
-
     //cout << "conf is " << confSum << ", r: " << rConf << ", " << tConf << endl;
 
     confSum += rConf + tConf;
 
     if (!dep){
       for (int i = 0; i < nfactors; i++){
-        float featConf = outputModels[i]->getConf(inputs);
+        float featConf = featConfs[i];
         confSum += featConf;
         //cout << "indep, conf for " << i << ": " << featConf << endl;
       }
     }
-    confSum /= (float)(state.size() + 2.0);
+    confSum /= (float)(nfeats + 2.0);
   } else {
     confSum = 1.0;
   }
@@ -690,27 +946,532 @@ float FactoredModel::getStateActionInfo(const std::vector<float> &state, int act
 
 
 
+bool FactoredModel::singleOutcome(){
+  return (nModels == 1 && regressionModels());
+}
+
+
+bool FactoredModel::regressionModels(){
+  return (modelType == M5MULTI || modelType == M5SINGLE ||
+          modelType == M5ALLMULTI || modelType == M5ALLSINGLE ||
+          modelType == LSTMULTI || modelType == LSTSINGLE ||
+          modelType == ALLM5TYPES);
+}
+
+
+int FactoredModel::getNumMembers(){
+  if (predType != SAMPLED || outputModels.size() == 0)
+    return 1;
+  return rewardModel->getNumMembers();
+}
+
+
+// fill in StateActionInfo struct from one tree of each forest
+float FactoredModel::getMemberStateActionInfo(const std::vector<float> &state, int act, int member, StateActionInfo* retval){
+  if (MODEL_DEBUG) cout << "getMemberStateActionInfo, " << &state <<  ", " << act << ", member " << member << endl;
+
+  // stochastic dependent factors are predicted given each other's outcomes,
+  // which we only do for the whole forest
+  if (getNumMembers() == 1 || (dep && !regressionModels())){
+    return getStateActionInfo(state, act, retval);
+  }
+
+  retval->transitionProbs.clear();
+
+  // input we want predictions for
+  std::vector<float> inputs(state.size() + nact);
+  for (unsigned i = 0; i < state.size(); i++){
+    inputs[i] = state[i];
+  }
+  // convert to binary vector of length nact
+  for (int k = 0; k < nact; k++){
+    if (act == k)
+      inputs[state.size()+k] = 1;
+    else
+      inputs[state.size()+k] = 0;
+  }
+
+  retval->known = true;
+  float confSum = 0.0;
+
+  if (dep){
+    // each tree gives one value, which the next factor depends on
+    std::vector<float> MLnext(nfactors);
+    std::vector<float> inputCopy = inputs;
+    for (int i = 0; i < nfactors; i++){
+      std::map<float, float> outputPreds;
+      outputModels[i]->testMember(member, inputCopy, &outputPreds);
+      float val = outputPreds.begin()->first;
+      if (relTrans) val = val + inputs[i];
+      MLnext[i] = val;
+      inputCopy.push_back(val);
+    }
+    retval->transitionProbs[MLnext] = 1.0;
+  }
+
+  else {
+    std::vector< std::map<float,float> > predictions(nfactors);
+    for (int i = 0; i < nfactors; i++){
+      outputModels[i]->testMember(member, inputs, &(predictions[i]));
+    }
+
+    combineFactorProbs(inputs, retval, predictions, &confSum);
+  }
+
+  std::map<float, float> rewardPreds;
+  rewardModel->testMember(member, inputs, &rewardPreds);
+
+  std::map<float, float> termProbs;
+  if (!episodic){
+    termProbs[0.0] = 1.0;
+  } else {
+    terminalModel->testMember(member, inputs, &termProbs);
+  }
+
+  // one tree has nothing to disagree with, the uncertainty comes from
+  // which tree is sampled
+  std::vector<float> featConfs(nfactors, 1.0);
+  finishStateActionInfo(state.size(), rewardPreds, termProbs,
+                        confSum, 1.0, 1.0, featConfs, retval);
+  if (!retval->known)
+    return 0;
+  return 1.0;
+
+}
+
+
+void FactoredModel::getStateActionInfos(const std::vector<const std::vector<float>*> &states,
+                                        const std::vector<int> &actions,
+                                        const std::vector<StateActionInfo*> &retval,
+                                        std::vector<float>* confs){
+
+  if (cacheSize > 0 && outputModels.size() > 0){
+    confs->resize(states.size());
+    for (unsigned k = 0; k < states.size(); k++){
+      (*confs)[k] = cachedStateActionInfo(*(states[k]), actions[k], retval[k]);
+    }
+    return;
+  }
+
+  predictStateActionInfos(states, actions, retval, confs);
+
+}
+
+
+void FactoredModel::predictStateActionInfos(const std::vector<const std::vector<float>*> &states,
+                                            const std::vector<int> &actions,
+                                            const std::vector<StateActionInfo*> &retval,
+                                            std::vector<float>* confs){
+
+  int n = states.size();
+  bool single = singleOutcome();
+
+  // stochastic predictions with dependent factors must be made one at a time
+  if (n == 0 || outputModels.size() == 0 || (dep && !single)){
+    confs->resize(n);
+    for (int k = 0; k < n; k++){
+      (*confs)[k] = predictStateActionInfo(*(states[k]), actions[k], retval[k]);
+    }
+    return;
+  }
+
+  if (MODEL_DEBUG) cout << "getStateActionInfos for " << n << " state-actions" << endl;
+
+  confs->resize(n);
+
+  // inputs we want predictions for
+  batchInputs.resize(n);
+  for (int k = 0; k < n; k++){
+    const std::vector<float> &state = *(states[k]);
+    std::vector<float> &inputs = batchInputs[k];
+    inputs.resize(state.size() + nact);
+    for (unsigned i = 0; i < state.size(); i++){
+      inputs[i] = state[i];
+    }
+    // convert to binary vector of length nact
+    for (int a = 0; a < nact; a++){
+      if (actions[k] == a)
+        inputs[state.size()+a] = 1;
+      else
+        inputs[state.size()+a] = 0;
+    }
+    retval[k]->transitionProbs.clear();
+    retval[k]->known = true;
+  }
+
+  std::vector<float> confSum(n, 0.0);
+
+  // get the predictions of each factor for all the inputs at once
+  batchFeatConfs.resize(nfactors);
+  if (single){
+    // one deterministic outcome per input, which is appended to
+    // its inputs before predicting the next factor with dep
+    batchNext.resize(n);
+    std::vector<std::vector<float> > inputCopies = batchInputs;
+    for (int k = 0; k < n; k++){
+      batchNext[k].resize(nfactors);
+    }
+    for (int i = 0; i < nfactors; i++){
+      outputModels[i]->testInstances(inputCopies, &batchPreds,
+                                     needConf ? &(batchFeatConfs[i]) : NULL);
+      for (int k = 0; k < n; k++){
+        if (needConf && dep) confSum[k] += batchFeatConfs[i][k];
+        float val = batchPreds[k].begin()->first;
+        if (relTrans) val = val + batchInputs[k][i];
+        batchNext[k][i] = val;
+        if (dep){
+          inputCopies[k].push_back(val);
+        }
+      }
+    }
+    for (int k = 0; k < n; k++){
+      retval[k]->transitionProbs[batchNext[k]] = 1.0;
+    }
+  }
+
+  else {
+    // gather each input's predictions for all factors, then combine them
+    batchFactorPreds.resize(n);
+    for (int k = 0; k < n; k++){
+      batchFactorPreds[k].resize(nfactors);
+    }
+    for (int i = 0; i < nfactors; i++){
+      outputModels[i]->testInstances(batchInputs, &batchPreds,
+                                     needConf ? &(batchFeatConfs[i]) : NULL);
+      for (int k = 0; k < n; k++){
+        batchFactorPreds[k][i].swap(batchPreds[k]);
+      }
+    }
+    for (int k = 0; k < n; k++){
+      combineFactorProbs(batchInputs[k], retval[k], batchFactorPreds[k],
+                         &(confSum[k]));
+    }
+  }
+
+  // get reward and termination predictions
+  rewardModel->testInstances(batchInputs, &batchRewards,
+                             needConf ? &batchRConfs : NULL);
+  if (episodic){
+    terminalModel->testInstances(batchInputs, &batchTerms,
+                                 needConf ? &batchTConfs : NULL);
+  } else {
+    batchTerms.resize(n);
+    for (int k = 0; k < n; k++){
+      batchTerms[k].clear();
+      batchTerms[k][0.0] = 1.0;
+    }
+  }
+
+  std::vector<float> featConfs;
+  if (needConf && !dep) featConfs.resize(nfactors);
+  for (int k = 0; k < n; k++){
+    float rConf = 0.0;
+    float tConf = 1.0;
+    if (needConf){
+      rConf = batchRConfs[k];
+      if (episodic)
+        tConf = batchTConfs[k];
+      if (!dep){
+        for (int i = 0; i < nfactors; i++){
+          featConfs[i] = batchFeatConfs[i][k];
+        }
+      }
+    }
+    (*confs)[k] = finishStateActionInfo(states[k]->size(), batchRewards[k],
+                                        batchTerms[k], confSum[k], rConf,
+                                        tConf, featConfs, retval[k]);
+  }
+
+}
+
+
+
+/** Arguments for training each tree of the model on the thread pool */
+struct factor_train_job {
+  FactoredModel* model;
+  std::vector<std::vector<classPair> >* data;
+  std::vector<Classifier*> models;
+  std::vector<int> toTrain;
+  std::vector<int> changed;
+  bool single;
+};
+
+// train one of the trees picked in trainModels
+void FactoredModel::trainModelTask(void* arg, int k){
+  factor_train_job* job = (factor_train_job*)arg;
+  int i = job->toTrain[k];
+  std::vector<classPair> &instances = (*job->data)[i];
+
+  if (job->single)
+    job->changed[k] = job->models[i]->trainInstance(instances[0]);
+  else
+    job->changed[k] = job->models[i]->trainInstances(instances);
+}
+
+bool FactoredModel::trainModels(std::vector<std::vector<classPair> > &data, bool single){
+
+  factor_train_job job;
+  job.model = this;
+  job.data = &data;
+  job.single = single;
+  job.models = outputModels;
+  job.models.push_back(rewardModel);
+  job.models.push_back(terminalModel);
+  for (int i = 0; i < nfactors + 2; i++){
+    if (job.models[i] != NULL && data[i].size() > 0)
+      job.toTrain.push_back(i);
+  }
+  job.changed.resize(job.toTrain.size(), false);
+
+  // with dep, a tree's inputs include the actual next values of the
+  // factors before it, not their predictions, so the trees still only
+  // touch their own structure and can be trained at once. the inputs are
+  // all in the store already
+  pool->parallelFor(job.toTrain.size(), trainModelTask, &job);
+
+  bool changed = false;
+  for (unsigned k = 0; k < job.toTrain.size(); k++){
+    modelTrained(job.toTrain[k]);
+    changed = changed || job.changed[k];
+  }
+
+  if (MODEL_DEBUG) cout << "Trained " << job.toTrain.size() << " trees, changed: " << changed << endl;
+  return changed;
+}
+
+
+void FactoredModel::modelTrained(int i){
+  // trees report a change only when their splits change, but a rebuild
+  // can still change the counts in a leaf, and an ensemble's accuracy
+  modelVersions[i]++;
+}
+
+
+float FactoredModel::cachedStateActionInfo(const std::vector<float> &state, int act, StateActionInfo* retval){
+
+  cacheKey.assign(state.begin(), state.end());
+  cacheKey.push_back(act);
+
+  pred_cache::iterator it = predCache.find(cacheKey);
+
+  if (it == predCache.end()){
+    cacheMisses++;
+
+    // make room by dropping the least recently used one
+    if ((int)predCache.size() >= cacheSize){
+      predCache.erase(cacheOrder.back());
+      cacheOrder.pop_back();
+    }
+
+    it = predCache.insert(std::make_pair(cacheKey, pred_entry())).first;
+    it->second.versions.assign(modelVersions.size(), -1);
+    cacheOrder.push_front(it);
+    it->second.lru = cacheOrder.begin();
+  }
+
+  else {
+    cacheOrder.splice(cacheOrder.begin(), cacheOrder, it->second.lru);
+    if (it->second.versions == modelVersions)
+      cacheHits++;
+    else
+      cacheRefreshes++;
+  }
+
+  if (MODEL_DEBUG && PRED_CACHE_REPORT_FREQ > 0 &&
+      (cacheHits + cacheRefreshes + cacheMisses) % PRED_CACHE_REPORT_FREQ == 0)
+    printCacheStats();
+
+  pred_entry* entry = &(it->second);
+
+  if (entry->versions != modelVersions){
+    if (dep){
+      // every factor depends on the ones before it
+      entry->conf = predictStateActionInfo(state, act, &(entry->info));
+    } else {
+      entry->conf = refreshEntry(state, act, entry);
+    }
+    entry->versions = modelVersions;
+  }
+
+  int frameUpdated = retval->frameUpdated;
+  *retval = entry->info;
+  retval->frameUpdated = frameUpdated;
+
+  return entry->conf;
+
+}
+
+
+float FactoredModel::refreshEntry(const std::vector<float> &state, int act, pred_entry* entry){
+
+  // input we want predictions for
+  std::vector<float> inputs(state.size() + nact);
+  for (unsigned i = 0; i < state.size(); i++){
+    inputs[i] = state[i];
+  }
+  // convert to binary vector of length nact
+  for (int k = 0; k < nact; k++){
+    if (act == k)
+      inputs[state.size()+k] = 1;
+    else
+      inputs[state.size()+k] = 0;
+  }
+
+  int nmodels = nfactors + 2;
+  entry->preds.resize(nmodels);
+  entry->confs.resize(nmodels, 1.0);
+
+  // test just the trees that changed
+  for (int i = 0; i < nmodels; i++){
+    if (entry->versions[i] != modelVersions[i])
+      testModel(i, inputs, &(entry->preds[i]), &(entry->confs[i]));
+  }
+
+  // then combine them as in predictStateActionInfo
+  return combinePredictions(inputs, state.size(), entry->preds, entry->confs,
+                            &(entry->info));
+
+}
+
+
+void FactoredModel::setCacheSize(int size){
+  cacheSize = size;
+  while ((int)predCache.size() > cacheSize){
+    predCache.erase(cacheOrder.back());
+    cacheOrder.pop_back();
+  }
+}
+
+
+float FactoredModel::getCacheHitRate(){
+  long lookups = cacheHits + cacheRefreshes + cacheMisses;
+  if (lookups == 0)
+    return 0.0;
+  return (float)cacheHits / (float)lookups;
+}
+
+
+long FactoredModel::getCacheMemory(){
+
+  // rough sizes of a std::map node and std::list node beyond their contents
+  const long mapNode = 32;
+  const long listNode = 16;
+
+  long bytes = 0;
+  for (pred_cache::iterator it = predCache.begin(); it != predCache.end(); it++){
+    const pred_entry &entry = it->second;
+    bytes += mapNode + listNode + sizeof(pred_entry) + sizeof(std::vector<float>);
+    bytes += it->first.capacity() * sizeof(float);
+    bytes += entry.versions.capacity() * sizeof(int);
+    bytes += entry.confs.capacity() * sizeof(float);
+    bytes += entry.preds.capacity() * sizeof(std::map<float, float>);
+    for (unsigned i = 0; i < entry.preds.size(); i++){
+      bytes += entry.preds[i].size() * (mapNode + 2*sizeof(float));
+    }
+    bytes += entry.info.transitionProbs.size() *
+      (mapNode + sizeof(std::vector<float>) + sizeof(float) + nfactors*sizeof(float));
+  }
+  return bytes;
+}
+
+
+void FactoredModel::printCacheStats(){
+  cout << "Prediction cache: " << predCache.size() << " of " << cacheSize
+       << " entries, " << getCacheMemory() << " bytes, hits: " << cacheHits
+       << " refreshed: " << cacheRefreshes << " misses: " << cacheMisses
+       << " hit rate: " << getCacheHitRate() << endl;
+}
+
+
+void FactoredModel::setOutcomeLimits(int maxOutcomes, float minProb){
+  this->maxOutcomes = maxOutcomes;
+  minOutcomeProb = minProb;
+
+  // cached predictions were pruned with the old limits
+  predCache.clear();
+  cacheOrder.clear();
+}
+
+
+// combine the factor predictions into probabilities of whole next states
+void FactoredModel::combineFactorProbs(std::vector<float>& x, StateActionInfo* retval, const std::vector< std::map<float,float> > &predictions, float* confSum){
+
+  factorProbs.resize(nfactors);
+  factorNext.resize(nfactors);
+  if (dep) depPreds.resize(nfactors);
+  outcomeValues.clear();
+  outcomeProbs.clear();
+  prunedProb = 0.0;
+
+  // expand the outcomes into the flat buffers
+  addFactorProb(x, 0, predictions, confSum);
+
+  int n = outcomeProbs.size();
+  int keep = n;
+
+  // only keep the most likely outcomes
+  outcomeOrder.resize(n);
+  for (int i = 0; i < n; i++){
+    outcomeOrder[i] = i;
+  }
+  if (maxOutcomes > 0 && n > maxOutcomes){
+    keep = maxOutcomes;
+    std::nth_element(outcomeOrder.begin(), outcomeOrder.begin() + keep,
+                     outcomeOrder.end(), outcomeCompare(outcomeProbs));
+    for (int k = keep; k < n; k++){
+      prunedProb += outcomeProbs[outcomeOrder[k]];
+    }
+    // but still add them in the order they were found
+    std::sort(outcomeOrder.begin(), outcomeOrder.begin() + keep);
+  }
+
+  // give the probability of the pruned outcomes to the ones we kept
+  float scale = 1.0;
+  if (prunedProb > 0.0){
+    float keptProb = 0.0;
+    for (int k = 0; k < keep; k++){
+      keptProb += outcomeProbs[outcomeOrder[k]];
+    }
+    if (keptProb > 0.0)
+      scale = (keptProb + prunedProb) / keptProb;
+    if (MODEL_DEBUG) cout << "Pruned " << (n - keep) << " outcomes and "
+                          << prunedProb << " prob, kept " << keep
+                          << " with prob " << keptProb << endl;
+  }
+
+  for (int k = 0; k < keep; k++){
+    int i = outcomeOrder[k];
+    outcomeKey.assign(outcomeValues.begin() + i*nfactors,
+                      outcomeValues.begin() + (i+1)*nfactors);
+    retval->transitionProbs[outcomeKey] += outcomeProbs[i] * scale;
+  }
+
+}
+
+
 // gets the values/probs for index and adds them to the appropriate spot in the array
-void FactoredModel::addFactorProb(float* probs, std::vector<float>* next, std::vector<float>& x, StateActionInfo* retval, int index, const std::vector< std::map<float,float> > &predictions, float* confSum){
+void FactoredModel::addFactorProb(std::vector<float>& x, int index, const std::vector< std::map<float,float> > &predictions, float* confSum){
 
   // get values, probs etc for this index
-  std::map<float, float> outputPreds = predictions[index];
+  const std::map<float, float>* outputPreds = &(predictions[index]);
 
   // get prediction each time for dep
   if (dep){
-    outputModels[index]->testInstance(x, &outputPreds);
+    depPreds[index].clear();
+    outputModels[index]->testInstance(x, &(depPreds[index]));
+    outputPreds = &(depPreds[index]);
   }
 
   // sum up confidences
   if (dep && needConf){
     float conf = outputModels[index]->getConf(x);
     if (index > 0)
-      (*confSum) += conf * probs[index-1];
+      (*confSum) += conf * factorProbs[index-1];
     else
       (*confSum) += conf;
   }
 
-  for (std::map<float, float>::iterator it1 = outputPreds.begin(); it1 != outputPreds.end(); it1++){
+  for (std::map<float, float>::const_iterator it1 = outputPreds->begin(); it1 != outputPreds->end(); it1++){
     // get key from iterator
     float val = (*it1).first;
 
@@ -722,6 +1483,17 @@ void FactoredModel::addFactorProb(float* probs, std::vector<float>* next, std::v
       continue;
     }
 
+    float prob = (*it1).second;
+    if (index > 0)
+      prob *= factorProbs[index-1];
+
+    // the outcomes below this one can only be less likely
+    if (prob < minOutcomeProb){
+      if (MODEL_DEBUG) cout << "Prob " << prob << " below min, prune" << endl;
+      prunedProb += prob;
+      continue;
+    }
+
     if (dep){
       x.push_back(val);
     }
@@ -729,32 +1501,29 @@ void FactoredModel::addFactorProb(float* probs, std::vector<float>* next, std::v
     if (relTrans)
       val = val + x[index];
 
-    (*next)[index] = val;
-    if (index == 0)
-      probs[index] = (*it1).second;
-    else
-      probs[index] = probs[index-1] * (*it1).second;
+    factorNext[index] = val;
+    factorProbs[index] = prob;
 
-    // if last one, lets set it in our transition prob map
-    if (index == nfactors - 1 && probs[index] > 0.0){
+    // if last one, add it to the list of outcomes
+    if (index == nfactors - 1 && prob > 0.0){
 
       if (MODEL_DEBUG){
         cout << "Final prob of outcome: ";
         for (int i = 0; i < nfactors; i++){
-          cout << (*next)[i] << ", ";
+          cout << factorNext[i] << ", ";
         }
-        cout << " is " << probs[index] << endl;
-        cout << " was " << retval->transitionProbs[*next] << endl;
-        cout << " now " << (retval->transitionProbs[*next]+probs[index]) << endl;
+        cout << " is " << prob << endl;
       }
 
-      retval->transitionProbs[*next] += probs[index];
+      outcomeValues.insert(outcomeValues.end(), factorNext.begin(), factorNext.end());
+      outcomeProbs.push_back(prob);
       if (dep) x.pop_back();
       continue;
     }
 
     // next factors
-    addFactorProb(probs, next, x, retval, index+1, predictions, confSum);
+    if (index < nfactors - 1)
+      addFactorProb(x, index+1, predictions, confSum);
     if (dep) x.pop_back();
 
   }
@@ -13,10 +13,29 @@
 #include "../Models/Stump.hh"
 #include "../Models/MultipleClassifiers.hh"
 #include "../Models/SepPlanExplore.hh"
+#include "../Models/ThreadPool.hh"
 
 #include <rl_common/Random.h>
 #include <rl_common/core.hh>
 #include <vector>
+#include <list>
+#include <algorithm>
+
+/** Most next states kept for a prediction, with the least likely ones pruned (0 for no limit) */
+#define MAX_OUTCOMES 0
+/** Joint probability below which next states are pruned while they are expanded (0 for none) */
+#define MIN_OUTCOME_PROB 0.0
+
+/** Default # of state-action predictions kept in the prediction cache (0 for none).
+    Every training call invalidates the predictions of the trees trained, so
+    the cache only pays off with many lookups between experiences. */
+#define PRED_CACHE_SIZE 0
+
+/** With MODEL_DEBUG, print the prediction cache statistics every this many lookups */
+#define PRED_CACHE_REPORT_FREQ 100000
+
+/** Version of the model files written by saveModel */
+#define MODEL_FILE_VERSION 2
 
 
 /** Builds an mdp model consisting of a tree (or ensemble of trees) to predict each feature, reward, and termination probability. Thus forming a complete model of the MDP. */
@@ -39,15 +58,18 @@ public:
       \param featPct pct of features to remove from set used for each tree split
       \param stoch if the domain is stochastic or deterministic
       \param episodic if the domain is episodic
+      \param compress have the trees keep repeated experiences as one weighted experience
+      \param expCap most experiences each tree keeps, sampled from all it has seen (0 for no limit)
       \param rng Random Number Generator 
   */
   FactoredModel(int id, int numactions, int M, int modelType, 
           int predType, int nModels, float treeThreshold,
           const std::vector<float> &featRange, float rRange,
           bool needConf, bool dep, bool relTrans, float featPct, 
-	  bool stoch, bool episodic, Random rng = Random());
+	  bool stoch, bool episodic, bool compress, int expCap,
+          Random rng = Random());
 
-  /** Copy Constructor for MDP Tree */
+  /** Copy Constructor for MDP Tree. The copy gets its own copy of the prediction cache, with the versions of the trees each entry was made from, and carries on its statistics. */
   FactoredModel(const FactoredModel &);
 
   virtual ~FactoredModel();
@@ -57,14 +79,63 @@ public:
 
   /** Initialize the MDP model with the given # of state features */
   bool initMDPModel(int nfactors);
+  /** Get the prediction for the state-action, from the prediction cache when the trees it was made from have not changed since. */
   virtual float getStateActionInfo(const std::vector<float> &state, int act, StateActionInfo* retval);
+
+  /** Get the predictions for a batch of state-actions. With the cache on, they are looked up one at a time so only changed trees are tested. */
+  virtual void getStateActionInfos(const std::vector<const std::vector<float>*> &states,
+                                   const std::vector<int> &actions,
+                                   const std::vector<StateActionInfo*> &retval,
+                                   std::vector<float>* confs);
+  /** Predict the state-action from the trees, without the cache */
+  float predictStateActionInfo(const std::vector<float> &state, int act, StateActionInfo* retval);
+
+  /** Predict a batch of state-actions from the trees, without the cache, going through each tree once for the batch */
+  void predictStateActionInfos(const std::vector<const std::vector<float>*> &states,
+                               const std::vector<int> &actions,
+                               const std::vector<StateActionInfo*> &retval,
+                               std::vector<float>* confs);
+
+  virtual int getNumMembers();
+  virtual float getMemberStateActionInfo(const std::vector<float> &state, int act, int member, StateActionInfo* retval);
   virtual FactoredModel* getCopy();
 
   /** Method to get a single sample of the predicted next state for the given state-action, rather than the full distribution given by getStateActionInfo */
   float getSingleSAInfo(const std::vector<float> &state, int act, StateActionInfo* retval);
 
-  /** Combines predictions for each separate state feature into probabilities of the overall state vector */
-  void addFactorProb(float* probs, std::vector<float>* next, std::vector<float>& x, StateActionInfo* retval, int index, const std::vector< std::map<float,float> > &predictions, float* confSum);
+  /** Combines predictions for each separate state feature into probabilities of the overall state vector, pruning unlikely ones as set by setOutcomeLimits */
+  void combineFactorProbs(std::vector<float>& x, StateActionInfo* retval, const std::vector< std::map<float,float> > &predictions, float* confSum);
+
+  /** Expand the outcomes of the factors from index on into the flat outcome buffers, given the outcomes chosen for the earlier factors */
+  void addFactorProb(std::vector<float>& x, int index, const std::vector< std::map<float,float> > &predictions, float* confSum);
+
+  /** Keep up to size state-action predictions in the cache, dropping the least recently used ones (0 turns the cache off) */
+  void setCacheSize(int size);
+
+  /** Fraction of cache lookups answered without testing any trees */
+  float getCacheHitRate();
+
+  /** Approximate # of bytes used by the prediction cache */
+  long getCacheMemory();
+
+  /** Print the # of entries, hit rate and memory of the prediction cache */
+  void printCacheStats();
+
+  /** Limit predictions to the maxOutcomes most likely next states (0 for no limit), and prune next states with a joint probability below minProb. The probability of pruned states is spread over the ones kept. */
+  void setOutcomeLimits(int maxOutcomes, float minProb);
+
+  /** Fill in the reward, termination probability and confidence of a prediction from the outputs of the reward and termination models, returning the confidence */
+  float finishStateActionInfo(int nfeats, const std::map<float, float> &rewardPreds,
+                              const std::map<float, float> &termProbs,
+                              float confSum, float rConf, float tConf,
+                              const std::vector<float> &featConfs,
+                              StateActionInfo* retval);
+
+  /** Does each factor model make a single deterministic prediction? */
+  bool singleOutcome();
+
+  /** Are the models regression trees, with each tree making a single prediction? */
+  bool regressionModels();
 
   /** Set some parameters of the subtrees */
   void setTreeParams(float margin, float forestPct, float minRatio);
@@ -74,6 +145,19 @@ public:
 
   /** Helper function to subtract two vectors */
   std::vector<float> subVec(const std::vector<float> &a, const std::vector<float> &b);
+
+  /** Add the inputs of an experience to the shared experience store, returning its row (or -1 when the trees are capped and keep their own inputs) */
+  int appendToStore(const std::vector<float> &inputs, const experience &e);
+
+  /** # of input rows in the experience store shared by the trees */
+  int getStoreSize();
+
+  /** Write the trained trees, with the store of inputs they were trained on, to a model file. Only C4.5 trees (single or in an ensemble) can be saved.
+      \return false if nothing was trained yet or the trees can't be saved */
+  bool saveModel(const char* filename);
+
+  /** Load the trees of a model file into this untrained model, which must have been made with the same settings that shape the trees: # of actions, model type, # of models, types of transitions, M, pct of features removed, and duplicate compression. Training can carry on from there as if the trees had been trained here. */
+  bool loadModel(const char* filename);
   
 private:
   
@@ -86,6 +170,9 @@ private:
   /** Classifier to prediction termination probability */
   Classifier* terminalModel;
 
+  /** Inputs of every experience, stored once and shared by all of the models (and by copies of this model) */
+  ExperienceStore* store;
+
   int id;
   int nfactors;
   const int nact;
@@ -105,6 +192,8 @@ private:
   const float FEAT_PCT;
   const bool stoch;
   const bool episodic;
+  const bool compress;
+  const int expCap;
   Random rng;
   
   float EXP_PCT;
@@ -112,6 +201,90 @@ private:
   bool MODEL_DEBUG;
   bool COPYDEBUG;
 
+  // buffers reused between batches of predictions
+  std::vector<std::vector<float> > batchInputs;
+  std::vector<std::map<float, float> > batchPreds;
+  std::vector<std::vector<std::map<float, float> > > batchFactorPreds;
+  std::vector<std::vector<float> > batchFeatConfs;
+  std::vector<std::vector<float> > batchNext;
+  std::vector<std::map<float, float> > batchRewards;
+  std::vector<std::map<float, float> > batchTerms;
+  std::vector<float> batchRConfs;
+  std::vector<float> batchTConfs;
+
+  int maxOutcomes;
+  float minOutcomeProb;
+
+  /** A cached prediction for a state-action, made from the given version of each tree (the factor trees, then reward and termination). Without dep, each tree's own prediction is kept too, so only the trees that changed need to be tested again. */
+  struct pred_entry {
+    StateActionInfo info;
+    float conf;
+    std::vector<int> versions;
+    std::vector<std::map<float, float> > preds;
+    std::vector<float> confs;
+    std::list<std::map<std::vector<float>, pred_entry>::iterator>::iterator lru;
+  };
+
+  typedef std::map<std::vector<float>, pred_entry> pred_cache;
+
+  /** Get the prediction for the state-action from the cache, bringing it up to date first if needed */
+  float cachedStateActionInfo(const std::vector<float> &state, int act, StateActionInfo* retval);
+
+  /** Re-test the trees that changed since the entry was made, and combine their predictions again */
+  float refreshEntry(const std::vector<float> &state, int act, pred_entry* entry);
+
+  /** Test tree i (the factors, then reward and termination) on the inputs, with its confidence if we need it */
+  void testModel(int i, const std::vector<float> &inputs,
+                 std::map<float, float>* preds, float* conf);
+
+  /** Combine the predictions and confidences of each tree (the factors, then reward and termination) into a prediction of the next state. With dep, the factor trees are tested here instead, as each depends on the factors before it. */
+  float combinePredictions(std::vector<float> &inputs, int nfeats,
+                           const std::vector< std::map<float,float> > &preds,
+                           const std::vector<float> &confs,
+                           StateActionInfo* retval);
+
+  /** Count a training call on tree i (the factors, then reward and termination), which invalidates its cached predictions */
+  void modelTrained(int i);
+
+  /** Train each tree (the factors, then reward and termination) on its instances, with the trees trained in parallel. If single is set, each one gets at most one instance. Returns true if any of them changed. */
+  bool trainModels(std::vector<std::vector<classPair> > &data, bool single);
+
+  /** Thread pool task that trains one of the trees */
+  static void trainModelTask(void* arg, int k);
+
+  /** Pool of threads the trees are trained on, shared with the ensembles. */
+  ThreadPool* pool;
+
+  /** Version of each tree, bumped each time it is trained */
+  std::vector<int> modelVersions;
+
+  pred_cache predCache;
+  /** Entries of the cache, most recently used first */
+  std::list<pred_cache::iterator> cacheOrder;
+  int cacheSize;
+  long cacheHits;
+  long cacheRefreshes;
+  long cacheMisses;
+  std::vector<float> cacheKey;
+
+  /** Orders outcomes from most to least likely */
+  struct outcomeCompare {
+    const std::vector<float> &probs;
+    outcomeCompare(const std::vector<float> &p): probs(p) {}
+    bool operator()(int a, int b) const { return probs[a] > probs[b]; }
+  };
+
+  // buffers for expanding the outcomes of each factor into next states
+  std::vector<float> factorProbs;
+  std::vector<float> factorNext;
+  std::vector<std::map<float, float> > depPreds;
+  /** nfactors values for each next state found */
+  std::vector<float> outcomeValues;
+  std::vector<float> outcomeProbs;
+  std::vector<int> outcomeOrder;
+  std::vector<float> outcomeKey;
+  float prunedProb;
+
 };
 
 
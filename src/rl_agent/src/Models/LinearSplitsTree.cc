@@ -1,4 +1,5 @@
 #include "LinearSplitsTree.hh"
+#include "M5Tree.hh"
 
 // LinearSplitsTree, from the following sources:
 
@@ -17,19 +18,30 @@ using namespace NEWMAT;              // access NEWMAT namespace
 
 LinearSplitsTree::LinearSplitsTree(int id, int trainMode, int trainFreq, int m,
                                    float featPct, bool simple, float min_er,
-                                   Random rng):
+                                   Random rng, ExperienceStore* store):
   id(id), mode(trainMode), 
   freq(trainFreq), M(m),
   featPct(featPct), SIMPLE(simple), 
-  MIN_ER(min_er), rng(rng)
+  MIN_ER(min_er), rng(rng), store(store)
 {
 
   nnodes = 0;
+  lastLeaf = -1;
   nOutput = 0;
   nExperiences = 0;
   hadError = false;
-  maxnodes = N_LS_NODES;
+  maxnodes = 0;
+
+  experiences = new exp_list;
+  experiences->refs = 1;
   totalnodes = 0;
+  nfeat = 0;
+
+  // share the given experience store, or keep our own
+  if (store == NULL)
+    this->store = new ExperienceStore();
+  else
+    store->retain();
 
   // how close a split has to be to be randomly selected
   SPLIT_MARGIN = 0.0; //0.02; //5; //01; //0.05; //0.2; //0.05;
@@ -51,7 +63,6 @@ LinearSplitsTree::LinearSplitsTree(int id, int trainMode, int trainFreq, int m,
   cout << " MIN_ER: " << MIN_ER << endl;
 
 
-  initNodes();
   initTree();
 
 }
@@ -60,15 +71,15 @@ LinearSplitsTree::LinearSplitsTree(const LinearSplitsTree& ls):
   id(ls.id), mode(ls.mode), 
   freq(ls.freq), M(ls.M),
   featPct(ls.featPct), SIMPLE(ls.SIMPLE), 
-  MIN_ER(ls.MIN_ER), rng(ls.rng)
+  MIN_ER(ls.MIN_ER), rng(ls.rng), store(ls.store)
 {
   COPYDEBUG = ls.COPYDEBUG;
   if (COPYDEBUG) cout << "LS copy " << id << endl;
-  nnodes = 0;
+  nnodes = ls.nnodes;
   nOutput = ls.nOutput;
   nExperiences = ls.nExperiences;
   hadError = ls.hadError;
-  totalnodes = 0;
+  totalnodes = ls.totalnodes;
   maxnodes = ls.maxnodes;
   SPLIT_MARGIN = ls.SPLIT_MARGIN; 
   LMDEBUG = ls.LMDEBUG;
@@ -77,30 +88,21 @@ LinearSplitsTree::LinearSplitsTree(const LinearSplitsTree& ls):
   STOCH_DEBUG = ls.STOCH_DEBUG; 
   INCDEBUG = ls.INCDEBUG; 
   NODEDEBUG = ls.NODEDEBUG;
+  nfeat = ls.nfeat;
 
-  if (COPYDEBUG) cout << "   LS copy nodes, experiences, root, etc" << endl;
-  // copy all experiences
-  for (int i = 0; i < N_LST_EXP; i++){
-    allExp[i] = ls.allExp[i];
-  }
-  if (COPYDEBUG) cout << "   LS copied exp array" << endl;
-
-  // set experience pointers
-  experiences.resize(ls.experiences.size());
-  for (unsigned i = 0; i < ls.experiences.size(); i++){
-    experiences[i] = &(allExp[i]);
-  }
-  if (COPYDEBUG) cout << "   LS set experience pointers" << endl;
+  // inputs are append-only, so the copy can share them
+  store->retain();
 
-  // now the tricky part, set the pointers inside the tree nodes correctly
-  initNodes();
+  // share experiences and nodes, each tree copies what it changes
+  if (COPYDEBUG) cout << "   LS share experiences, root, etc" << endl;
+  experiences = ls.experiences;
+  experiences->refs++;
+  root = ls.root;
+  root->refs++;
+  compiled = ls.compiled;
+  compiled->refs++;
+  lastLeaf = -1;
 
-  if (COPYDEBUG) cout << "   LS copy tree " << endl;
-  root = allocateNode();
-  lastNode = root;
-  copyTree(root, ls.root);
-  if (COPYDEBUG) cout << "   LS  tree copy done" << endl;
-   
   if (COPYDEBUG) {
     cout << endl << "New tree: " << endl;
     printTree(root, 0);
@@ -110,48 +112,16 @@ LinearSplitsTree::LinearSplitsTree(const LinearSplitsTree& ls):
 
 }
 
-void LinearSplitsTree::copyTree(tree_node* newNode, tree_node* origNode){
-
-  int nodeId = newNode->id;
-
-  if (COPYDEBUG) {
-    cout << "    Copy node " << newNode->id << " from node " << origNode->id << endl;
-    cout << "    NewAddy " << newNode << ", old: " << origNode << endl;
-  }
-
-  // copy node from t
-  *newNode = *origNode;
-  newNode->id = nodeId;
-
-  // if it has children, allocate and copy them too
-  if (origNode->l != NULL && !newNode->leaf){
-    newNode->l = allocateNode();
-    if (COPYDEBUG) cout << "     Copy left node " << newNode->l->id << " from " << origNode->l->id << endl;
-    copyTree(newNode->l, origNode->l);
-  } else {
-    newNode->l = NULL;
-  }
-
-  if (origNode->r != NULL && !newNode->leaf){
-    newNode->r = allocateNode();
-    if (COPYDEBUG) cout << "     Copy right node " << newNode->r->id << " from " << origNode->r->id << endl;
-    copyTree(newNode->r, origNode->r);
-  } else {
-    newNode->r = NULL;
-  }
-}
-
 LinearSplitsTree* LinearSplitsTree::getCopy(){
   LinearSplitsTree* copy = new LinearSplitsTree(*this);
   return copy;
 }
 
 LinearSplitsTree::~LinearSplitsTree() {
-  deleteTree(root);
-  for (unsigned i = N_LST_EXP; i < experiences.size(); i++){
-    delete experiences[i];
-  }
-  experiences.clear();
+  releaseNode(root);
+  releaseCompiled(compiled);
+  releaseExperiences(experiences);
+  store->release();
 }
 
 // here the target output will be a single value
@@ -163,30 +133,22 @@ bool LinearSplitsTree::trainInstance(classPair &instance){
 
   // simply add this instance to the set of experiences
 
-  // take from static array until we run out
-  tree_experience *e;
-  if (nExperiences < N_LST_EXP){
-    // from statically created set of experiences
-    e = &(allExp[nExperiences]);
+  // inputs go in the experience store, unless already placed there for us
+  int row = instance.row;
+  if (row < 0)
+    row = store->append(instance.in);
+  if ((int)instance.in.size() > nfeat)
+    nfeat = instance.in.size();
 
-  } else {
-    // dynamically create experience
-    e = new tree_experience;
-  }
-
-
-  e->input = instance.in;
-  e->output = instance.out;
-  experiences.push_back(e);
-  nExperiences++;
+  tree_experience *e = addExperience(row, instance.out);
 
   if (nExperiences == 1000000){
     cout << "Reached limit of # experiences allowed." << endl;
     return false;
   }
 
-  if (nExperiences != (int)experiences.size())
-    cout << "ERROR: experience size mismatch: " << nExperiences << ", " << experiences.size() << endl;
+  if (nExperiences != (int)experiences->ptrs.size())
+    cout << "ERROR: experience size mismatch: " << nExperiences << ", " << experiences->ptrs.size() << endl;
 
   //cout << nExperiences << endl << flush;
   //if (nExperiences == 503 && id == 10){
@@ -203,8 +165,8 @@ bool LinearSplitsTree::trainInstance(classPair &instance){
     cout << endl << " Original output: " << instance.out << endl;
     cout << "Added exp id: " << nExperiences << " output: " << e->output << endl;
     cout << "Address: " << e << " Input : ";
-    for (unsigned i = 0; i < e->input.size(); i++){
-      cout << e->input[i] << ", ";
+    for (int i = 0; i < nfeat; i++){
+      cout << store->get(e->row, i) << ", ";
     }
     cout << endl << " Now have " << nExperiences << " experiences." << endl;
   }
@@ -221,7 +183,7 @@ bool LinearSplitsTree::trainInstance(classPair &instance){
     // build on misclassification
     // check for misclassify
     std::map<float, float> answer;
-    testInstance(e->input, &answer);
+    testInstance(instance.in, &answer);
     float val = answer.begin()->first;
     float error = fabs(val - e->output);
 
@@ -290,30 +252,22 @@ bool LinearSplitsTree::trainInstances(std::vector<classPair> &instances){
 
     // simply add this instance to the set of experiences
 
-    // take from static array until we run out
-    tree_experience *e;
-    if (nExperiences < N_LST_EXP){
-      // from statically created set of experiences
-      e = &(allExp[nExperiences]);
+    // inputs go in the experience store, unless already placed there for us
+    int row = instance.row;
+    if (row < 0)
+      row = store->append(instance.in);
+    if ((int)instance.in.size() > nfeat)
+      nfeat = instance.in.size();
 
-    } else {
-      // dynamically create experience
-      e = new tree_experience;
-    }
-
-
-    e->input = instance.in;
-    e->output = instance.out;
-    experiences.push_back(e);
-    nExperiences++;
+    tree_experience *e = addExperience(row, instance.out);
 
     if (nExperiences == 1000000){
       cout << "Reached limit of # experiences allowed." << endl;
       return false;
     }
 
-    if (nExperiences != (int)experiences.size())
-      cout << "ERROR: experience size mismatch: " << nExperiences << ", " << experiences.size() << endl;
+    if (nExperiences != (int)experiences->ptrs.size())
+      cout << "ERROR: experience size mismatch: " << nExperiences << ", " << experiences->ptrs.size() << endl;
 
     if (DTDEBUG) {
       cout << "Original input: ";
@@ -323,8 +277,8 @@ bool LinearSplitsTree::trainInstances(std::vector<classPair> &instances){
       cout << endl << " Original output: " << instance.out << endl;
       cout << "Added exp id: " << nExperiences << " output: " << e->output << endl;
       cout << "Address: " << e << " Input : ";
-      for (unsigned i = 0; i < e->input.size(); i++){
-        cout << e->input[i] << ", ";
+      for (int i = 0; i < nfeat; i++){
+        cout << store->get(e->row, i) << ", ";
       }
       cout << endl << " Now have " << nExperiences << " experiences." << endl;
     }
@@ -366,7 +320,7 @@ bool LinearSplitsTree::trainInstances(std::vector<classPair> &instances){
       // build on misclassification
       // check for misclassify
       std::map<float, float> answer;
-      testInstance(e->input, &answer);
+      testInstance(instance.in, &answer);
       float val = answer.begin()->first;
       float error = fabs(val - e->output);
 
@@ -410,12 +364,15 @@ bool LinearSplitsTree::trainInstances(std::vector<classPair> &instances){
 
 void LinearSplitsTree::rebuildTree(){
   //cout << "rebuild tree " << id << " on exp: " << nExperiences << endl;
-  //deleteTree(root);
+  root = unshareNode(root);
 
   // re-calculate avg error for root
-  root->avgError = calcAvgErrorforSet(experiences);
+  root->avgError = calcAvgErrorforSet(experiences->ptrs);
+
+  buildTree(root, experiences->ptrs, false);
 
-  buildTree(root, experiences, false);
+  // predictions now use the new tree
+  compileTree();
   //cout << "tree " << id << " rebuilt. " << endl;
 }
 
@@ -427,17 +384,17 @@ void LinearSplitsTree::testInstance(const std::vector<float> &input, std::map<fl
   retval->clear();
 
   // in case the tree is empty
-  if (experiences.size() == 0){
+  if (nExperiences == 0){
     (*retval)[0.0] = 1.0;
     return;
   }
 
   // follow through tree to leaf
-  tree_node* leaf = traverseTree(root, input);
-  lastNode = leaf;
+  int leaf = traverseCompiled(input);
+  lastLeaf = leaf;
 
-  // and return mapping of outputs and their probabilities
-  leafPrediction(leaf, input, retval);
+  // and return the leaf's regression prediction
+  compiledPrediction(leaf, input, retval);
 
 }
 
@@ -445,23 +402,51 @@ float LinearSplitsTree::getConf(const std::vector<float> &input){
   if (DTDEBUG) cout << "numVisits" << endl;
 
   // in case the tree is empty
-  if (experiences.size() == 0){
+  if (nExperiences == 0){
     return 0;
   }
 
-  if (lastNode == NULL)
+  if (lastLeaf < 0)
     return 0;
 
   // follow through tree to leaf
   //tree_node* leaf = traverseTree(root, input);
 
   // and return # in this leaf
-  float conf = (float)lastNode->nInstances / (float)(2.0*M);
-  if (conf > 1.0)
-    return 1.0;
-  else
-    return conf;
+  return compiledConf(lastLeaf);
+
+}
+
+
+void LinearSplitsTree::testInstances(const std::vector<std::vector<float> > &inputs,
+                                     std::vector<std::map<float, float> >* retval,
+                                     std::vector<float>* confs){
+  if (DTDEBUG) cout << "testInstances: " << inputs.size() << endl;
+
+  retval->resize(inputs.size());
+  if (confs != NULL) confs->resize(inputs.size());
+
+  // in case the tree is empty
+  if (nExperiences == 0){
+    for (unsigned j = 0; j < inputs.size(); j++){
+      (*retval)[j].clear();
+      (*retval)[j][0.0] = 1.0;
+      if (confs != NULL) (*confs)[j] = 0;
+    }
+    return;
+  }
+
+  // follow all the inputs through the compiled tree together
+  traverseCompiled(inputs, &batchLeaves);
+
+  for (unsigned j = 0; j < inputs.size(); j++){
+    (*retval)[j].clear();
+    compiledPrediction(batchLeaves[j], inputs[j], &((*retval)[j]));
+    if (confs != NULL) (*confs)[j] = compiledConf(batchLeaves[j]);
+  }
 
+  if (inputs.size() > 0)
+    lastLeaf = batchLeaves.back();
 }
 
 // check to see if this state is one we should explore
@@ -473,6 +458,8 @@ float LinearSplitsTree::getConf(const std::vector<float> &input){
 void LinearSplitsTree::initTree(){
   if (DTDEBUG) cout << "initTree()" << endl;
   root = allocateNode();
+  compiled = NULL;
+  compileTree();
 
   if (DTDEBUG) cout << "   root id = " << root->id << endl;
 
@@ -517,44 +504,50 @@ void LinearSplitsTree::initTreeNode(tree_node* node){
 
   node->leaf = true;
   node->avgError = 10000;
+  node->refs = 1;
 
 }
 
 /** delete current tree */
-void LinearSplitsTree::deleteTree(tree_node* node){
+void LinearSplitsTree::releaseNode(tree_node* node){
   if (node==NULL)
     return;
 
-  if (DTDEBUG) cout << "deleteTree, node=" << node->id << endl;
+  node->refs--;
+  if (node->refs > 0)
+    return;
+
+  if (DTDEBUG) cout << "releaseNode, node=" << node->id << endl;
 
   totalnodes--;
 
-  node->nInstances = 0;
-  node->coefficients.clear();
- 
-  //recursively call deleteTree on children
-  // then delete them
-  if (!node->leaf){
-    // left child
-    if (node->l != NULL){
-      deleteTree(node->l);
-      deallocateNode(node->l);
-      node->l = NULL;
-    }
+  // children lose this reference
+  releaseNode(node->l);
+  releaseNode(node->r);
 
-    // right child
-    if (node->r != NULL){
-      deleteTree(node->r);
-      deallocateNode(node->r);
-      node->r = NULL;
-    }
+  delete node;
+}
+
+
+LinearSplitsTree::tree_node* LinearSplitsTree::unshareNode(tree_node* node){
+  if (node->refs == 1)
+    return node;
+
+  // copy the node, the copy shares the same children
+  tree_node* copy = new tree_node(*node);
+  copy->id = nnodes++;
+  copy->refs = 1;
+  if (copy->l != NULL) copy->l->refs++;
+  if (copy->r != NULL) copy->r->refs++;
+  if (COPYDEBUG) cout << id << " copy shared node " << node->id << " to " << copy->id << endl;
+
+  totalnodes++;
+  if (totalnodes > maxnodes){
+    maxnodes = totalnodes;
   }
 
-  node->dim = -1;
-  node->leaf = true;
-  node->avgError = 10000;
-  node->val = -1;
-  node->constant = 0;
+  node->refs--;
+  return copy;
 }
 
 
@@ -599,6 +592,20 @@ bool LinearSplitsTree::passTest(int dim, float val, const std::vector<float> &in
 }
 
 
+/** Decide if the stored input of an experience passes the test */
+bool LinearSplitsTree::passTest(int dim, float val, const tree_experience* e){
+  float input = store->get(e->row, dim);
+  if (DTDEBUG) cout << "passTest, dim=" << dim << ",val=" << val 
+                    << ",input["<<dim<<"]=" << input <<endl;
+
+  if (input > val)
+    return false;
+  else
+    return true;
+
+}
+
+
 /** Build the tree from this node down using this set of experiences. */
 void LinearSplitsTree::buildTree(tree_node *node,
                        const std::vector<tree_experience*> &instances,
@@ -671,6 +678,10 @@ void LinearSplitsTree::buildTree(tree_node *node,
 
   implementSplit(node, instances, bestER, bestDim, bestVal, bestLeft, bestRight, changed, leftError, rightError);
 
+  // only leaves need a linear model
+  if (!node->leaf)
+    node->coefficients.clear();
+
 }
 
 
@@ -678,14 +689,12 @@ void LinearSplitsTree::makeLeaf(tree_node* node, const std::vector<tree_experien
 
   // check on children
   if (node->l != NULL){
-    deleteTree(node->l);
-    deallocateNode(node->l);
+    releaseNode(node->l);
     node->l = NULL;
   }
 
   if (node->r != NULL){
-    deleteTree(node->r);
-    deallocateNode(node->r);
+    releaseNode(node->r);
     node->r = NULL;
   }
 
@@ -712,8 +721,8 @@ float LinearSplitsTree::fitMultiLinearModel(const std::vector<tree_experience*>
                               << ",nInstances:" << instances.size() << endl;
 
   // make sure there are enough coefficients for all the features
-  if (bestCoefficients->size() != instances[0]->input.size()){
-    bestCoefficients->resize(instances[0]->input.size(), 0);  
+  if (bestCoefficients->size() != (unsigned)nfeat){
+    bestCoefficients->resize(nfeat, 0);  
   }
 
   // in case of size 1
@@ -738,6 +747,9 @@ float LinearSplitsTree::fitMultiLinearModel(const std::vector<tree_experience*>
 
   std::vector<bool> featureMask(bestCoefficients->size(), true);
 
+  // newmat keeps global state, so only one tree can use it at a time
+  pthread_mutex_lock(&newmat_mutex);
+
   while (doRegression){
     //cout << id << " Attempt linear model " << ntimes << endl;
     ntimes++;
@@ -775,7 +787,7 @@ float LinearSplitsTree::fitMultiLinearModel(const std::vector<tree_experience*>
         if (!featureMask[j])
           continue;
 
-        if (constants[j] && e->input[j] != instances[0]->input[j]){
+        if (constants[j] && store->get(e->row, j) != store->get(instances[0]->row, j)){
           constants[j] = false;
         }
 
@@ -792,7 +804,7 @@ float LinearSplitsTree::fitMultiLinearModel(const std::vector<tree_experience*>
 
         featIndices[featIndex-1] = j;
         // HACK: I'm adding random noise here to prevent colinear features
-        X(i+1,featIndex) = e->input[j]; // + rng.uniform(-0.00001, 0.00001);
+        X(i+1,featIndex) = store->get(e->row, j); // + rng.uniform(-0.00001, 0.00001);
         if (LMDEBUG){
           cout << " Feat " << featIndex << " index " << j
                << " val " << X(i+1,featIndex) << ",";
@@ -931,6 +943,8 @@ float LinearSplitsTree::fitMultiLinearModel(const std::vector<tree_experience*>
 
   }
 
+  pthread_mutex_unlock(&newmat_mutex);
+
   // return error
   return avgError;
 
@@ -943,8 +957,8 @@ float LinearSplitsTree::fitSimpleLinearModel(const std::vector<tree_experience*>
                               << ",nInstances:" << instances.size() << endl;
   
   // make sure there are enough coefficients for all the features
-  if (bestCoefficients->size() != instances[0]->input.size()){
-    bestCoefficients->resize(instances[0]->input.size(), 0);  
+  if (bestCoefficients->size() != (unsigned)nfeat){
+    bestCoefficients->resize(nfeat, 0);  
   }
 
   // loop through all features, try simple single variable regression
@@ -969,9 +983,9 @@ float LinearSplitsTree::fitSimpleLinearModel(const std::vector<tree_experience*>
     return 0;
   }
 
-  std::vector<float> xsum(instances[0]->input.size(), 0);
-  std::vector<float> xysum(instances[0]->input.size(), 0);
-  std::vector<float> x2sum(instances[0]->input.size(), 0);
+  std::vector<float> xsum(nfeat, 0);
+  std::vector<float> xysum(nfeat, 0);
+  std::vector<float> x2sum(nfeat, 0);
   float ysum = 0;
 
   int nObs = (int)instances.size();
@@ -980,18 +994,19 @@ float LinearSplitsTree::fitSimpleLinearModel(const std::vector<tree_experience*>
     if (LMDEBUG) cout << "Obs: " << i;
     
     // go through all features
-    for (unsigned j = 0; j < instances[0]->input.size(); j++){
-      if (LMDEBUG) cout << ", F" << j << ": " << e->input[j];
-      xsum[j] += e->input[j];
-      xysum[j] += (e->input[j] * e->output);
-      x2sum[j] += (e->input[j] * e->input[j]);
+    for (int j = 0; j < nfeat; j++){
+      float x = store->get(e->row, j);
+      if (LMDEBUG) cout << ", F" << j << ": " << x;
+      xsum[j] += x;
+      xysum[j] += (x * e->output);
+      x2sum[j] += (x * x);
     }
     ysum += e->output;
     if (LMDEBUG) cout << ", out: " << e->output << endl;
   }
 
   // now go through all features and calc coeff and constant
-  for (unsigned j = 0; j < instances[0]->input.size(); j++){
+  for (int j = 0; j < nfeat; j++){
     float coeff = (xysum[j] - xsum[j]*ysum/nObs)/(x2sum[j]-(xsum[j]*xsum[j])/nObs);
     float constant = (ysum/nObs) - coeff*(xsum[j]/nObs);
 
@@ -1012,7 +1027,7 @@ float LinearSplitsTree::fitSimpleLinearModel(const std::vector<tree_experience*>
     float errorSum = 0;
     for (int i = 0; i < nObs; i++){
       tree_experience *e = instances[i];
-      float pred = constant + coeff * e->input[j];
+      float pred = constant + coeff * store->get(e->row, j);
       float error = fabs(pred - e->output);
       if (LMDEBUG) cout << "Instance " << i << " error: " << error << endl;
       errorSum += error;
@@ -1035,7 +1050,7 @@ float LinearSplitsTree::fitSimpleLinearModel(const std::vector<tree_experience*>
          << *bestConstant << " avgE: " << bestError << endl;
   }
 
-  if (bestFeat < 0 || bestFeat > (int)instances[0]->input.size()){
+  if (bestFeat < 0 || bestFeat > nfeat){
     for (unsigned i = 0; i < bestCoefficients->size(); i++){
       (*bestCoefficients)[i] = 0.0;
     }
@@ -1093,6 +1108,8 @@ void LinearSplitsTree::implementSplit(tree_node* node,
       && !node->leaf && node->l != NULL && node->r != NULL){
     // same split as before.
     if (DTDEBUG || SPLITDEBUG) cout << "Same split as before " << node->id << endl;
+    node->l = unshareNode(node->l);
+    node->r = unshareNode(node->r);
     node->l->avgError = leftError;
     node->r->avgError = rightError;
 
@@ -1146,6 +1163,8 @@ void LinearSplitsTree::implementSplit(tree_node* node,
     if (DTDEBUG) cout << "Init new right tree nodes " << endl;
     node->r = allocateNode();
   }
+  node->l = unshareNode(node->l);
+  node->r = unshareNode(node->r);
 
   // recursively build the sub-trees to this one
   if (DTDEBUG) cout << "Building left tree for node " << node->id << endl;
@@ -1169,7 +1188,7 @@ void LinearSplitsTree::testPossibleSplits(float avgError, const std::vector<tree
   int nties = 0;
 
   // for each possible split, calc standard deviation reduction
-  for (unsigned idim = 0; idim < instances[0]->input.size(); idim++){
+  for (int idim = 0; idim < nfeat; idim++){
 
     //float* sorted = sortOnDim(idim, instances);
     float minVal, maxVal;
@@ -1289,7 +1308,7 @@ float LinearSplitsTree::calcER(int dim, float val,
   for (unsigned i = 0; i < instances.size(); i++){
     if (DTDEBUG) cout << " calcER - Classify instance " << i << " on new split " << endl;
 
-    if (passTest(dim, val, instances[i]->input)){
+    if (passTest(dim, val, instances[i])){
       left.push_back(instances[i]);
     }
     else{
@@ -1351,14 +1370,16 @@ std::set<float> LinearSplitsTree::getUniques(int dim, const std::vector<tree_exp
   if (DTDEBUG) cout << "getUniques,dim = " << dim;
 
   std::set<float> uniques;
+  const std::vector<float> &featVals = store->column(dim);
 
   for (int i = 0; i < (int)instances.size(); i++){
-    if (i == 0 || instances[i]->input[dim] < minVal)
-      minVal = instances[i]->input[dim];
-    if (i == 0 || instances[i]->input[dim] > maxVal)
-      maxVal = instances[i]->input[dim];
+    float val = featVals[instances[i]->row];
+    if (i == 0 || val < minVal)
+      minVal = val;
+    if (i == 0 || val > maxVal)
+      maxVal = val;
 
-    uniques.insert(instances[i]->input[dim]);
+    uniques.insert(val);
   }
 
   
@@ -1384,11 +1405,12 @@ float* LinearSplitsTree::sortOnDim(int dim, const std::vector<tree_experience*>
   if (DTDEBUG) cout << "sortOnDim,dim = " << dim << endl;
 
   float* values = new float[instances.size()];
+  const std::vector<float> &featVals = store->column(dim);
 
   for (int i = 0; i < (int)instances.size(); i++){
     //cout << "Instance " << i << endl;
 
-    float val = instances[i]->input[dim];
+    float val = featVals[instances[i]->row];
     //cout << " val: " << val << endl;
 
     // find where this should go
@@ -1497,48 +1519,157 @@ void LinearSplitsTree::leafPrediction(tree_node* leaf, const std::vector<float>
 }
 
 
-void LinearSplitsTree::initNodes(){
+LinearSplitsTree::tree_node* LinearSplitsTree::allocateNode(){
+  tree_node* newNode = new tree_node;
+  initTreeNode(newNode);
+  if (NODEDEBUG) 
+    cout << id << " allocate node " << newNode->id << endl;
+  return newNode;
+}
+
 
-  for (int i = 0; i < N_LS_NODES; i++){
-    initTreeNode(&(allNodes[i]));
-    freeNodes.push_back(i);
-    if (NODEDEBUG) 
-      cout << "init node " << i << " with id " << allNodes[i].id 
-           << ", now " << freeNodes.size() << " free nodes." << endl;
+LinearSplitsTree::tree_experience* LinearSplitsTree::addExperience(int row, float output){
+
+  // someone else has added to our list, so copy the part that is ours
+  if ((int)experiences->ptrs.size() != nExperiences){
+    if (COPYDEBUG) cout << id << " copy experience list of size " << nExperiences << endl;
+    exp_list* list = new exp_list;
+    list->refs = 1;
+    list->exps.insert(list->exps.end(), experiences->exps.begin(),
+                      experiences->exps.begin() + nExperiences);
+    list->ptrs.resize(nExperiences);
+    for (int i = 0; i < nExperiences; i++){
+      list->ptrs[i] = &(list->exps[i]);
+    }
+    releaseExperiences(experiences);
+    experiences = list;
   }
 
+  experiences->exps.push_back(tree_experience());
+  tree_experience *e = &(experiences->exps.back());
+  e->row = row;
+  e->output = output;
+  experiences->ptrs.push_back(e);
+  nExperiences++;
+
+  return e;
 }
 
-LinearSplitsTree::tree_node* LinearSplitsTree::allocateNode(){
-  if (freeNodes.empty()){
-    tree_node* newNode = new tree_node;
-    initTreeNode(newNode);
-    if (NODEDEBUG) 
-      cout << id << " PROBLEM: No more pre-allocated nodes!!!" << endl
-           << "return new node " << newNode->id 
-           << ", now " << freeNodes.size() << " free nodes." << endl;
-    return newNode;
+void LinearSplitsTree::releaseExperiences(exp_list* list){
+  list->refs--;
+  if (list->refs == 0)
+    delete list;
+}
+
+
+void LinearSplitsTree::compileTree(){
+  flat_tree* flat = new flat_tree;
+  flat->refs = 1;
+
+  // breadth-first, so node i of the queue becomes compiled node i
+  std::vector<tree_node*> queue;
+  queue.push_back(root);
+  for (unsigned i = 0; i < queue.size(); i++){
+    tree_node* node = queue[i];
+    flat_node f;
+    f.val = node->val;
+    if (node->leaf){
+      f.dim = -1;
+      f.next = flat->leaves.size();
+      flat_leaf fl;
+      fl.constant = node->constant;
+      fl.start = flat->coefficients.size();
+      fl.nCoeffs = node->coefficients.size();
+      fl.nInstances = node->nInstances;
+      flat->coefficients.insert(flat->coefficients.end(),
+                                node->coefficients.begin(),
+                                node->coefficients.end());
+      flat->leaves.push_back(fl);
+    } else {
+      f.dim = node->dim;
+      f.next = queue.size();
+      queue.push_back(node->l);
+      queue.push_back(node->r);
+    }
+    flat->nodes.push_back(f);
   }
 
-  int i = freeNodes.back();
-  freeNodes.pop_back();
-  if (NODEDEBUG) 
-    cout << id << " allocate node " << i << " with id " << allNodes[i].id 
-         << ", now " << freeNodes.size() << " free nodes." << endl;
-  return &(allNodes[i]);
+  if (compiled != NULL)
+    releaseCompiled(compiled);
+  compiled = flat;
+  lastLeaf = -1;
 }
 
-void LinearSplitsTree::deallocateNode(tree_node* node){
-  if (node->id >= N_LS_NODES){
-    if (NODEDEBUG) 
-      cout << id << " dealloc extra node id " << node->id 
-           << ", now " << freeNodes.size() << " free nodes." << endl;
-    delete node;
-    return;
+
+int LinearSplitsTree::traverseCompiled(const std::vector<float> &input){
+  const flat_node* nodes = &(compiled->nodes[0]);
+
+  int i = 0;
+  while (nodes[i].dim >= 0){
+    if (passTest(nodes[i].dim, nodes[i].val, input))
+      i = nodes[i].next;
+    else
+      i = nodes[i].next + 1;
   }
 
-  freeNodes.push_back(node->id);
-  if (NODEDEBUG) 
-    cout << id << " dealloc node " << node->id 
-         << ", now " << freeNodes.size() << " free nodes." << endl;
+  return nodes[i].next;
+}
+
+
+void LinearSplitsTree::traverseCompiled(const std::vector<std::vector<float> > &inputs, std::vector<int> *leaves){
+  const flat_node* nodes = &(compiled->nodes[0]);
+  leaves->assign(inputs.size(), 0);
+
+  // move every input down one level per pass, so each pass reads
+  // one level of nodes, which are next to each other
+  bool moved = true;
+  while (moved){
+    moved = false;
+    for (unsigned j = 0; j < inputs.size(); j++){
+      int i = (*leaves)[j];
+      if (nodes[i].dim < 0)
+        continue;
+      if (passTest(nodes[i].dim, nodes[i].val, inputs[j]))
+        (*leaves)[j] = nodes[i].next;
+      else
+        (*leaves)[j] = nodes[i].next + 1;
+      moved = true;
+    }
+  }
+
+  // index of the leaf each input reached
+  for (unsigned j = 0; j < inputs.size(); j++){
+    (*leaves)[j] = nodes[(*leaves)[j]].next;
+  }
+}
+
+
+void LinearSplitsTree::compiledPrediction(int leaf, const std::vector<float> &input, std::map<float, float>* retval){
+  const flat_leaf &fl = compiled->leaves[leaf];
+  float prediction = fl.constant;
+  int n = fl.nCoeffs;
+  if ((int)input.size() < n)
+    n = input.size();
+
+  // plus each coefficient
+  for (int i = 0; i < n; i++){
+    prediction += compiled->coefficients[fl.start + i] * input[i];
+  }
+  retval->insert(retval->end(), std::pair<float,float>(prediction, 1.0));
+}
+
+
+float LinearSplitsTree::compiledConf(int leaf){
+  float conf = (float)compiled->leaves[leaf].nInstances / (float)(2.0*M);
+  if (conf > 1.0)
+    return 1.0;
+  else
+    return conf;
+}
+
+
+void LinearSplitsTree::releaseCompiled(flat_tree* tree){
+  tree->refs--;
+  if (tree->refs == 0)
+    delete tree;
 }
@@ -3,12 +3,12 @@
 
 #include <rl_common/Random.h>
 #include <rl_common/core.hh>
+#include "ExperienceStore.hh"
 #include <vector>
 #include <set>
 #include <map>
+#include <deque>
 
-#define N_LST_EXP 200000
-#define N_LS_NODES 2500
 
 #define BUILD_EVERY 0
 #define BUILD_ON_ERROR 1
@@ -24,7 +24,8 @@ public:
   // mode - re-build tree every step?  
   // re-build only on misclassifications? or rebuild every 'trainFreq' steps
   LinearSplitsTree(int id, int trainMode, int trainFreq, int m, 
-                   float featPct, bool simple, float min_er, Random rng);
+                   float featPct, bool simple, float min_er, Random rng,
+                   ExperienceStore* store = NULL);
 
   LinearSplitsTree(const LinearSplitsTree&);
   virtual LinearSplitsTree* getCopy();
@@ -34,6 +35,8 @@ public:
   // structs to be defined
   struct tree_node;
   struct tree_experience;
+  struct exp_list;
+  struct flat_tree;
   
     
   /** Tree node struct */
@@ -58,21 +61,55 @@ public:
     // set of all outputs seen at this leaf/node
     int nInstances;
 
+    // # of trees (or parent nodes) pointing at this node
+    int refs;
   };
 
   struct tree_experience {
-    std::vector<float> input;
+    int row;
     float output;
   };
 
+  /** Append-only experiences shared by a tree and its copies */
+  struct exp_list {
+    std::deque<tree_experience> exps;
+    std::vector<tree_experience*> ptrs;
+    int refs;
+  };
+
+  /** Compiled tree node, stored breadth-first. next is the first child (passing the test) or, for leaves (dim -1), the leaf index */
+  struct flat_node {
+    int dim;
+    float val;
+    int next;
+  };
+
+  /** Compiled leaf model, coefficients from start */
+  struct flat_leaf {
+    float constant;
+    int start;
+    int nCoeffs;
+    int nInstances;
+  };
+
+  /** Compiled tree for predictions, shared by copies */
+  struct flat_tree {
+    std::vector<flat_node> nodes;
+    std::vector<flat_leaf> leaves;
+    std::vector<float> coefficients;
+    int refs;
+  };
+
   bool trainInstance(classPair &instance);
   bool trainInstances(std::vector<classPair> &instances);
   void testInstance(const std::vector<float> &input, std::map<float, float>* retval);
   float getConf(const std::vector<float> &input);
+  void testInstances(const std::vector<std::vector<float> > &inputs,
+                     std::vector<std::map<float, float> >* retval,
+                     std::vector<float>* confs);
 
   void buildTree(tree_node* node, const std::vector<tree_experience*> &instances,
                  bool changed);
-  void copyTree(tree_node* newNode, tree_node* origNode);
 
 
   // helper functions
@@ -82,6 +119,7 @@ public:
   tree_node* traverseTree(tree_node* node, const std::vector<float> &input);
   tree_node* getCorrectChild(tree_node* node, const std::vector<float> &input);
   bool passTest(int dim, float val, const std::vector<float> &input);
+  bool passTest(int dim, float val, const tree_experience* e);
   float calcER(int dim, float val, 
                const std::vector<tree_experience*> &instances, float error,
                std::vector<tree_experience*> &left,
@@ -89,7 +127,16 @@ public:
                float *leftError, float *rightError);
   float* sortOnDim(int dim, const std::vector<tree_experience*> &instances);
   std::set<float> getUniques(int dim, const std::vector<tree_experience*> &instances, float & minVal, float& maxVal);
-  void deleteTree(tree_node* node);
+  void releaseNode(tree_node* node);
+  tree_node* unshareNode(tree_node* node);
+  tree_experience* addExperience(int row, float output);
+  void releaseExperiences(exp_list* list);
+  void compileTree();
+  int traverseCompiled(const std::vector<float> &input);
+  void traverseCompiled(const std::vector<std::vector<float> > &inputs, std::vector<int> *leaves);
+  void compiledPrediction(int leaf, const std::vector<float> &input, std::map<float, float>* retval);
+  float compiledConf(int leaf);
+  void releaseCompiled(flat_tree* tree);
   float calcAvgErrorforSet(const std::vector<tree_experience*> &instances);
   void printTree(tree_node *t, int level);
   void testPossibleSplits(float avgError, const std::vector<tree_experience*> &instances, 
@@ -122,8 +169,6 @@ public:
                             float* constant, std::vector<float> * coeff);
 
   tree_node* allocateNode();
-  void deallocateNode(tree_node* node);
-  void initNodes();
 
   bool INCDEBUG;
   bool DTDEBUG;
@@ -149,6 +194,7 @@ private:
 
   Random rng;
 
+  int nfeat;
   int nOutput;
   int nnodes;
   bool hadError;
@@ -156,14 +202,14 @@ private:
   int maxnodes;
 
   // INSTANCES
-  std::vector<tree_experience*> experiences;
-  tree_experience allExp[N_LST_EXP];
-  tree_node allNodes[N_LS_NODES];
-  std::vector<int> freeNodes;
+  exp_list* experiences;
+  ExperienceStore* store;
 
   // TREE
   tree_node* root;
-  tree_node* lastNode;
+  flat_tree* compiled;
+  int lastLeaf;
+  std::vector<int> batchLeaves;
 
 };
 
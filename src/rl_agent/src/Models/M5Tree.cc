@@ -17,22 +17,33 @@
 using namespace NEWMAT;              // access NEWMAT namespace
 #endif
 
+// only one tree can use newmat at a time
+pthread_mutex_t newmat_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 
 
 M5Tree::M5Tree(int id, int trainMode, int trainFreq, int m,
                float featPct, bool simple, bool allowAllFeats, 
-	       float min_sdr, Random rng):
+	       float min_sdr, Random rng, ExperienceStore* store):
   id(id), mode(trainMode), freq(trainFreq), M(m),
   featPct(featPct), SIMPLE(simple), ALLOW_ALL_FEATS(allowAllFeats),
-  MIN_SDR(min_sdr), rng(rng)
+  MIN_SDR(min_sdr), rng(rng), store(store)
 {
 
   nnodes = 0;
+  lastLeaf = -1;
   nOutput = 0;
   nExperiences = 0;
+  nUnique = 0;
+  compress = COMPRESS_DUPLICATES;
+  cap = 0;
+  replaced = false;
   hadError = false;
   totalnodes = 0;
-  maxnodes = N_M5_NODES;
+  maxnodes = 0;
+
+  experiences = new exp_list;
+  experiences->refs = 1;
 
 
   // how close a split has to be to be randomly selected
@@ -47,6 +58,15 @@ M5Tree::M5Tree(int id, int trainMode, int trainFreq, int m,
   COPYDEBUG = false; //true;
   nfeat = 4;
 
+  // share the given experience store, or keep our own
+  if (store == NULL)
+    this->store = new ExperienceStore();
+  else
+    store->retain();
+
+  if (TREE_EXPERIENCE_CAP > 0)
+    setExperienceCap(TREE_EXPERIENCE_CAP);
+
   cout << "Created m5 decision tree " << id;
   if (SIMPLE) cout << " simple regression";
   else cout << " multivariate regression";
@@ -57,7 +77,6 @@ M5Tree::M5Tree(int id, int trainMode, int trainFreq, int m,
   }
   cout << " MIN_SDR: " << MIN_SDR << endl;
 
-  initNodes();
   initTree();
 
 
@@ -66,15 +85,19 @@ M5Tree::M5Tree(int id, int trainMode, int trainFreq, int m,
 M5Tree::M5Tree(const M5Tree& m5):
   id(m5.id), mode(m5.mode), freq(m5.freq), M(m5.M),
   featPct(m5.featPct), SIMPLE(m5.SIMPLE), ALLOW_ALL_FEATS(m5.ALLOW_ALL_FEATS),
-  MIN_SDR(m5.MIN_SDR), rng(m5.rng)
+  MIN_SDR(m5.MIN_SDR), rng(m5.rng), store(m5.store)
 {
   COPYDEBUG = m5.COPYDEBUG;
   if (COPYDEBUG) cout << "m5 copy " << id << endl;
-  nnodes = 0;
+  nnodes = m5.nnodes;
   nOutput = m5.nOutput;
   nExperiences = m5.nExperiences;
+  nUnique = m5.nUnique;
+  compress = m5.compress;
+  cap = m5.cap;
+  replaced = m5.replaced;
   hadError = m5.hadError;
-  totalnodes = 0;
+  totalnodes = m5.totalnodes;
   maxnodes = m5.maxnodes;
   SPLIT_MARGIN = m5.SPLIT_MARGIN; 
   LMDEBUG = m5.LMDEBUG;
@@ -84,30 +107,21 @@ M5Tree::M5Tree(const M5Tree& m5):
   INCDEBUG = m5.INCDEBUG; 
   NODEDEBUG = m5.NODEDEBUG;
   nfeat = m5.nfeat;
+  pendingWeights = m5.pendingWeights;
 
-  if (COPYDEBUG) cout << "   M5 copy nodes, experiences, root, etc" << endl;
-  // copy all experiences
-  for (int i = 0; i < N_M5_EXP; i++){
-    allExp[i] = m5.allExp[i];
-  }
-  if (COPYDEBUG) cout << "   M5 copied exp array" << endl;
-
-  // set experience pointers
-  experiences.resize(m5.experiences.size());
-  for (unsigned i = 0; i < m5.experiences.size(); i++){
-    experiences[i] = &(allExp[i]);
-  }
-  if (COPYDEBUG) cout << "   M5 set experience pointers" << endl;
+  // inputs are append-only, so the copy can share them
+  store->retain();
 
-  // now the tricky part, set the pointers inside the tree nodes correctly
-  initNodes();
+  // share experiences and nodes, each tree copies what it changes
+  if (COPYDEBUG) cout << "   M5 share experiences, root, etc" << endl;
+  experiences = m5.experiences;
+  experiences->refs++;
+  root = m5.root;
+  root->refs++;
+  compiled = m5.compiled;
+  compiled->refs++;
+  lastLeaf = -1;
 
-  if (COPYDEBUG) cout << "   M5 copy tree " << endl;
-  root = allocateNode();
-  lastNode = root;
-  copyTree(root, m5.root);
-  if (COPYDEBUG) cout << "   M5 tree copy done" << endl;
-   
   if (COPYDEBUG) {
     cout << endl << "New tree: " << endl;
     printTree(root, 0);
@@ -117,48 +131,21 @@ M5Tree::M5Tree(const M5Tree& m5):
 
 }
 
-void M5Tree::copyTree(tree_node* newNode, tree_node* origNode){
-
-  int nodeId = newNode->id;
-
-  if (COPYDEBUG) {
-    cout << "    Copy node " << newNode->id << " from node " << origNode->id << endl;
-    cout << "    NewAddy " << newNode << ", old: " << origNode << endl;
-  }
-
-  // copy node from t
-  *newNode = *origNode;
-  newNode->id = nodeId;
-
-  // if it has children, allocate and copy them too
-  if (origNode->l != NULL && !newNode->leaf){
-    newNode->l = allocateNode();
-    if (COPYDEBUG) cout << "     Copy left node " << newNode->l->id << " from " << origNode->l->id << endl;
-    copyTree(newNode->l, origNode->l);
-  } else {
-    newNode->l = NULL;
-  }
-
-  if (origNode->r != NULL && !newNode->leaf){
-    newNode->r = allocateNode();
-    if (COPYDEBUG) cout << "     Copy right node " << newNode->r->id << " from " << origNode->r->id << endl;
-    copyTree(newNode->r, origNode->r);
-  } else {
-    newNode->r = NULL;
-  }
-}
-
 M5Tree* M5Tree::getCopy(){
+  // while nobody else has our experiences, add the weights that were
+  // waiting for them, so the copy doesn't carry them on
+  if (experiences->refs == 1)
+    addPendingWeights();
+
   M5Tree* copy = new M5Tree(*this);
   return copy;
 }
 
 M5Tree::~M5Tree() {
-  deleteTree(root);
-  for (unsigned i = N_M5_EXP; i < experiences.size(); i++){
-    delete experiences[i];
-  }
-  experiences.clear();
+  releaseNode(root);
+  releaseCompiled(compiled);
+  releaseExperiences(experiences);
+  store->release();
 }
 
 // here the target output will be a single value
@@ -174,30 +161,20 @@ bool M5Tree::trainInstance(classPair &instance){
 
   // simply add this instance to the set of experiences
 
-  // take from static array until we run out
-  tree_experience *e;
-  if (nExperiences < N_M5_EXP){
-    // from statically created set of experiences
-    e = &(allExp[nExperiences]);
-
-  } else {
-    // dynamically create experience
-    e = new tree_experience;
-  }
-
+  // inputs go in the experience store, unless already placed there for us
+  tree_experience *e = addExperience(instance.in, instance.row, instance.out);
 
-  e->input = instance.in;
-  e->output = instance.out;
-  experiences.push_back(e);
-  nExperiences++;
+  // left out of the sample
+  if (e == NULL)
+    return false;
 
   if (nExperiences == 1000000){
     cout << "Reached limit of # experiences allowed." << endl;
     return false;
   }
 
-  if (nExperiences != (int)experiences.size())
-    cout << "ERROR: experience size mismatch: " << nExperiences << ", " << experiences.size() << endl;
+  if (nUnique != (int)experiences->ptrs.size())
+    cout << "ERROR: experience size mismatch: " << nUnique << ", " << experiences->ptrs.size() << endl;
 
   //cout << nExperiences << endl << flush;
   //if (nExperiences == 503 && id == 10){
@@ -214,8 +191,8 @@ bool M5Tree::trainInstance(classPair &instance){
     cout << endl << " Original output: " << instance.out << endl;
     cout << "Added exp id: " << nExperiences << " output: " << e->output << endl;
     cout << "Address: " << e << " Input : ";
-    for (unsigned i = 0; i < e->input.size(); i++){
-      cout << e->input[i] << ", ";
+    for (int i = 0; i < nfeat; i++){
+      cout << store->get(e->row, i) << ", ";
     }
     cout << endl << " Now have " << nExperiences << " experiences." << endl;
   }
@@ -234,7 +211,7 @@ bool M5Tree::trainInstance(classPair &instance){
     // build on misclassification
     // check for misclassify
     std::map<float, float> answer;
-    testInstance(e->input, &answer);
+    testInstance(instance.in, &answer);
     float val = answer.begin()->first;
     float error = fabs(val - e->output);
 
@@ -287,30 +264,20 @@ bool M5Tree::trainInstances(std::vector<classPair> &instances){
 
     // simply add this instance to the set of experiences
 
-    // take from static array until we run out
-    tree_experience *e;
-    if (nExperiences < N_M5_EXP){
-      // from statically created set of experiences
-      e = &(allExp[nExperiences]);
-
-    } else {
-      // dynamically create experience
-      e = new tree_experience;
-    }
-
+    // inputs go in the experience store, unless already placed there for us
+    tree_experience *e = addExperience(instance.in, instance.row, instance.out);
 
-    e->input = instance.in;
-    e->output = instance.out;
-    experiences.push_back(e);
-    nExperiences++;
+    // left out of the sample
+    if (e == NULL)
+      continue;
 
     if (nExperiences == 1000000){
       cout << "Reached limit of # experiences allowed." << endl;
       return false;
     }
 
-    if (nExperiences != (int)experiences.size())
-      cout << "ERROR: experience size mismatch: " << nExperiences << ", " << experiences.size() << endl;
+    if (nUnique != (int)experiences->ptrs.size())
+      cout << "ERROR: experience size mismatch: " << nUnique << ", " << experiences->ptrs.size() << endl;
 
     if (DTDEBUG) {
       cout << "Original input: ";
@@ -320,8 +287,8 @@ bool M5Tree::trainInstances(std::vector<classPair> &instances){
       cout << endl << " Original output: " << instance.out << endl;
       cout << "Added exp id: " << nExperiences << " output: " << e->output << endl;
       cout << "Address: " << e << " Input : ";
-      for (unsigned i = 0; i < e->input.size(); i++){
-        cout << e->input[i] << ", ";
+      for (int i = 0; i < nfeat; i++){
+        cout << store->get(e->row, i) << ", ";
       }
       cout << endl << " Now have " << nExperiences << " experiences." << endl;
     }
@@ -342,7 +309,7 @@ bool M5Tree::trainInstances(std::vector<classPair> &instances){
       // build on misclassification
       // check for misclassify
       std::map<float, float> answer;
-      testInstance(e->input, &answer);
+      testInstance(instance.in, &answer);
       float val = answer.begin()->first;
       float error = fabs(val - e->output);
 
@@ -386,8 +353,14 @@ bool M5Tree::trainInstances(std::vector<classPair> &instances){
 
 void M5Tree::rebuildTree(){
   //cout << "rebuild tree " << id << " on exp: " << nExperiences << endl;
-  //  deleteTree(root);
-  buildTree(root, experiences, false);
+  addPendingWeights();
+  root = unshareNode(root);
+  // replaced experiences can change any part of the tree
+  buildTree(root, experiences->ptrs, replaced);
+  replaced = false;
+
+  // predictions now use the new tree
+  compileTree();
   //cout << "tree " << id << " rebuilt. " << endl;
 }
 
@@ -399,17 +372,17 @@ void M5Tree::testInstance(const std::vector<float> &input, std::map<float, float
   retval->clear();
 
   // in case the tree is empty
-  if (experiences.size() == 0){
+  if (nExperiences == 0){
     (*retval)[0.0] = 1.0;
     return;
   }
 
   // follow through tree to leaf
-  tree_node* leaf = traverseTree(root, input);
-  lastNode = leaf;
+  int leaf = traverseCompiled(input);
+  lastLeaf = leaf;
 
-  // and return mapping of outputs and their probabilities
-  leafPrediction(leaf, input, retval);
+  // and return the leaf's regression prediction
+  compiledPrediction(leaf, input, retval);
 
 }
 
@@ -417,11 +390,11 @@ float M5Tree::getConf(const std::vector<float> &input){
   if (DTDEBUG) cout << "numVisits" << endl;
 
   // in case the tree is empty
-  if (experiences.size() == 0){
+  if (nExperiences == 0){
     return 0;
   }
 
-  if (lastNode == NULL){
+  if (lastLeaf < 0){
     return 0;
   }
 
@@ -429,14 +402,42 @@ float M5Tree::getConf(const std::vector<float> &input){
   //tree_node* leaf = traverseTree(root, input);
 
   // and return # in this leaf
-  float conf = (float)lastNode->nInstances / (float)(2.0*M);
-  if (conf > 1.0)
-    return 1.0;
-  else
-    return conf;
+  return compiledConf(lastLeaf);
 
 }
 
+
+void M5Tree::testInstances(const std::vector<std::vector<float> > &inputs,
+                           std::vector<std::map<float, float> >* retval,
+                           std::vector<float>* confs){
+  if (DTDEBUG) cout << "testInstances: " << inputs.size() << endl;
+
+  retval->resize(inputs.size());
+  if (confs != NULL) confs->resize(inputs.size());
+
+  // in case the tree is empty
+  if (nExperiences == 0){
+    for (unsigned j = 0; j < inputs.size(); j++){
+      (*retval)[j].clear();
+      (*retval)[j][0.0] = 1.0;
+      if (confs != NULL) (*confs)[j] = 0;
+    }
+    return;
+  }
+
+  // follow all the inputs through the compiled tree together
+  traverseCompiled(inputs, &batchLeaves);
+
+  for (unsigned j = 0; j < inputs.size(); j++){
+    (*retval)[j].clear();
+    compiledPrediction(batchLeaves[j], inputs[j], &((*retval)[j]));
+    if (confs != NULL) (*confs)[j] = compiledConf(batchLeaves[j]);
+  }
+
+  if (inputs.size() > 0)
+    lastLeaf = batchLeaves.back();
+}
+
 // check to see if this state is one we should explore
 // to get more info on potential splits
 
@@ -445,6 +446,8 @@ float M5Tree::getConf(const std::vector<float> &input){
 void M5Tree::initTree(){
   if (DTDEBUG) cout << "initTree()" << endl;
   root = allocateNode();
+  compiled = NULL;
+  compileTree();
 
   if (DTDEBUG) cout << "   root id = " << root->id << endl;
 
@@ -486,42 +489,49 @@ void M5Tree::initTreeNode(tree_node* node){
   node->r = NULL;
 
   node->leaf = true;
+  node->refs = 1;
 
 }
 
-void M5Tree::deleteTree(tree_node* node){
+void M5Tree::releaseNode(tree_node* node){
   if (node==NULL)
     return;
 
-  if (DTDEBUG) cout << "deleteTree, node=" << node->id << endl;
+  node->refs--;
+  if (node->refs > 0)
+    return;
+
+  if (DTDEBUG) cout << "releaseNode, node=" << node->id << endl;
 
   totalnodes--;
 
-  node->nInstances = 0;
-  node->coefficients.clear();
-
-  //recursively call deleteTree on children
-  // then delete them
-  if (!node->leaf){
-    // left child
-    if (node->l != NULL){
-      deleteTree(node->l);
-      deallocateNode(node->l);
-      node->l = NULL;
-    }
+  // children lose this reference
+  releaseNode(node->l);
+  releaseNode(node->r);
 
-    // right child
-    if (node->r != NULL){
-      deleteTree(node->r);
-      deallocateNode(node->r);
-      node->r = NULL;
-    }
+  delete node;
+}
+
+
+M5Tree::tree_node* M5Tree::unshareNode(tree_node* node){
+  if (node->refs == 1)
+    return node;
+
+  // copy the node, the copy shares the same children
+  tree_node* copy = new tree_node(*node);
+  copy->id = nnodes++;
+  copy->refs = 1;
+  if (copy->l != NULL) copy->l->refs++;
+  if (copy->r != NULL) copy->r->refs++;
+  if (COPYDEBUG) cout << id << " copy shared node " << node->id << " to " << copy->id << endl;
+
+  totalnodes++;
+  if (totalnodes > maxnodes){
+    maxnodes = totalnodes;
   }
 
-  node->leaf  = true;
-  node->dim = -1;
-  node->val = -1;
-  node->constant = 0;
+  node->refs--;
+  return copy;
 }
 
 
@@ -562,6 +572,19 @@ bool M5Tree::passTest(int dim, float val, const std::vector<float> &input){
 }
 
 
+bool M5Tree::passTest(int dim, float val, const tree_experience* e){
+  float input = store->get(e->row, dim);
+  if (DTDEBUG) cout << "passTest, dim=" << dim << ",val=" << val 
+                    << ",input["<<dim<<"]=" << input <<endl;
+
+  if (input > val)
+    return false;
+  else
+    return true;
+
+}
+
+
 void M5Tree::buildTree(tree_node *node,
                        const std::vector<tree_experience*> &instances,
                        bool changed){
@@ -579,7 +602,7 @@ void M5Tree::buildTree(tree_node *node,
   //std::vector<float> chiSquare = calcChiSquare(instances);
 
   // first, add instances to tree
-  node->nInstances = instances.size();
+  node->nInstances = totalWeight(instances);
 
   bool allSame = true;
   float val0 = instances[0]->output;
@@ -607,19 +630,21 @@ void M5Tree::buildTree(tree_node *node,
   if (node->leaf && node->coefficients.size() > 0) {
     //cout << "Node " << node->id << " is leaf, checking lm" << endl;
     float errorSum = 0;
+    std::vector<float> input;
     for (unsigned i = 0; i < instances.size(); i++){
       // get prediction for instance and compare with actual output
-      tree_node* leaf = traverseTree(node, instances[i]->input);
+      store->getRow(instances[i]->row, nfeat, &input);
+      tree_node* leaf = traverseTree(node, input);
       std::map<float, float> retval;
-      leafPrediction(leaf, instances[i]->input, &retval);
+      leafPrediction(leaf, input, &retval);
       float prediction = retval.begin()->first;
       float absError = fabs(prediction - instances[i]->output);
-      errorSum += absError;
+      errorSum += instances[i]->weight * absError;
       //cout << "instance " << i << " leaf predicted: " << prediction
       //     << " actual: " << instances[i]->output
       //   << " error: " << absError << endl;
     }
-    float avgError = errorSum / (float)instances.size();
+    float avgError = errorSum / (float)node->nInstances;
     if (avgError < 0.001){
       //      cout << "stick with linear model" << endl;
       return;
@@ -667,14 +692,12 @@ void M5Tree::makeLeaf(tree_node* node){
 void M5Tree::removeChildren(tree_node* node){
   // check on children
   if (node->l != NULL){
-    deleteTree(node->l);
-    deallocateNode(node->l);
+    releaseNode(node->l);
     node->l = NULL;
   }
 
   if (node->r != NULL){
-    deleteTree(node->r);
-    deallocateNode(node->r);
+    releaseNode(node->r);
     node->r = NULL;
   }
 
@@ -693,29 +716,34 @@ void M5Tree::pruneTree(tree_node *node,
   // TODO: no pruning right now
   //  return;
 
+  // weighted # of instances
+  size_t nInst = totalWeight(instances);
+
   // calculate error of current subtree
   float subtreeErrorSum = 0;
+  std::vector<float> input;
   for (unsigned i = 0; i < instances.size(); i++){
     
     // get prediction for instance and compare with actual output
-    tree_node* leaf = traverseTree(node, instances[i]->input);
+    store->getRow(instances[i]->row, nfeat, &input);
+    tree_node* leaf = traverseTree(node, input);
     std::map<float, float> retval;
-    leafPrediction(leaf, instances[i]->input, &retval);
+    leafPrediction(leaf, input, &retval);
     float prediction = retval.begin()->first;
     float absError = fabs(prediction - instances[i]->output);
-    subtreeErrorSum += absError;
+    subtreeErrorSum += instances[i]->weight * absError;
     if (LMDEBUG || DTDEBUG){
       cout << "instance " << i << " subtree predicted: " << prediction
            << " actual: " << instances[i]->output
            << " error: " << absError << endl;
     }
   }
-  if (instances.size() < 3){
+  if (nInst < 3){
     if (LMDEBUG || DTDEBUG) cout << "instances size <= 2!!!" << endl;
     return;
   }
 
-  float avgTreeError = subtreeErrorSum / (float)instances.size();
+  float avgTreeError = subtreeErrorSum / (float)nInst;
 
   // if this is zero error, we're not going to replace it
   if (false && avgTreeError <= 0.0001){
@@ -726,7 +754,7 @@ void M5Tree::pruneTree(tree_node *node,
   }
                                                                 
   // figure out tree feats used
-  std::vector<bool> treeFeatsUsed(instances[0]->input.size(), false);
+  std::vector<bool> treeFeatsUsed(nfeat, false);
   getFeatsUsed(node, &treeFeatsUsed);
   int nTreeFeatsUsed = 0;
   for (unsigned i = 0; i < treeFeatsUsed.size(); i++){
@@ -736,7 +764,7 @@ void M5Tree::pruneTree(tree_node *node,
 
   // Just use them all... otherwise we ignore some that weren't good enough
   // for splitting, but are good here
-  std::vector<bool> featsUsed(instances[0]->input.size(), true);
+  std::vector<bool> featsUsed(nfeat, true);
   int nFeatsUsed = featsUsed.size();
 
   // or just use ones allowed by subtree
@@ -753,16 +781,16 @@ void M5Tree::pruneTree(tree_node *node,
 
   // add on error bonus based on nInstances and nParams
   float treeErrorEst = avgTreeError;
-  float denom = (instances.size() - nTreeFeatsUsed);
+  float denom = (nInst - nTreeFeatsUsed);
   if (denom < 1){
     denom = 0.5;
     if (LMDEBUG) {
       cout << "denom of tree error factor is " << denom 
-           << " with nInst " << instances.size() 
+           << " with nInst " << nInst
            << " nfeats: " << nTreeFeatsUsed << endl;
     }
   }
-  treeErrorEst *= (instances.size() + nTreeFeatsUsed) / denom;
+  treeErrorEst *= (nInst + nTreeFeatsUsed) / denom;
 
   // fit linear model to this set of instances
   float lmErrorSum = 0;
@@ -772,19 +800,19 @@ void M5Tree::pruneTree(tree_node *node,
   else 
     nlmFeats = fitLinearModel(node, instances, featsUsed, nFeatsUsed, &lmErrorSum);
 
-  float avgLMError = lmErrorSum / (float)instances.size();
+  float avgLMError = lmErrorSum / (float)nInst;
 
   float lmErrorEst = avgLMError;
-  float denom2 = (instances.size() - nlmFeats);
+  float denom2 = (nInst - nlmFeats);
   if (denom2 < 1){
     denom2 = 0.5;
     if (LMDEBUG) {
       cout << "denom2 of lm error factor is " << denom2
-           << " with nInst " << instances.size() 
+           << " with nInst " << nInst
            << " nfeats: " << nlmFeats << endl;
     }
   }
-  lmErrorEst *= (instances.size() + nlmFeats) / denom2; 
+  lmErrorEst *= (nInst + nlmFeats) / denom2; 
 
   // replace subtree with linear model?
   if (LMDEBUG || DTDEBUG) {
@@ -798,8 +826,9 @@ void M5Tree::pruneTree(tree_node *node,
       cout << node->id << " replace tree with linear model" << endl;
     removeChildren(node);
   } else {
-    // remove coefficients again, for memory
-    //    node->coefficients.clear();
+    // remove coefficients again, for memory (only leaves use them)
+    if (!node->leaf)
+      node->coefficients.clear();
   }
 
 }
@@ -814,8 +843,8 @@ int M5Tree::fitLinearModel(tree_node *node,
                               << ",nInstances:" << instances.size() << endl;
 
   // make sure there are enough coefficients for all the features
-  if (node->coefficients.size() != instances[0]->input.size()){
-    node->coefficients.resize(instances[0]->input.size(), 0);
+  if (node->coefficients.size() != (unsigned)nfeat){
+    node->coefficients.resize(nfeat, 0);
   }
 
   node->constant = 0.0;
@@ -824,6 +853,9 @@ int M5Tree::fitLinearModel(tree_node *node,
   int nlmFeats = 10;
   (*resSum) = 1000000;
 
+  // newmat keeps global state, so only one tree can use it at a time
+  pthread_mutex_lock(&newmat_mutex);
+
   while (doRegression){
     //cout << id << " Attempt linear model " << ntimes << endl;
     ntimes++;
@@ -856,7 +888,7 @@ int M5Tree::fitLinearModel(tree_node *node,
         if (!featureMask[j])
           continue;
       
-        if (constants[j] && e->input[j] != instances[0]->input[j]){
+        if (constants[j] && store->get(e->row, j) != store->get(instances[0]->row, j)){
           constants[j] = false;
         }
 
@@ -884,7 +916,7 @@ int M5Tree::fitLinearModel(tree_node *node,
 
         featIndices[featIndex-1] = j;
         // HACK: I'm adding random noise here to prevent colinear features
-        X(i+1,featIndex) = e->input[j]; // + rng.uniform(-0.00001, 0.00001);
+        X(i+1,featIndex) = store->get(e->row, j); // + rng.uniform(-0.00001, 0.00001);
         if (LMDEBUG){
           cout << " Feat " << featIndex << " index " << j
                << " val " << X(i+1,featIndex) << ",";
@@ -902,18 +934,45 @@ int M5Tree::fitLinearModel(tree_node *node,
     // make vector of 1s
     ColumnVector Ones(nObs); Ones = 1.0;
 
+    // and of the weights of each observation
+    ColumnVector W(nObs);
+    int totalW = 0;
+    for (int i = 0; i < nObs; i++){
+      W(i+1) = instances[i]->weight;
+      totalW += instances[i]->weight;
+    }
+
     // calculate means (averages) of x1 and x2 [ .t() takes transpose]
-    RowVector Mrow = Ones.t() * X / nObs;
+    // and of Y [use Sum to get sum of elements], weighted if needed
+    RowVector Mrow;
+    Real mval;
+    if (totalW == nObs){
+      Mrow = Ones.t() * X / nObs;
+      mval = Sum(Y) / nObs;
+    } else {
+      Mrow = W.t() * X / totalW;
+      mval = (W.t() * Y).AsScalar() / totalW;
+    }
 
     // and subtract means from x1 and x1
     Matrix XC(nObs,nFeats);
     XC = X - Ones * Mrow;
 
-    // do the same to Y [use Sum to get sum of elements]
+    // do the same to Y
     ColumnVector YC(nObs);
-    Real mval = Sum(Y) / nObs;
     YC = Y - Ones * mval;
 
+    // scale each observation by the sqrt of its weight, for weighted least squares
+    if (totalW != nObs){
+      for (int i = 0; i < nObs; i++){
+        Real sw = sqrt(W(i+1));
+        for (int j = 0; j < nFeats; j++){
+          XC(i+1,j+1) *= sw;
+        }
+        YC(i+1) *= sw;
+      }
+    }
+
     Try {
 
       // form sum of squares and product matrix
@@ -957,7 +1016,7 @@ int M5Tree::fitLinearModel(tree_node *node,
                << " actual: " << instances[i]->output
                << " error: " << Residual(i+1) << endl;
         }
-        (*resSum) += fabs(Residual(i+1));
+        (*resSum) += instances[i]->weight * fabs(Residual(i+1));
       }
 
 
@@ -1003,6 +1062,8 @@ int M5Tree::fitLinearModel(tree_node *node,
 
   }
 
+  pthread_mutex_unlock(&newmat_mutex);
+
   // return # features used
   return nlmFeats;
 
@@ -1016,8 +1077,8 @@ int M5Tree::fitSimpleLinearModel(tree_node *node,
                               << ",nInstances:" << instances.size() << endl;
   
   // make sure there are enough coefficients for all the features
-  if (node->coefficients.size() != instances[0]->input.size()){
-    node->coefficients.resize(instances[0]->input.size(), 0);
+  if (node->coefficients.size() != (unsigned)nfeat){
+    node->coefficients.resize(nfeat, 0);
   }
 
   // loop through all features, try simple single variable regression
@@ -1027,31 +1088,35 @@ int M5Tree::fitSimpleLinearModel(tree_node *node,
   float bestError = 1000000;
   float bestConstant = -1;
 
-  std::vector<float> xsum(instances[0]->input.size(), 0);
-  std::vector<float> xysum(instances[0]->input.size(), 0);
-  std::vector<float> x2sum(instances[0]->input.size(), 0);
+  std::vector<float> xsum(nfeat, 0);
+  std::vector<float> xysum(nfeat, 0);
+  std::vector<float> x2sum(nfeat, 0);
   float ysum = 0;
 
-  int nObs = (int)instances.size();
-  for (int i = 0; i < nObs; i++){
+  // sums weighted by how many times each instance was seen
+  int nUniqueObs = (int)instances.size();
+  int nObs = totalWeight(instances);
+  for (int i = 0; i < nUniqueObs; i++){
     tree_experience *e = instances[i];
     if (LMDEBUG) cout << "Obs: " << i;
     
     // go through all features
-    for (unsigned j = 0; j < instances[0]->input.size(); j++){
+    for (int j = 0; j < nfeat; j++){
       if (!featureMask[j]) continue;
-      if (LMDEBUG) cout << ", F" << j << ": " << e->input[j];
-      xsum[j] += e->input[j];
-      xysum[j] += (e->input[j] * e->output);
-      x2sum[j] += (e->input[j] * e->input[j]);
+      float x = store->get(e->row, j);
+      if (LMDEBUG) cout << ", F" << j << ": " << x;
+      xsum[j] += e->weight * x;
+      xysum[j] += e->weight * (x * e->output);
+      x2sum[j] += e->weight * (x * x);
     }
-    ysum += e->output;
+    ysum += e->weight * e->output;
     if (LMDEBUG) cout << ", out: " << e->output << endl;
   }
   
   // now go through all features and calc coeff and constant
-  for (unsigned j = 0; j < instances[0]->input.size(); j++){
+  for (int j = 0; j < nfeat; j++){
     if (!featureMask[j]) continue;
+    const std::vector<float> &featVals = store->column(j);
     /*
       if (rng.uniform() < featPct){
       continue;
@@ -1067,12 +1132,12 @@ int M5Tree::fitSimpleLinearModel(tree_node *node,
 
     // now try to make predictions and see what error is
     float errorSum = 0;
-    for (int i = 0; i < nObs; i++){
+    for (int i = 0; i < nUniqueObs; i++){
       tree_experience *e = instances[i];
-      float pred = constant + coeff * e->input[j];
+      float pred = constant + coeff * featVals[e->row];
       float error = fabs(pred - e->output);
       if (LMDEBUG) cout << "Instance " << i << " error: " << error << endl;
-      errorSum += error;
+      errorSum += e->weight * error;
     }
     if (LMDEBUG) cout << "eSum: " << errorSum << endl;
 
@@ -1091,7 +1156,7 @@ int M5Tree::fitSimpleLinearModel(tree_node *node,
          << bestConstant << " avgE: " << (bestError/nObs) << endl;
   }
 
-  if (bestFeat < 0 || bestFeat > (int)instances[0]->input.size()){
+  if (bestFeat < 0 || bestFeat > nfeat){
     node->constant = 0.0;
     for (unsigned i = 0; i < node->coefficients.size(); i++){
       node->coefficients[i] = 0.0;
@@ -1141,9 +1206,9 @@ void M5Tree::implementSplit(tree_node* node,
     makeLeaf(node);
     float valSum = 0;
     for (unsigned i = 0; i < instances.size(); i++){
-      valSum += instances[i]->output;
+      valSum += instances[i]->weight * instances[i]->output;
     }
-    float avg = valSum / (float)(instances.size());
+    float avg = valSum / (float)(node->nInstances);
     node->constant = avg;
     if (SPLITDEBUG || STOCH_DEBUG){
       cout << "DT " << id << " Node " << node->id << " Poor sdr "
@@ -1162,15 +1227,17 @@ void M5Tree::implementSplit(tree_node* node,
     if (DTDEBUG || SPLITDEBUG) cout << "Same split as before" << endl;
 
     // see which leaf changed
-    if (bestLeft.size() > (unsigned)node->l->nInstances){
+    if (totalWeight(bestLeft) > node->l->nInstances){
       // redo left side
       if (DTDEBUG) cout << "Rebuild left side of tree" << endl;
+      node->l = unshareNode(node->l);
       buildTree(node->l, bestLeft, changed);
     }
 
-    if (bestRight.size() > (unsigned)node->r->nInstances){
+    if (totalWeight(bestRight) > node->r->nInstances){
       // redo right side
       if (DTDEBUG) cout << "Rebuild right side of tree" << endl;
+      node->r = unshareNode(node->r);
       buildTree(node->r, bestRight, changed);
     }
     return;
@@ -1210,6 +1277,8 @@ void M5Tree::implementSplit(tree_node* node,
     if (DTDEBUG) cout << "Init new right tree nodes " << endl;
     node->r = allocateNode();
   }
+  node->l = unshareNode(node->l);
+  node->r = unshareNode(node->r);
 
   // recursively build the sub-trees to this one
   if (DTDEBUG) cout << "Building left tree for node " << node->id << endl;
@@ -1261,7 +1330,7 @@ void M5Tree::testPossibleSplits(const std::vector<tree_experience*> &instances,
   int nties = 0;
 
   // for each possible split, calc standard deviation reduction
-  for (unsigned idim = 0; idim < instances[0]->input.size(); idim++){
+  for (int idim = 0; idim < nfeat; idim++){
 
     //float* sorted = sortOnDim(idim, instances);
     float minVal, maxVal;
@@ -1367,15 +1436,19 @@ float M5Tree::calcSDR(int dim, float val,
   right.clear();
 
   // split into two sides
+  int leftWeight = 0;
+  int rightWeight = 0;
   for (unsigned i = 0; i < instances.size(); i++){
     if (DTDEBUG) cout << "calcSDR - Classify instance " << i 
                       << " on new split " << endl;
 
-    if (passTest(dim, val, instances[i]->input)){
+    if (passTest(dim, val, instances[i])){
       left.push_back(instances[i]);
+      leftWeight += instances[i]->weight;
     }
     else{
       right.push_back(instances[i]);
+      rightWeight += instances[i]->weight;
     }
   }
 
@@ -1386,8 +1459,8 @@ float M5Tree::calcSDR(int dim, float val,
   float sdLeft = calcSDforSet(left);
   float sdRight = calcSDforSet(right);
 
-  float leftRatio = (float)left.size() / (float)instances.size();
-  float rightRatio = (float)right.size() / (float)instances.size();
+  float leftRatio = (float)leftWeight / (float)(leftWeight + rightWeight);
+  float rightRatio = (float)rightWeight / (float)(leftWeight + rightWeight);
 
   float sdr = sd - (leftRatio * sdLeft + rightRatio * sdRight);
 
@@ -1406,7 +1479,7 @@ float M5Tree::calcSDR(int dim, float val,
 float M5Tree::calcSDforSet(const std::vector<tree_experience*> &instances){
   if (DTDEBUG) cout << "calcSDforSet" << endl;
 
-  int n = instances.size();
+  int n = totalWeight(instances);
 
   if (n == 0)
     return 0;
@@ -1417,8 +1490,9 @@ float M5Tree::calcSDforSet(const std::vector<tree_experience*> &instances){
   // go through instances and calculate sums, sum of squares
   for (unsigned i = 0; i < instances.size(); i++){
     float val = instances[i]->output;
-    sum += val;
-    sumSqr += (val * val);
+    double w = instances[i]->weight;
+    sum += w * val;
+    sumSqr += w * (val * val);
   }
 
   double mean = sum / (double)n;
@@ -1433,14 +1507,16 @@ std::set<float> M5Tree::getUniques(int dim, const std::vector<tree_experience*>
   if (DTDEBUG) cout << "getUniques,dim = " << dim;
 
   std::set<float> uniques;
+  const std::vector<float> &featVals = store->column(dim);
 
   for (int i = 0; i < (int)instances.size(); i++){
-    if (i == 0 || instances[i]->input[dim] < minVal)
-      minVal = instances[i]->input[dim];
-    if (i == 0 || instances[i]->input[dim] > maxVal)
-      maxVal = instances[i]->input[dim];
+    float val = featVals[instances[i]->row];
+    if (i == 0 || val < minVal)
+      minVal = val;
+    if (i == 0 || val > maxVal)
+      maxVal = val;
 
-    uniques.insert(instances[i]->input[dim]);
+    uniques.insert(val);
   }
 
   // lets not try more than 100 possible splits per dimension
@@ -1462,11 +1538,12 @@ float* M5Tree::sortOnDim(int dim, const std::vector<tree_experience*> &instances
   if (DTDEBUG) cout << "sortOnDim,dim = " << dim << endl;
 
   float* values = new float[instances.size()];
+  const std::vector<float> &featVals = store->column(dim);
 
   for (int i = 0; i < (int)instances.size(); i++){
     //cout << "Instance " << i << endl;
 
-    float val = instances[i]->input[dim];
+    float val = featVals[instances[i]->row];
     //cout << " val: " << val << endl;
 
     // find where this should go
@@ -1572,48 +1649,297 @@ void M5Tree::leafPrediction(tree_node* leaf, const std::vector<float> &input, st
 }
 
 
-void M5Tree::initNodes(){
+M5Tree::tree_node* M5Tree::allocateNode(){
+  tree_node* newNode = new tree_node;
+  initTreeNode(newNode);
+  if (NODEDEBUG) 
+    cout << id << " allocate node " << newNode->id << endl;
+  return newNode;
+}
+
+
+M5Tree::tree_experience* M5Tree::addExperience(const std::vector<float> &input, int row, float output){
+
+  // see if we already have this pair
+  std::vector<float> key;
+  if (compress){
+    key = input;
+    key.push_back(output);
+    std::map<std::vector<float>, int>::iterator it = experiences->index.find(key);
+    if (it != experiences->index.end() && it->second < nUnique){
+      // copies of the tree must not see the weight change, so while the
+      // list is shared it waits until we next build the tree
+      tree_experience *e = experiences->ptrs[it->second];
+      if (experiences->refs > 1)
+        pendingWeights.push_back(it->second);
+      else
+        e->weight++;
+      nExperiences++;
+      return e;
+    }
+  }
+
+  // once full, keep it with probability cap / # seen, in place of a random one
+  if (cap > 0 && nUnique >= cap){
+    nExperiences++;
+    int slot = rng.uniformDiscrete(0, nExperiences-1);
+    if (slot >= cap)
+      return NULL;
+
+    // copies of the tree must not see the replacement
+    if (experiences->refs > 1 || (int)experiences->ptrs.size() != nUnique)
+      copyExperiences();
+    else
+      addPendingWeights();
+
+    tree_experience *e = experiences->ptrs[slot];
+    if (compress){
+      std::vector<float> oldKey;
+      store->getRow(e->row, nfeat, &oldKey);
+      oldKey.push_back(e->output);
+      experiences->index.erase(oldKey);
+      experiences->index[key] = slot;
+    }
+    e->row = store->append(input);
+    e->output = output;
+    e->weight = 1;
+    replaced = true;
+
+    // drop the inputs of replaced experiences
+    if (store->size() >= 2 * cap)
+      compactStore();
+
+    return e;
+  }
 
-  for (int i = 0; i < N_M5_NODES; i++){
-    initTreeNode(&(allNodes[i]));
-    freeNodes.push_back(i);
-    if (NODEDEBUG) 
-      cout << "init node " << i << " with id " << allNodes[i].id 
-           << ", now " << freeNodes.size() << " free nodes." << endl;
+  // someone else has added to our list, so copy the part that is ours
+  if ((int)experiences->ptrs.size() != nUnique){
+    copyExperiences();
   }
 
+  // inputs go in our own store when sampling
+  if (row < 0 || cap > 0)
+    row = store->append(input);
+
+  experiences->exps.push_back(tree_experience());
+  tree_experience *e = &(experiences->exps.back());
+  e->row = row;
+  e->output = output;
+  e->weight = 1;
+  experiences->ptrs.push_back(e);
+  if (compress)
+    experiences->index[key] = nUnique;
+  nUnique++;
+  nExperiences++;
+
+  return e;
 }
 
-M5Tree::tree_node* M5Tree::allocateNode(){
-  if (freeNodes.empty()){
-    tree_node* newNode = new tree_node;
-    initTreeNode(newNode);
-    if (NODEDEBUG) 
-      cout << "PROBLEM: No more pre-allocated nodes!!!" << endl
-           << "return new node " << newNode->id 
-           << ", now " << freeNodes.size() << " free nodes." << endl;
-    return newNode;
-  }
-
-  int i = freeNodes.back();
-  freeNodes.pop_back();
-  if (NODEDEBUG) 
-    cout << "allocate node " << i << " with id " << allNodes[i].id 
-         << ", now " << freeNodes.size() << " free nodes." << endl;
-  return &(allNodes[i]);
+void M5Tree::copyExperiences(){
+  if (COPYDEBUG) cout << id << " copy experience list of size " << nUnique << endl;
+
+  exp_list* list = new exp_list;
+  list->refs = 1;
+  list->exps.insert(list->exps.end(), experiences->exps.begin(),
+                    experiences->exps.begin() + nUnique);
+  list->ptrs.resize(nUnique);
+  for (int i = 0; i < nUnique; i++){
+    list->ptrs[i] = &(list->exps[i]);
+  }
+
+  // re-index the part we kept
+  if (compress){
+    std::vector<float> key;
+    for (int i = 0; i < nUnique; i++){
+      store->getRow(list->exps[i].row, nfeat, &key);
+      key.push_back(list->exps[i].output);
+      list->index[key] = i;
+    }
+  }
+
+  // the new list is ours alone
+  for (unsigned i = 0; i < pendingWeights.size(); i++){
+    list->ptrs[pendingWeights[i]]->weight++;
+  }
+  pendingWeights.clear();
+
+  releaseExperiences(experiences);
+  experiences = list;
 }
 
-void M5Tree::deallocateNode(tree_node* node){
-  if (node->id >= N_M5_NODES){
-    if (NODEDEBUG) 
-      cout << "dealloc extra node id " << node->id 
-           << ", now " << freeNodes.size() << " free nodes." << endl;
-    delete node;
+void M5Tree::addPendingWeights(){
+  if (pendingWeights.size() == 0)
+    return;
+
+  if (experiences->refs > 1 || (int)experiences->ptrs.size() != nUnique){
+    copyExperiences();
     return;
   }
 
-  freeNodes.push_back(node->id);
-  if (NODEDEBUG) 
-    cout << "dealloc node " << node->id 
-         << ", now " << freeNodes.size() << " free nodes." << endl;
+  for (unsigned i = 0; i < pendingWeights.size(); i++){
+    experiences->ptrs[pendingWeights[i]]->weight++;
+  }
+  pendingWeights.clear();
+}
+
+void M5Tree::setCompressDuplicates(bool compress){
+  this->compress = compress;
+}
+
+void M5Tree::setExperienceCap(int cap){
+  this->cap = cap;
+
+  // inputs we replace can't be dropped from a store other trees use
+  if (cap > 0){
+    store->release();
+    store = new ExperienceStore();
+  }
+}
+
+void M5Tree::compactStore(){
+  if (DTDEBUG) cout << id << " compact store of " << store->size() << " rows to " << nUnique << endl;
+
+  // rows are about to change
+  if (experiences->refs > 1)
+    copyExperiences();
+  else
+    addPendingWeights();
+
+  ExperienceStore* compact = new ExperienceStore();
+  std::vector<float> input;
+  for (int i = 0; i < nUnique; i++){
+    store->getRow(experiences->ptrs[i]->row, nfeat, &input);
+    experiences->ptrs[i]->row = compact->append(input);
+  }
+
+  // copies of the tree keep the old store
+  store->release();
+  store = compact;
+}
+
+int M5Tree::totalWeight(const std::vector<tree_experience*> &instances){
+  int total = 0;
+  for (unsigned i = 0; i < instances.size(); i++){
+    total += instances[i]->weight;
+  }
+  return total;
+}
+
+void M5Tree::releaseExperiences(exp_list* list){
+  list->refs--;
+  if (list->refs == 0)
+    delete list;
+}
+
+
+void M5Tree::compileTree(){
+  flat_tree* flat = new flat_tree;
+  flat->refs = 1;
+
+  // breadth-first, so node i of the queue becomes compiled node i
+  std::vector<tree_node*> queue;
+  queue.push_back(root);
+  for (unsigned i = 0; i < queue.size(); i++){
+    tree_node* node = queue[i];
+    flat_node f;
+    f.val = node->val;
+    if (node->leaf){
+      f.dim = -1;
+      f.next = flat->leaves.size();
+      flat_leaf fl;
+      fl.constant = node->constant;
+      fl.start = flat->coefficients.size();
+      fl.nCoeffs = node->coefficients.size();
+      fl.nInstances = node->nInstances;
+      flat->coefficients.insert(flat->coefficients.end(),
+                                node->coefficients.begin(),
+                                node->coefficients.end());
+      flat->leaves.push_back(fl);
+    } else {
+      f.dim = node->dim;
+      f.next = queue.size();
+      queue.push_back(node->l);
+      queue.push_back(node->r);
+    }
+    flat->nodes.push_back(f);
+  }
+
+  if (compiled != NULL)
+    releaseCompiled(compiled);
+  compiled = flat;
+  lastLeaf = -1;
+}
+
+
+int M5Tree::traverseCompiled(const std::vector<float> &input){
+  const flat_node* nodes = &(compiled->nodes[0]);
+
+  int i = 0;
+  while (nodes[i].dim >= 0){
+    if (passTest(nodes[i].dim, nodes[i].val, input))
+      i = nodes[i].next;
+    else
+      i = nodes[i].next + 1;
+  }
+
+  return nodes[i].next;
+}
+
+
+void M5Tree::traverseCompiled(const std::vector<std::vector<float> > &inputs, std::vector<int> *leaves){
+  const flat_node* nodes = &(compiled->nodes[0]);
+  leaves->assign(inputs.size(), 0);
+
+  // move every input down one level per pass, so each pass reads
+  // one level of nodes, which are next to each other
+  bool moved = true;
+  while (moved){
+    moved = false;
+    for (unsigned j = 0; j < inputs.size(); j++){
+      int i = (*leaves)[j];
+      if (nodes[i].dim < 0)
+        continue;
+      if (passTest(nodes[i].dim, nodes[i].val, inputs[j]))
+        (*leaves)[j] = nodes[i].next;
+      else
+        (*leaves)[j] = nodes[i].next + 1;
+      moved = true;
+    }
+  }
+
+  // index of the leaf each input reached
+  for (unsigned j = 0; j < inputs.size(); j++){
+    (*leaves)[j] = nodes[(*leaves)[j]].next;
+  }
+}
+
+
+void M5Tree::compiledPrediction(int leaf, const std::vector<float> &input, std::map<float, float>* retval){
+  const flat_leaf &fl = compiled->leaves[leaf];
+  float prediction = fl.constant;
+  int n = fl.nCoeffs;
+  if ((int)input.size() < n)
+    n = input.size();
+
+  // plus each coefficient
+  for (int i = 0; i < n; i++){
+    prediction += compiled->coefficients[fl.start + i] * input[i];
+  }
+  retval->insert(retval->end(), std::pair<float,float>(prediction, 1.0));
+}
+
+
+float M5Tree::compiledConf(int leaf){
+  float conf = (float)compiled->leaves[leaf].nInstances / (float)(2.0*M);
+  if (conf > 1.0)
+    return 1.0;
+  else
+    return conf;
+}
+
+
+void M5Tree::releaseCompiled(flat_tree* tree){
+  tree->refs--;
+  if (tree->refs == 0)
+    delete tree;
 }
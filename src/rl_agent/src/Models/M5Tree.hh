@@ -10,12 +10,13 @@
 
 #include <rl_common/Random.h>
 #include <rl_common/core.hh>
+#include "ExperienceStore.hh"
 #include <vector>
 #include <set>
 #include <map>
+#include <deque>
+#include <pthread.h>
 
-#define N_M5_EXP 200000
-#define N_M5_NODES 2500
 
 #define BUILD_EVERY 0
 #define BUILD_ON_ERROR 1
@@ -23,6 +24,15 @@
 #define BUILD_ON_TERMINAL 3
 #define BUILD_ON_TERMINAL_AND_ERROR 4
 
+/** Default for whether trees keep repeated (input, output) pairs as one weighted experience */
+#define COMPRESS_DUPLICATES false
+
+/** Default most distinct experiences a tree keeps, sampling from all it has seen (0 for no limit) */
+#define TREE_EXPERIENCE_CAP 0
+
+/** The newmat matrix library keeps global trace and error state, so trees fitting linear models (M5 and linear split trees) hold this mutex while using it. */
+extern pthread_mutex_t newmat_mutex;
+
 /** M5 regression tree class */
 class M5Tree: public Classifier {
 
@@ -38,12 +48,13 @@ public:
       \param allowAllFeats all linear regression to use all features, regardless of if they were in the subtree being replaced
       \param min_sdr Minimum standard deviation reduction for a split to be implemented.
       \param rng Random Number Generator 
+      \param store shared store of training inputs (the tree makes its own if NULL)
   */
   M5Tree(int id, int trainMode, int trainFreq, int m, 
          float featPct, bool simple, bool allowAllFeats, 
-	 float min_sdr, Random rng);
+	 float min_sdr, Random rng, ExperienceStore* store = NULL);
 
-  /** Copy constrcutor. */
+  /** Copy constrcutor. The copy shares its nodes and experiences with the original; either tree copies a node or the experience list before it changes it. */
   M5Tree(const M5Tree&);
 
   virtual M5Tree* getCopy();
@@ -53,6 +64,8 @@ public:
   // structs to be defined
   struct tree_node;
   struct tree_experience;
+  struct exp_list;
+  struct flat_tree;
   
     
   /** Tree node struct. For decision nodes, it contains split information and pointers to child nodes. For leaf nodes, the regression coefficients. */
@@ -75,21 +88,55 @@ public:
     float constant;
     std::vector<float> coefficients;
 
+    // # of trees (or parent nodes) pointing at this node
+    int refs;
   };
 
-  /** Experiences the tree is trained on. A vector of inputs and one float output to predict */
+  /** Experiences the tree is trained on. The row of the inputs in the experience store, one float output to predict, and the # of times this pair was seen (always 1 unless duplicates are compressed) */
   struct tree_experience {
-    std::vector<float> input;
+    int row;
     float output;
+    int weight;
+  };
+
+  /** Experiences shared by a tree and its copies. It is append-only: a tree uses the first nUnique, and may append in place as long as no other tree has appended past that. When compressing duplicates, index maps each input (with the output appended) to its place in exps. */
+  struct exp_list {
+    std::deque<tree_experience> exps;
+    std::vector<tree_experience*> ptrs;
+    std::map<std::vector<float>, int> index;
+    int refs;
   };
-  
-  /** Make a copy of the subtree from origNode to newNode */
-  void copyTree(tree_node* newNode, tree_node* origNode);
 
+  /** Node of the compiled tree. Nodes are stored breadth-first. For a decision node, next is the index of the child that passes the test, with the other child right after it. Leaves have dim -1 and next is the index of their flat_leaf. */
+  struct flat_node {
+    int dim;
+    float val;
+    int next;
+  };
+
+  /** Leaf of the compiled tree: its constant and nCoeffs regression coefficients starting at start in the coefficients block. */
+  struct flat_leaf {
+    float constant;
+    int start;
+    int nCoeffs;
+    int nInstances;
+  };
+
+  /** The tree compiled into contiguous arrays for fast predictions, with the leaf models kept apart from the nodes. It is replaced after each build and shared with copies of the tree. */
+  struct flat_tree {
+    std::vector<flat_node> nodes;
+    std::vector<flat_leaf> leaves;
+    std::vector<float> coefficients;
+    int refs;
+  };
+  
   virtual bool trainInstance(classPair &instance);
   virtual bool trainInstances(std::vector<classPair> &instances);
   virtual void testInstance(const std::vector<float> &input, std::map<float, float>* retval);
   virtual float getConf(const std::vector<float> &input);
+  virtual void testInstances(const std::vector<std::vector<float> > &inputs,
+                             std::vector<std::map<float, float> >* retval,
+                             std::vector<float>* confs);
 
   /** Build the tree with the given instances from the given tree node */
   void buildTree(tree_node* node, const std::vector<tree_experience*> &instances,  bool changed);
@@ -113,6 +160,9 @@ public:
   /** Determine if the input passes the test defined by dim, val, type */
   bool passTest(int dim, float val, const std::vector<float> &input);
 
+  /** Determine if the stored input of an experience passes the test defined by dim, val */
+  bool passTest(int dim, float val, const tree_experience* e);
+
   /** Calculate the reduction in standard deviation on each side of the proposed tree split */
   float calcSDR(int dim, float val, 
 		       const std::vector<tree_experience*> &instances, float sd,
@@ -125,8 +175,53 @@ public:
   /** Get all the unique values of the features on dimension dim */
   std::set<float> getUniques(int dim, const std::vector<tree_experience*> &instances, float & minVal, float& maxVal);
 
-  /** Delete this tree node and all nodes below it in the tree. */
-  void deleteTree(tree_node* node);
+  /** Drop a reference to this tree node, deleting it and releasing its children when it has none left. */
+  void releaseNode(tree_node* node);
+
+  /** Return a node only this tree points at, copying the given one if it is shared. The caller must store the result in place of the node. */
+  tree_node* unshareNode(tree_node* node);
+
+  /** Add an experience to the end of our experience list, first copying the list if another tree has appended to it. The input is appended to the store if row is -1. When compressing duplicates, a pair we already have just gets its weight increased. */
+  tree_experience* addExperience(const std::vector<float> &input, int row, float output);
+
+  /** Replace our experience list with a copy of the part of it we use, which only we point at, with the pending weights added */
+  void copyExperiences();
+
+  /** Add the weights of duplicates seen while our experience list was shared, copying the list if it still is */
+  void addPendingWeights();
+
+  /** Keep repeated (input, output) pairs as a single experience with a weight, so builds scale with the # of distinct experiences. Must be set before training. */
+  virtual void setCompressDuplicates(bool compress);
+
+  /** Sum of the weights of the given experiences */
+  int totalWeight(const std::vector<tree_experience*> &instances);
+
+  /** Keep at most cap distinct experiences (0 for no limit). Once full, each new experience replaces a random one with probability cap / # seen (reservoir sampling), so the tree is trained on a uniform sample of everything it has seen. The tree then keeps its own experience store, which is compacted as it fills up with replaced inputs. Must be set before training. */
+  virtual void setExperienceCap(int cap);
+
+  /** Copy the inputs of our experiences into a new store, dropping the ones that were replaced */
+  void compactStore();
+
+  /** Drop a reference to an experience list, deleting it when it has none left. */
+  void releaseExperiences(exp_list* list);
+
+  /** Compile the tree into breadth-first arrays used for predictions */
+  void compileTree();
+
+  /** Follow the compiled tree to a leaf for the given input, returning the index of the leaf */
+  int traverseCompiled(const std::vector<float> &input);
+
+  /** Follow a batch of inputs through the compiled tree together, one level at a time, filling in the index of the leaf each one reaches */
+  void traverseCompiled(const std::vector<std::vector<float> > &inputs, std::vector<int> *leaves);
+
+  /** Get the prediction of the given compiled leaf for this input */
+  void compiledPrediction(int leaf, const std::vector<float> &input, std::map<float, float>* retval);
+
+  /** Get the confidence of the given compiled leaf */
+  float compiledConf(int leaf);
+
+  /** Drop a reference to a compiled tree, deleting it when it has none left. */
+  void releaseCompiled(flat_tree* tree);
 
   /** Calculate the standard deviation for the given vector of experiences */
   float calcSDforSet(const std::vector<tree_experience*> &instances);
@@ -182,14 +277,8 @@ public:
   /** Determine the features used for splits in the given subtree */
   void getFeatsUsed(tree_node* node, std::vector<bool> *featsUsed);
 
-  /** Allocate a new node from our pre-allocated store of tree nodes */
+  /** Allocate and initialize a new tree node */
   tree_node* allocateNode();
-  
-  /** Return tree node back to store of nodes */
-  void deallocateNode(tree_node* node);
-  
-  /** Initialize our store of tree nodes */
-  void initNodes();
 
   bool INCDEBUG;
   bool DTDEBUG;
@@ -225,21 +314,39 @@ private:
   int maxnodes;
 
   // INSTANCES
-  /** Vector of all experiences used to train the tree */
-  std::vector<tree_experience*> experiences;
-  
-  /** Pre-allocated array of experiences to be filled during training. */
-  tree_experience allExp[N_M5_EXP];
-  
-  /** Pre-allocated array of tree nodes to be used for tree */
-  tree_node allNodes[N_M5_NODES];
-  std::vector<int> freeNodes;
+  /** All experiences used to train the tree, possibly shared with copies of the tree */
+  exp_list* experiences;
+
+  /** # of experiences in the list that are ours (less than nExperiences if duplicates are compressed) */
+  int nUnique;
+
+  /** Keep duplicates as weighted experiences */
+  bool compress;
+
+  /** Indices of experiences seen again while the list was shared with a copy of the tree. Their weights are added when the tree is next built, rather than copying the list for each one. */
+  std::vector<int> pendingWeights;
+
+  /** Most distinct experiences to keep, or 0 */
+  int cap;
+
+  /** Whether an experience was replaced since the last build, so the whole tree must be rebuilt */
+  bool replaced;
+
+  /** Store holding the inputs of our experiences. */
+  ExperienceStore* store;
 
   // TREE
   /** Pointer to root node of tree. */
   tree_node* root;
-  /** Pointer to last node of tree used (leaf used in last prediction made). */
-  tree_node* lastNode;
+
+  /** Compiled form of the tree, used for predictions. */
+  flat_tree* compiled;
+
+  /** Index of the compiled leaf used in the last prediction made, or -1. */
+  int lastLeaf;
+
+  /** Leaves reached by the last batch of inputs. */
+  std::vector<int> batchLeaves;
 
 };
 
@@ -12,14 +12,15 @@ MultipleClassifiers::MultipleClassifiers(int id, int modelType, int predType,
                                          int trainFreq,
                                          float featPct, float expPct,
                                          float treeThreshold, bool stoch,
-                                         float featRange, Random rng):
+                                         float featRange, Random rng,
+                                         ExperienceStore* store):
   id(id), modelType(modelType), predType(predType), nModels(nModels),
   mode(trainMode), freq(trainFreq),
   featPct(featPct), expPct(expPct), 
   treeThresh(treeThreshold), stoch(stoch), 
   addNoise(!stoch && (modelType == M5MULTI || modelType == M5SINGLE || modelType == M5ALLMULTI || modelType == M5ALLSINGLE || modelType == LSTMULTI || modelType == LSTSINGLE)),
   featRange(featRange),
-  rng(rng)
+  rng(rng), store(store), cap(0), pool(ThreadPool::shared())
 {
   STDEBUG = false;//true;
   ACC_DEBUG = false;//true;
@@ -33,6 +34,11 @@ MultipleClassifiers::MultipleClassifiers(int id, int modelType, int predType,
   for (int i = -1; i < id; i++)
     rng.uniform(0,1);
 
+  // members share one store of inputs, so each input is only kept once
+  if (store == NULL)
+    this->store = new ExperienceStore();
+  else
+    store->retain();
 
   initModels();
 
@@ -43,7 +49,7 @@ MultipleClassifiers::MultipleClassifiers(const MultipleClassifiers &t):
   mode(t.mode), freq(t.freq),
   featPct(t.featPct), expPct(t.expPct), 
   treeThresh(t.treeThresh), stoch(t.stoch), addNoise(t.addNoise),
-  featRange(t.featRange), rng(t.rng)
+  featRange(t.featRange), rng(t.rng), store(t.store), cap(t.cap), pool(t.pool)
 {
   COPYDEBUG = t.COPYDEBUG;
   if (COPYDEBUG) cout << "  MC copy constructor id " << id << endl;
@@ -52,6 +58,7 @@ MultipleClassifiers::MultipleClassifiers(const MultipleClassifiers &t):
   PRED_DEBUG = t.PRED_DEBUG;
   CONF_DEBUG = t.CONF_DEBUG;
   nsteps = t.nsteps;
+  store->retain();
 
   accuracy = t.accuracy;
 
@@ -81,6 +88,7 @@ MultipleClassifiers::~MultipleClassifiers() {
   models.clear();
   accuracy.clear();
   infos.clear();
+  store->release();
 }
 
 
@@ -94,17 +102,22 @@ bool MultipleClassifiers::trainInstances(std::vector<classPair> &instances){
     subsets[i].reserve(instances.size());
   }
 
+  std::vector<int> origRows(instances.size());
+
   for (unsigned j = 0; j < instances.size(); j++){
     bool didUpdate = false;
+
+    // store the input once for all the models
+    origRows[j] = instances[j].row;
+    if (instances[j].row < 0 && cap == 0)
+      instances[j].row = store->append(instances[j].in);
     
     // train each model
     for (int i = 0; i < nModels; i++){
       
       // check accuracy of this model
       if (predType == BEST || predType == WEIGHTAVG){
-	for (unsigned j = 0; j < instances.size(); j++){
-	  updateModelAccuracy(i, instances[j].in, instances[j].out);
-	}
+        updateModelAccuracy(i, instances[j].in, instances[j].out);
       }
 
       // create new vector with some random subset of experiences
@@ -126,19 +139,12 @@ bool MultipleClassifiers::trainInstances(std::vector<classPair> &instances){
       subsets[model].push_back(instances[j]);
       if (addNoise) instances[j].out = origOutput;
     }
+    instances[j].row = origRows[j];
+    nsteps++;
   } // instances loop
     
-  // now update models
-  for (int i = 0; i < nModels; i++){
-    if (subsets[i].size() > 0){
-      if (STDEBUG) cout << id << " train model " << i << " on subset of size "
-                        << subsets[i].size() << endl;
-      bool singleChange = models[i]->trainInstances(subsets[i]);
-      changed = changed || singleChange;
-    }
-  }
-  
-  nsteps += instances.size();
+  // now update models, all at once
+  changed = trainModels(subsets, false);
 
   return changed;
 }
@@ -149,7 +155,14 @@ bool MultipleClassifiers::trainInstance(classPair &instance){
 
   bool changed = false;
 
-  // train each model
+  // store the input once for all the models
+  int origRow = instance.row;
+  if (instance.row < 0 && cap == 0)
+    instance.row = store->append(instance.in);
+
+  // pick which models get the instance (with their own noise) first,
+  // so that they can all be trained at once
+  std::vector< std::vector<classPair> >subsets(nModels);
   bool didUpdate = false;
   for (int i = 0; i < nModels; i++){
 
@@ -161,24 +174,21 @@ bool MultipleClassifiers::trainInstance(classPair &instance){
     // update with new experience
     if (rng.uniform() < expPct){
       didUpdate = true;
-      float origOutput = instance.out;
-      if (addNoise) instance.out += rng.uniform(-0.2,0.2)*treeThresh;
-      bool singleChange = models[i]->trainInstance(instance);
-      if (addNoise) instance.out = origOutput;
-      changed = changed || singleChange;
+      subsets[i].push_back(instance);
+      if (addNoise) subsets[i][0].out += rng.uniform(-0.2,0.2)*treeThresh;
     }
   }
 
   // make sure some model got the transition
   if (!didUpdate){
     int model = rng.uniformDiscrete(0,nModels-1);
-    float origOutput = instance.out;
-    if (addNoise) instance.out += rng.uniform(-0.2,0.2)*treeThresh;
-    bool singleChange = models[model]->trainInstance(instance);
-    if (addNoise) instance.out = origOutput;
-    changed = singleChange || changed;
+    subsets[model].push_back(instance);
+    if (addNoise) subsets[model][0].out += rng.uniform(-0.2,0.2)*treeThresh;
   }
 
+  changed = trainModels(subsets, true);
+  instance.row = origRow;
+
   nsteps++;
 
   return changed;
@@ -186,17 +196,61 @@ bool MultipleClassifiers::trainInstance(classPair &instance){
 }
 
 
-// get all the models outputs and combine them somehow
-void MultipleClassifiers::testInstance(const std::vector<float> &input, std::map<float, float>* retval){
-  if (STDEBUG) cout << id << " testInstance" << endl;
+/** Arguments for training each model of the ensemble on the thread pool */
+struct train_job {
+  MultipleClassifiers* mc;
+  std::vector< std::vector<classPair> >* subsets;
+  std::vector<int> toTrain;
+  std::vector<int> changed;
+  bool single;
+};
+
+// train one of the models picked in trainModels
+void MultipleClassifiers::trainModelTask(void* arg, int k){
+  train_job* job = (train_job*)arg;
+  int i = job->toTrain[k];
+  std::vector<classPair> &subset = (*job->subsets)[i];
+  Classifier* model = job->mc->models[i];
+
+  if (job->single)
+    job->changed[k] = model->trainInstance(subset[0]);
+  else
+    job->changed[k] = model->trainInstances(subset);
+}
 
-  if ((int)infos.size() != nModels){
-    infos.resize(nModels);
+bool MultipleClassifiers::trainModels(std::vector< std::vector<classPair> > &subsets, bool single){
+
+  // predictions we kept may change
+  clearPredictions();
+
+  train_job job;
+  job.mc = this;
+  job.subsets = &subsets;
+  job.single = single;
+  for (int i = 0; i < nModels; i++){
+    if (subsets[i].size() > 0){
+      if (STDEBUG) cout << id << " train model " << i << " on subset of size "
+                        << subsets[i].size() << endl;
+      job.toTrain.push_back(i);
+    }
   }
+  job.changed.resize(job.toTrain.size(), false);
 
-  for (unsigned i = 0; i < infos.size(); i++){
-    infos[i].clear();
+  // models only touch their own trees and rng, and read the shared
+  // store, which already holds every input, so they can be trained at once
+  pool->parallelFor(job.toTrain.size(), trainModelTask, &job);
+
+  bool changed = false;
+  for (unsigned k = 0; k < job.changed.size(); k++){
+    changed = changed || job.changed[k];
   }
+  return changed;
+}
+
+
+// get all the models outputs and combine them somehow
+void MultipleClassifiers::testInstance(const std::vector<float> &input, std::map<float, float>* retval){
+  if (STDEBUG) cout << id << " testInstance" << endl;
 
   retval->clear();
 
@@ -206,20 +260,11 @@ void MultipleClassifiers::testInstance(const std::vector<float> &input, std::map
 
   ///////////////////////////////////
   // return best
+  // (keeping its prediction for getConf)
   if (predType == BEST){
-    float acc = -1.0;
-    int best = -1;
-    for (int i = 0; i < nModels; i++){
-      if (PRED_DEBUG) cout << "Model " << i << " has acc "
-                           << accuracy[i] << endl;
-      if (accuracy[i] > acc){
-        acc = accuracy[i];
-        best = i;
-      }
-    }
-    if (PRED_DEBUG) cout << id << " Returning model " << best
-                         << " with accuracy " << acc << endl;
-    models[best]->testInstance(input, retval);
+    int best = bestModel();
+    memberPrediction(best, input);
+    *retval = infos[best];
     return;
   }
   //////////////////////////////////////
@@ -228,28 +273,210 @@ void MultipleClassifiers::testInstance(const std::vector<float> &input, std::map
   /////////////////////////////////////////
   // calculate weights for weighted avg
   std::vector<float> weights(nModels, 1.0);
-  if (predType == WEIGHTAVG){
-    float accSum = 0.0;
-    
-    for (int j = 0; j < nModels; j++){
-      accSum += accuracy[j];
+  calcWeights(&weights);
+  /////////////////////////////////////////
+
+  // get state action info from each tree in our set
+  memberPredictions(input);
+
+  combinePredictions(weights, retval);
+}
+
+
+int MultipleClassifiers::getNumMembers(){
+  return nModels;
+}
+
+
+// just one model's prediction, as for a sampled uct rollout
+void MultipleClassifiers::testMember(int member, const std::vector<float> &input, std::map<float, float>* retval){
+  if (STDEBUG) cout << id << " testMember " << member << endl;
+
+  // possibly have to init our model
+  if ((int)models.size() != nModels)
+    initModels();
+
+  retval->clear();
+  models[member]->testInstance(input, retval);
+}
+
+
+bool MultipleClassifiers::saveModel(std::ostream &out){
+
+  out.write((char*)&nModels, sizeof(int));
+  out.write((char*)&nsteps, sizeof(int));
+  out.write((char*)&(accuracy[0]), sizeof(float)*nModels);
+
+  for (int i = 0; i < nModels; i++){
+    if (!models[i]->saveModel(out))
+      return false;
+  }
+
+  return out.good();
+}
+
+
+bool MultipleClassifiers::loadModel(std::istream &in){
+
+  int n = 0;
+  in.read((char*)&n, sizeof(int));
+  if (!in.good() || n != nModels){
+    cout << "MultClass " << id << " has " << nModels << " models, not " << n << endl;
+    return false;
+  }
+  in.read((char*)&nsteps, sizeof(int));
+  in.read((char*)&(accuracy[0]), sizeof(float)*nModels);
+
+  for (int i = 0; i < nModels; i++){
+    if (!models[i]->loadModel(in))
+      return false;
+  }
+
+  clearPredictions();
+
+  return true;
+}
+
+
+void MultipleClassifiers::setCompressDuplicates(bool compress){
+  for (int i = 0; i < nModels; i++){
+    models[i]->setCompressDuplicates(compress);
+  }
+}
+
+void MultipleClassifiers::setExperienceCap(int cap){
+  this->cap = cap;
+  for (int i = 0; i < nModels; i++){
+    models[i]->setExperienceCap(cap);
+  }
+}
+
+
+int MultipleClassifiers::bestModel(){
+  float acc = -1.0;
+  int best = -1;
+  for (int i = 0; i < nModels; i++){
+    if (PRED_DEBUG) cout << "Model " << i << " has acc "
+                         << accuracy[i] << endl;
+    if (accuracy[i] > acc){
+      acc = accuracy[i];
+      best = i;
     }
+  }
+  if (PRED_DEBUG) cout << id << " Returning model " << best
+                       << " with accuracy " << acc << endl;
+  return best;
+}
 
-    if (accSum > 0.0){
-      for (int j  = 0; j < nModels; j++){
-        weights[j] = (float)nModels * accuracy[j] / accSum;
-        if (PRED_DEBUG || ACC_DEBUG) cout << "Model " << j << " acc: "
-                                          << accuracy[j] << " weight: "
-                                          << weights[j] << endl;
-      }
+
+void MultipleClassifiers::memberPredictions(const std::vector<float> &input){
+  for (int i = 0; i < nModels; i++){
+    memberPrediction(i, input);
+  }
+}
+
+
+void MultipleClassifiers::memberPrediction(int i, const std::vector<float> &input){
+
+  if ((int)infos.size() != nModels){
+    infos.resize(nModels);
+  }
+
+  // a new input, none of the predictions we have are for it
+  if ((int)haveInfo.size() != nModels || input != infoInput){
+    haveInfo.assign(nModels, false);
+    infoInput = input;
+  }
+
+  if (haveInfo[i])
+    return;
+
+  infos[i].clear();
+  models[i]->testInstance(input, &(infos[i]));
+  haveInfo[i] = true;
+}
+
+
+void MultipleClassifiers::clearPredictions(){
+  haveInfo.clear();
+}
+
+
+void MultipleClassifiers::testInstances(const std::vector<std::vector<float> > &inputs,
+                                        std::vector<std::map<float, float> >* retval,
+                                        std::vector<float>* confs){
+  if (STDEBUG) cout << id << " testInstances: " << inputs.size() << endl;
+
+  // possibly have to init our model
+  if ((int)models.size() != nModels)
+    initModels();
+
+  // only the best model is needed if we don't want confidences
+  if (predType == BEST && confs == NULL){
+    models[bestModel()]->testInstances(inputs, retval, NULL);
+    return;
+  }
+
+  if ((int)infos.size() != nModels){
+    infos.resize(nModels);
+  }
+
+  retval->resize(inputs.size());
+  if (confs != NULL) confs->resize(inputs.size());
+
+  if (inputs.size() == 0)
+    return;
+
+  std::vector<float> weights(nModels, 1.0);
+  calcWeights(&weights);
+
+  // each model goes through the whole batch at once
+  batchInfos.resize(nModels);
+  for (int j = 0; j < nModels; j++){
+    models[j]->testInstances(inputs, &(batchInfos[j]), NULL);
+  }
+
+  // then combine them for each input, as in testInstance
+  int best = (predType == BEST) ? bestModel() : -1;
+  for (unsigned k = 0; k < inputs.size(); k++){
+    for (int j = 0; j < nModels; j++){
+      infos[j].swap(batchInfos[j][k]);
     }
+    infoInput = inputs[k];
+    haveInfo.assign(nModels, true);
+
+    (*retval)[k].clear();
+    if (predType == BEST)
+      (*retval)[k] = infos[best];
+    else
+      combinePredictions(weights, &((*retval)[k]));
+    if (confs != NULL) (*confs)[k] = getConf(inputs[k]);
   }
-  /////////////////////////////////////////
+}
 
-  // get state action info from each tree in our set
+
+void MultipleClassifiers::calcWeights(std::vector<float>* weights){
+  if (predType != WEIGHTAVG)
+    return;
+
+  float accSum = 0.0;
+    
   for (int j = 0; j < nModels; j++){
-    models[j]->testInstance(input, &(infos[j]));
+    accSum += accuracy[j];
+  }
+
+  if (accSum > 0.0){
+    for (int j  = 0; j < nModels; j++){
+      (*weights)[j] = (float)nModels * accuracy[j] / accSum;
+      if (PRED_DEBUG || ACC_DEBUG) cout << "Model " << j << " acc: "
+                                        << accuracy[j] << " weight: "
+                                        << (*weights)[j] << endl;
+    }
   }
+}
+
+
+void MultipleClassifiers::combinePredictions(const std::vector<float> &weights, std::map<float, float>* retval){
 
   // make a list of all outcomes any model predicted
   for (int i = 0; i < nModels; i++){
@@ -294,18 +521,13 @@ void MultipleClassifiers::testInstance(const std::vector<float> &input, std::map
 float MultipleClassifiers::getConf(const std::vector<float> &input){
   if (STDEBUG || CONF_DEBUG) cout << id << " getConf" << endl;
 
-  if ((int)infos.size() != nModels){
-    infos.resize(nModels);
-  }
+  // possibly have to init our model
+  if ((int)models.size() != nModels)
+    initModels();
 
   // get predictions if we haven't
-  if (predType == BEST || predType == SEPARATE){
-    if (CONF_DEBUG) cout << "conf: getting predictions again" << endl;
-    for (int j = 0; j < nModels; j++){
-      infos[j].clear();
-      models[j]->testInstance(input, &(infos[j]));
-    }
-  }
+  // (testInstance on this input already made them, except with BEST)
+  memberPredictions(input);
 
   float conf = 0;
 
@@ -353,12 +575,15 @@ float MultipleClassifiers::klDivergence(const std::vector<float> &input){
           continue;
         }
 
+        // look it up without adding it, since infos may be reused
+        std::map<float, float>::iterator jt = infos[j].find(outcome);
+        float jProb = (jt == infos[j].end()) ? 0.0 : jt->second;
+
         if (CONF_DEBUG) 
           cout << "model " << i << " predicts " << outcome << " with prob " 
                << prob << ", model " << j << " has prob " 
-               << infos[j][outcome] << endl;
+               << jProb << endl;
 
-        float jProb = infos[j][outcome];
         if (jProb == 0) jProb = 0.01;
 
         singleKL += prob * log(prob / jProb);
@@ -417,35 +642,35 @@ void MultipleClassifiers::initModels(){
   for (int i = 0; i < nModels; i++){
 
     if (modelType == C45TREE){
-      models[i] = new C45Tree(id + i*(1+nModels), mode, freq, 0, featPct, rng);
+      models[i] = new C45Tree(id + i*(1+nModels), mode, freq, 0, featPct, rng, store);
     }
     else if (modelType == M5MULTI){
-      models[i] = new M5Tree(id + i*(1+nModels), mode, freq, 0, featPct, false, false, treeThresh, rng);
+      models[i] = new M5Tree(id + i*(1+nModels), mode, freq, 0, featPct, false, false, treeThresh, rng, store);
     }
     else if (modelType == M5ALLMULTI){
-      models[i] = new M5Tree(id + i*(1+nModels), mode, freq, 0, featPct, false, true, treeThresh, rng);
+      models[i] = new M5Tree(id + i*(1+nModels), mode, freq, 0, featPct, false, true, treeThresh, rng, store);
     }
     else if (modelType == M5ALLSINGLE){
-      models[i] = new M5Tree(id + i*(1+nModels), mode, freq, 0, featPct, true, true, treeThresh, rng);
+      models[i] = new M5Tree(id + i*(1+nModels), mode, freq, 0, featPct, true, true, treeThresh, rng, store);
     }
     else if (modelType == M5SINGLE){
-      models[i] = new M5Tree(id + i*(1+nModels), mode, freq, 0, featPct, true, false, treeThresh, rng);
+      models[i] = new M5Tree(id + i*(1+nModels), mode, freq, 0, featPct, true, false, treeThresh, rng, store);
     }
     else if (modelType == LSTSINGLE){
-      models[i] = new LinearSplitsTree(id + i*(1+nModels), mode, freq, 0, featPct, true, treeThresh, rng);
+      models[i] = new LinearSplitsTree(id + i*(1+nModels), mode, freq, 0, featPct, true, treeThresh, rng, store);
     }
     else if (modelType == LSTMULTI){
-      models[i] = new LinearSplitsTree(id + i*(1+nModels), mode, freq, 0, featPct, false, treeThresh, rng);
+      models[i] = new LinearSplitsTree(id + i*(1+nModels), mode, freq, 0, featPct, false, treeThresh, rng, store);
     }
     else if (modelType == STUMP){
-      models[i] = new Stump(id + i*(1+nModels), mode, freq, 0, featPct, rng);
+      models[i] = new Stump(id + i*(1+nModels), mode, freq, 0, featPct, rng, store);
     }
     else if (modelType == ALLM5TYPES){
       // select an m5 type randomly.  so multivariate v single and allfeats v subtree feats
       bool simple = rng.bernoulli(0.5);
       bool allFeats = rng.bernoulli(0.5);
       //cout << "ALL types init tree " << i << " with simple: " << simple << " and allFeats: " << allFeats << endl;
-      models[i] = new M5Tree(id + i*(1+nModels), mode, freq, 0, featPct, simple, allFeats, treeThresh, rng);
+      models[i] = new M5Tree(id + i*(1+nModels), mode, freq, 0, featPct, simple, allFeats, treeThresh, rng, store);
     }
     else {
       cout << "Invalid model type for this committee" << endl;
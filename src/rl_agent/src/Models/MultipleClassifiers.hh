@@ -11,6 +11,7 @@
 #include "../Models/LinearSplitsTree.hh"
 
 #include "../Models/Stump.hh"
+#include "../Models/ThreadPool.hh"
 
 #include <rl_common/Random.h>
 #include <rl_common/core.hh>
@@ -35,11 +36,13 @@ public:
       \param treeThreshold determines the amount of error to be tolerated in the tree (prevents over-fitting with larger and larger trees)
       \param stoch if the domain is stochastic or deterministic
       \param rng Random Number Generator 
+      \param store shared store of training inputs (one is made for the ensemble if NULL)
   */
   MultipleClassifiers(int id, int modelType, int predType, int nModels, 
                       int trainMode, int trainFreq,
                       float featPct, float expPct, float treeThreshold,
-                      bool stoch, float featRange, Random rng);
+                      bool stoch, float featRange, Random rng,
+                      ExperienceStore* store = NULL);
 
   /** Copy constructor */
   MultipleClassifiers(const MultipleClassifiers&);
@@ -51,6 +54,23 @@ public:
   virtual bool trainInstance(classPair &instance);
   virtual void testInstance(const std::vector<float> &input, std::map<float, float>* retval);
   virtual float getConf(const std::vector<float> &s);
+  virtual void testInstances(const std::vector<std::vector<float> > &inputs,
+                             std::vector<std::map<float, float> >* retval,
+                             std::vector<float>* confs);
+  virtual int getNumMembers();
+  virtual void testMember(int member, const std::vector<float> &input, std::map<float, float>* retval);
+
+  /** Write the accuracy of each model and then the models themselves. */
+  virtual bool saveModel(std::ostream &out);
+
+  /** Read an ensemble written by saveModel, which must have the same # of models. */
+  virtual bool loadModel(std::istream &in);
+
+  /** Have each of the models compress duplicate experiences */
+  virtual void setCompressDuplicates(bool compress);
+
+  /** Cap the experiences of each of the models */
+  virtual void setExperienceCap(int cap);
   
   /** Update measure of accuracy for model if we're using best model only */
   void updateModelAccuracy(int i, const std::vector<float> &input, float out);
@@ -64,6 +84,30 @@ public:
   /** Calculate the variance of the model's predictions of continuous values */
   float variance(const std::vector<float> &input);
 
+  /** Calculate the weight of each model's predictions, by accuracy if we're doing a weighted average */
+  void calcWeights(std::vector<float>* weights);
+
+  /** Train each model on its subset of instances (one instance each if single is set), with the models trained in parallel. Returns true if any of them changed. */
+  bool trainModels(std::vector< std::vector<classPair> > &subsets, bool single);
+
+  /** Thread pool task that trains one of the models */
+  static void trainModelTask(void* arg, int k);
+
+  /** Combine the predictions of the models in infos into one distribution */
+  void combinePredictions(const std::vector<float> &weights, std::map<float, float>* retval);
+
+  /** Get the prediction of each model for this input into infos, keeping any already made for the same input */
+  void memberPredictions(const std::vector<float> &input);
+
+  /** Get the prediction of model i for this input into infos, unless it is already there */
+  void memberPrediction(int i, const std::vector<float> &input);
+
+  /** Forget the predictions cached in infos, after the models change */
+  void clearPredictions();
+
+  /** Index of the model with the best accuracy */
+  int bestModel();
+
   bool STDEBUG;
   bool PRED_DEBUG;
   bool ACC_DEBUG;
@@ -90,10 +134,28 @@ private:
   
   Random rng;
 
+  /** Store of training inputs shared by all the models in the ensemble. */
+  ExperienceStore* store;
+
+  /** Experience cap of the models, which then keep their inputs themselves */
+  int cap;
+
+  /** Pool of threads the models are trained on. */
+  ThreadPool* pool;
+
   std::vector<float> accuracy;
   int nsteps;
   std::vector<std::map<float, float> >infos;
 
+  /** Input the predictions in infos were made for. testInstance and getConf on the same input share them, so each model is only tested once. */
+  std::vector<float> infoInput;
+
+  /** Whether infos holds model i's prediction for infoInput */
+  std::vector<bool> haveInfo;
+
+  /** Predictions of each model for the last batch of inputs. */
+  std::vector<std::vector<std::map<float, float> > > batchInfos;
+
 };
 
 
@@ -5,6 +5,8 @@
 
 #include "RMaxModel.hh"
 
+#include <string.h>
+
 
 
 
@@ -13,29 +15,24 @@ RMaxModel::RMaxModel(int m, int nact, Random rng):
 {
 
   nstates = 0;
+  stateStart.push_back(0);
   RMAX_DEBUG = false; //true;
-  //initMDPModel(nfactors);  
+  //initMDPModel(nfactors);
 }
 
 RMaxModel::RMaxModel(const RMaxModel &rm):
-M(rm.M), nact(rm.nact), rng(rm.rng)
+  stateTable(rm.stateTable), stateFeats(rm.stateFeats),
+  stateStart(rm.stateStart), stateHash(rm.stateHash),
+  visits(rm.visits), terminations(rm.terminations),
+  Rsum(rm.Rsum), known(rm.known),
+  outcomes(rm.outcomes), nOutcomes(rm.nOutcomes),
+  M(rm.M), nact(rm.nact), rng(rm.rng)
 {
 
+  // ids are indices, so everything copies as is
   nstates = rm.nstates;
   RMAX_DEBUG = rm.RMAX_DEBUG;
 
-  statespace = rm.statespace;
-
-  // copy info into map for each of these
-  // because map is by address, must get correct address for each
-  for (std::map<state_t, state_info>::const_iterator i = rm.statedata.begin();
-       i != rm.statedata.end(); i++){
-
-    state_t s = canonicalize(*((*i).first));
-    statedata[s] = (*i).second;
-
-  }
-
 }
 
 RMaxModel* RMaxModel::getCopy(){
@@ -49,7 +46,7 @@ RMaxModel::~RMaxModel() {}
 bool RMaxModel::updateWithExperiences(std::vector<experience> &instances){
 
   bool changed = false;
-  
+
   for (unsigned i = 0; i < instances.size(); i++){
     bool singleChange = updateWithExperience(instances[i]);
     changed = changed || singleChange;
@@ -61,51 +58,46 @@ bool RMaxModel::updateWithExperiences(std::vector<experience> &instances){
 // update all the counts, check if model has changed
 // stop counting at M
 bool RMaxModel::updateWithExperience(experience &e){
-  if (RMAX_DEBUG) cout << "updateWithExperience " << &(e.s) << ", " << e.act 
+  if (RMAX_DEBUG) cout << "updateWithExperience " << &(e.s) << ", " << e.act
                        << ", " << &(e.next) << ", " << e.reward << endl;
 
-  // get state info for last state
-  state_t l = canonicalize(e.s);
-  state_info* info = &(statedata[l]);
+  // get state-action index for last state
+  int l = getStateId(e.s);
+  int sa = l * nact + e.act;
 
   bool modelChanged = false;
 
   // stop at M
-  //if (info->visits[e.act] == M)
-  if (info->known[e.act])
+  if (known[sa])
     return false;
 
   // update visit count for action just executed
-  info->visits[e.act]++;
+  visits[sa]++;
 
   // update termination count
-  if (e.terminal) info->terminations[e.act]++;
+  if (e.terminal) terminations[sa]++;
 
   // update reward sum for this action
-  info->Rsum[e.act] += e.reward;
-
-  // update transition count for outcome that occured
-  std::vector<int> &transCounts = info->outCounts[e.next];
-
-  // first, check that we have resized this counter
-  checkTransitionCountSize(&transCounts);
+  Rsum[sa] += e.reward;
 
   // only update state transition counts for non-terminal transitions
   if (!e.terminal){
-    // then update transition count for this action/outcome
-    transCounts[e.act]++;
-  }    
+    addOutcome(sa, getStateId(e.next));
+  }
 
-  // check if count becomes known 
-  if (!info->known[e.act] && info->visits[e.act] >= M){
-    info->known[e.act] = true;
+  // visits changed, so all the outcome probabilities did
+  updateOutcomeProbs(sa);
+
+  // check if count becomes known
+  if (!known[sa] && visits[sa] >= M){
+    known[sa] = true;
     modelChanged = true;
   }
 
-  if (RMAX_DEBUG) cout << "s" << info->id << " act: " << e.act 
-                               << " transCounts[act] = " << transCounts[e.act] 
-                               << " visits[act] = " << info->visits[e.act] << endl;
-  
+  if (RMAX_DEBUG) cout << "s" << l << " act: " << e.act
+                       << " outcomes = " << nOutcomes[sa]
+                       << " visits[act] = " << visits[sa] << endl;
+
   // anything that got past the 'return false' above is a change in conf or predictions
   return true; //modelChanged;
 
@@ -119,13 +111,12 @@ float RMaxModel::getStateActionInfo(const std::vector<float> &state, int act, St
 
   retval->transitionProbs.clear();
 
-  // get state-action info for this state
-  state_t l = canonicalize(state);
-  state_info* info = &(statedata[l]);
+  // get state-action index for this state
+  int sa = getStateId(state) * nact + act;
+
 
-  
   // see if it has any visits (could still be unknown)
-  if (info->visits[act] == 0){
+  if (visits[sa] == 0){
     if (RMAX_DEBUG) cout << "This outcome is unknown" << endl;
     retval->reward = -0.001;
 
@@ -135,43 +126,43 @@ float RMaxModel::getStateActionInfo(const std::vector<float> &state, int act, St
     retval->termProb = 0.0;
     return 0;
   }
-  
-  
-  // fill in transition probs
-  for (std::map<std::vector<float>, std::vector<int> >::iterator it = info->outCounts.begin(); 
-       it != info->outCounts.end(); it++){
 
-    // get key from iterator
-    std::vector<float> next = (*it).first;
-    int count = ((*it).second)[act];
 
-    // add to transition map
-    if (count > 0 && info->visits[act] > info->terminations[act]){
-      retval->transitionProbs[next] = (float)count / (float)(info->visits[act] - info->terminations[act]);
-      if (RMAX_DEBUG) cout << "Outcome " << &next << " has prob " << retval->transitionProbs[next]
-			   << " from count of " << count << " on " 
-			   << info->visits[act] << " visits." << endl;
+  // fill in transition probs, already normalized
+  if (visits[sa] > terminations[sa]){
+    std::vector<outcome_slot> &table = outcomes[sa];
+    for (unsigned i = 0; i < table.size(); i++){
+      if (table[i].next < 0 || table[i].count == 0) continue;
+
+      // add to transition map, with the state vector as key
+      int start = stateStart[table[i].next];
+      int end = stateStart[table[i].next+1];
+      std::vector<float> next(stateFeats.begin() + start, stateFeats.begin() + end);
+      retval->transitionProbs[next] = table[i].prob;
+      if (RMAX_DEBUG) cout << "Outcome " << table[i].next << " has prob " << table[i].prob
+                           << " from count of " << table[i].count << " on "
+                           << visits[sa] << " visits." << endl;
     }
   }
-  
+
 
   // add in avg rewrad
-  retval->reward = (float)info->Rsum[act] / (float)info->visits[act];
-  if (RMAX_DEBUG) cout << "Avg Reward of  " << retval->reward << " from reward sum of " 
-		       << info->Rsum[act] 
-		       << " on " << info->visits[act] << " visits." << endl;
+  retval->reward = (float)Rsum[sa] / (float)visits[sa];
+  if (RMAX_DEBUG) cout << "Avg Reward of  " << retval->reward << " from reward sum of "
+                       << Rsum[sa]
+                       << " on " << visits[sa] << " visits." << endl;
 
   // termination probability
-  retval->termProb = (float)info->terminations[act] / (float)info->visits[act];
+  retval->termProb = (float)terminations[sa] / (float)visits[sa];
   if (RMAX_DEBUG) cout << "termProb: " << retval->termProb << endl;
   if (retval->termProb < 0 || retval->termProb > 1){
     cout << "Problem with termination probability: " << retval->termProb << endl;
   }
 
 
-  retval->known = info->known[act];
+  retval->known = known[sa];
   // conf as a pct of float m (so 0.5 is exactly M)
-  float conf = (float)info->visits[act]/ (2.0 * (float)M);
+  float conf = (float)visits[sa]/ (2.0 * (float)M);
 
   return conf;
 
@@ -180,58 +171,151 @@ float RMaxModel::getStateActionInfo(const std::vector<float> &state, int act, St
 
 
 
+int RMaxModel::getStateId(const std::vector<float> &s){
+  if (RMAX_DEBUG) cout << "getStateId, s = " << &s << endl;
 
-RMaxModel::state_t RMaxModel::canonicalize(const std::vector<float> &s) {
-  if (RMAX_DEBUG) cout << "canonicalize, s = " << &s << endl;
+  if (stateTable.size() == 0)
+    stateTable.resize(64, -1);
 
-  // get state_t for pointer if its in statespace
-  const std::pair<std::set<std::vector<float> >::iterator, bool> result =
-    statespace.insert(s);
-  state_t retval = &*result.first; // Dereference iterator then get pointer 
+  // linear probing from the state's hash
+  unsigned h = hashState(s);
+  unsigned mask = stateTable.size() - 1;
+  unsigned i = h & mask;
+  while (stateTable[i] != -1){
+    int id = stateTable[i];
+    if (stateHash[id] == h && sameState(id, s))
+      return id;
+    i = (i + 1) & mask;
+  }
+
+  // new state, with zero counts for every action
+  int id = nstates++;
+  if (RMAX_DEBUG) cout << " new state id = " << id << endl;
+
+  stateTable[i] = id;
+  stateHash.push_back(h);
+  stateFeats.insert(stateFeats.end(), s.begin(), s.end());
+  stateStart.push_back(stateFeats.size());
 
-  if (RMAX_DEBUG) cout << " returns " << retval << endl;
+  visits.resize(nstates * nact, 0);
+  terminations.resize(nstates * nact, 0);
+  Rsum.resize(nstates * nact, 0);
+  known.resize(nstates * nact, false);
+  outcomes.resize(nstates * nact);
+  nOutcomes.resize(nstates * nact, 0);
 
-  // if not, init this new state
-  if (result.second) { // s is new, so initialize Q(s,a) for all a
-    initNewState(retval);
+  // keep the table at most half full
+  if (2 * nstates > (int)stateTable.size())
+    growStateTable();
+
+  return id;
+}
+
+
+unsigned RMaxModel::hashState(const std::vector<float> &s){
+
+  // FNV-1a over the bits of each feature
+  unsigned h = 2166136261u;
+  for (unsigned i = 0; i < s.size(); i++){
+    // -0 and 0 are the same state
+    float f = (s[i] == 0) ? 0.0 : s[i];
+    unsigned bits;
+    memcpy(&bits, &f, sizeof(bits));
+    for (int b = 0; b < 4; b++){
+      h ^= (bits >> (8*b)) & 0xff;
+      h *= 16777619u;
+    }
   }
+  return h;
+}
 
-  return retval; 
+
+bool RMaxModel::sameState(int id, const std::vector<float> &s){
+  int start = stateStart[id];
+  if (stateStart[id+1] - start != (int)s.size())
+    return false;
+  for (unsigned i = 0; i < s.size(); i++){
+    if (stateFeats[start + i] != s[i])
+      return false;
+  }
+  return true;
 }
 
-void RMaxModel::initNewState(state_t s){
-  if (RMAX_DEBUG) cout << "initNewState(s = " << s 
-		       << ")" << endl;
-  
-  // create state info and add to hash map
-  state_info* info = &(statedata[s]);
-  initStateInfo(info);
 
+void RMaxModel::growStateTable(){
+
+  stateTable.assign(stateTable.size() * 2, -1);
+  unsigned mask = stateTable.size() - 1;
+
+  for (int id = 0; id < nstates; id++){
+    unsigned i = stateHash[id] & mask;
+    while (stateTable[i] != -1)
+      i = (i + 1) & mask;
+    stateTable[i] = id;
+  }
 }
 
 
-// init state info
-void RMaxModel::initStateInfo(state_info* info){
-  if (RMAX_DEBUG) cout << "initStateInfo()";
+void RMaxModel::addOutcome(int sa, int next){
+
+  std::vector<outcome_slot> &table = outcomes[sa];
 
-  info->id = nstates++;
-  if (RMAX_DEBUG) cout << " id = " << info->id << endl;
+  // first outcome of this state-action
+  if (table.size() == 0){
+    outcome_slot empty;
+    empty.next = -1;
+    empty.count = 0;
+    empty.prob = 0;
+    table.resize(RMAX_OUTCOME_SLOTS, empty);
+  }
 
-  // model data (q values, state-action counts, transition, etc)
-  info->visits.resize(nact, 0);
-  info->Rsum.resize(nact, 0);
-  info->known.resize(nact, false);
-  info->terminations.resize(nact, 0);
+  // linear probing from the next state's id
+  unsigned mask = table.size() - 1;
+  unsigned i = ((unsigned)next * 2654435761u) & mask;
+  while (table[i].next != -1 && table[i].next != next)
+    i = (i + 1) & mask;
+
+  if (table[i].next == next){
+    table[i].count++;
+    return;
+  }
 
+  table[i].next = next;
+  table[i].count = 1;
+  nOutcomes[sa]++;
+
+  // keep the table at most half full
+  if (2 * nOutcomes[sa] > (int)table.size()){
+    std::vector<outcome_slot> old;
+    old.swap(table);
+    outcome_slot empty;
+    empty.next = -1;
+    empty.count = 0;
+    empty.prob = 0;
+    table.resize(old.size() * 2, empty);
+    mask = table.size() - 1;
+    for (unsigned j = 0; j < old.size(); j++){
+      if (old[j].next == -1) continue;
+      i = ((unsigned)old[j].next * 2654435761u) & mask;
+      while (table[i].next != -1)
+        i = (i + 1) & mask;
+      table[i] = old[j];
+    }
+  }
 }
 
 
-void RMaxModel::checkTransitionCountSize(std::vector<int>* transCounts){
-  if (RMAX_DEBUG) cout << "checkTransitionCountSize(transCounts) " 
-		    << "size: " << transCounts->size() << endl;
+void RMaxModel::updateOutcomeProbs(int sa){
 
-  // resize to numactions if not initialized for this outcome yet
-  if (transCounts->size() == 0)
-    transCounts->resize(nact, 0);
+  int nonTerminal = visits[sa] - terminations[sa];
+  std::vector<outcome_slot> &table = outcomes[sa];
 
+  for (unsigned i = 0; i < table.size(); i++){
+    if (table[i].next < 0) continue;
+    if (nonTerminal > 0)
+      table[i].prob = (float)table[i].count / (float)nonTerminal;
+    else
+      table[i].prob = 0;
+  }
 }
+
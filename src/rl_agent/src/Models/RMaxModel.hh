@@ -12,8 +12,13 @@
 #include <map>
 #include <set>
 
+/** Initial # of slots in the outcome table of a state-action (a power of 2) */
+#define RMAX_OUTCOME_SLOTS 4
 
-/** MDPModel used for RMax. Tabular model with Maximum Likelihood model for each state-action. */
+
+/** MDPModel used for RMax. Tabular model with Maximum Likelihood model for each state-action.
+    States are given dense integer ids, and all the counts are kept in flat arrays indexed by id and action.
+*/
 class RMaxModel: public MDPModel {
 
 public:
@@ -21,10 +26,10 @@ public:
   /** Default constructor
       \param m # of visits before a state-actions becomes known.
       \param nact # of actions in the domain
-      \param rng Random Number Generator 
+      \param rng Random Number Generator
   */
   RMaxModel(int m, int nact, Random rng);
-  
+
   /** Copy constructor */
   RMaxModel(const RMaxModel&);
 
@@ -36,56 +41,63 @@ public:
   virtual float getStateActionInfo(const std::vector<float> &state, int act, StateActionInfo* retval);
 
 
-  // structs to be defined
-  struct state_info;
+  /** One slot of the open-addressed outcome table of a state-action.
+      Holds the # of times we went to the next state with this id, and the
+      probability of it, which is kept up to date as the counts change. */
+  struct outcome_slot {
+    int next;
+    int count;
+    float prob;
+  };
 
+protected:
 
-  /** State info struct. Maintaints visit counts, outcome counts,
-      reward sums, terminal transitions, and whether the state-action is 
-      considered 'known' (>= m visits) 
-  */
-  struct state_info {
-    int id;
+  // various helper functions that we need
 
-    // model data (visit counts, outcome counts, reward sums, known)
-    std::vector<int> visits;
+  /** Get the id of the given state, adding it (with zeroed counts) if it is new. */
+  int getStateId(const std::vector<float> &s);
 
-    std::map< std::vector<float> , std::vector<int> > outCounts;
-    std::vector<float> Rsum;
-    std::vector<int> terminations;
+  /** Hash the features of a state */
+  unsigned hashState(const std::vector<float> &s);
 
-    std::vector<bool> known;
+  /** Check if the state with the given id has these features */
+  bool sameState(int id, const std::vector<float> &s);
 
-  };
+  /** Double the size of the state table and re-insert every state */
+  void growStateTable();
 
-protected:
-  typedef const std::vector<float> *state_t;
+  /** Add one to the count of going to next in the outcome table of state-action sa */
+  void addOutcome(int sa, int next);
 
-  // various helper functions that we need
+  /** Recompute the probabilities of all the outcomes of state-action sa after its counts changed */
+  void updateOutcomeProbs(int sa);
 
-  /** Initialize a state_info struct */
-  void initStateInfo(state_info* info);
-  
-  /** Add the given state to the state set. initializes state info for new states not yet in set. The pointer to the state in the set is used for map of state_info's */
-  state_t canonicalize(const std::vector<float> &s);
 
-  /** Make sure the transition count vector is sized properly before indexing into it. */
-  void checkTransitionCountSize(std::vector<int> *transCounts);
+private:
 
-  /** Initialize a new state */
-  void initNewState(state_t s);
+  /** Open-addressed table of state ids, hashed on the state features. -1 for empty slots. */
+  std::vector<int> stateTable;
 
+  /** Features of all the states, one after the other */
+  std::vector<float> stateFeats;
 
+  /** Where each state's features start in stateFeats. The entry after the last state is the end. */
+  std::vector<int> stateStart;
 
-private:
-  
-  /** Set of all distinct sensations seen.  Pointers to elements of
-      this set serve as the internal representation of the environment
-      state. */
-  std::set<std::vector<float> > statespace;
+  /** Hash of each state, so the table can grow without re-hashing */
+  std::vector<unsigned> stateHash;
 
-  /** Hashmap mapping state vectors to their state_info structs.    */
-  std::map<state_t, state_info> statedata;
+  // model data, indexed by state id * nact + action
+  std::vector<int> visits;
+  std::vector<int> terminations;
+  std::vector<float> Rsum;
+  std::vector<bool> known;
+
+  /** Outcome table of each state-action, left empty until it is visited. Its size is a power of 2. */
+  std::vector<std::vector<outcome_slot> > outcomes;
+
+  /** # of outcomes in each outcome table */
+  std::vector<int> nOutcomes;
 
   int nstates;
 
@@ -94,7 +106,7 @@ private:
   Random rng;
 
   bool RMAX_DEBUG;
-  
+
 };
 
 
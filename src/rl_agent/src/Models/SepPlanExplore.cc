@@ -7,12 +7,13 @@ SepPlanExplore::SepPlanExplore(int id, int modelType, int predType,
                                int trainFreq,
                                float featPct, float expPct,
                                float treeThreshold, bool stoch,
-                               float featRange, Random rng):
+                               float featRange, Random rng,
+                               ExperienceStore* store):
   id(id), modelType(modelType), predType(predType), nModels(nModels),
   mode(trainMode), freq(trainFreq),
   featPct(featPct), expPct(expPct),
   treeThresh(treeThreshold), stoch(stoch),
-  featRange(featRange), rng(rng)
+  featRange(featRange), rng(rng), store(store), cap(0)
 {
   SPEDEBUG = false;//true;
 
@@ -21,6 +22,11 @@ SepPlanExplore::SepPlanExplore(int id, int modelType, int predType,
   for (int i = 0; i < id; i++)
     rng.uniform(0,1);
 
+  if (store == NULL)
+    this->store = new ExperienceStore();
+  else
+    store->retain();
+
   initModels();
 
 }
@@ -31,10 +37,11 @@ SepPlanExplore::SepPlanExplore(const SepPlanExplore& spe):
   mode(spe.mode), freq(spe.freq),
   featPct(spe.featPct), expPct(spe.expPct),
   treeThresh(spe.treeThresh), stoch(spe.stoch),
-  featRange(spe.featRange), rng(spe.rng)
+  featRange(spe.featRange), rng(spe.rng), store(spe.store), cap(spe.cap)
 {
   cout << "spe get copy" << endl;
   SPEDEBUG = spe.SPEDEBUG;
+  store->retain();
   expModel = spe.expModel->getCopy();
   planModel = spe.planModel->getCopy();
 }
@@ -47,16 +54,29 @@ SepPlanExplore* SepPlanExplore::getCopy(){
 SepPlanExplore::~SepPlanExplore() {
   delete expModel;
   delete planModel;
+  store->release();
 }
 
 
 bool SepPlanExplore::trainInstances(std::vector<classPair> &instances){
   if (SPEDEBUG) cout << id << "SPE trainInstances: " << instances.size() << endl;
 
+  // store the inputs once for both models
+  std::vector<int> origRows(instances.size());
+  for (unsigned i = 0; i < instances.size(); i++){
+    origRows[i] = instances[i].row;
+    if (instances[i].row < 0 && cap == 0)
+      instances[i].row = store->append(instances[i].in);
+  }
+
   // train both
   bool expChanged = expModel->trainInstances(instances);
   bool planChanged = planModel->trainInstances(instances);
 
+  for (unsigned i = 0; i < instances.size(); i++){
+    instances[i].row = origRows[i];
+  }
+
   return (expChanged || planChanged);
 
 }
@@ -67,10 +87,17 @@ bool SepPlanExplore::trainInstances(std::vector<classPair> &instances){
 bool SepPlanExplore::trainInstance(classPair &instance){
   if (SPEDEBUG) cout << id << "SPE trainInstance: " << endl;
 
+  // store the input once for both models
+  int origRow = instance.row;
+  if (instance.row < 0 && cap == 0)
+    instance.row = store->append(instance.in);
+
   // train both
   bool expChanged = expModel->trainInstance(instance);
   bool planChanged = planModel->trainInstance(instance);
 
+  instance.row = origRow;
+
   return (expChanged || planChanged);
 
 }
@@ -97,6 +124,18 @@ float SepPlanExplore::getConf(const std::vector<float> &input){
 }
 
 
+void SepPlanExplore::setCompressDuplicates(bool compress){
+  expModel->setCompressDuplicates(compress);
+  planModel->setCompressDuplicates(compress);
+}
+
+void SepPlanExplore::setExperienceCap(int cap){
+  this->cap = cap;
+  expModel->setExperienceCap(cap);
+  planModel->setExperienceCap(cap);
+}
+
+
 // init models
 void SepPlanExplore::initModels(){
   if (SPEDEBUG) cout << "initModels()" << endl;
@@ -109,39 +148,40 @@ void SepPlanExplore::initModels(){
   // explore model should be of type MultipleClassifiers
   expModel = new MultipleClassifiers(id, modelType, predType,
                                      nModels, mode, freq,
-                                     featPct, expPct, treeThresh, stoch, featRange, rng);
+                                     featPct, expPct, treeThresh, stoch, featRange, rng,
+                                     store);
 
   // init the trees or stumps
   if (modelType == C45TREE){
-    planModel = new C45Tree(id, mode, freq, 0, 0.0, rng);
+    planModel = new C45Tree(id, mode, freq, 0, 0.0, rng, store);
   }
   else if (modelType == M5MULTI){
-    planModel = new M5Tree(id, mode, freq, 0, 0.0, false, false, treeThresh, rng);
+    planModel = new M5Tree(id, mode, freq, 0, 0.0, false, false, treeThresh, rng, store);
   }
   else if (modelType == M5ALLMULTI){
-    planModel = new M5Tree(id, mode, freq, 0, 0.0, false, true, treeThresh, rng);
+    planModel = new M5Tree(id, mode, freq, 0, 0.0, false, true, treeThresh, rng, store);
   }
   else if (modelType == M5ALLSINGLE){
-    planModel = new M5Tree(id, mode, freq, 0, 0.0, true, true, treeThresh, rng);
+    planModel = new M5Tree(id, mode, freq, 0, 0.0, true, true, treeThresh, rng, store);
   }
   else if (modelType == M5SINGLE){
-    planModel = new M5Tree(id, mode, freq, 0, 0.0, true, false, treeThresh, rng);
+    planModel = new M5Tree(id, mode, freq, 0, 0.0, true, false, treeThresh, rng, store);
   }
   else if (modelType == LSTSINGLE){
-    planModel = new LinearSplitsTree(id, mode, freq, 0, 0.0, true, treeThresh, rng);
+    planModel = new LinearSplitsTree(id, mode, freq, 0, 0.0, true, treeThresh, rng, store);
   }
   else if (modelType == LSTMULTI){
-    planModel = new LinearSplitsTree(id, mode, freq, 0, 0.0, false, treeThresh, rng);
+    planModel = new LinearSplitsTree(id, mode, freq, 0, 0.0, false, treeThresh, rng, store);
   }
   else if (modelType == STUMP){
-    planModel = new Stump(id, mode, freq, 0, 0.0, rng);
+    planModel = new Stump(id, mode, freq, 0, 0.0, rng, store);
   }
   else if (modelType == ALLM5TYPES){
     // select an m5 type randomly.  so multivariate v single and allfeats v subtree feats
     bool simple = rng.bernoulli(0.5);
     bool allFeats = rng.bernoulli(0.5);
     //cout << "ALL types init tree " << i << " with simple: " << simple << " and allFeats: " << allFeats << endl;
-    planModel = new M5Tree(id, mode, freq, 0, 0.0, simple, allFeats, treeThresh, rng);
+    planModel = new M5Tree(id, mode, freq, 0, 0.0, simple, allFeats, treeThresh, rng, store);
   }
   else {
     cout << "Invalid model type for this committee" << endl;
@@ -24,7 +24,7 @@ public:
   SepPlanExplore(int id, int modelType, int predType, int nModels, 
                  int trainMode, int trainFreq,
                  float featPct, float expPct, float treeThreshold, bool stoch,
-                 float featRange, Random rng);
+                 float featRange, Random rng, ExperienceStore* store = NULL);
 
   SepPlanExplore(const SepPlanExplore&);
   virtual SepPlanExplore* getCopy();
@@ -35,6 +35,12 @@ public:
   virtual bool trainInstance(classPair &instance);
   virtual void testInstance(const std::vector<float> &input, std::map<float, float>* retval);
   virtual float getConf(const std::vector<float> &s);
+
+  /** Have both models compress duplicate experiences */
+  virtual void setCompressDuplicates(bool compress);
+
+  /** Cap the experiences of both models */
+  virtual void setExperienceCap(int cap);
   
   void initModels();
 
@@ -56,6 +62,12 @@ private:
 
   Random rng;
 
+  // inputs shared by both models
+  ExperienceStore* store;
+
+  // experience cap of the models, which then keep their inputs themselves
+  int cap;
+
   Classifier* expModel;
   Classifier* planModel;
 
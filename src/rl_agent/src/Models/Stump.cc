@@ -2,12 +2,21 @@
 
 
 
-Stump::Stump(int id, int trainMode, int trainFreq, int m, float featPct, Random rng):
-  id(id), mode(trainMode), freq(trainFreq), M(m), featPct(featPct), rng(rng)
+Stump::Stump(int id, int trainMode, int trainFreq, int m, float featPct, Random rng,
+             ExperienceStore* store):
+  id(id), mode(trainMode), freq(trainFreq), M(m), featPct(featPct), rng(rng),
+  store(store)
 {
 
   nOutput = 0;
   nExperiences = 0;
+  nfeat = 0;
+
+  // share the given experience store, or keep our own
+  if (store == NULL)
+    this->store = new ExperienceStore();
+  else
+    store->retain();
 
   // how close a split has to be to be randomly selected
   SPLIT_MARGIN = 0.02; //5; //01; //0.05; //0.2; //0.05;
@@ -33,9 +42,11 @@ Stump::Stump(int id, int trainMode, int trainFreq, int m, float featPct, Random
 }
 
 Stump::Stump(const Stump& s):
-id(s.id), mode(s.mode), freq(s.freq), M(s.M), featPct(s.featPct), rng(s.rng)
+id(s.id), mode(s.mode), freq(s.freq), M(s.M), featPct(s.featPct), rng(s.rng),
+  store(s.store)
 {
   nOutput = s.nOutput;
+  nfeat = s.nfeat;
   nExperiences = s.nExperiences;
   SPLIT_MARGIN = s.SPLIT_MARGIN;
   LOSS_MARGIN = s.LOSS_MARGIN;
@@ -45,9 +56,9 @@ id(s.id), mode(s.mode), freq(s.freq), M(s.M), featPct(s.featPct), rng(s.rng)
   STDEBUG = s.STDEBUG;
   SPLITDEBUG = s.SPLITDEBUG;
 
-  for (int i = 0; i < N_STUMP_EXP; i++){
-    allExp[i] = s.allExp[i];
-  }
+  // inputs are append-only, so the copy can share them
+  store->retain();
+  allExp = s.allExp;
 
   // set experience pointers
   experiences.resize(s.experiences.size());
@@ -70,10 +81,9 @@ Stump* Stump::getCopy(){
 }
 
 Stump::~Stump() {
-  for (unsigned i = N_STUMP_EXP; i < experiences.size(); i++){
-    delete experiences[i];
-  }
   experiences.clear();
+  allExp.clear();
+  store->release();
 }
 
 
@@ -88,18 +98,17 @@ bool Stump::trainInstances(std::vector<classPair> &instances){
   for (unsigned a = 0; a < instances.size(); a++){
     classPair instance = instances[a];
 
-    // take from static array until we run out
-    stump_experience *e;
-    if (nExperiences < N_STUMP_EXP){
-      // from statically created set of experiences
-      e = &(allExp[nExperiences]);
+    // inputs go in the experience store, unless already placed there for us
+    int row = instance.row;
+    if (row < 0)
+      row = store->append(instance.in);
+    if ((int)instance.in.size() > nfeat)
+      nfeat = instance.in.size();
 
-    } else {
-      // dynamically create experience
-      e = new stump_experience;
-    }
+    allExp.push_back(stump_experience());
+    stump_experience *e = &(allExp.back());
 
-    e->input = instance.in;
+    e->row = row;
     e->output = instance.out;
     e->id = nExperiences;
     experiences.push_back(e);
@@ -128,8 +137,8 @@ bool Stump::trainInstances(std::vector<classPair> &instances){
       cout << endl << " Original output: " << instance.out << endl;
       cout << "Added exp id: " << e->id << " output: " << e->output << endl;
       cout << "Address: " << e << " Input : ";
-      for (unsigned i = 0; i < e->input.size(); i++){
-        cout << e->input[i] << ", ";
+      for (int i = 0; i < nfeat; i++){
+        cout << store->get(e->row, i) << ", ";
       }
       cout << endl << " Now have " << nExperiences << " experiences." << endl;
     }
@@ -177,19 +186,17 @@ bool Stump::trainInstance(classPair &instance){
 
   // simply add this instance to the set of experiences
 
-  // take from static array until we run out
-  stump_experience *e;
-  if (nExperiences < N_STUMP_EXP){
-    // from statically created set of experiences
-    e = &(allExp[nExperiences]);
+  // inputs go in the experience store, unless already placed there for us
+  int row = instance.row;
+  if (row < 0)
+    row = store->append(instance.in);
+  if ((int)instance.in.size() > nfeat)
+    nfeat = instance.in.size();
 
-  } else {
-    // dynamically create experience
-    e = new stump_experience;
-  }
+  allExp.push_back(stump_experience());
+  stump_experience *e = &(allExp.back());
 
-
-  e->input = instance.in;
+  e->row = row;
   e->output = instance.out;
   e->id = nExperiences;
   experiences.push_back(e);
@@ -218,8 +225,8 @@ bool Stump::trainInstance(classPair &instance){
     cout << endl << " Original output: " << instance.out << endl;
     cout << "Added exp id: " << e->id << " output: " << e->output << endl;
     cout << "Address: " << e << " Input : ";
-    for (unsigned i = 0; i < e->input.size(); i++){
-      cout << e->input[i] << ", ";
+    for (int i = 0; i < nfeat; i++){
+      cout << store->get(e->row, i) << ", ";
     }
     cout << endl << " Now have " << nExperiences << " experiences." << endl;
   }
@@ -305,7 +312,7 @@ int Stump::findMatching(const std::vector<stump_experience*> &instances, int dim
   int count = 0;
 
   for (unsigned i = 0; i < instances.size(); i++){
-    if (!passTest(dim, val, ONLY, instances[i]->input)){
+    if (!passTest(dim, val, ONLY, instances[i])){
       count++;
       // no need to continue if this won't be the new min
       if (count >= minConf)
@@ -363,6 +370,29 @@ bool Stump::passTest(int dim, float val, int type, const std::vector<float> &inp
 }
 
 
+/** Decide if the stored input of an experience passes the test */
+bool Stump::passTest(int dim, float val, int type, const stump_experience* e){
+  float input = store->get(e->row, dim);
+  if (STDEBUG) cout << "passTest, dim=" << dim << ",val=" << val << ",type=" << type
+                    << ",input["<<dim<<"]=" << input <<endl;
+
+  if (type == CUT){
+    if (input > val)
+      return false;
+    else
+      return true;
+  } else if (type == ONLY){
+    if (input == val)
+      return false;
+    else
+      return true;
+  } else {
+    return false;
+  }
+
+}
+
+
 /** Build the stump from this node down using this set of experiences. */
 void Stump::buildStump(){
   if(STDEBUG) cout << "buildStump" << endl;
@@ -414,7 +444,7 @@ void Stump::implementSplit(float bestGainRatio, int bestDim,
   for (unsigned i = 0; i < experiences.size(); i++){
     if (STDEBUG) cout << "implmentSplit - Classify instance " << i << " id: "
                       << experiences[i]->id << " on new split " << endl;
-    if (passTest(dim, val, type, experiences[i]->input)){
+    if (passTest(dim, val, type, experiences[i])){
       left.push_back(experiences[i]);
       leftOutputs.insert(experiences[i]->output);
     }
@@ -443,7 +473,7 @@ void Stump::testPossibleSplits(float *bestGainRatio, int *bestDim,
   int nties = 0;
 
   // for each possible split, calc gain ratio
-  for (unsigned idim = 0; idim < experiences[0]->input.size(); idim++){
+  for (int idim = 0; idim < nfeat; idim++){
 
     // we eliminate some random number of splits
     // here (decision is taken from the random set that are left)
@@ -581,7 +611,7 @@ float Stump::calcGainRatio(int dim, float val, int type,
     if (STDEBUG) cout << "calcGainRatio - Classify instance " << i << " id: "
                       << experiences[i]->id << " on new split " << endl;
 
-    if (passTest(dim, val, type, experiences[i]->input)){
+    if (passTest(dim, val, type, experiences[i])){
       left.push_back(experiences[i]);
     }
     else{
@@ -675,11 +705,12 @@ float* Stump::sortOnDim(int dim){
   if (STDEBUG) cout << "sortOnDim,dim = " << dim << endl;
 
   float* values = new float[experiences.size()];
+  const std::vector<float> &featVals = store->column(dim);
 
   for (int i = 0; i < (int)experiences.size(); i++){
     //cout << "Instance " << i << endl;
 
-    float val = experiences[i]->input[dim];
+    float val = featVals[experiences[i]->row];
     //cout << " val: " << val << endl;
 
     // find where this should go
@@ -3,11 +3,11 @@
 
 #include <rl_common/Random.h>
 #include <rl_common/core.hh>
+#include "ExperienceStore.hh"
 #include <vector>
 #include <set>
 #include <map>
-
-#define N_STUMP_EXP 250000
+#include <deque>
 
 /** C4.5 decision stump class */
 class Stump: public Classifier {
@@ -16,7 +16,8 @@ public:
 
   // mode - re-build stump every step?  
   // re-build only on misclassifications? or rebuild every 'trainFreq' steps
-  Stump(int id, int trainMode, int trainFreq, int m, float featPct, Random rng);
+  Stump(int id, int trainMode, int trainFreq, int m, float featPct, Random rng,
+        ExperienceStore* store = NULL);
 
   Stump(const Stump&);
   virtual Stump* getCopy();
@@ -27,7 +28,7 @@ public:
   struct stump_experience;
       
   struct stump_experience {
-    std::vector<float> input;
+    int row;
     float output;
     int id;
   };
@@ -47,6 +48,7 @@ public:
   // helper functions
   void initStump();
   bool passTest(int dim, float val, int type, const std::vector<float> &input);
+  bool passTest(int dim, float val, int type, const stump_experience* e);
   float calcGainRatio(int dim, float val, int type,float I);
   float* sortOnDim(int dim);
   float calcIofP(float* P, int size);
@@ -88,12 +90,14 @@ private:
 
   Random rng;
 
+  int nfeat;
   int nOutput;
   int nnodes;
 
   // INSTANCES
   std::vector<stump_experience*> experiences;
-  stump_experience allExp[N_STUMP_EXP];
+  std::deque<stump_experience> allExp;
+  ExperienceStore* store;
 
   // split criterion
   int dim;
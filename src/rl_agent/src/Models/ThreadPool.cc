@@ -0,0 +1,134 @@
+/** \file ThreadPool.cc
+    Implements the ThreadPool class.
+*/
+
+#include "ThreadPool.hh"
+
+#include <algorithm>
+#include <unistd.h>
+
+
+ThreadPool* ThreadPool::sharedPool = NULL;
+pthread_once_t ThreadPool::sharedOnce = PTHREAD_ONCE_INIT;
+
+
+ThreadPool::ThreadPool(int nthreads):
+  stopping(false)
+{
+  pthread_mutex_init(&pool_mutex, NULL);
+  pthread_cond_init(&work_cond, NULL);
+  pthread_cond_init(&done_cond, NULL);
+
+  for (int i = 0; i < nthreads; i++){
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, workerStart, this) != 0)
+      break;
+    threads.push_back(thread);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  pthread_mutex_lock(&pool_mutex);
+  stopping = true;
+  pthread_cond_broadcast(&work_cond);
+  pthread_mutex_unlock(&pool_mutex);
+
+  for (unsigned i = 0; i < threads.size(); i++){
+    pthread_join(threads[i], NULL);
+  }
+  threads.clear();
+
+  pthread_cond_destroy(&done_cond);
+  pthread_cond_destroy(&work_cond);
+  pthread_mutex_destroy(&pool_mutex);
+}
+
+
+void ThreadPool::parallelFor(int n, task_t task, void* arg){
+
+  // nothing to share
+  if (n <= 1 || threads.size() == 0){
+    for (int i = 0; i < n; i++){
+      task(arg, i);
+    }
+    return;
+  }
+
+  job j;
+  j.task = task;
+  j.arg = arg;
+  j.n = n;
+  j.next = 0;
+  j.done = 0;
+
+  pthread_mutex_lock(&pool_mutex);
+  jobs.push_back(&j);
+  pthread_cond_broadcast(&work_cond);
+
+  // work on our own job until every iteration is claimed
+  while (j.next < j.n){
+    runNext(&j);
+  }
+
+  // then wait for the ones other threads are running
+  while (j.done < j.n){
+    pthread_cond_wait(&done_cond, &pool_mutex);
+  }
+  pthread_mutex_unlock(&pool_mutex);
+
+}
+
+
+void ThreadPool::runNext(job* j){
+
+  int i = j->next++;
+
+  // take it off the list once it's all claimed
+  if (j->next == j->n){
+    jobs.erase(std::find(jobs.begin(), jobs.end(), j));
+  }
+
+  pthread_mutex_unlock(&pool_mutex);
+  j->task(j->arg, i);
+  pthread_mutex_lock(&pool_mutex);
+
+  j->done++;
+  if (j->done == j->n)
+    pthread_cond_broadcast(&done_cond);
+
+}
+
+
+void ThreadPool::workerLoop(){
+
+  pthread_mutex_lock(&pool_mutex);
+  while (!stopping){
+    if (jobs.size() == 0){
+      pthread_cond_wait(&work_cond, &pool_mutex);
+      continue;
+    }
+    runNext(jobs.front());
+  }
+  pthread_mutex_unlock(&pool_mutex);
+
+}
+
+
+void* ThreadPool::workerStart(void* arg){
+  ((ThreadPool*)arg)->workerLoop();
+  return NULL;
+}
+
+
+void ThreadPool::createShared(){
+  int nthreads = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+  if (nthreads < 0) nthreads = 0;
+  if (nthreads > MAX_POOL_THREADS) nthreads = MAX_POOL_THREADS;
+  sharedPool = new ThreadPool(nthreads);
+}
+
+
+ThreadPool* ThreadPool::shared(){
+  pthread_once(&sharedOnce, createShared);
+  return sharedPool;
+}
@@ -0,0 +1,83 @@
+/** \file ThreadPool.hh
+    Defines the ThreadPool class, a fixed set of pthreads used to run the
+    iterations of a loop in parallel, such as training each model of an ensemble.
+*/
+
+#ifndef _THREADPOOL_HH_
+#define _THREADPOOL_HH_
+
+#include <vector>
+#include <deque>
+#include <pthread.h>
+
+/** Most worker threads the shared pool will start */
+#define MAX_POOL_THREADS 16
+
+/** Pool of worker threads that run parallel loops. Each call to parallelFor posts a job, and idle workers take iterations from whichever posted job still has some left. The calling thread works through its own job as well, so parallelFor can be called from inside a running iteration (e.g. a model training its sub-models in parallel) without running out of threads. */
+class ThreadPool {
+
+public:
+
+  /** Function run for each iteration i of a loop, with the argument given to parallelFor */
+  typedef void (*task_t)(void* arg, int i);
+
+  /** Start a pool with the given # of worker threads. With 0 workers, loops simply run on the calling thread. */
+  ThreadPool(int nthreads);
+
+  /** Stops and joins the workers. No loops can be running. */
+  ~ThreadPool();
+
+  /** Run task(arg, i) for i from 0 to n-1, spread over the pool and the calling thread, returning when all of them are done. Iterations must not depend on each other. */
+  void parallelFor(int n, task_t task, void* arg);
+
+  /** # of worker threads in the pool */
+  int size() const { return (int)threads.size(); }
+
+  /** Pool shared by all the models, with a worker for each other processor (up to MAX_POOL_THREADS). It is created on first use. */
+  static ThreadPool* shared();
+
+private:
+
+  /** A loop posted to the pool. It lives on the stack of the thread that called parallelFor. */
+  struct job {
+    task_t task;
+    void* arg;
+    int n;
+    int next;
+    int done;
+  };
+
+  /** Unimplemented: pools are not copied */
+  ThreadPool(const ThreadPool&);
+  ThreadPool& operator=(const ThreadPool&);
+
+  /** Claim the next iteration of the job and run it. Called with pool_mutex held, which is released while the iteration runs. */
+  void runNext(job* j);
+
+  /** Take iterations from posted jobs until the pool is stopped */
+  void workerLoop();
+
+  /** Start routine of the worker threads */
+  static void* workerStart(void* arg);
+
+  /** Create the shared pool */
+  static void createShared();
+
+  /** Jobs with iterations no thread has claimed yet. */
+  std::deque<job*> jobs;
+
+  std::vector<pthread_t> threads;
+  bool stopping;
+
+  pthread_mutex_t pool_mutex;
+  /** Signalled when a job is posted or the pool is stopping. */
+  pthread_cond_t work_cond;
+  /** Signalled when a job's last iteration finishes. */
+  pthread_cond_t done_cond;
+
+  static ThreadPool* sharedPool;
+  static pthread_once_t sharedOnce;
+
+};
+
+#endif
@@ -28,6 +28,7 @@ ETUCT::ETUCT(int numactions, float gamma, float rrange, float lambda,
   nstates = 0;
   nactions = 0;
   lastUpdate = -1;
+  rolloutMember = -1;
   seedMode = false;
 
   timingType = true;
@@ -293,6 +294,37 @@ void ETUCT::updateStateActionHistoryFromModel(const std::vector<float> &modState
 
 
 
+void ETUCT::updateStateFromModel(state_t s, state_info* info, bool staleOnly){
+
+  if (HISTORY_SIZE > 0){
+    for (int j = 0; j < numactions; j++){
+      updateStateActionFromModel(s, j, info);
+    }
+    return;
+  }
+
+  std::deque<float> history(1,0.0);
+  batchStates.clear();
+  batchActions.clear();
+  batchInfos.clear();
+  for (int j = 0; j < numactions; j++){
+    StateActionInfo* newModel = &(info->historyModel[j][history]);
+    if (staleOnly && newModel->frameUpdated >= lastUpdate)
+      continue;
+    batchStates.push_back(s);
+    batchActions.push_back(j);
+    batchInfos.push_back(newModel);
+  }
+
+  model->getStateActionInfos(batchStates, batchActions, batchInfos, &batchConfs);
+
+  for (unsigned k = 0; k < batchInfos.size(); k++){
+    batchInfos[k]->frameUpdated = nactions;
+  }
+
+}
+
+
 void ETUCT::canonNextStates(StateActionInfo* modelInfo){
 
   // loop through all next states
@@ -332,6 +364,11 @@ int ETUCT::getBestAction(const std::vector<float> &state){
   int i = 0;
   for (i = 0; i < MAX_ITER; i++){
 
+    // with a sampled ensemble, each rollout draws one of its models to
+    // use past the root
+    int nMembers = model->getNumMembers();
+    rolloutMember = (nMembers > 1) ? rng.uniformDiscrete(0, nMembers-1) : -1;
+
     std::deque<float> searchHistory = saHistory;
     uctSearch(state, s, 0, searchHistory);
 
@@ -398,9 +435,7 @@ void ETUCT::planOnNewModel(){
       state_t s = canonicalize(*i);
       state_info* info = &(statedata[s]);
       if (info->needsUpdate){
-        for (int j = 0; j < numactions; j++){
-          updateStateActionFromModel(s, j, info);
-        }
+        updateStateFromModel(s, info, false);
         info->needsUpdate = false;
       }
     }
@@ -486,6 +521,7 @@ void ETUCT::initStateInfo(state_t s, state_info* info){
   }
 
   info->historyModel = new std::map< std::deque<float>, StateActionInfo>[numactions];
+  info->memberModel = NULL;
 
   // model q values, visit counts
   info->Q.resize(numactions, 0);
@@ -529,6 +565,7 @@ void ETUCT::printStates(){
 void ETUCT::deleteInfo(state_info* info){
 
   delete [] info->historyModel;
+  delete [] info->memberModel;
 
 }
 
@@ -596,7 +633,9 @@ float ETUCT::uctSearch(const std::vector<float> &actS, state_t discS, int depth,
   info->needsUpdate = true;
 
   // simulate next state, reward, terminal
-  std::vector<float> actualNext = simulateNextState(actS, discS, info, searchHistory, action, &reward, &term);
+  // the root is planned on the whole model, the rest of the rollout on its sampled member
+  int member = (depth == 0) ? -1 : rolloutMember;
+  std::vector<float> actualNext = simulateNextState(actS, discS, info, searchHistory, action, &reward, &term, member);
 
   // simulate reward from this action
   if (term){
@@ -734,10 +773,17 @@ int ETUCT::selectUCTAction(state_info* info){
 
 
 
-std::vector<float> ETUCT::simulateNextState(const std::vector<float> &actualState, state_t discState, state_info* info, const std::deque<float> &history, int action, float* reward, bool* term){
+std::vector<float> ETUCT::simulateNextState(const std::vector<float> &actualState, state_t discState, state_info* info, const std::deque<float> &history, int action, float* reward, bool* term, int member){
 
-  StateActionInfo* modelInfo = &(info->historyModel[action][history]);
-  bool upToDate = modelInfo->frameUpdated >= lastUpdate;
+  StateActionInfo* modelInfo = NULL;
+  bool upToDate = true;
+
+  if (member >= 0 && HISTORY_SIZE == 0){
+    modelInfo = memberStateActionInfo(discState, info, action, member);
+  } else {
+    modelInfo = &(info->historyModel[action][history]);
+    upToDate = modelInfo->frameUpdated >= lastUpdate;
+  }
 
   if (!upToDate){
     // must put in appropriate history
@@ -748,7 +794,8 @@ std::vector<float> ETUCT::simulateNextState(const std::vector<float> &actualStat
       }
       updateStateActionHistoryFromModel(modState, action, modelInfo);
     } else {
-      updateStateActionHistoryFromModel(*discState, action, modelInfo);
+      // the other actions here are likely out of date too
+      updateStateFromModel(discState, info, true);
     }
   }
 
@@ -785,6 +832,10 @@ std::vector<float> ETUCT::simulateNextState(const std::vector<float> &actualStat
     }
   }
 
+  // probabilities summing to just under 1 can miss them all
+  if (nextstate.size() == 0 && modelInfo->transitionProbs.size() > 0)
+    nextstate = modelInfo->transitionProbs.rbegin()->first;
+
   if (trackActual){
 
 
@@ -813,6 +864,27 @@ std::vector<float> ETUCT::simulateNextState(const std::vector<float> &actualStat
 }
 
 
+StateActionInfo* ETUCT::memberStateActionInfo(state_t s, state_info* info, int a, int member){
+
+  if (info->memberModel == NULL)
+    info->memberModel = new std::vector<StateActionInfo>[numactions];
+
+  std::vector<StateActionInfo> &members = info->memberModel[a];
+  if ((int)members.size() <= member)
+    members.resize(member+1);
+
+  StateActionInfo* modelInfo = &(members[member]);
+
+  // only asked for as rollouts reach it, so it may never have been filled in
+  if (modelInfo->frameUpdated < 0 || modelInfo->frameUpdated < lastUpdate){
+    model->getMemberStateActionInfo(*s, a, member, modelInfo);
+    modelInfo->frameUpdated = nactions;
+  }
+
+  return modelInfo;
+}
+
+
 void ETUCT::savePolicy(const char* filename){
 
   ofstream policyFile(filename, ios::out | ios::binary | ios::trunc);
@@ -111,6 +111,10 @@ protected:
     // data filled in from models
     std::map< std::deque<float>, StateActionInfo>* historyModel;
 
+    // predictions of each model of a sampled ensemble, for each action
+    // (NULL until a sampled rollout reaches this state)
+    std::vector<StateActionInfo>* memberModel;
+
     // q values from policy creation
     std::vector<float> Q;
 
@@ -159,6 +163,9 @@ protected:
   /** Update the state_info copy of the model for the given state-action and k-action history from the MDPModel. */
   void updateStateActionHistoryFromModel(const std::vector<float> &modState, int a, StateActionInfo *newModel);
 
+  /** Update the model predictions of every action of this state, or of only the ones predicted before the model last changed if staleOnly is set. Without a history, all of them are requested from the model in one batch. */
+  void updateStateFromModel(state_t s, state_info* info, bool staleOnly);
+
   /** Get the current time in seconds */
   double getSeconds();
 
@@ -180,7 +187,10 @@ protected:
 
   /** Return a sampled state from the next state distribution of the model. 
       Simulate the next state from the given state, action, and possibly history of past actions. */
-  std::vector<float> simulateNextState(const std::vector<float> &actualState, state_t discState, state_info* info, const std::deque<float> &searchHistory, int action, float* reward, bool* term);
+  std::vector<float> simulateNextState(const std::vector<float> &actualState, state_t discState, state_info* info, const std::deque<float> &searchHistory, int action, float* reward, bool* term, int member);
+
+  /** Get the prediction of one member of a sampled ensemble model for the given state-action, updating it from the model if it is out of date. */
+  StateActionInfo* memberStateActionInfo(state_t s, state_info* info, int a, int member);
 
   /** Select UCT action based on UCB1 algorithm. */
   int selectUCTAction(state_info* info);
@@ -223,6 +233,9 @@ private:
   int nstates;
   int nactions; 
   int lastUpdate;
+
+  /** Member of the model used below the root in the current rollout, or -1 to use the whole model. */
+  int rolloutMember;
   bool timingType;
 
   const int numactions;
@@ -239,6 +252,12 @@ private:
   const int HISTORY_SIZE;
   const int HISTORY_FL_SIZE;
 
+  // state-actions being predicted together by the model
+  std::vector<const std::vector<float>*> batchStates;
+  std::vector<int> batchActions;
+  std::vector<StateActionInfo*> batchInfos;
+  std::vector<float> batchConfs;
+
 };
 
 #endif
@@ -0,0 +1,318 @@
+/** \file EnvUCT.cc
+    Implements UCT with eligibility traces on a simulator of the true
+    environment.  A modified version of UCT as presented in:
+    L. Kocsis and C. Szepesv´ari, "Bandit based monte-carlo planning," in
+    ECML-06. Number 4212 in LNCS. Springer, 2006, pp. 282-293.
+*/
+
+#include "EnvUCT.hh"
+#include <algorithm>
+
+#include <sys/time.h>
+
+
+EnvUCT::EnvUCT(int numactions, float gamma, float rrange, float lambda,
+               int MAX_ITER, float MAX_TIME, int MAX_DEPTH,
+               const std::vector<float> &fmax, const std::vector<float> &fmin,
+               const std::vector<int> &nstatesPerDim,
+               Environment* env, Environment* sim, Random r):
+  env(env), sim(sim),
+  numactions(numactions), gamma(gamma), rrange(rrange), lambda(lambda),
+  MAX_ITER(MAX_ITER), MAX_TIME(MAX_TIME),
+  MAX_DEPTH(MAX_DEPTH), statesPerDim(nstatesPerDim)
+{
+  rng = r;
+
+  nstates = 0;
+  nactions = 0;
+
+  PLANNERDEBUG = false;
+  UCTDEBUG = false;
+
+  featmax = fmax;
+  featmin = fmin;
+
+  if (env == NULL || sim == NULL){
+    std::cerr << "ERROR: EnvUCT needs the environment and a simulator of it" << endl;
+    exit(-1);
+  }
+
+  if (statesPerDim[0] > 0){
+    cout << "Planner EnvUCT using discretization of " << statesPerDim[0] << endl;
+  }
+
+}
+
+EnvUCT::~EnvUCT() {
+  featmax.clear();
+  featmin.clear();
+
+  statespace.clear();
+  statedata.clear();
+}
+
+void EnvUCT::setModel(MDPModel*){
+  // rollouts use the simulator instead
+}
+
+bool EnvUCT::updateModelWithExperience(const std::vector<float> &,
+                                       int,
+                                       const std::vector<float> &,
+                                       float, bool){
+  return false;
+}
+
+void EnvUCT::planOnNewModel(){
+  // simulator never changes, nothing to replan
+}
+
+
+int EnvUCT::getBestAction(const std::vector<float> &){
+
+  double planTime = getSeconds();
+
+  // start every rollout from the real environment's full state
+  env->snapshot(&rootState);
+  state_t s = canonicalize(env->sensation());
+
+  int i = 0;
+  for (i = 0; i < MAX_ITER; i++){
+
+    sim->restore(rootState);
+    uctSearch(s, 0);
+
+    // break after some max time
+    if ((getSeconds() - planTime) > MAX_TIME){
+      break;
+    }
+
+  }
+  if (UCTDEBUG){
+    cout << "Search complete after " << (getSeconds()-planTime)
+         << " seconds and " << i << " iterations." << endl;
+  }
+
+  // get state info
+  state_info* info = &(statedata[s]);
+
+  // Get Q values
+  std::vector<float> &Q = info->Q;
+
+  // Choose an action
+  const std::vector<float>::iterator a =
+    random_max_element(Q.begin(), Q.end()); // Choose maximum
+
+  int act = a - Q.begin();
+  nactions++;
+
+  // return index of action
+  return act;
+}
+
+
+////////////////////////////
+// Helper Functions       //
+////////////////////////////
+
+EnvUCT::state_t EnvUCT::canonicalize(const std::vector<float> &s) {
+
+  // discretize it
+  std::vector<float> s2;
+  if (statesPerDim[0] > 0){
+    s2 = discretizeState(s);
+  } else {
+    s2 = s;
+  }
+
+  // get state_t for pointer if its in statespace
+  const std::pair<std::set<std::vector<float> >::iterator, bool> result =
+    statespace.insert(s2);
+  state_t retval = &*result.first; // Dereference iterator then get pointer
+
+  // if not, init this new state
+  if (result.second) { // s is new, so initialize Q(s,a) for all a
+    initStateInfo(&(statedata[retval]));
+    if (PLANNERDEBUG) {
+      cout << " New state initialized "
+           << " orig:(" << s[0] << "," << s[1] << ")"
+           << " disc:(" << s2[0] << "," << s2[1] << ")" << endl;
+    }
+  }
+
+  return retval;
+}
+
+
+// init state info
+void EnvUCT::initStateInfo(state_info* info){
+
+  info->id = nstates++;
+
+  // q values, visit counts
+  info->Q.resize(numactions, 0);
+  info->uctActions.resize(numactions, 1);
+  info->uctVisits = 1;
+  info->visited = 0;
+
+  for (int i = 0; i < numactions; i++){
+    info->Q[i] = rng.uniform(0,0.01);
+  }
+
+}
+
+
+double EnvUCT::getSeconds(){
+  struct timezone tz;
+  timeval timeT;
+  gettimeofday(&timeT, &tz);
+  return  timeT.tv_sec + (timeT.tv_usec / 1000000.0);
+}
+
+
+float EnvUCT::uctSearch(state_t discS, int depth){
+
+  state_info* info = &(statedata[discS]);
+
+  // past max depth, return max q value here
+  if (depth > MAX_DEPTH){
+    std::vector<float>::iterator maxAct =
+      std::max_element(info->Q.begin(),
+                       info->Q.end());
+    return *maxAct;
+  }
+
+  // select action
+  int action = selectUCTAction(info);
+
+  float learnRate = 10.0 / (info->uctActions[action] + 10.0);
+
+  // step the simulator for next state, reward, terminal
+  float reward = sim->apply(action);
+
+  if (sim->terminal()){
+    info->Q[action] += learnRate * (reward - info->Q[action]);
+    info->uctVisits++;
+    info->uctActions[action]++;
+    if (UCTDEBUG)
+      cout << " Depth: " << depth << " Selected action " << action
+           << " r: " << reward << " terminal" << endl;
+
+    return reward;
+  }
+
+  // get discretized version of next
+  state_t discNext = canonicalize(sim->sensation());
+
+  if (UCTDEBUG)
+    cout << " Depth: " << depth << " Selected action " << action
+         << " r: " << reward << endl;
+
+  info->visited++;
+
+  // new q value
+  float newQ = reward + gamma * uctSearch(discNext, depth+1);
+
+  if (info->visited == 1){
+
+    // update q and visit counts
+    info->Q[action] += learnRate * (newQ - info->Q[action]);
+    info->uctVisits++;
+    info->uctActions[action]++;
+
+    if (lambda < 1.0){
+
+      // replace with w avg of maxq and new val
+      std::vector<float>::iterator maxAct =
+        std::max_element(info->Q.begin(),
+                         info->Q.end());
+      newQ = (lambda * newQ) + ((1.0-lambda) * (*maxAct));
+    }
+
+  }
+
+  info->visited--;
+
+  // return q
+  return newQ;
+
+}
+
+
+int EnvUCT::selectUCTAction(state_info* info){
+
+  std::vector<float> &Q = info->Q;
+
+  float rewardBound = rrange;
+  if (rewardBound < 1.0)
+    rewardBound = 1.0;
+  rewardBound /= (1.0 - gamma);
+
+  std::vector<float> uctQ(numactions, 0.0);
+
+  for (int i = 0; i < numactions; i++){
+
+    // this actions value is Q + rMax * 2 sqrt (log N(s) / N(s,a))
+    uctQ[i] = Q[i] +
+      rewardBound * 2.0 * sqrt(log((float)info->uctVisits) /
+                               (float)info->uctActions[i]);
+  }
+
+  // max element of uctQ
+  std::vector<float>::iterator maxAct =
+    max_element(uctQ.begin(), uctQ.end());
+
+  return maxAct - uctQ.begin();
+
+}
+
+
+void EnvUCT::savePolicy(const char* filename){
+
+  ofstream policyFile(filename, ios::out | ios::binary | ios::trunc);
+
+  // first part, save the vector size
+  int fsize = featmin.size();
+  policyFile.write((char*)&fsize, sizeof(int));
+
+  // save numactions
+  policyFile.write((char*)&numactions, sizeof(int));
+
+  // go through all states, and save Q values
+  for (std::set< std::vector<float> >::iterator i = statespace.begin();
+       i != statespace.end(); i++){
+
+    state_t s = canonicalize(*i);
+    state_info* info = &(statedata[s]);
+
+    // save state
+    policyFile.write((char*)&((*i)[0]), sizeof(float)*fsize);
+
+    // save q-values
+    policyFile.write((char*)&(info->Q[0]), sizeof(float)*numactions);
+
+  }
+
+  policyFile.close();
+}
+
+
+// same discretization as ETUCT::discretizeState
+std::vector<float> EnvUCT::discretizeState(const std::vector<float> &s){
+  std::vector<float> ds(s.size());
+
+  for (unsigned i = 0; i < s.size(); i++){
+
+    // center bins on 0, not edge on 0
+    float factor = (featmax[i] - featmin[i]) / (float)statesPerDim[i];
+    int bin = 0;
+    if (s[i] > 0){
+      bin = (int)((s[i]+factor/2) / factor);
+    } else {
+      bin = (int)((s[i]-factor/2) / factor);
+    }
+
+    ds[i] = factor*bin;
+  }
+
+  return ds;
+}
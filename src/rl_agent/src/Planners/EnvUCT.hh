@@ -0,0 +1,156 @@
+/** \file EnvUCT.hh
+    Defines the EnvUCT class.
+    UCT with eligibility traces that performs its Monte Carlo rollouts
+    on a copy of the true environment rather than on a learned model.
+    A modified version of UCT as presented in:
+    L. Kocsis and C. Szepesv´ari, "Bandit based monte-carlo planning," in
+    ECML-06. Number 4212 in LNCS. Springer, 2006, pp. 282-293.
+*/
+
+#ifndef _ENVUCT_HH_
+#define _ENVUCT_HH_
+
+#include <rl_common/Random.h>
+#include <rl_common/core.hh>
+
+#include <set>
+#include <vector>
+#include <map>
+
+/** This class defines a version of ETUCT that plans with a simulator of
+    the domain.  Before each action, the full state of the real
+    environment is saved with Environment::snapshot, and every rollout
+    restores it into the simulator and steps the simulator itself, so
+    no model is learned or queried.  This gives a ground-truth planning
+    baseline for the model-based planners. */
+class EnvUCT: public Planner {
+public:
+
+  /** Standard constructor
+      \param numactions, numactions in the domain
+      \param gamma discount factor
+      \param rrange range of one-step rewards in the domain
+      \param lambda for use with eligibility traces
+      \param MAX_ITER maximum number of MC rollouts to perform
+      \param MAX_TIME maximum amount of time to run Monte Carlo rollouts
+      \param MAX_DEPTH maximum depth to perform rollout to
+      \param featmax maximum value of each feature
+      \param featmin minimum value of each feature
+      \param statesPerDim # of values to discretize each feature into
+      \param env the real environment the agent is acting in
+      \param sim another environment of the same type and configuration
+      as env, used for the rollouts
+      \param rng random number generator
+  */
+  EnvUCT(int numactions, float gamma, float rrange, float lambda,
+         int MAX_ITER, float MAX_TIME, int MAX_DEPTH,
+         const std::vector<float> &featmax, const std::vector<float> &featmin,
+         const std::vector<int> &statesPerDim,
+         Environment* env, Environment* sim, Random rng = Random());
+
+  /** Unimplemented copy constructor: internal state cannot be simply
+      copied. */
+  EnvUCT(const EnvUCT &);
+
+  virtual ~EnvUCT();
+
+  /** The model is not used: rollouts are done on the simulator. */
+  virtual void setModel(MDPModel* model);
+
+  /** Experiences are not needed, as there is no model to learn.
+      \return false, the model never changes. */
+  virtual bool updateModelWithExperience(const std::vector<float> &last,
+                                         int act,
+                                         const std::vector<float> &curr,
+                                         float reward, bool term);
+  virtual void planOnNewModel();
+
+  /** Plans from the current state of the real environment (the given
+      state is only used by the agent, and may be a discretized version
+      of it). */
+  virtual int getBestAction(const std::vector<float> &s);
+
+  virtual void savePolicy(const char* filename);
+
+  /** Return a discretized version of the input state. */
+  std::vector<float> discretizeState(const std::vector<float> &s);
+
+  bool PLANNERDEBUG;
+  bool UCTDEBUG;
+
+  /** The implementation maps all sensations to a set of canonical
+      pointers, which serve as the internal representation of
+      environment state. */
+  typedef const std::vector<float> *state_t;
+
+protected:
+
+  /** State info struct. Maintains visit counts and q-values for state-actions. */
+  struct state_info {
+
+    // q values from rollouts
+    std::vector<float> Q;
+
+    // uct experience data
+    int uctVisits;
+    std::vector<int> uctActions;
+    short unsigned int visited;
+    short unsigned int id;
+
+  };
+
+  /** Initialize state info struct */
+  void initStateInfo(state_info* info);
+
+  /** Produces a canonical representation of the given sensation.
+      \param s The current sensation from the environment.
+      \return A pointer to an equivalent state in statespace. */
+  state_t canonicalize(const std::vector<float> &s);
+
+  /** Get the current time in seconds */
+  double getSeconds();
+
+  /** Perform a UCT/Monte Carlo rollout from the simulator's current
+      state, stepping the simulator with the action selected by UCB1.
+      Updates the q value of the selected action towards
+      reward + gamma * searchReturn and returns the (lambda-mixed) q. */
+  float uctSearch(state_t state, int depth);
+
+  /** Select UCT action based on UCB1 algorithm. */
+  int selectUCTAction(state_info* info);
+
+private:
+
+  /** Set of all distinct sensations seen.  Pointers to elements of
+      this set serve as the internal representation of the environment
+      state. */
+  std::set<std::vector<float> > statespace;
+
+  /** Hashmap mapping state vectors to their state_info structs. */
+  std::map<state_t, state_info> statedata;
+
+  /** Snapshot of the real environment that each rollout starts from. */
+  std::vector<float> rootState;
+
+  Environment* env;
+  Environment* sim;
+
+  std::vector<float> featmax;
+  std::vector<float> featmin;
+
+  int nstates;
+  int nactions;
+
+  const int numactions;
+  const float gamma;
+  const float rrange;
+  const float lambda;
+
+  const int MAX_ITER;
+  const float MAX_TIME;
+  const int MAX_DEPTH;
+  const std::vector<int> statesPerDim;
+
+};
+
+#endif
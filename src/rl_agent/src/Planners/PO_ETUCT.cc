@@ -775,6 +775,10 @@ std::vector<float> PO_ETUCT::simulateNextState(const std::vector<float> &actualS
     }
   }
 
+  // probabilities summing to just under 1 can miss them all
+  if (nextstate.size() == 0 && modelInfo->transitionProbs.size() > 0)
+    nextstate = modelInfo->transitionProbs.rbegin()->first;
+
   if (trackActual){
 
     // find the relative change from discrete center
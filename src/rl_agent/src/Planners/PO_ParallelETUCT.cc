@@ -76,6 +76,7 @@ PO_ParallelETUCT::PO_ParallelETUCT(int numactions, float gamma, float rrange, fl
   discPlanState = NULL;
   modelThreadStarted = false;
   planThreadStarted = false;
+  stopThreads = false;
   expList.clear();
 
   if (HISTORY_SIZE == 0){
@@ -94,26 +95,20 @@ PO_ParallelETUCT::PO_ParallelETUCT(int numactions, float gamma, float rrange, fl
   }
 
   //  initStates();
-  expfile.initFile("experiences.bin", featmax.size());
 }
 
 PO_ParallelETUCT::~PO_ParallelETUCT() {
-  // join threads
-
-  //pthread_kill(planThread);
-  //pthread_kill(modelThread);
-
-  pthread_detach(planThread);//, NULL);
-  pthread_detach(modelThread);//, NULL);
-
-  pthread_cancel(planThread);//, NULL);
-  pthread_cancel(modelThread);//, NULL);
-
-  //pthread_join(planThread, NULL);
-  //pthread_join(modelThread, NULL);
+  // join threads, which return once they finish what they're doing, so
+  // none are left running on us (trials may run one after another)
+  pthread_mutex_lock(&list_mutex);
+  stopThreads = true;
+  pthread_cond_broadcast(&list_cond);
+  pthread_mutex_unlock(&list_mutex);
 
-  //pthread_detach(planThread);//, NULL);
-  //pthread_detach(modelThread);//, NULL);
+  if (planThreadStarted)
+    pthread_join(planThread, NULL);
+  if (modelThreadStarted)
+    pthread_join(modelThread, NULL);
 
 
   pthread_mutex_lock(&plan_state_mutex);
@@ -125,6 +120,10 @@ PO_ParallelETUCT::~PO_ParallelETUCT() {
   // delete exp list
   expList.clear();
 
+  // the model thread swaps in its own copies, so the model is ours now
+  delete model;
+  model = NULL;
+
   for (std::map<state_t, state_info>::iterator i = statedata.begin();
        i != statedata.end(); i++){
 
@@ -542,7 +541,7 @@ void PO_ParallelETUCT::planOnNewModel(){
 void* poParallelModelLearningStart(void* arg){
   cout << "Start model learning thread" << endl << flush;
   PO_ParallelETUCT* pe = reinterpret_cast<PO_ParallelETUCT*>(arg);
-  while(true){
+  while(!pe->threadsStopping()){
     pe->parallelModelLearning();
     /*
       if (!pe->planThreadStarted){
@@ -554,14 +553,25 @@ void* poParallelModelLearningStart(void* arg){
   return NULL;
 }
 
+bool PO_ParallelETUCT::threadsStopping(){
+  pthread_mutex_lock(&list_mutex);
+  bool stopping = stopThreads;
+  pthread_mutex_unlock(&list_mutex);
+  return stopping;
+}
+
 void PO_ParallelETUCT::parallelModelLearning(){
   //while(true){
 
   // wait for experience list to be non-empty
   pthread_mutex_lock(&list_mutex);
-  while (expList.size() == 0){
+  while (expList.size() == 0 && !stopThreads){
     pthread_cond_wait(&list_cond,&list_mutex);
   }
+  if (stopThreads){
+    pthread_mutex_unlock(&list_mutex);
+    return;
+  }
   pthread_mutex_unlock(&list_mutex);
 
   // copy over experience list
@@ -1045,6 +1055,10 @@ std::vector<float> PO_ParallelETUCT::simulateNextState(const std::vector<float>
     }
   }
 
+  // probabilities summing to just under 1 can miss them all
+  if (nextstate.size() == 0 && modelInfo->transitionProbs.size() > 0)
+    nextstate = modelInfo->transitionProbs.rbegin()->first;
+
   pthread_mutex_unlock(&info->statemodel_mutex);
 
   if (trackActual){
@@ -1127,7 +1141,7 @@ void* poParallelSearchStart(void* arg){
 
   cout << "start parallel uct planning search thread" << endl << flush;
 
-  while(true){
+  while(!pe->threadsStopping()){
     pe->parallelSearch();
   }
 
@@ -107,6 +107,9 @@ public:
   bool modelThreadStarted;
   bool planThreadStarted;
 
+  /** Set (under list_mutex) to have the threads return */
+  bool stopThreads;
+
   // the threads
   /** Thread that performs planning using UCT. */
   pthread_t planThread;
@@ -166,6 +169,9 @@ public:
   
   /** Start the parallel model learning thread. */
   void parallelModelLearning();
+
+  /** Have the planning and model learning threads been told to stop? */
+  bool threadsStopping();
   
   /** Start the parallel UCT planning thread. */
   void parallelSearch();
@@ -320,6 +326,7 @@ private:
   const int HISTORY_SIZE;
   const int HISTORY_FL_SIZE;
 
+  /** Log of experiences, only written if initFile is called on it */
   ExperienceFile expfile;
 };
 
@@ -78,6 +78,7 @@ ParallelETUCT::ParallelETUCT(int numactions, float gamma, float rrange, float la
   discPlanState = NULL;
   modelThreadStarted = false;
   planThreadStarted = false;
+  stopThreads = false;
   expList.clear();
 
   if (HISTORY_SIZE == 0){
@@ -96,26 +97,20 @@ ParallelETUCT::ParallelETUCT(int numactions, float gamma, float rrange, float la
   }
 
   //  initStates();
-  expfile.initFile("experiences.bin", featmax.size());
 }
 
 ParallelETUCT::~ParallelETUCT() {
-  // join threads
-
-  //pthread_kill(planThread);
-  //pthread_kill(modelThread);
-
-  pthread_detach(planThread);//, NULL);
-  pthread_detach(modelThread);//, NULL);
-
-  pthread_cancel(planThread);//, NULL);
-  pthread_cancel(modelThread);//, NULL);
-
-  //pthread_join(planThread, NULL);
-  //pthread_join(modelThread, NULL);
+  // join threads, which return once they finish what they're doing, so
+  // none are left running on us (trials may run one after another)
+  pthread_mutex_lock(&list_mutex);
+  stopThreads = true;
+  pthread_cond_broadcast(&list_cond);
+  pthread_mutex_unlock(&list_mutex);
 
-  //pthread_detach(planThread);//, NULL);
-  //pthread_detach(modelThread);//, NULL);
+  if (planThreadStarted)
+    pthread_join(planThread, NULL);
+  if (modelThreadStarted)
+    pthread_join(modelThread, NULL);
 
 
   pthread_mutex_lock(&plan_state_mutex);
@@ -126,6 +121,10 @@ ParallelETUCT::~ParallelETUCT() {
   // delete exp list
   expList.clear();
 
+  // the model thread swaps in its own copies, so the model is ours now
+  delete model;
+  model = NULL;
+
   for (std::map<state_t, state_info>::iterator i = statedata.begin();
        i != statedata.end(); i++){
 
@@ -375,6 +374,40 @@ void ParallelETUCT::updateStateActionHistoryFromModel(const std::vector<float> &
 
 }
 
+/** Update all the actions of a state from the model in one batch */
+void ParallelETUCT::updateStateFromModel(state_t s, state_info* info, bool staleOnly){
+
+  pthread_mutex_lock(&update_mutex);
+  int updated = lastUpdate;
+  pthread_mutex_unlock(&update_mutex);
+
+  pthread_mutex_lock(&model_mutex);
+
+  std::deque<float> history(1,0.0);
+  batchStates.clear();
+  batchActions.clear();
+  batchInfos.clear();
+  for (int j = 0; j < numactions; j++){
+    StateActionInfo* newModel = &(info->historyModel[j][history]);
+    if (staleOnly && newModel->frameUpdated >= updated)
+      continue;
+    batchStates.push_back(s);
+    batchActions.push_back(j);
+    batchInfos.push_back(newModel);
+  }
+
+  model->getStateActionInfos(batchStates, batchActions, batchInfos, &batchConfs);
+
+  pthread_mutex_lock(&nactions_mutex);
+  for (unsigned k = 0; k < batchInfos.size(); k++){
+    batchInfos[k]->frameUpdated = nactions;
+  }
+  pthread_mutex_unlock(&nactions_mutex);
+
+  pthread_mutex_unlock(&model_mutex);
+
+}
+
 void ParallelETUCT::canonNextStates(StateActionInfo* modelInfo){
 
 
@@ -522,7 +555,7 @@ void ParallelETUCT::planOnNewModel(){
 void* parallelModelLearningStart(void* arg){
   cout << "Start model learning thread" << endl << flush;
   ParallelETUCT* pe = reinterpret_cast<ParallelETUCT*>(arg);
-  while(true){
+  while(!pe->threadsStopping()){
     pe->parallelModelLearning();
     /*
       if (!pe->planThreadStarted){
@@ -534,14 +567,25 @@ void* parallelModelLearningStart(void* arg){
   return NULL;
 }
 
+bool ParallelETUCT::threadsStopping(){
+  pthread_mutex_lock(&list_mutex);
+  bool stopping = stopThreads;
+  pthread_mutex_unlock(&list_mutex);
+  return stopping;
+}
+
 void ParallelETUCT::parallelModelLearning(){
   //while(true){
 
   // wait for experience list to be non-empty
   pthread_mutex_lock(&list_mutex);
-  while (expList.size() == 0){
+  while (expList.size() == 0 && !stopThreads){
     pthread_cond_wait(&list_cond,&list_mutex);
   }
+  if (stopThreads){
+    pthread_mutex_unlock(&list_mutex);
+    return;
+  }
   pthread_mutex_unlock(&list_mutex);
 
   // copy over experience list
@@ -628,10 +672,17 @@ void ParallelETUCT::resetAndUpdateStateActions(){
     for (int j = 0; j < numactions; j++){
       if (info->uctActions[j] > MIN_VISITS)
         info->uctActions[j] = MIN_VISITS;
-      if (info->needsUpdate || info->historyModel[j].size() > CLEAR_SIZE){
+      if (HISTORY_SIZE > 0 &&
+          (info->needsUpdate || info->historyModel[j].size() > CLEAR_SIZE)){
         updateStateActionFromModel(s, j, info);
       }
     }
+    // without history, get all the actions at once
+    if (HISTORY_SIZE == 0 && info->needsUpdate){
+      pthread_mutex_lock(&info->statemodel_mutex);
+      updateStateFromModel(s, info, false);
+      pthread_mutex_unlock(&info->statemodel_mutex);
+    }
     info->needsUpdate = false;
     pthread_mutex_unlock(&info->stateinfo_mutex);
 
@@ -1038,7 +1089,8 @@ std::vector<float> ParallelETUCT::simulateNextState(const std::vector<float> &ac
       }
       updateStateActionHistoryFromModel(modState, action, modelInfo);
     } else {
-      updateStateActionHistoryFromModel(*discState, action, modelInfo);
+      // the other actions here are likely out of date too
+      updateStateFromModel(discState, info, true);
     }
   }
 
@@ -1145,7 +1197,7 @@ void* parallelSearchStart(void* arg){
 
   cout << "start parallel uct planning search thread" << endl << flush;
 
-  while(true){
+  while(!pe->threadsStopping()){
     pe->parallelSearch();
   }
 
@@ -104,6 +104,9 @@ public:
   bool modelThreadStarted;
   bool planThreadStarted;
 
+  /** Set (under list_mutex) to have the threads return */
+  bool stopThreads;
+
   /** Thread that performs planning using UCT. */
   pthread_t planThread;
 
@@ -162,6 +165,9 @@ public:
   /** Start the parallel model learning thread. */
   void parallelModelLearning();
 
+  /** Have the planning and model learning threads been told to stop? */
+  bool threadsStopping();
+
   /** Start the parallel UCT planning thread. */
   void parallelSearch();
 
@@ -243,6 +249,9 @@ protected:
   /** Update the state_info copy of the model for the given state-action and k-action history from the MDPModel. */
   void updateStateActionHistoryFromModel(const std::vector<float> &modState, int a, StateActionInfo *newModel);
 
+  /** Update the state_info copy of the model for every action of a state without a history, or only the ones predicted before the model last changed if staleOnly is set. They are requested from the MDPModel in one batch. The caller must hold the state's statemodel_mutex. */
+  void updateStateFromModel(state_t s, state_info* info, bool staleOnly);
+
   /** Get the current time in seconds */
   double getSeconds();
 
@@ -318,7 +327,14 @@ private:
   const int HISTORY_FL_SIZE;
 
   const unsigned CLEAR_SIZE;
+  /** Log of experiences, only written if initFile is called on it */
   ExperienceFile expfile;
+
+  // state-actions being predicted together by the model, guarded by model_mutex
+  std::vector<const std::vector<float>*> batchStates;
+  std::vector<int> batchActions;
+  std::vector<StateActionInfo*> batchInfos;
+  std::vector<float> batchConfs;
 };
 
 #endif
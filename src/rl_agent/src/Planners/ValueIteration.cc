@@ -111,9 +111,8 @@ void ValueIteration::initNewState(state_t s){
   initStateInfo(info);
 
   // init these from model
-  for (int i = 0; i < numactions; i++){
-    model->getStateActionInfo(*s, i, &(info->modelInfo[i]));
-  }
+  queueStateForUpdate(s, info);
+  flushModelUpdates();
 
 
   if (PLANNERDEBUG) cout << "done with initNewState()" << endl;
@@ -213,9 +212,7 @@ void ValueIteration::updateStatesFromModel(){
 
     // update state info
     // get state action info for each action
-    for (int j = 0; j < numactions; j++){
-      model->getStateActionInfo(*s, j, &(info->modelInfo[j]));
-    }
+    queueStateForUpdate(s, info);
 
     //s2.clear();
 
@@ -225,11 +222,40 @@ void ValueIteration::updateStatesFromModel(){
 
   }
 
+  // predict any left over
+  flushModelUpdates();
+
   if (PLANNERDEBUG) cout << "updateStatesFromModel " << " totally complete" << endl;
 
 }
 
 
+void ValueIteration::queueStateForUpdate(state_t s, state_info* info){
+  for (int j = 0; j < numactions; j++){
+    batchStates.push_back(s);
+    batchActions.push_back(j);
+    batchInfos.push_back(&(info->modelInfo[j]));
+  }
+  if ((int)batchStates.size() >= MODEL_BATCH_SIZE)
+    flushModelUpdates();
+}
+
+
+void ValueIteration::flushModelUpdates(){
+  if (batchStates.size() == 0)
+    return;
+
+  if (PLANNERDEBUG) cout << "flushModelUpdates, " << batchStates.size()
+                         << " state-actions" << endl;
+
+  model->getStateActionInfos(batchStates, batchActions, batchInfos, &batchConfs);
+
+  batchStates.clear();
+  batchActions.clear();
+  batchInfos.clear();
+}
+
+
 int ValueIteration::getBestAction(const std::vector<float> &state){
   if (PLANNERDEBUG) cout << "getBestAction(s = " << &state
                          << ")" << endl;
@@ -423,8 +449,6 @@ void ValueIteration::createPolicy(){
                                nextinfo->Q.end());
             maxval = *maxAct;
             
-            nextstate.clear();
-            
             if (POLICYDEBUG) cout << "    Max value: " << maxval << endl;
 
             // update q value with this value
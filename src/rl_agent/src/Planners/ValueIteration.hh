@@ -13,6 +13,9 @@
 #include <vector>
 #include <map>
 
+/** # of state-actions sent to the model at a time when updating from it */
+#define MODEL_BATCH_SIZE 256
+
 /** Planner that performs value iteration to compute a policy based on a model */
 class ValueIteration: public Planner {
 public:
@@ -130,6 +133,12 @@ protected:
   /** Update a given state-actions model in its state_info struct from the MDPModel */
   void updateStateActionFromModel(const std::vector<float> &state, int j);
 
+  /** Queue every action of the given state to be updated from the model, flushing the queue when it is full */
+  void queueStateForUpdate(state_t s, state_info* info);
+
+  /** Get predictions from the model for all the queued state-actions at once */
+  void flushModelUpdates();
+
   /** Get the current time in seconds */
   double getSeconds();
 
@@ -168,6 +177,12 @@ private:
   const int modelType;
   const std::vector<int> statesPerDim;
 
+  // state-actions waiting on predictions from the model
+  std::vector<const std::vector<float>*> batchStates;
+  std::vector<int> batchActions;
+  std::vector<StateActionInfo*> batchInfos;
+  std::vector<float> batchConfs;
+
 };
 
 
@@ -18,6 +18,7 @@
 #include <rl_agent/SavedPolicy.hh>
 #include <rl_agent/Dyna.hh>
 #include <rl_agent/Sarsa.hh>
+#include <rl_agent/TileCodingAgent.hh>
 
 #include "std_msgs/String.h"
 
@@ -53,6 +54,7 @@ int planner = PAR_ETUCT_ACTUAL;
 int nmodels = 1;
 bool reltrans = true;
 int nstates = 0;
+int ntilings = TILE_NUM_TILINGS;
 int k = 1000;
 char *filename = NULL;
 int history = 0;
@@ -63,7 +65,7 @@ float n = 0;
 
 void displayHelp(){
   cout << "\n Call agent --agent type [options]\n";
-  cout << "Agent types: qlearner sarsa modelbased rmax texplore dyna savedpolicy\n";
+  cout << "Agent types: qlearner sarsa modelbased rmax texplore dyna savedpolicy tilecoding\n";
   cout << "\n Options:\n";
   cout << "--seed value (integer seed for random number generator)\n";
   cout << "--gamma value (discount factor between 0 and 1)\n";
@@ -79,9 +81,10 @@ void displayHelp(){
   cout << "--model type (tabular,tree,m5tree)\n";
   cout << "--planner type (vi,pi,sweeping,uct,parallel-uct,delayed-uct,delayed-parallel-uct)\n";
   cout << "--explore type (unknown,greedy,epsilongreedy,variancenovelty)\n";
-  cout << "--combo type (average,best,separate)\n";
+  cout << "--combo type (average,best,separate,sampled)\n";
   cout << "--nmodels value (# of models)\n";
   cout << "--nstates value (optionally discretize domain into value # of states on each feature)\n";
+  cout << "--ntilings value (For tilecoding: # of tilings, each with nstates tiles on each feature)\n";
   cout << "--reltrans (learn relative transitions)\n";
   cout << "--abstrans (learn absolute transitions)\n";
   cout << "--v value (For TEXPLORE: b/v coefficient for rewarding state-actions where models disagree)\n";
@@ -188,7 +191,7 @@ void processEnvDescription(const rl_msgs::RLEnvDescription::ConstPtr &envIn){
                                 nstates,
                                 history, v, n, false, reltrans, 0.2,
                                 envIn->stochastic, envIn->episodic,
-                                rng);
+                                false, 0, rng);
 
   }
 
@@ -206,6 +209,16 @@ void processEnvDescription(const rl_msgs::RLEnvDescription::ConstPtr &envIn){
                       rng);
   }
 
+  else if (strcmp(agentType, "tilecoding") == 0){
+    cout << "Agent: Tile Coding" << endl;
+    agent = new TileCodingAgent(envIn->num_actions, discountfactor,
+                                initialvalue, alpha, epsilon, lambda,
+                                (nstates > 0) ? nstates : 10, ntilings,
+                                TILE_MEMORY_SIZE, false,
+                                envIn->min_state_range, envIn->max_state_range,
+                                rng);
+  }
+
   else if (strcmp(agentType, "savedpolicy") == 0){
     cout << "Agent: Saved Policy" << endl;
     agent = new SavedPolicy(envIn->num_actions, filename);
@@ -218,8 +231,9 @@ void processEnvDescription(const rl_msgs::RLEnvDescription::ConstPtr &envIn){
   }
 
   Agent* a2 = agent;
-  // not for model based when doing continuous model
-  if (nstates > 0 && (model != M5ALLMULTI || strcmp(agentType, "qlearner") == 0)){
+  // not for model based when doing continuous model, or tile coding
+  if (nstates > 0 && (model != M5ALLMULTI || strcmp(agentType, "qlearner") == 0)
+      && strcmp(agentType, "tilecoding") != 0){
     int totalStates = powf(nstates,envIn->min_state_range.size());
     if (PRINTS) cout << "Discretize with " << nstates << ", total: " << totalStates << endl;
     agent = new DiscretizationAgent(nstates, a2,
@@ -313,7 +327,8 @@ int main(int argc, char *argv[])
     {"history", 1, 0, 'y'},
     {"b", 1, 0, 'b'},
     {"v", 1, 0, 'v'},
-    {"n", 1, 0, 'n'}
+    {"n", 1, 0, 'n'},
+    {"ntilings", 1, 0, 13}
   };
 
   bool epsilonChanged = false;
@@ -367,11 +382,11 @@ int main(int argc, char *argv[])
 
     case 'a':
       {
-        if (strcmp(agentType, "qlearner") == 0 || strcmp(agentType, "dyna") == 0 || strcmp(agentType, "sarsa") == 0){
+        if (strcmp(agentType, "qlearner") == 0 || strcmp(agentType, "dyna") == 0 || strcmp(agentType, "sarsa") == 0 || strcmp(agentType, "tilecoding") == 0){
           alpha = std::atof(optarg);
           cout << "alpha: " << alpha << endl;
         } else {
-          cout << "--alpha option is only valid for Q-Learning, Dyna, and Sarsa" << endl;
+          cout << "--alpha option is only valid for Q-Learning, Dyna, Sarsa, and tile coding" << endl;
           exit(-1);
         }
         break;
@@ -379,11 +394,11 @@ int main(int argc, char *argv[])
 
     case 'i':
       {
-        if (strcmp(agentType, "qlearner") == 0 || strcmp(agentType, "dyna") == 0 || strcmp(agentType, "sarsa") == 0){
+        if (strcmp(agentType, "qlearner") == 0 || strcmp(agentType, "dyna") == 0 || strcmp(agentType, "sarsa") == 0 || strcmp(agentType, "tilecoding") == 0){
           initialvalue = std::atof(optarg);
           cout << "initialvalue: " << initialvalue << endl;
         } else {
-          cout << "--initialvalue option is only valid for Q-Learning, Dyna, and Sarsa" << endl;
+          cout << "--initialvalue option is only valid for Q-Learning, Dyna, Sarsa, and tile coding" << endl;
           exit(-1);
         }
         break;
@@ -405,7 +420,7 @@ int main(int argc, char *argv[])
     case 'l':
       {
         lambdaChanged = true;
-        if (strcmp(agentType, "texplore") == 0 || strcmp(agentType, "modelbased") == 0 || strcmp(agentType, "rmax") == 0 || strcmp(agentType, "sarsa") == 0){
+        if (strcmp(agentType, "texplore") == 0 || strcmp(agentType, "modelbased") == 0 || strcmp(agentType, "rmax") == 0 || strcmp(agentType, "sarsa") == 0 || strcmp(agentType, "tilecoding") == 0){
           lambda = std::atof(optarg);
           cout << "lambda: " << lambda << endl;
         } else {
@@ -504,6 +519,7 @@ int main(int argc, char *argv[])
           else if (strcmp(optarg, "weighted") == 0) modelcombo = WEIGHTAVG;
           else if (strcmp(optarg, "best") == 0) modelcombo = BEST;
           else if (strcmp(optarg, "separate") == 0) modelcombo = SEPARATE;
+          else if (strcmp(optarg, "sampled") == 0) modelcombo = SAMPLED;
           cout << "modelcombo: " << comboNames[modelcombo] << endl;
         } else {
           cout << "--combo is an invalid option for agent: " << agentType << endl;
@@ -600,6 +616,18 @@ int main(int argc, char *argv[])
         break;
       }
 
+    case 13:
+      {
+        if (strcmp(agentType, "tilecoding") == 0){
+          ntilings = std::atoi(optarg);
+          cout << "ntilings: " << ntilings << endl;
+        } else {
+          cout << "--ntilings option is only valid for the tilecoding agent" << endl;
+          exit(-1);
+        }
+        break;
+      }
+
     case 'h':
     case '?':
     case 0:
@@ -0,0 +1,131 @@
+/** \file benchmark.cpp
+    Times predictions of the tree models used by the model based agents.
+    Usage: benchmark [# training instances] [# predictions]
+    \author Todd Hester
+*/
+
+#include <rl_common/Random.h>
+#include <rl_common/core.hh>
+
+#include "Models/C45Tree.hh"
+#include "Models/M5Tree.hh"
+#include "Models/LinearSplitsTree.hh"
+#include "Models/MultipleClassifiers.hh"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#define NFEATS 6
+
+int ntrain = 2000;
+int npredict = 1000000;
+
+
+double getSeconds(){
+  struct timezone tz;
+  timeval timeT;
+  gettimeofday(&timeT, &tz);
+  return  timeT.tv_sec + (timeT.tv_usec / 1000000.0);
+}
+
+
+/** Make random inputs on a grid, with a discrete output for classification
+    trees and a piecewise linear output for regression trees. */
+void makeData(Random &rng, int n, bool discrete, std::vector<classPair> *data){
+  data->resize(n);
+  for (int i = 0; i < n; i++){
+    classPair &cp = (*data)[i];
+    cp.in.resize(NFEATS);
+    for (int j = 0; j < NFEATS; j++){
+      cp.in[j] = rng.uniformDiscrete(0, 20);
+    }
+    if (discrete){
+      cp.out = ((int)(7*cp.in[0] + 3*cp.in[1] + cp.in[2]) % 5)
+        - (cp.in[3] > cp.in[4]);
+    } else {
+      cp.out = ((int)cp.in[0] % 4) * cp.in[1] + ((int)cp.in[2] % 3) * cp.in[3]
+        - (cp.in[4] > 10) * cp.in[5];
+    }
+  }
+}
+
+
+/** Train the tree, then time its predictions on the given inputs. */
+void timeTree(const char* name, Classifier* tree,
+              std::vector<classPair> &train, std::vector<classPair> &test){
+
+  double trainStart = getSeconds();
+  tree->trainInstances(train);
+  double trainTime = getSeconds() - trainStart;
+
+  std::map<float, float> retval;
+  float sum = 0;
+  double start = getSeconds();
+  for (int i = 0; i < npredict; i++){
+    const std::vector<float> &input = test[i % test.size()].in;
+    tree->testInstance(input, &retval);
+    sum += retval.begin()->first + tree->getConf(input);
+  }
+  double elapsed = getSeconds() - start;
+
+  printf("%-12s train: %8.3f s  predictions/sec: %12.0f  (checksum %g)\n",
+         name, trainTime, npredict / elapsed, sum);
+}
+
+
+/** Time training an ensemble one instance at a time, as the agents do. */
+void timeEnsemble(const char* name, Classifier* ensemble,
+                  std::vector<classPair> &train){
+
+  double start = getSeconds();
+  for (unsigned i = 0; i < train.size(); i++){
+    ensemble->trainInstance(train[i]);
+  }
+  double elapsed = getSeconds() - start;
+
+  printf("%-12s train: %8.3f s  (%d threads in pool)\n",
+         name, elapsed, ThreadPool::shared()->size());
+}
+
+
+int main(int argc, char **argv){
+
+  if (argc > 1) ntrain = atoi(argv[1]);
+  if (argc > 2) npredict = atoi(argv[2]);
+
+  printf("%d training instances, %d predictions\n", ntrain, npredict);
+
+  Random rng(1 + ntrain);
+  std::vector<classPair> train;
+  std::vector<classPair> test;
+
+  makeData(rng, ntrain, true, &train);
+  makeData(rng, 1000, true, &test);
+  C45Tree* c45 = new C45Tree(0, BUILD_ON_ERROR, 5, 0, 0, rng);
+  timeTree("C4.5 Tree", c45, train, test);
+  delete c45;
+
+  makeData(rng, ntrain, false, &train);
+  makeData(rng, 1000, false, &test);
+  M5Tree* m5 = new M5Tree(0, BUILD_ON_ERROR, 5, 0, 0, false, false, 0.1, rng);
+  timeTree("M5 Tree", m5, train, test);
+  delete m5;
+
+  LinearSplitsTree* ls = new LinearSplitsTree(0, BUILD_ON_ERROR, 5, 0, 0, false, 0.1, rng);
+  timeTree("LS Tree", ls, train, test);
+  delete ls;
+
+  // forests, rebuilt every 100 instances with each tree trained on the thread pool
+  makeData(rng, ntrain, true, &train);
+  MultipleClassifiers* c45Forest = new MultipleClassifiers(0, C45TREE, AVERAGE, 5, BUILD_EVERY_N, 100, 0.2, 0.6, 0, true, 20, rng);
+  timeEnsemble("C4.5 Forest", c45Forest, train);
+  delete c45Forest;
+
+  makeData(rng, ntrain, false, &train);
+  MultipleClassifiers* m5Forest = new MultipleClassifiers(0, M5MULTI, AVERAGE, 5, BUILD_EVERY_N, 100, 0.2, 0.6, 0.1, false, 20, rng);
+  timeEnsemble("M5 Forest", m5Forest, train);
+  delete m5Forest;
+
+  return 0;
+}
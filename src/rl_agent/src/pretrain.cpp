@@ -0,0 +1,301 @@
+/** \file pretrain.cpp
+    Trains the tree models of the model based agents offline on logged
+    experiences, and writes them to a model file the agents can start
+    from (rl_experiment --modelfile), rather than seeding the agent with
+    the experiences one at a time.
+    Usage: model_pretrain [options] --out file log [log ...]
+*/
+
+#include <rl_common/Random.h>
+#include <rl_common/core.hh>
+#include <rl_common/ExperienceFile.hh>
+
+#include "Models/FactoredModel.hh"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <sys/time.h>
+
+
+double getSeconds(){
+  struct timezone tz;
+  timeval timeT;
+  gettimeofday(&timeT, &tz);
+  return  timeT.tv_sec + (timeT.tv_usec / 1000000.0);
+}
+
+
+void displayHelp(){
+  cout << "\n Usage: model_pretrain [options] --out file log [log ...]\n";
+  cout << "\n Trains the trees of a model based agent on the experiences in the logs\n";
+  cout << " (written with rl_experiment --explog) and saves them to file.\n";
+  cout << " The model options must match the ones of the agent that loads it.\n";
+
+  cout << "\n Options:\n";
+  cout << "--out file (model file to write)\n";
+  cout << "--agent type (texplore,modelbased: sets the model defaults of that agent)\n";
+  cout << "--model type (tree,texplore,c45tree)\n";
+  cout << "--combo type (average,best,weighted,sampled)\n";
+  cout << "--nmodels value (# of models)\n";
+  cout << "--m value (parameter for R-Max)\n";
+  cout << "--reltrans (learn relative transitions)\n";
+  cout << "--abstrans (learn absolute transitions)\n";
+  cout << "--featpct value (pct of features to remove from each tree split of a forest)\n";
+  cout << "--compress (trees keep repeated experiences as one weighted experience)\n";
+  cout << "--actions value (# of actions in the domain (one more than the largest logged action default)\n";
+  cout << "--episodic (the domain is episodic (default if any logged experience is terminal)\n";
+  cout << "--continuing (the domain is not episodic)\n";
+  cout << "--seed value (integer seed for random number generator)\n";
+
+  exit(-1);
+}
+
+
+/** Read all the experiences of a log onto the end of exps.
+    \return the # of features of the log */
+int readLog(const char* filename, std::vector<experience> *exps){
+  ExperienceFile log;
+  if (!log.openFile(filename)){
+    std::cerr << "Could not read experience log " << filename << endl;
+    exit(-1);
+  }
+
+  const int nfeats = log.numFeatures();
+  const int recSize = ExperienceFile::recordSize(nfeats);
+  exps->reserve(exps->size() + log.numExperiences());
+  for (int ch = 0; ch < log.numChunks(); ch++){
+    int nexp = 0;
+    const float* rec = log.chunk(ch, &nexp);
+    for (int i = 0; i < nexp; i++){
+      exps->push_back(experience());
+      ExperienceFile::getExperience(rec + i*recSize, nfeats, &(exps->back()));
+    }
+  }
+
+  cout << "Read " << log.numExperiences() << " experiences with "
+       << nfeats << " features from " << filename << endl;
+  return nfeats;
+}
+
+
+int main(int argc, char **argv){
+
+  // defaults of the modelbased agent in rl_experiment
+  const char* outfile = NULL;
+  int modelType = C45TREE;
+  int predType = BEST;
+  int nmodels = 1;
+  int M = 5;
+  bool reltrans = true;
+  float featPct = 0.2;
+  bool compress = false;
+  int numactions = 0;
+  int episodic = -1;
+  int seed = 1;
+
+  static struct option long_options[] = {
+    {"out", 1, 0, 'f'},
+    {"agent", 1, 0, 'q'},
+    {"model", 1, 0, 'o'},
+    {"combo", 1, 0, 'c'},
+    {"nmodels", 1, 0, '#'},
+    {"m", 1, 0, 'm'},
+    {"reltrans", 0, 0, 't'},
+    {"abstrans", 0, 0, '0'},
+    {"featpct", 1, 0, 'p'},
+    {"compress", 0, 0, 'z'},
+    {"actions", 1, 0, 'a'},
+    {"episodic", 0, 0, 'e'},
+    {"continuing", 0, 0, 'n'},
+    {"seed", 1, 0, 's'},
+    {"help", 0, 0, 'h'},
+    {0, 0, 0, 0}
+  };
+
+  int ch;
+  int option_index = 0;
+  while(-1 != (ch = getopt_long_only(argc, argv, "", long_options, &option_index))) {
+    switch(ch) {
+
+    case 'f':
+      outfile = optarg;
+      break;
+
+    case 'q':
+      // same model as rl_experiment sets up for these agents
+      if (strcmp(optarg, "texplore") == 0){
+        predType = AVERAGE;
+        nmodels = 5;
+        M = 0;
+      } else if (strcmp(optarg, "modelbased") != 0){
+        cout << "Only texplore and modelbased agents use tree models" << endl;
+        exit(-1);
+      }
+      break;
+
+    case 'o':
+      if (strcmp(optarg, "tree") == 0 || strcmp(optarg, "texplore") == 0 ||
+          strcmp(optarg, "c45tree") == 0){
+        modelType = C45TREE;
+      } else if (strcmp(optarg, "m5tree") == 0 || strcmp(optarg, "m5") == 0){
+        cout << "M5 trees can't be saved to a model file yet, only c4.5 trees" << endl;
+        exit(-1);
+      } else {
+        cout << "Only c4.5 tree models can be saved" << endl;
+        exit(-1);
+      }
+      break;
+
+    case 'c':
+      if (strcmp(optarg, "average") == 0) predType = AVERAGE;
+      else if (strcmp(optarg, "weighted") == 0) predType = WEIGHTAVG;
+      else if (strcmp(optarg, "best") == 0) predType = BEST;
+      else if (strcmp(optarg, "sampled") == 0) predType = SAMPLED;
+      else {
+        cout << "Invalid combo type (separate models can't be saved)" << endl;
+        exit(-1);
+      }
+      break;
+
+    case '#':
+      nmodels = std::atoi(optarg);
+      if (nmodels < 1){
+        cout << "nmodels must be > 0" << endl;
+        exit(-1);
+      }
+      break;
+
+    case 'm':
+      M = std::atoi(optarg);
+      break;
+
+    case 't':
+      reltrans = true;
+      break;
+
+    case '0':
+      reltrans = false;
+      break;
+
+    case 'p':
+      featPct = std::atof(optarg);
+      break;
+
+    case 'z':
+      compress = true;
+      break;
+
+    case 'a':
+      numactions = std::atoi(optarg);
+      break;
+
+    case 'e':
+      episodic = 1;
+      break;
+
+    case 'n':
+      episodic = 0;
+      break;
+
+    case 's':
+      seed = std::atoi(optarg);
+      break;
+
+    case 'h':
+    case '?':
+    default:
+      displayHelp();
+      break;
+    }
+  }
+
+  if (outfile == NULL || optind >= argc){
+    cout << "--out file and at least one log are required" << endl;
+    displayHelp();
+  }
+
+  // every log, in one batch
+  std::vector<experience> exps;
+  int nfeats = -1;
+  for (int i = optind; i < argc; i++){
+    int n = readLog(argv[i], &exps);
+    if (nfeats >= 0 && n != nfeats){
+      std::cerr << argv[i] << " has " << n << " features, not " << nfeats << endl;
+      exit(-1);
+    }
+    nfeats = n;
+  }
+
+  if (exps.size() == 0){
+    std::cerr << "No experiences to train on" << endl;
+    exit(-1);
+  }
+
+  // ranges of the features and rewards, actions and termination seen
+  std::vector<float> featMin(exps[0].s);
+  std::vector<float> featMax(exps[0].s);
+  float minR = exps[0].reward;
+  float maxR = exps[0].reward;
+  int maxAct = 0;
+  bool sawTerminal = false;
+  for (unsigned i = 0; i < exps.size(); i++){
+    const experience &e = exps[i];
+    for (int j = 0; j < nfeats; j++){
+      featMin[j] = std::min(featMin[j], std::min(e.s[j], e.next[j]));
+      featMax[j] = std::max(featMax[j], std::max(e.s[j], e.next[j]));
+    }
+    minR = std::min(minR, e.reward);
+    maxR = std::max(maxR, e.reward);
+    maxAct = std::max(maxAct, e.act);
+    sawTerminal = sawTerminal || e.terminal;
+  }
+
+  if (numactions == 0)
+    numactions = maxAct + 1;
+  if (maxAct >= numactions){
+    std::cerr << "Logged action " << maxAct << " is outside the "
+              << numactions << " actions" << endl;
+    exit(-1);
+  }
+  if (episodic < 0)
+    episodic = sawTerminal;
+
+  std::vector<float> featRange(nfeats);
+  for (int j = 0; j < nfeats; j++){
+    featRange[j] = featMax[j] - featMin[j];
+  }
+
+  cout << exps.size() << " experiences, " << numactions << " actions, "
+       << (episodic ? "episodic" : "not episodic") << endl;
+
+  // the same model ModelBasedAgent makes, with its random values.  The
+  // settings that shape c4.5 trees are written to the model file, and the
+  // agent loading it checks them against its own.  The others (the ranges
+  // seen in the logs, tree threshold, stochasticity and confidence) only
+  // change how the trees are used, which the loading agent sets itself.
+  Random rng(1 + seed);
+  for (int i = 0; i < modelType; i++){
+    rng.uniform(0, 1);
+  }
+  FactoredModel model(0, numactions, M, modelType, predType, nmodels, 0.0001,
+                      featRange, maxR - minR, false, false, reltrans,
+                      featPct, true, episodic, compress,
+                      0, // trees with capped experiences can't be saved
+                      rng);
+
+  // one pass, with the trees built once each on the thread pool
+  double start = getSeconds();
+  model.updateWithExperiences(exps);
+  cout << "Trained on " << exps.size() << " experiences in "
+       << (getSeconds() - start) << " seconds" << endl;
+
+  if (!model.saveModel(outfile)){
+    std::cerr << "Could not save model to " << outfile << endl;
+    exit(-1);
+  }
+  cout << "Saved model to " << outfile << endl;
+
+  return 0;
+}
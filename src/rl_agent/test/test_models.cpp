@@ -0,0 +1,203 @@
+/** \file test_models.cpp
+    Unit tests of the tree models.
+*/
+
+#include <rl_common/Random.h>
+#include <rl_common/core.hh>
+
+#include "../src/Models/FactoredModel.hh"
+#include "../src/Models/C45Tree.hh"
+
+#include <gtest/gtest.h>
+
+
+/** Experiences from state (0,0) with action 0, where the first feature
+    goes to 1 in 4 of every 10 and the second in 3 of every 10, independently */
+std::vector<experience> stochasticExperiences(){
+  std::vector<experience> exps;
+  const int next0[10] = {0, 0, 0, 0, 0, 0, 1, 1, 1, 1};
+  const int next1[10] = {0, 1, 0, 0, 1, 0, 0, 1, 0, 0};
+  for (int i = 0; i < 10; i++){
+    experience e;
+    e.s.assign(2, 0.0);
+    e.act = 0;
+    e.reward = -1.0;
+    e.next.resize(2);
+    e.next[0] = next0[i];
+    e.next[1] = next1[i];
+    e.terminal = false;
+    exps.push_back(e);
+  }
+  return exps;
+}
+
+/** A single C4.5 tree per feature, with absolute transitions */
+FactoredModel* stochasticModel(){
+  std::vector<float> featRange(2, 1.0);
+  FactoredModel* model = new FactoredModel(0, 2, 0, C45TREE, BEST, 1, 0.0001,
+                                           featRange, 1.0, false, false, false,
+                                           0.2, true, false, false, 0, Random(1));
+  std::vector<experience> exps = stochasticExperiences();
+  model->updateWithExperiences(exps);
+  return model;
+}
+
+float outcomeProb(const StateActionInfo &info, float f0, float f1){
+  std::vector<float> next(2);
+  next[0] = f0;
+  next[1] = f1;
+  std::map<std::vector<float>, float>::const_iterator it = info.transitionProbs.find(next);
+  if (it == info.transitionProbs.end())
+    return 0.0;
+  return it->second;
+}
+
+
+TEST(FactoredModel, PredictsJointDistribution){
+  FactoredModel* model = stochasticModel();
+  std::vector<float> state(2, 0.0);
+  StateActionInfo info;
+  model->getStateActionInfo(state, 0, &info);
+
+  ASSERT_EQ(4u, info.transitionProbs.size());
+  EXPECT_NEAR(0.42, outcomeProb(info, 0, 0), 1e-4);
+  EXPECT_NEAR(0.18, outcomeProb(info, 0, 1), 1e-4);
+  EXPECT_NEAR(0.28, outcomeProb(info, 1, 0), 1e-4);
+  EXPECT_NEAR(0.12, outcomeProb(info, 1, 1), 1e-4);
+  delete model;
+}
+
+TEST(FactoredModel, KeepsMostLikelyOutcomes){
+  FactoredModel* model = stochasticModel();
+  model->setOutcomeLimits(2, 0.0);
+  std::vector<float> state(2, 0.0);
+  StateActionInfo info;
+  model->getStateActionInfo(state, 0, &info);
+
+  // the 0.3 pruned is spread over the two kept in proportion
+  ASSERT_EQ(2u, info.transitionProbs.size());
+  EXPECT_NEAR(0.6, outcomeProb(info, 0, 0), 1e-4);
+  EXPECT_NEAR(0.4, outcomeProb(info, 1, 0), 1e-4);
+  delete model;
+}
+
+TEST(FactoredModel, PrunesUnlikelyOutcomes){
+  FactoredModel* model = stochasticModel();
+  std::vector<float> state(2, 0.0);
+  StateActionInfo info;
+
+  // limits set after a prediction was cached still apply
+  model->setCacheSize(100);
+  model->getStateActionInfo(state, 0, &info);
+  model->setOutcomeLimits(0, 0.15);
+  model->getStateActionInfo(state, 0, &info);
+
+  ASSERT_EQ(3u, info.transitionProbs.size());
+  EXPECT_NEAR(0.42 / 0.88, outcomeProb(info, 0, 0), 1e-4);
+  EXPECT_NEAR(0.18 / 0.88, outcomeProb(info, 0, 1), 1e-4);
+  EXPECT_NEAR(0.28 / 0.88, outcomeProb(info, 1, 0), 1e-4);
+  EXPECT_EQ(0.0, outcomeProb(info, 1, 1));
+  delete model;
+}
+
+/** Experiences with 100 different states, each taking action 0 to the next state */
+std::vector<experience> distinctExperiences(){
+  std::vector<experience> exps;
+  for (int i = 0; i < 100; i++){
+    experience e;
+    e.s.assign(1, i);
+    e.act = 0;
+    e.reward = -1.0;
+    e.next.assign(1, i+1);
+    e.terminal = false;
+    exps.push_back(e);
+  }
+  return exps;
+}
+
+TEST(FactoredModel, CacheFollowsLeafCounts){
+  FactoredModel* model = stochasticModel();
+  model->setCacheSize(100);
+  std::vector<float> state(2, 0.0);
+  StateActionInfo info;
+  model->getStateActionInfo(state, 0, &info);
+  EXPECT_NEAR(0.28, outcomeProb(info, 1, 0), 1e-4);
+
+  // another experience from the same state only changes the counts in
+  // the trees' single leaves, not their splits
+  experience e;
+  e.s.assign(2, 0.0);
+  e.act = 0;
+  e.reward = -1.0;
+  e.next.assign(2, 0.0);
+  e.next[0] = 1;
+  e.terminal = false;
+  model->updateWithExperience(e);
+
+  model->getStateActionInfo(state, 0, &info);
+  EXPECT_NEAR(5.0/11.0 * 8.0/11.0, outcomeProb(info, 1, 0), 1e-4);
+  delete model;
+}
+
+TEST(FactoredModel, CappedTreesSkipSharedStore){
+  std::vector<float> featRange(1, 100.0);
+  FactoredModel model(0, 1, 0, C45TREE, BEST, 1, 0.0001, featRange, 1.0,
+                      false, false, false, 0.2, true, false, false, 10,
+                      Random(1));
+  std::vector<experience> exps = distinctExperiences();
+  model.updateWithExperiences(exps);
+
+  // the capped trees keep the inputs they sample themselves
+  EXPECT_EQ(0, model.getStoreSize());
+}
+
+TEST(C45Tree, StoreStaysFlatPastCap){
+  C45Tree tree(0, BUILD_ON_ERROR, 5, 0, 0.0, Random(1));
+  tree.setExperienceCap(10);
+  for (int i = 0; i < 1000; i++){
+    classPair cp;
+    cp.in.assign(1, i);
+    cp.out = i % 2;
+    cp.row = -1;
+    tree.trainInstance(cp);
+
+    // replaced inputs are compacted away once they fill the store
+    ASSERT_LT(tree.getStoreSize(), 20);
+  }
+  EXPECT_GE(tree.getStoreSize(), 10);
+}
+
+TEST(FactoredModel, LoadsOnlyMatchingModelFiles){
+  FactoredModel* model = stochasticModel();
+  std::string filename = testing::TempDir() + "test_models.model";
+  ASSERT_TRUE(model->saveModel(filename.c_str()));
+
+  std::vector<float> featRange(2, 1.0);
+  FactoredModel same(0, 2, 0, C45TREE, BEST, 1, 0.0001, featRange, 1.0,
+                     false, false, false, 0.2, true, false, false, 0,
+                     Random(1));
+  ASSERT_TRUE(same.loadModel(filename.c_str()));
+  std::vector<float> state(2, 0.0);
+  StateActionInfo info;
+  same.getStateActionInfo(state, 0, &info);
+  EXPECT_NEAR(0.42, outcomeProb(info, 0, 0), 1e-4);
+
+  // trees trained without compressing duplicates, or with another M
+  FactoredModel compressed(0, 2, 0, C45TREE, BEST, 1, 0.0001, featRange, 1.0,
+                           false, false, false, 0.2, true, false, true, 0,
+                           Random(1));
+  EXPECT_FALSE(compressed.loadModel(filename.c_str()));
+  FactoredModel otherM(0, 2, 5, C45TREE, BEST, 1, 0.0001, featRange, 1.0,
+                       false, false, false, 0.2, true, false, false, 0,
+                       Random(1));
+  EXPECT_FALSE(otherM.loadModel(filename.c_str()));
+
+  remove(filename.c_str());
+  delete model;
+}
+
+
+int main(int argc, char **argv){
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
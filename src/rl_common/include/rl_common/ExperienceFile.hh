@@ -1,3 +1,24 @@
+/** \file ExperienceFile.hh
+    Defines the ExperienceFile class, which logs experiences to a chunked,
+    append-only file from a background thread, and reads them back
+    through a memory map.
+
+    File layout (in host byte order):
+    - header: magic "RLEXPLOG", version, # of features, experiences per
+      chunk, and flags.
+    - chunks: a chunk header (magic, # of experiences, raw and stored
+      sizes, compression, CRC-32 of the stored bytes), then the stored
+      bytes, padded to a multiple of 4.
+    - index, written when the file is closed: the offset and # of
+      experiences of each chunk, then a footer with the offset of the
+      index, the # of chunks and a magic.
+
+    Each experience is stored as a record of 2*nfeats+3 words: s, next,
+    act (int), reward and terminal (int).  A file that was never closed
+    has no index, and its chunks are found by scanning them and checking
+    their CRCs, stopping at the first one that was not fully written.
+*/
+
 #ifndef _EXPFILE_HH_
 #define _EXPFILE_HH_
 
@@ -5,54 +26,342 @@
 #include "core.hh"
 
 #include <vector>
+#include <deque>
 #include <algorithm>
+#include <string.h>
+#include <stdio.h>
 
 #include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+/** Default # of experiences per chunk */
+#define EXPFILE_CHUNK_SIZE 1024
+
+#define EXPFILE_VERSION 1
+#define EXPFILE_CHUNK_MAGIC 0x4b4e4843 // "CHNK"
+#define EXPFILE_INDEX_MAGIC 0x58444e49 // "INDX"
+
+/** Ways a chunk's records can be stored */
+enum expFileCompression {
+  EXPFILE_RAW,       // the records as they are
+  EXPFILE_ZERO_RUNS  // runs of zero bytes replaced by their length
+};
+
+/** Header at the start of an experience file */
+struct expFileHeader {
+  char magic[8];
+  int version;
+  int nfeats;
+  int chunkSize;
+  int flags;
+};
+
+/** Header before each chunk of records */
+struct expChunkHeader {
+  int magic;
+  int nexp;
+  int rawBytes;
+  int storedBytes;
+  int compression;
+  unsigned int crc;
+};
+
+/** Index entry for one chunk */
+struct expChunkIndex {
+  long long offset;
+  int nexp;
+  int unused;
+};
+
+/** Footer at the end of a closed file, locating the index */
+struct expFileFooter {
+  long long indexOffset;
+  int nchunks;
+  int magic;
+};
+
 
 class ExperienceFile {
 public:
   /** Standard constructor
    */
-
-  ofstream vectorFile;
-  int expNum;
-
   ExperienceFile(){
     expNum = 0;
+    nfeats = 0;
+    chunkSize = EXPFILE_CHUNK_SIZE;
+    compress = false;
+
+    outFile = NULL;
+    writing = false;
+    stopping = false;
+    nQueued = 0;
+    nWritten = 0;
+    fileOffset = 0;
+
+    mapData = NULL;
+    mapSize = 0;
+    mappedFeats = 0;
+
+    // CRC-32 table (polynomial 0xEDB88320)
+    for (unsigned int i = 0; i < 256; i++){
+      unsigned int c = i;
+      for (int k = 0; k < 8; k++){
+        c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+      }
+      crcTable[i] = c;
+    }
   }
 
   ~ExperienceFile(){
-    if (vectorFile.is_open())
-      vectorFile.close();
+    closeFile();
+    unmapFile();
   }
 
-  void initFile(const char* filename, int nfeats){
-    vectorFile.open(filename, ios::out | ios::binary);
+  /** # of experiences saved */
+  int expNum;
+
+
+  ///////////////////////////////////////
+  // Writing
+  ///////////////////////////////////////
+
+  /** Start a new experience file, and the thread that writes it.
+      \param filename File to write
+      \param nfeats # of features of each state
+      \param compressChunks Store chunks with runs of zero bytes compressed
+      (only used where it makes them smaller)
+      \param expPerChunk # of experiences to collect before handing them to the writer
+  */
+  void initFile(const char* filename, int nf, bool compressChunks = false,
+                int expPerChunk = EXPFILE_CHUNK_SIZE){
+    closeFile();
 
-    // first part, save the vector size
-    vectorFile.write((char*)&nfeats, sizeof(int));
+    outFile = fopen(filename, "wb");
+    if (outFile == NULL){
+      cerr << "Could not open experience file " << filename << endl;
+      return;
+    }
+
+    nfeats = nf;
+    chunkSize = (expPerChunk > 0) ? expPerChunk : 1;
+    compress = compressChunks;
+    expNum = 0;
+
+    expFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "RLEXPLOG", 8);
+    header.version = EXPFILE_VERSION;
+    header.nfeats = nfeats;
+    header.chunkSize = chunkSize;
+    fwrite(&header, sizeof(header), 1, outFile);
+    fileOffset = sizeof(header);
+
+    index.clear();
+    current.clear();
+    current.reserve(chunkSize * recordSize(nfeats));
+    nQueued = 0;
+    nWritten = 0;
+    stopping = false;
+
+    pthread_mutex_init(&file_mutex, NULL);
+    pthread_cond_init(&write_cond, NULL);
+    pthread_cond_init(&written_cond, NULL);
+    pthread_create(&writer, NULL, writerStart, this);
+    writing = true;
   }
 
+  /** Add an experience to the file.  It is only copied into the current
+      chunk here; full chunks are written by the writer thread. */
   void saveExperience(const experience& e){
-    if (!vectorFile.is_open())
+    if (!writing)
       return;
 
-    /*
-      if (expNum == 50){
-      vectorFile.close();
+    if ((int)e.s.size() != nfeats || (int)e.next.size() != nfeats){
+      cerr << "Error in experience sizes" << endl;
       return;
-      }
-    */
+    }
 
-    vectorFile.write((char*)&(e.s[0]), e.s.size()*sizeof(float));
-    vectorFile.write((char*)&(e.next[0]), e.next.size()*sizeof(float));
-    vectorFile.write((char*)&e.act, sizeof(int));
-    vectorFile.write((char*)&e.reward, sizeof(float));
-    vectorFile.write((char*)&e.terminal, sizeof(bool));
+    pthread_mutex_lock(&file_mutex);
 
-    //cout << "Experience " << expNum << endl;
+    unsigned start = current.size();
+    current.resize(start + recordSize(nfeats));
+    float* rec = &current[start];
+    memcpy(rec, &(e.s[0]), nfeats*sizeof(float));
+    memcpy(rec + nfeats, &(e.next[0]), nfeats*sizeof(float));
+    int term = e.terminal;
+    memcpy(rec + 2*nfeats, &e.act, sizeof(int));
+    rec[2*nfeats+1] = e.reward;
+    memcpy(rec + 2*nfeats+2, &term, sizeof(int));
     expNum++;
-    //printExperience(e);
+
+    if ((int)current.size() >= chunkSize * recordSize(nfeats))
+      queueChunk();
+
+    pthread_mutex_unlock(&file_mutex);
+  }
+
+  /** Write out all the experiences saved so far, returning once they are written. */
+  void flush(){
+    if (!writing)
+      return;
+
+    pthread_mutex_lock(&file_mutex);
+    if (current.size() > 0)
+      queueChunk();
+
+    // wait for the writer to catch up
+    int target = nQueued;
+    while (nWritten < target){
+      pthread_cond_wait(&written_cond, &file_mutex);
+    }
+    pthread_mutex_unlock(&file_mutex);
+  }
+
+  /** Write out the remaining experiences and the index, and close the file. */
+  void closeFile(){
+    if (!writing)
+      return;
+
+    flush();
+
+    pthread_mutex_lock(&file_mutex);
+    stopping = true;
+    pthread_cond_signal(&write_cond);
+    pthread_mutex_unlock(&file_mutex);
+    pthread_join(writer, NULL);
+
+    pthread_cond_destroy(&written_cond);
+    pthread_cond_destroy(&write_cond);
+    pthread_mutex_destroy(&file_mutex);
+    writing = false;
+
+    expFileFooter footer;
+    footer.indexOffset = fileOffset;
+    footer.nchunks = index.size();
+    footer.magic = EXPFILE_INDEX_MAGIC;
+    if (index.size() > 0)
+      fwrite(&index[0], sizeof(expChunkIndex), index.size(), outFile);
+    fwrite(&footer, sizeof(footer), 1, outFile);
+
+    fclose(outFile);
+    outFile = NULL;
+  }
+
+
+  ///////////////////////////////////////
+  // Reading
+  ///////////////////////////////////////
+
+  /** Memory-map an experience file for reading.
+      \return false if it could not be opened or is not in this format */
+  bool openFile(const char* filename){
+    unmapFile();
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+      return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(expFileHeader)){
+      ::close(fd);
+      return false;
+    }
+
+    void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED)
+      return false;
+
+    mapData = (const char*)data;
+    mapSize = st.st_size;
+
+    const expFileHeader* header = (const expFileHeader*)mapData;
+    if (memcmp(header->magic, "RLEXPLOG", 8) != 0
+        || header->version != EXPFILE_VERSION){
+      unmapFile();
+      return false;
+    }
+    mappedFeats = header->nfeats;
+
+    if (!readIndex())
+      scanChunks();
+
+    return true;
+  }
+
+  /** Unmap the file opened with openFile */
+  void unmapFile(){
+    if (mapData != NULL)
+      munmap((void*)mapData, mapSize);
+    mapData = NULL;
+    mapSize = 0;
+    mappedFeats = 0;
+    mappedChunks.clear();
+  }
+
+  /** # of features of the mapped file */
+  int numFeatures() const { return mappedFeats; }
+
+  /** # of chunks in the mapped file */
+  int numChunks() const { return mappedChunks.size(); }
+
+  /** # of experiences in the mapped file */
+  int numExperiences() const {
+    int n = 0;
+    for (unsigned i = 0; i < mappedChunks.size(); i++){
+      n += mappedChunks[i].nexp;
+    }
+    return n;
+  }
+
+  /** Get the records of one chunk of the mapped file, after checking its
+      CRC.  Uncompressed chunks point straight into the mapping;
+      compressed ones are expanded into a buffer that is reused by the
+      next call.
+      \param c Chunk to get
+      \param nexp Set to the # of records in the chunk
+      \return The records, or NULL if the chunk is corrupt */
+  const float* chunk(int c, int *nexp){
+    *nexp = 0;
+    const expChunkHeader* ch = (const expChunkHeader*)(mapData + mappedChunks[c].offset);
+    const unsigned char* stored = (const unsigned char*)(ch + 1);
+
+    if (crc32(stored, ch->storedBytes) != ch->crc){
+      cerr << "Experience file chunk " << c << " is corrupt" << endl;
+      return NULL;
+    }
+
+    *nexp = ch->nexp;
+    if (ch->compression == EXPFILE_RAW)
+      return (const float*)stored;
+
+    chunkBuf.resize(ch->rawBytes / sizeof(float));
+    if (!expandZeroRuns(stored, ch->storedBytes, (unsigned char*)&chunkBuf[0], ch->rawBytes)){
+      cerr << "Experience file chunk " << c << " is corrupt" << endl;
+      *nexp = 0;
+      return NULL;
+    }
+    return &chunkBuf[0];
+  }
+
+  /** Words in the record of an experience with the given # of features */
+  static int recordSize(int nf){
+    return 2*nf + 3;
+  }
+
+  /** Fill in an experience from a record */
+  static void getExperience(const float* rec, int nf, experience *e){
+    e->s.assign(rec, rec + nf);
+    e->next.assign(rec + nf, rec + 2*nf);
+    int term;
+    memcpy(&e->act, rec + 2*nf, sizeof(int));
+    e->reward = rec[2*nf+1];
+    memcpy(&term, rec + 2*nf+2, sizeof(int));
+    e->terminal = (term != 0);
   }
 
   void printExperience(const experience& e){
@@ -70,9 +379,174 @@ public:
 
   }
 
+  /** Load all the experiences of a file.  Files in the old format (the
+      # of features, then unchunked records) are read too. */
+  std::vector<experience> loadExperiences(const char* filename){
+    std::vector<experience> seeds;
 
+    if (!openFile(filename))
+      return loadOldExperiences(filename);
 
-  std::vector<experience> loadExperiences(const char* filename){
+    seeds.reserve(numExperiences());
+    for (int c = 0; c < numChunks(); c++){
+      int nexp = 0;
+      const float* rec = chunk(c, &nexp);
+      for (int i = 0; i < nexp; i++){
+        seeds.push_back(experience());
+        getExperience(rec + i*recordSize(mappedFeats), mappedFeats, &seeds.back());
+      }
+    }
+
+    unmapFile();
+
+    return seeds;
+  }
+
+private:
+
+  /** Unimplemented: files are not copied */
+  ExperienceFile(const ExperienceFile&);
+  ExperienceFile& operator=(const ExperienceFile&);
+
+  /** Hand the current chunk to the writer (called with the lock held) */
+  void queueChunk(){
+    pending.push_back(std::vector<float>());
+    pending.back().swap(current);
+    current.reserve(chunkSize * recordSize(nfeats));
+    nQueued++;
+    pthread_cond_signal(&write_cond);
+  }
+
+  /** Write one chunk of records */
+  void writeChunk(const std::vector<float> &records){
+    const unsigned char* raw = (const unsigned char*)&records[0];
+    int rawBytes = records.size() * sizeof(float);
+
+    expChunkHeader ch;
+    ch.magic = EXPFILE_CHUNK_MAGIC;
+    ch.nexp = records.size() / recordSize(nfeats);
+    ch.rawBytes = rawBytes;
+    ch.compression = EXPFILE_RAW;
+
+    const unsigned char* stored = raw;
+    if (compress){
+      compressZeroRuns(raw, rawBytes, &packed);
+      if (packed.size() < (unsigned)rawBytes){
+        ch.compression = EXPFILE_ZERO_RUNS;
+        stored = &packed[0];
+        rawBytes = packed.size();
+      }
+    }
+    ch.storedBytes = rawBytes;
+    ch.crc = crc32(stored, ch.storedBytes);
+
+    expChunkIndex entry;
+    entry.offset = fileOffset;
+    entry.nexp = ch.nexp;
+    entry.unused = 0;
+    index.push_back(entry);
+
+    // keep the records of every chunk aligned
+    static const char padding[4] = {0, 0, 0, 0};
+    int pad = (4 - ch.storedBytes % 4) % 4;
+
+    fwrite(&ch, sizeof(ch), 1, outFile);
+    fwrite(stored, 1, ch.storedBytes, outFile);
+    fwrite(padding, 1, pad, outFile);
+    fflush(outFile);
+    fileOffset += sizeof(ch) + ch.storedBytes + pad;
+  }
+
+  /** Write queued chunks until the file is closed */
+  void writerLoop(){
+    pthread_mutex_lock(&file_mutex);
+    while (true){
+      if (pending.size() == 0){
+        if (stopping) break;
+        pthread_cond_wait(&write_cond, &file_mutex);
+        continue;
+      }
+
+      std::vector<float> records;
+      records.swap(pending.front());
+      pending.pop_front();
+
+      // write without holding the lock, so experiences can keep being saved
+      pthread_mutex_unlock(&file_mutex);
+      writeChunk(records);
+      pthread_mutex_lock(&file_mutex);
+
+      nWritten++;
+      pthread_cond_broadcast(&written_cond);
+    }
+    pthread_mutex_unlock(&file_mutex);
+  }
+
+  /** Start routine of the writer thread */
+  static void* writerStart(void* arg){
+    ((ExperienceFile*)arg)->writerLoop();
+    return NULL;
+  }
+
+  /** Read the chunk index of a closed file.
+      \return false if the file has no valid index */
+  bool readIndex(){
+    if (mapSize < sizeof(expFileHeader) + sizeof(expFileFooter))
+      return false;
+
+    const expFileFooter* footer = (const expFileFooter*)(mapData + mapSize - sizeof(expFileFooter));
+    if (footer->magic != EXPFILE_INDEX_MAGIC || footer->nchunks < 0
+        || footer->indexOffset < (long long)sizeof(expFileHeader)
+        || footer->indexOffset + footer->nchunks * sizeof(expChunkIndex)
+        != mapSize - sizeof(expFileFooter))
+      return false;
+
+    const expChunkIndex* entries = (const expChunkIndex*)(mapData + footer->indexOffset);
+    mappedChunks.assign(entries, entries + footer->nchunks);
+
+    for (unsigned i = 0; i < mappedChunks.size(); i++){
+      if (!validChunk(mappedChunks[i].offset, footer->indexOffset)){
+        mappedChunks.clear();
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /** Find the chunks of a file that has no index, up to the first one
+      that is incomplete or corrupt. */
+  void scanChunks(){
+    mappedChunks.clear();
+    long long offset = sizeof(expFileHeader);
+    while (validChunk(offset, mapSize)){
+      const expChunkHeader* ch = (const expChunkHeader*)(mapData + offset);
+      if (crc32((const unsigned char*)(ch + 1), ch->storedBytes) != ch->crc)
+        break;
+
+      expChunkIndex entry;
+      entry.offset = offset;
+      entry.nexp = ch->nexp;
+      entry.unused = 0;
+      mappedChunks.push_back(entry);
+
+      offset += sizeof(expChunkHeader) + ch->storedBytes + (4 - ch->storedBytes % 4) % 4;
+    }
+  }
+
+  /** Check that a chunk header at offset is sane and its data ends before end */
+  bool validChunk(long long offset, long long end){
+    if (offset + (long long)sizeof(expChunkHeader) > end)
+      return false;
+    const expChunkHeader* ch = (const expChunkHeader*)(mapData + offset);
+    return (ch->magic == EXPFILE_CHUNK_MAGIC && ch->nexp >= 0
+            && ch->rawBytes == ch->nexp * recordSize(mappedFeats) * (int)sizeof(float)
+            && ch->storedBytes >= 0
+            && offset + (long long)sizeof(expChunkHeader) + ch->storedBytes <= end);
+  }
+
+  /** Read a file in the old format: the # of features, then records of
+      s, next, act, reward and a one byte terminal. */
+  std::vector<experience> loadOldExperiences(const char* filename){
     ifstream inFile (filename, ios::in | ios::binary);
 
     int numFeats;
@@ -94,9 +568,6 @@ public:
       inFile.read((char*)&e.reward, sizeof(float));
       inFile.read((char*)&e.terminal, sizeof(bool));
 
-      //cout << "Experience " << seeds.size() << endl;
-      //printExperience(e);
-
       seeds.push_back(e);
     }
 
@@ -105,11 +576,93 @@ public:
     return seeds;
   }
 
-  void closeFile(){
-    if (vectorFile.is_open())
-      vectorFile.close();
+  unsigned int crc32(const unsigned char* buf, int len) const {
+    unsigned int c = 0xFFFFFFFFu;
+    for (int i = 0; i < len; i++){
+      c = crcTable[(c ^ buf[i]) & 0xFF] ^ (c >> 8);
+    }
+    return c ^ 0xFFFFFFFFu;
   }
 
+  /** Replace each run of zero bytes with a zero and the run's length (up to 255) */
+  static void compressZeroRuns(const unsigned char* in, int len, std::vector<unsigned char> *out){
+    out->clear();
+    out->reserve(len);
+    for (int i = 0; i < len; ){
+      if (in[i] != 0){
+        out->push_back(in[i++]);
+        continue;
+      }
+      int run = 0;
+      while (i < len && in[i] == 0 && run < 255){
+        i++;
+        run++;
+      }
+      out->push_back(0);
+      out->push_back(run);
+    }
+  }
+
+  /** Undo compressZeroRuns.
+      \return false if the data does not expand to exactly len bytes */
+  static bool expandZeroRuns(const unsigned char* in, int inLen, unsigned char* out, int len){
+    int j = 0;
+    for (int i = 0; i < inLen; i++){
+      if (in[i] != 0){
+        if (j >= len) return false;
+        out[j++] = in[i];
+        continue;
+      }
+      if (++i >= inLen) return false;
+      int run = in[i];
+      if (j + run > len) return false;
+      memset(out + j, 0, run);
+      j += run;
+    }
+    return (j == len);
+  }
+
+  // writing
+  int nfeats;
+  int chunkSize;
+  bool compress;
+
+  FILE* outFile;
+  long long fileOffset;
+  std::vector<expChunkIndex> index;
+
+  /** Records of the chunk being filled */
+  std::vector<float> current;
+
+  /** Full chunks waiting to be written */
+  std::deque<std::vector<float> > pending;
+
+  /** Buffer for compressing a chunk (writer thread only) */
+  std::vector<unsigned char> packed;
+
+  bool writing;
+  bool stopping;
+  int nQueued;
+  int nWritten;
+
+  pthread_t writer;
+  pthread_mutex_t file_mutex;
+  /** Signalled when a chunk is queued or the file is closing. */
+  pthread_cond_t write_cond;
+  /** Signalled when a chunk has been written. */
+  pthread_cond_t written_cond;
+
+  // reading
+  const char* mapData;
+  size_t mapSize;
+  int mappedFeats;
+  std::vector<expChunkIndex> mappedChunks;
+
+  /** Expanded records of the last compressed chunk read */
+  std::vector<float> chunkBuf;
+
+  unsigned int crcTable[256];
+
 };
 
 #endif
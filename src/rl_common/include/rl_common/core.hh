@@ -55,13 +55,15 @@ const std::string modelNames[] = {
 #define WEIGHTAVG      2
 #define BEST           3
 #define SEPARATE       4 // sep model for planning, and forest for uncertainty
+#define SAMPLED        5 // average for the root, one sampled model per uct rollout
 
 const std::string comboNames[] = {
   "Unknown",
   "Average",
   "Weighted Average",
   "Best",
-  "Separate"
+  "Separate",
+  "Sampled"
 };
 
 // types of exploration
@@ -175,6 +177,14 @@ struct modelPair {
 struct classPair {
   std::vector<float> in;
   float out;
+
+  // row of 'in' in a shared experience store, or -1 if the classifier should store it itself
+  int row;
+
+  classPair(){
+    out = 0.0;
+    row = -1;
+  };
 };
 
 /** Interface for an environment, whose states can be represented as
@@ -232,10 +242,82 @@ public:
   /** Set the current state for testing purposes. */
   virtual void setSensation(std::vector<float> s){};
 
+  /** Saves the full internal state of the environment, including any
+      state that is not part of the sensation (action delays, hidden
+      actuator positions, ...), so that it can be restored later.  The
+      random number generator is not part of the snapshot.  By default
+      the snapshot is just the sensation.
+      \param state Filled in with the saved state. */
+  virtual void snapshot(std::vector<float> *state) const {
+    *state = sensation();
+  };
+
+  /** Restores a state saved by snapshot() on this environment or on
+      another one of the same type and configuration.
+      \param state The saved state. */
+  virtual void restore(const std::vector<float> &state){
+    setSensation(state);
+  };
+
   virtual ~Environment() {};
 
 };
 
+/** Interface for a batch of independent copies of an environment that
+    are all stepped at once, for running many rollouts or trials of a
+    simulator.  The state of the copies is kept one feature at a time
+    (every copy's value of feature 0, then of feature 1, ...), so a step
+    of the whole batch is one loop over plain arrays rather than a
+    virtual call and a sensation vector per copy. */
+class BatchEnvironment {
+public:
+  /** Returns the number of copies in the batch. */
+  virtual int size() const = 0;
+
+  /** Provides access to one feature of every copy.
+      \param f The feature.
+      \return size() values, the feature of each copy. */
+  virtual const float* feature(int f) const = 0;
+
+  /** Gets the current sensation of one copy.
+      \param i The copy.
+      \param s Filled with the sensation of copy i. */
+  virtual void sensation(int i, std::vector<float> *s) const = 0;
+
+  /** Applies one action to each copy.  Copies that are in a terminal
+      state are stepped as well; reset them to start a new episode.
+      \param actions size() actions, one per copy.
+      \param rewards Filled with the one-step reward of each copy.
+      \param terminals If not NULL, filled with whether each copy is
+      now in a terminal state. */
+  virtual void apply(const int *actions, float *rewards, bool *terminals) = 0;
+
+  /** Determines whether one copy has reached a terminal state. */
+  virtual bool terminal(int i) const = 0;
+
+  /** Resets one copy according to the initial state distribution. */
+  virtual void reset(int i) = 0;
+
+  /** Sets the state of one copy, e.g. to start a rollout from it. */
+  virtual void setSensation(int i, const std::vector<float> &s) = 0;
+
+  /** Returns the number of actions available in this environment. */
+  virtual int getNumActions() = 0;
+
+  /** Gets the minimum and maximum of the features in the environment. */
+  virtual void getMinMaxFeatures(std::vector<float> *minFeat,
+                                 std::vector<float> *maxFeat) = 0;
+
+  /** Gets the minimum and maximum one-step reward in the domain. */
+  virtual void getMinMaxReward(float *minR, float *maxR) = 0;
+
+  /** Returns if the domain is episodic (true by default). */
+  virtual bool isEpisodic(){ return true; };
+
+  virtual ~BatchEnvironment() {};
+
+};
+
 /** Interface for an agent.  Implementations of the Agent interface
     determine the choice of actions given previous sensations and
     rewards. */
@@ -307,9 +389,43 @@ public:
   /** Get the model's confidence in its predictions for a given input. */
   virtual float getConf(const std::vector<float> &in) = 0;
 
+  /** Get the model's predictions for a batch of inputs, and its confidence in each one if confs is not NULL. 
+      Models can override this to go through their structure once for the whole batch. The output vectors are resized, so passing the same ones each time re-uses their storage. */
+  virtual void testInstances(const std::vector<std::vector<float> > &in,
+                             std::vector<std::map<float, float> >* retval,
+                             std::vector<float>* confs){
+    retval->resize(in.size());
+    if (confs != NULL) confs->resize(in.size());
+    for (unsigned i = 0; i < in.size(); i++){
+      testInstance(in[i], &((*retval)[i]));
+      if (confs != NULL) (*confs)[i] = getConf(in[i]);
+    }
+  };
+
+  /** # of separate models (e.g. ensemble members) whose predictions this one combines */
+  virtual int getNumMembers() { return 1; };
+
+  /** Get the prediction of just one of the member models for a given input */
+  virtual void testMember(int member, const std::vector<float> &in, std::map<float, float>* retval){
+    testInstance(in, retval);
+  };
+
   /** Get a copy of the model */
   virtual Classifier* getCopy() = 0;
 
+  /** Write the trained model to out, so it can be read back with loadModel. Training inputs kept in a shared store are written by the owner of the store, not here.
+      \return false if this type of model can't be saved */
+  virtual bool saveModel(std::ostream &out) { return false; };
+
+  /** Read a model written by saveModel into this untrained one, which must have the same configuration. */
+  virtual bool loadModel(std::istream &in) { return false; };
+
+  /** Keep repeated (input, output) pairs as one experience with a weight, for models that support it. Must be set before training. */
+  virtual void setCompressDuplicates(bool compress) { };
+
+  /** Keep at most cap experiences (0 for no limit), for models that support it. Models that do keep the inputs in their own store, so the rows of a shared store are not needed. Must be set before training. */
+  virtual void setExperienceCap(int cap) { };
+
   virtual ~Classifier() {};
 };
 
@@ -346,6 +462,25 @@ public:
   /** Get the predictions of the MDP model for a given state action */
   virtual float getStateActionInfo(const std::vector<float> &state, int action, StateActionInfo* retval) = 0;
 
+  /** Get the predictions of the MDP model for a batch of state actions: retval[i] is filled in for *states[i] and actions[i], and confs[i] gets the confidence getStateActionInfo would return. */
+  virtual void getStateActionInfos(const std::vector<const std::vector<float>*> &states,
+                                   const std::vector<int> &actions,
+                                   const std::vector<StateActionInfo*> &retval,
+                                   std::vector<float>* confs){
+    confs->resize(states.size());
+    for (unsigned i = 0; i < states.size(); i++){
+      (*confs)[i] = getStateActionInfo(*states[i], actions[i], retval[i]);
+    }
+  };
+
+  /** # of members a planner can sample with getMemberStateActionInfo. More than 1 only for ensembles combined with SAMPLED. */
+  virtual int getNumMembers() { return 1; };
+
+  /** Get the predictions of one member of the model for a given state action, such as a single tree of each forest. */
+  virtual float getMemberStateActionInfo(const std::vector<float> &state, int action, int member, StateActionInfo* retval){
+    return getStateActionInfo(state, action, retval);
+  };
+
   /** Get a copy of the MDP Model */
   virtual MDPModel* getCopy() = 0;
   virtual ~MDPModel() {};
@@ -0,0 +1,58 @@
+/** \file BatchCartPole.hh
+    Defines a batch of Cart-Pole balancing domains that are stepped together.
+*/
+
+#ifndef _BATCHCARTPOLE_H_
+#define _BATCHCARTPOLE_H_
+
+#include <rl_common/Random.h>
+#include <rl_common/core.hh>
+#include <rl_env/BatchRandom.hh>
+
+/** This class defines a batch of independent Cart-Pole domains, with
+    the same dynamics as CartPole. */
+class BatchCartPole: public BatchEnvironment {
+public:
+
+  /** Creates a batch of Cart-Pole domains.
+      \param n # of copies
+      \param rand Random number generator, used to seed each copy's own
+      random number stream
+      \param stochastic noisy transitions?
+  */
+  BatchCartPole(int n, Random &rand, bool stochastic);
+
+  virtual ~BatchCartPole();
+
+  virtual int size() const;
+  virtual const float* feature(int f) const;
+  virtual void sensation(int i, std::vector<float> *s) const;
+  virtual void apply(const int *actions, float *rewards, bool *terminals);
+
+  virtual bool terminal(int i) const;
+  virtual void reset(int i);
+  virtual void setSensation(int i, const std::vector<float> &s);
+
+  virtual int getNumActions();
+  virtual void getMinMaxFeatures(std::vector<float> *minFeat, std::vector<float> *maxFeat);
+  virtual void getMinMaxReward(float* minR, float* maxR);
+
+private:
+
+  const int n;
+  const bool noisy;
+
+  BatchRandom rng;
+
+  /** Features of all the copies: cart positions, cart velocities, pole
+      angles, then pole velocities */
+  std::vector<float> s;
+
+  float *cartPos;
+  float *cartVel;
+  float *poleAngle;
+  float *poleVel;
+
+};
+
+#endif
@@ -0,0 +1,57 @@
+/** \file BatchMountainCar.hh
+    Defines a batch of Mountain Car domains that are stepped together.
+*/
+
+#ifndef _BATCHMOUNTAINCAR_H_
+#define _BATCHMOUNTAINCAR_H_
+
+#include <rl_common/Random.h>
+#include <rl_common/core.hh>
+#include <rl_env/BatchRandom.hh>
+
+/** This class defines a batch of independent Mountain Car domains, with
+    the same dynamics as MountainCar (without action delays). */
+class BatchMountainCar: public BatchEnvironment {
+public:
+
+  /** Creates a batch of Mountain Car domains.
+      \param n # of copies
+      \param rand Random number generator, used to seed each copy's own
+      random number stream
+      \param stochastic if transitions are noisy
+      \param lin create linearized transition dynamics
+  */
+  BatchMountainCar(int n, Random &rand, bool stochastic, bool lin);
+
+  virtual ~BatchMountainCar();
+
+  virtual int size() const;
+  virtual const float* feature(int f) const;
+  virtual void sensation(int i, std::vector<float> *s) const;
+  virtual void apply(const int *actions, float *rewards, bool *terminals);
+
+  virtual bool terminal(int i) const;
+  virtual void reset(int i);
+  virtual void setSensation(int i, const std::vector<float> &s);
+
+  virtual int getNumActions();
+  virtual void getMinMaxFeatures(std::vector<float> *minFeat, std::vector<float> *maxFeat);
+  virtual void getMinMaxReward(float* minR, float* maxR);
+
+private:
+
+  const int n;
+  const bool noisy;
+  const bool linear;
+
+  BatchRandom rng;
+
+  /** Features of all the copies: positions, then velocities */
+  std::vector<float> s;
+
+  float *pos;
+  float *vel;
+
+};
+
+#endif
@@ -0,0 +1,48 @@
+/** \file BatchRandom.hh
+    Defines the BatchRandom class, which gives each copy of a batch
+    environment its own stream of random numbers.
+*/
+
+#ifndef _BATCHRANDOM_H_
+#define _BATCHRANDOM_H_
+
+#include <vector>
+#include <rl_common/Random.h>
+
+/** Independent xorshift random number streams, one per copy of a batch
+    environment.  Each stream is a single word of state, so the copies
+    can draw their noise in the same loop that steps them. */
+class BatchRandom {
+public:
+
+  /** Creates n streams, each seeded from rng. */
+  BatchRandom(int n, Random &rng):
+    state(n)
+  {
+    for (int i = 0; i < n; i++){
+      // xorshift state must not be 0
+      state[i] = (unsigned)rng.uniformDiscrete(0, 1 << 30) * 2 + 1;
+    }
+  }
+
+  /** Draws a value uniformly on [min,max) from stream i. */
+  float uniform(int i, float min, float max){
+    unsigned x = state[i];
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    state[i] = x;
+    return min + (max - min) * ((x >> 8) * (1.0f / 16777216.0f));
+  }
+
+  /** Draws an integer uniformly from min to max (inclusive) from stream i. */
+  int uniformDiscrete(int i, int min, int max){
+    return min + (int)((max - min + 1) * uniform(i, 0.0, 1.0));
+  }
+
+private:
+  std::vector<unsigned> state;
+
+};
+
+#endif
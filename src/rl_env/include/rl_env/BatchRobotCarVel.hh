@@ -0,0 +1,77 @@
+/** \file BatchRobotCarVel.hh
+    Defines a batch of simulations of velocity control for the Austin
+    Robot Technology autonomous vehicle that are stepped together.
+*/
+
+#ifndef _BATCHROBOTCAR_H_
+#define _BATCHROBOTCAR_H_
+
+#include <rl_common/Random.h>
+#include <rl_common/core.hh>
+#include <rl_env/BatchRandom.hh>
+
+/** This class defines a batch of independent car velocity control
+    domains, with the same dynamics as RobotCarVel. */
+class BatchRobotCarVel: public BatchEnvironment {
+public:
+
+  /** Creates a batch of RobotCarVel domains.
+      \param n # of copies
+      \param rand Random number generator, used to seed each copy's own
+      random number stream
+      \param randomVel Use random starting and target velocities
+      \param upVel For specific velocity pair (not random), do target > starting vel
+      \param tenToSix Use 10 and 6 m/s for specific velocity pair, rather than 7 and 2
+      \param lag Implements lag on the brake actuator to fully model the real vehicle.
+  */
+  BatchRobotCarVel(int n, Random &rand, bool randomVel, bool upVel, bool tenToSix, bool lag);
+
+  virtual ~BatchRobotCarVel();
+
+  virtual int size() const;
+  virtual const float* feature(int f) const;
+  virtual void sensation(int i, std::vector<float> *s) const;
+  virtual void apply(const int *actions, float *rewards, bool *terminals);
+
+  virtual bool terminal(int i) const;
+  virtual void reset(int i);
+
+  /** Set the state of one copy.  The true throttle and brake positions
+      are not in the state, so they are set to their targets, as in
+      RobotCarVel::getExp. */
+  virtual void setSensation(int i, const std::vector<float> &s);
+
+  virtual int getNumActions();
+  virtual void getMinMaxFeatures(std::vector<float> *minFeat, std::vector<float> *maxFeat);
+  virtual void getMinMaxReward(float* minR, float* maxR);
+
+protected:
+  enum car_action_t {NOTHING, THROTTLE_UP, THROTTLE_DOWN, BRAKE_UP, BRAKE_DOWN};
+
+private:
+
+  const int n;
+  const bool randomVel;
+  const bool upVel;
+  const bool tenToSix;
+  const bool lag;
+
+  BatchRandom rng;
+
+  /** Features of all the copies: target velocities, current velocities,
+      throttle targets, then brake targets */
+  std::vector<float> s;
+
+  float *targetVel;
+  float *currVel;
+  float *throttleTarget;
+  float *brakeTarget;
+
+  // hidden state of each copy
+  std::vector<float> trueThrottle;
+  std::vector<float> trueBrake;
+  std::vector<float> brakePosVel;
+
+};
+
+#endif
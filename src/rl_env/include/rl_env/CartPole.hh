@@ -41,6 +41,9 @@ public:
   virtual void getMinMaxFeatures(std::vector<float> *minFeat, std::vector<float> *maxFeat);
   virtual void getMinMaxReward(float* minR, float* maxR);
 
+  virtual void snapshot(std::vector<float> *state) const;
+  virtual void restore(const std::vector<float> &state);
+
   /** Set the state vector (for debug purposes) */
   void setSensation(std::vector<float> newS);
 
@@ -37,6 +37,9 @@ public:
   virtual void getMinMaxFeatures(std::vector<float> *minFeat, std::vector<float> *maxFeat);
   virtual void getMinMaxReward(float* minR, float* maxR);
 
+  virtual void snapshot(std::vector<float> *state) const;
+  virtual void restore(const std::vector<float> &state);
+
   virtual std::vector<experience> getSeedings();
 
   /** Get an example experience for this state-action. */
@@ -33,6 +33,10 @@ public:
   virtual bool isEpisodic() { return false; };
   virtual void getMinMaxReward(float* minR, float* maxR);
 
+  /** Save/restore the state, including the key location in each room. */
+  virtual void snapshot(std::vector<float> *state) const;
+  virtual void restore(const std::vector<float> &state);
+
 
   friend std::ostream &operator<<(std::ostream &out, const LightWorld &playroom);
 
@@ -44,6 +44,10 @@ public:
   virtual void getMinMaxFeatures(std::vector<float> *minFeat, std::vector<float> *maxFeat);
   virtual void getMinMaxReward(float* minR, float* maxR);
 
+  /** Save/restore the state, including the delayed observation history. */
+  virtual void snapshot(std::vector<float> *state) const;
+  virtual void restore(const std::vector<float> &state);
+
   /** Set the state vector (for debug purposes) */
   void setSensation(std::vector<float> newS);
 
@@ -41,6 +41,11 @@ public:
   virtual void getMinMaxFeatures(std::vector<float> *minFeat, std::vector<float> *maxFeat);
   virtual void getMinMaxReward(float* minR, float* maxR);
 
+  /** Save/restore the state, including the true throttle and brake
+      positions, which are hidden from the agent. */
+  virtual void snapshot(std::vector<float> *state) const;
+  virtual void restore(const std::vector<float> &state);
+
   /** Set the state vector for debug purposes. */
   void setSensation(std::vector<float> newS);
 
@@ -54,6 +54,9 @@ public:
   virtual void getMinMaxFeatures(std::vector<float> *minFeat, std::vector<float> *maxFeat);
   virtual void getMinMaxReward(float* minR, float* maxR);
 
+  virtual void snapshot(std::vector<float> *state) const;
+  virtual void restore(const std::vector<float> &state);
+
   const Gridworld &gridworld() const { return *grid; }
 
   friend std::ostream &operator<<(std::ostream &out, const EnergyRooms &rooms);
@@ -57,6 +57,11 @@ public:
   virtual void getMinMaxFeatures(std::vector<float> *minFeat, std::vector<float> *maxFeat);
   virtual void getMinMaxReward(float* minR, float* maxR);
 
+  /** Save/restore the state, including the wall distance and reward
+      sensors that are not in the sensation. */
+  virtual void snapshot(std::vector<float> *state) const;
+  virtual void restore(const std::vector<float> &state);
+
   const Gridworld &gridworld() const { return *grid; }
 
   friend std::ostream &operator<<(std::ostream &out, const FourRooms &rooms);
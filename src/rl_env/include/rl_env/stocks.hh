@@ -32,6 +32,9 @@ public:
   virtual bool isEpisodic() { return false; };
   virtual void getMinMaxReward(float* minR, float* maxR);
 
+  virtual void snapshot(std::vector<float> *state) const;
+  virtual void restore(const std::vector<float> &state);
+
   void calcStockRising();
   float reward();
   void setSensation(std::vector<float> s);
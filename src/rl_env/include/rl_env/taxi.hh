@@ -54,6 +54,11 @@ public:
   virtual int getNumActions();
   virtual void getMinMaxFeatures(std::vector<float> *minFeat, std::vector<float> *maxFeat);
   virtual void getMinMaxReward(float* minR, float* maxR);
+
+  /** Save/restore the state, including whether the passenger may still
+      change destination. */
+  virtual void snapshot(std::vector<float> *state) const;
+  virtual void restore(const std::vector<float> &state);
   virtual std::vector<experience> getSeedings();
 
   /** Get an example experience for the given state-action. */
@@ -41,6 +41,11 @@ public:
   virtual void getMinMaxFeatures(std::vector<float> *minFeat, std::vector<float> *maxFeat);
   virtual void getMinMaxReward(float* minR, float* maxR);
 
+  /** Save/restore the state, including the delayed action history and
+      which goal is active. */
+  virtual void snapshot(std::vector<float> *state) const;
+  virtual void restore(const std::vector<float> &state);
+
   /** Create an experience tuple for the given state-action. */
   experience getExp(float s0, float s1, int a);
 
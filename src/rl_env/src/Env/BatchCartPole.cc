@@ -0,0 +1,168 @@
+/** \file BatchCartPole.cc
+    Implements a batch of Cart-Pole balancing domains that are stepped together.
+*/
+
+#include <rl_env/BatchCartPole.hh>
+
+// same constants as CartPole
+static const float GRAVITY = 9.8;
+static const float MASSCART = 1.0;
+static const float MASSPOLE = 0.1;
+static const float TOTAL_MASS = (MASSPOLE + MASSCART);
+static const float LENGTH = 0.5;    // actually half the pole's length
+static const float POLEMASS_LENGTH = (MASSPOLE * LENGTH);
+static const float FORCE_MAG = 10.0;
+static const float TAU = 0.02;      // seconds between state updates
+static const float FOURTHIRDS = 4.0 / 3.0;
+static const float DEG_T_RAD = 0.01745329;
+
+
+BatchCartPole::BatchCartPole(int n, Random &rand, bool stochastic):
+  n(n),
+  noisy(stochastic),
+  rng(n, rand),
+  s(4*n)
+{
+  cartPos = &s[0];
+  cartVel = &s[n];
+  poleAngle = &s[2*n];
+  poleVel = &s[3*n];
+
+  for (int i = 0; i < n; i++){
+    reset(i);
+  }
+}
+
+
+BatchCartPole::~BatchCartPole() { }
+
+int BatchCartPole::size() const {
+  return n;
+}
+
+const float* BatchCartPole::feature(int f) const {
+  return &s[f*n];
+}
+
+void BatchCartPole::sensation(int i, std::vector<float> *sens) const {
+  sens->resize(4);
+  (*sens)[0] = cartPos[i];
+  (*sens)[1] = cartVel[i];
+  (*sens)[2] = poleAngle[i];
+  (*sens)[3] = poleVel[i];
+}
+
+
+void BatchCartPole::apply(const int *actions, float *rewards, bool *terminals) {
+
+  // same dynamics as CartPole::transition, for every copy
+  for (int i = 0; i < n; i++){
+    float force = (actions[i] == 1) ? FORCE_MAG : -FORCE_MAG;
+
+    //Noise of 1.0 means possibly halfway to opposite action
+    if (noisy){
+      force += 1.0*FORCE_MAG*(rng.uniform(i, -0.5, 0.5));
+    }
+
+    float costheta = cos(poleAngle[i]);
+    float sintheta = sin(poleAngle[i]);
+
+    float temp = (force + POLEMASS_LENGTH * poleVel[i] * poleVel[i] * sintheta) / TOTAL_MASS;
+
+    float thetaacc = (GRAVITY * sintheta - costheta * temp) / (LENGTH * (FOURTHIRDS - MASSPOLE * costheta * costheta / TOTAL_MASS));
+
+    float xacc = temp - POLEMASS_LENGTH * thetaacc * costheta / TOTAL_MASS;
+
+    // Update the four state variables, using Euler's method.
+    cartPos[i] += TAU * cartVel[i];
+    cartVel[i] += TAU * xacc;
+    poleAngle[i] += TAU * poleVel[i];
+    poleVel[i] += TAU * thetaacc;
+
+    while (poleAngle[i] >= M_PI) {
+      poleAngle[i] -= 2.0 * M_PI;
+    }
+    while (poleAngle[i] < -M_PI) {
+      poleAngle[i] += 2.0 * M_PI;
+    }
+
+    // dont velocities go past ranges
+    if (cartVel[i] > 3) cartVel[i] = 3;
+    if (cartVel[i] < -3) cartVel[i] = -3;
+    if (poleVel[i] > M_PI) poleVel[i] = M_PI;
+    if (poleVel[i] < -M_PI) poleVel[i] = -M_PI;
+
+    // normally +1 and 0 on goal
+    bool done = terminal(i);
+    rewards[i] = done ? 0.0 : 1.0;
+    if (terminals != NULL) terminals[i] = done;
+  }
+
+}
+
+
+bool BatchCartPole::terminal(int i) const {
+  // current position past termination conditions (off track, pole angle)
+  return (fabs(poleAngle[i]) > (DEG_T_RAD*12.0) || fabs(cartPos[i]) > 2.4);
+}
+
+
+void BatchCartPole::reset(int i) {
+  if (noisy){
+    cartPos[i] = rng.uniform(i, -0.5, 0.5);
+    cartVel[i] = rng.uniform(i, -0.5, 0.5);
+    poleAngle[i] = rng.uniform(i, -0.0625, 0.0625);
+    poleVel[i] = rng.uniform(i, -0.0625, 0.0625);
+  } else {
+    cartPos[i] = 0.0;
+    cartVel[i] = 0.0;
+    poleAngle[i] = 0.0;
+    poleVel[i] = 0.0;
+  }
+}
+
+
+void BatchCartPole::setSensation(int i, const std::vector<float> &sens){
+  if (sens.size() != 4){
+    cerr << "Error in sensation sizes" << endl;
+    return;
+  }
+  cartPos[i] = sens[0];
+  cartVel[i] = sens[1];
+  poleAngle[i] = sens[2];
+  poleVel[i] = sens[3];
+}
+
+
+int BatchCartPole::getNumActions(){
+  return 2;
+}
+
+
+void BatchCartPole::getMinMaxFeatures(std::vector<float> *minFeat,
+                                      std::vector<float> *maxFeat){
+
+  minFeat->resize(4, 0.0);
+  maxFeat->resize(4, 1.0);
+
+  (*minFeat)[0] = -2.5;
+  (*maxFeat)[0] = 2.5;
+
+  (*minFeat)[1] = -3.0;
+  (*maxFeat)[1] = 3.0;
+
+  (*minFeat)[2] = -12.0 * DEG_T_RAD;
+  (*maxFeat)[2] = 12.0 * DEG_T_RAD;
+
+  (*minFeat)[3] = -M_PI;
+  (*maxFeat)[3] = M_PI;
+
+}
+
+void BatchCartPole::getMinMaxReward(float *minR,
+                                    float *maxR){
+
+  *minR = 0.0;
+  *maxR = 1.0;
+
+}
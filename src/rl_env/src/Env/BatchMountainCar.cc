@@ -0,0 +1,129 @@
+/** \file BatchMountainCar.cc
+    Implements a batch of Mountain Car domains that are stepped together.
+*/
+
+#include <rl_env/BatchMountainCar.hh>
+
+
+BatchMountainCar::BatchMountainCar(int n, Random &rand, bool stochastic, bool lin):
+  n(n),
+  noisy(stochastic),
+  linear(lin),
+  rng(n, rand),
+  s(2*n)
+{
+  pos = &s[0];
+  vel = &s[n];
+
+  for (int i = 0; i < n; i++){
+    reset(i);
+  }
+}
+
+
+BatchMountainCar::~BatchMountainCar() { }
+
+int BatchMountainCar::size() const {
+  return n;
+}
+
+const float* BatchMountainCar::feature(int f) const {
+  return &s[f*n];
+}
+
+void BatchMountainCar::sensation(int i, std::vector<float> *sens) const {
+  sens->resize(2);
+  (*sens)[0] = pos[i];
+  (*sens)[1] = vel[i];
+}
+
+
+void BatchMountainCar::apply(const int *actions, float *rewards, bool *terminals) {
+
+  // same dynamics as MountainCar::apply, for every copy
+  for (int i = 0; i < n; i++){
+    float actVal = ((float)actions[i]-1.0);
+    if (noisy){
+      actVal += rng.uniform(i, -0.5, 0.5);
+    }
+
+    float newVel;
+    if (linear){
+      newVel = vel[i] + 0.001 * actVal + -0.0075*pos[i];
+    } else {
+      newVel = vel[i] + 0.001 * actVal + -0.0025*cos(3.0*pos[i]);
+    }
+
+    if (newVel < -0.07f) newVel = -0.07;
+    if (newVel > 0.07f) newVel = 0.07;
+
+    float newPos = pos[i] + newVel;
+    if (newPos < -1.2f && newVel < 0.0f)
+      newVel = 0.0;
+    if (newPos < -1.2f) newPos = -1.2;
+    if (newPos > 0.6f) newPos = 0.6;
+
+    pos[i] = newPos;
+    vel[i] = newVel;
+
+    // normally -1 and 0 on goal
+    bool done = (newPos >= 0.6);
+    rewards[i] = done ? 0 : -1;
+    if (terminals != NULL) terminals[i] = done;
+  }
+
+}
+
+
+bool BatchMountainCar::terminal(int i) const {
+  return (pos[i] >= 0.6);
+}
+
+
+void BatchMountainCar::reset(int i) {
+  if (noisy){
+    pos[i] = rng.uniform(i, -1.2, 0.59);
+    vel[i] = rng.uniform(i, -0.07, 0.07);
+  } else {
+    pos[i] = 0;
+    vel[i] = 0;
+  }
+}
+
+
+void BatchMountainCar::setSensation(int i, const std::vector<float> &sens){
+  if (sens.size() != 2){
+    cerr << "Error in sensation sizes" << endl;
+    return;
+  }
+  pos[i] = sens[0];
+  vel[i] = sens[1];
+}
+
+
+int BatchMountainCar::getNumActions(){
+  return 3;
+}
+
+
+void BatchMountainCar::getMinMaxFeatures(std::vector<float> *minFeat,
+                                         std::vector<float> *maxFeat){
+
+  minFeat->resize(2, 0.0);
+  maxFeat->resize(2, 1.0);
+
+  (*minFeat)[0] = -1.2;
+  (*maxFeat)[0] = 0.6;
+
+  (*minFeat)[1] = -0.07;
+  (*maxFeat)[1] = 0.07;
+
+}
+
+void BatchMountainCar::getMinMaxReward(float *minR,
+                                       float *maxR){
+
+  *minR = -1.0;
+  *maxR = 0.0;
+
+}
@@ -0,0 +1,195 @@
+/** \file BatchRobotCarVel.cc
+    Implements a batch of simulations of velocity control for the Austin
+    Robot Technology autonomous vehicle that are stepped together.
+*/
+
+#include <rl_env/BatchRobotCarVel.hh>
+
+
+BatchRobotCarVel::BatchRobotCarVel(int n, Random &rand, bool randomVel, bool upVel, bool tenToSix, bool lag):
+  n(n),
+  randomVel(randomVel),
+  upVel(upVel),
+  tenToSix(tenToSix),
+  lag(lag),
+  rng(n, rand),
+  s(4*n),
+  trueThrottle(n),
+  trueBrake(n),
+  brakePosVel(n)
+{
+  targetVel = &s[0];
+  currVel = &s[n];
+  throttleTarget = &s[2*n];
+  brakeTarget = &s[3*n];
+
+  for (int i = 0; i < n; i++){
+    reset(i);
+  }
+}
+
+
+BatchRobotCarVel::~BatchRobotCarVel() { }
+
+int BatchRobotCarVel::size() const {
+  return n;
+}
+
+const float* BatchRobotCarVel::feature(int f) const {
+  return &s[f*n];
+}
+
+void BatchRobotCarVel::sensation(int i, std::vector<float> *sens) const {
+  sens->resize(4);
+  (*sens)[0] = targetVel[i];
+  (*sens)[1] = currVel[i];
+  (*sens)[2] = throttleTarget[i];
+  (*sens)[3] = brakeTarget[i];
+}
+
+
+void BatchRobotCarVel::apply(const int *actions, float *rewards, bool *terminals) {
+
+  const float HZ = 10.0;
+
+  // from the stage simulation
+  const float g = 9.81;         // acceleration due to gravity
+  const float throttle_accel = g;
+  const float brake_decel = g;
+  const float rolling_resistance = 0.01 * g;
+  const float drag_coeff = 0.01;
+  const float idle_accel = (rolling_resistance
+                            + drag_coeff * 3.1 * 3.1);
+
+  // same dynamics as RobotCarVel::apply, for every copy
+  for (int i = 0; i < n; i++){
+
+    // figure out reward based on target/curr vel
+    rewards[i] = -10.0 * fabs(currVel[i] - targetVel[i]);
+    if (terminals != NULL) terminals[i] = false;
+
+    if (lag){
+      float brakeChangePct = brakePosVel[i] / HZ;
+      float brakeVelTarget = 3.0*(brakeTarget[i] - trueBrake[i]);
+      brakePosVel[i] += (brakeVelTarget - brakePosVel[i]) * 3.0 / HZ;
+      trueBrake[i] += brakeChangePct;
+    } else {
+      trueBrake[i] += (brakeTarget[i]-trueBrake[i]) * 1.0f;
+    }
+    if (trueBrake[i] < 0.0f) trueBrake[i] = 0.0;
+    if (trueBrake[i] > 1.0f) trueBrake[i] = 1.0;
+
+    trueThrottle[i] += (throttleTarget[i]-trueThrottle[i]) * 1.0f;
+    if (trueThrottle[i] < 0.0f) trueThrottle[i] = 0.0;
+    if (trueThrottle[i] > 0.4f) trueThrottle[i] = 0.4;
+
+    float wind_resistance = drag_coeff * currVel[i] * currVel[i];
+    float accel = (idle_accel
+                   + trueThrottle[i] * throttle_accel
+                   - trueBrake[i] * brake_decel
+                   - rolling_resistance
+                   - wind_resistance);
+    currVel[i] += (accel / HZ);
+    if (currVel[i] < 0.0f) currVel[i] = 0.0;
+    if (currVel[i] > 12.0f) currVel[i] = 12.0;
+
+    // figure out action's adjustment to throttle/brake targets
+    int action = actions[i];
+    if (action == THROTTLE_UP){
+      brakeTarget[i] = 0.0;
+      if (throttleTarget[i] < 0.4)
+        throttleTarget[i] += 0.1;
+    }
+    else if (action == THROTTLE_DOWN){
+      brakeTarget[i] = 0.0;
+      if (throttleTarget[i] > 0.0)
+        throttleTarget[i] -= 0.1;
+    }
+    else if (action == BRAKE_UP){
+      throttleTarget[i] = 0.0;
+      if (brakeTarget[i] < 1.0)
+        brakeTarget[i] += 0.1;
+    }
+    else if (action == BRAKE_DOWN){
+      throttleTarget[i] = 0.0;
+      if (brakeTarget[i] > 0.0)
+        brakeTarget[i] -= 0.1;
+    }
+    if (throttleTarget[i] < 0.0f) throttleTarget[i] = 0.0;
+    if (throttleTarget[i] > 0.4f) throttleTarget[i] = 0.4;
+    if (brakeTarget[i] < 0.0f) brakeTarget[i] = 0.0;
+    if (brakeTarget[i] > 1.0f) brakeTarget[i] = 1.0;
+    throttleTarget[i] = 0.1 * (float)((int)(throttleTarget[i]*10.0));
+    brakeTarget[i] = 0.1 * (float)((int)(brakeTarget[i]*10.0));
+  }
+
+}
+
+
+bool BatchRobotCarVel::terminal(int i) const {
+  return false;
+}
+
+
+void BatchRobotCarVel::reset(int i) {
+
+  if (randomVel){
+    targetVel[i] = rng.uniformDiscrete(i, 0, 11);
+    currVel[i] = rng.uniformDiscrete(i, 0, 11);
+  } else {
+    if (tenToSix){ // 10 to 6
+      targetVel[i] = upVel ? 10.0 : 6.0;
+      currVel[i] = upVel ? 6.0 : 10.0;
+    } else { // 7 to 2
+      targetVel[i] = upVel ? 7.0 : 2.0;
+      currVel[i] = upVel ? 2.0 : 7.0;
+    }
+  }
+
+  throttleTarget[i] = rng.uniformDiscrete(i, 0, 4) * 0.1;
+  brakeTarget[i] = 0.0;
+  trueThrottle[i] = throttleTarget[i];
+  trueBrake[i] = brakeTarget[i];
+  brakePosVel[i] = 0.0;
+
+}
+
+
+void BatchRobotCarVel::setSensation(int i, const std::vector<float> &sens){
+  if (sens.size() != 4){
+    cerr << "Error in sensation sizes" << endl;
+    return;
+  }
+  targetVel[i] = sens[0];
+  currVel[i] = sens[1];
+  throttleTarget[i] = sens[2];
+  brakeTarget[i] = sens[3];
+  trueThrottle[i] = throttleTarget[i];
+  trueBrake[i] = brakeTarget[i];
+  brakePosVel[i] = 0.0;
+}
+
+
+int BatchRobotCarVel::getNumActions(){
+  return 5;
+}
+
+
+void BatchRobotCarVel::getMinMaxFeatures(std::vector<float> *minFeat,
+                                         std::vector<float> *maxFeat){
+
+  minFeat->resize(4, 0.0);
+  maxFeat->resize(4, 12.0);
+
+  (*maxFeat)[2] = 0.4;
+  (*maxFeat)[3] = 1.0;
+
+}
+
+void BatchRobotCarVel::getMinMaxReward(float *minR,
+                                       float *maxR){
+
+  *minR = -120.0;
+  *maxR = 0.0;
+
+}
@@ -247,3 +247,19 @@ void CartPole::getMinMaxReward(float *minR,
   *maxR = 1.0;    
   
 }
+
+
+void CartPole::snapshot(std::vector<float> *state) const {
+  *state = s;
+}
+
+void CartPole::restore(const std::vector<float> &state){
+  if (state.size() != s.size()){
+    cerr << "Error in snapshot sizes" << endl;
+    return;
+  }
+
+  for (unsigned i = 0; i < s.size(); i++){
+    s[i] = state[i];
+  }
+}
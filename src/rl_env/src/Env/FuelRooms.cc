@@ -399,3 +399,19 @@ void FuelRooms::getMinMaxReward(float *minR,
   *maxR = 0.0;    
   
 }
+
+
+void FuelRooms::snapshot(std::vector<float> *state) const {
+  *state = s;
+}
+
+void FuelRooms::restore(const std::vector<float> &state){
+  if (state.size() != s.size()){
+    cerr << "Error in snapshot sizes" << endl;
+    return;
+  }
+
+  for (unsigned i = 0; i < s.size(); i++){
+    s[i] = state[i];
+  }
+}
@@ -416,3 +416,27 @@ void LightWorld::getMinMaxReward(float *minR,
 }
 
 
+void LightWorld::snapshot(std::vector<float> *state) const {
+  *state = s;
+
+  // key may have been moved in any room
+  for (int i = 0; i < nrooms; i++){
+    state->push_back(rooms[i].key_ns);
+    state->push_back(rooms[i].key_ew);
+  }
+}
+
+void LightWorld::restore(const std::vector<float> &state){
+  if (state.size() != s.size() + 2*nrooms){
+    cerr << "Error in snapshot sizes" << endl;
+    return;
+  }
+
+  for (unsigned i = 0; i < s.size(); i++){
+    s[i] = state[i];
+  }
+  for (int i = 0; i < nrooms; i++){
+    rooms[i].key_ns = (int)state[s.size() + 2*i];
+    rooms[i].key_ew = (int)state[s.size() + 2*i + 1];
+  }
+}
@@ -219,3 +219,26 @@ void MountainCar::getMinMaxReward(float *minR,
   *maxR = 0.0;    
   
 }
+
+
+void MountainCar::snapshot(std::vector<float> *state) const {
+  *state = s;
+  state->insert(state->end(), posHistory.begin(), posHistory.end());
+  state->insert(state->end(), velHistory.begin(), velHistory.end());
+}
+
+void MountainCar::restore(const std::vector<float> &state){
+  unsigned nHist = (state.size() - s.size()) / 2;
+  if (state.size() != s.size() + 2*nHist){
+    cerr << "Error in snapshot sizes" << endl;
+    return;
+  }
+
+  for (unsigned i = 0; i < s.size(); i++){
+    s[i] = state[i];
+  }
+
+  std::vector<float>::const_iterator hist = state.begin() + s.size();
+  posHistory.assign(hist, hist + nHist);
+  velHistory.assign(hist + nHist, state.end());
+}
@@ -306,3 +306,27 @@ float RobotCarVel::bound(float val, float min, float max){
     return max;
   return val;
 }
+
+
+void RobotCarVel::snapshot(std::vector<float> *state) const {
+  *state = s;
+  state->insert(state->end(), hidden.begin(), hidden.end());
+  state->push_back(brakePosVel);
+  state->push_back(actNum);
+}
+
+void RobotCarVel::restore(const std::vector<float> &state){
+  if (state.size() != s.size() + hidden.size() + 2){
+    cerr << "Error in snapshot sizes" << endl;
+    return;
+  }
+
+  for (unsigned i = 0; i < s.size(); i++){
+    s[i] = state[i];
+  }
+  for (unsigned i = 0; i < hidden.size(); i++){
+    hidden[i] = state[s.size() + i];
+  }
+  brakePosVel = state[s.size() + hidden.size()];
+  actNum = (int)state[s.size() + hidden.size() + 1];
+}
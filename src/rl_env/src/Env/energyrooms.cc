@@ -381,3 +381,19 @@ void EnergyRooms::getMinMaxReward(float *minR,
   *maxR = 1.0;
 
 }
+
+
+void EnergyRooms::snapshot(std::vector<float> *state) const {
+  *state = s;
+}
+
+void EnergyRooms::restore(const std::vector<float> &state){
+  if (state.size() != s.size()){
+    cerr << "Error in snapshot sizes" << endl;
+    return;
+  }
+
+  for (unsigned i = 0; i < s.size(); i++){
+    s[i] = state[i];
+  }
+}
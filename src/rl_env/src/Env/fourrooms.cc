@@ -554,3 +554,23 @@ void FourRooms::getMinMaxReward(float *minR,
   }
 
 }
+
+
+void FourRooms::snapshot(std::vector<float> *state) const {
+  *state = s;
+  state->insert(state->end(), unused.begin(), unused.end());
+}
+
+void FourRooms::restore(const std::vector<float> &state){
+  if (state.size() != s.size() + unused.size()){
+    cerr << "Error in snapshot sizes" << endl;
+    return;
+  }
+
+  for (unsigned i = 0; i < s.size(); i++){
+    s[i] = state[i];
+  }
+  for (unsigned i = 0; i < unused.size(); i++){
+    unused[i] = state[s.size() + i];
+  }
+}
@@ -190,3 +190,19 @@ void Stocks::getMinMaxReward(float *minR,
   *minR = -(nsectors*nstocks);
   *maxR = (nsectors*nstocks);
 }
+
+
+void Stocks::snapshot(std::vector<float> *state) const {
+  *state = s;
+}
+
+void Stocks::restore(const std::vector<float> &state){
+  if (state.size() != s.size()){
+    cerr << "Error in snapshot sizes" << endl;
+    return;
+  }
+
+  for (unsigned i = 0; i < s.size(); i++){
+    s[i] = state[i];
+  }
+}
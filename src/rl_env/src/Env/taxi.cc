@@ -307,3 +307,21 @@ void Taxi::getMinMaxReward(float *minR,
   *maxR = 20.0;
 
 }
+
+
+void Taxi::snapshot(std::vector<float> *state) const {
+  *state = s;
+  state->push_back(fickle);
+}
+
+void Taxi::restore(const std::vector<float> &state){
+  if (state.size() != s.size() + 1){
+    cerr << "Error in snapshot sizes" << endl;
+    return;
+  }
+
+  for (unsigned i = 0; i < s.size(); i++){
+    s[i] = state[i];
+  }
+  fickle = (state[s.size()] != 0);
+}
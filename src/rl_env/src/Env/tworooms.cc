@@ -286,3 +286,27 @@ experience TwoRooms::getExp(float s0, float s1, int a){
 
   return e;
 }
+
+
+void TwoRooms::snapshot(std::vector<float> *state) const {
+  *state = s;
+  state->push_back(useGoal2);
+  state->insert(state->end(), actHistory.begin(), actHistory.end());
+}
+
+void TwoRooms::restore(const std::vector<float> &state){
+  if (state.size() != s.size() + 1 + actDelay){
+    cerr << "Error in snapshot sizes" << endl;
+    return;
+  }
+
+  for (unsigned i = 0; i < s.size(); i++){
+    s[i] = state[i];
+  }
+  useGoal2 = (state[s.size()] != 0);
+
+  actHistory.clear();
+  for (unsigned i = s.size() + 1; i < state.size(); i++){
+    actHistory.push_back((int)state[i]);
+  }
+}
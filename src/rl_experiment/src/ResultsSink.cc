@@ -0,0 +1,190 @@
+/** \file ResultsSink.cc
+    Implements the ResultsSink class.
+*/
+
+#include "ResultsSink.hh"
+
+#include <fstream>
+#include <sstream>
+#include <stdlib.h>
+
+
+ResultsSink::ResultsSink(int format, const char* filename, int bufferSize):
+  format(format), bufferSize(bufferSize > 0 ? bufferSize : 1),
+  nQueued(0), nWritten(0), stopping(false)
+{
+
+  if (filename == NULL){
+    out = &std::cerr;
+    ownOut = false;
+  } else {
+    std::ofstream* file = new std::ofstream(filename, std::ios::out | std::ios::binary);
+    if (!file->is_open()){
+      std::cerr << "Could not open results file " << filename << std::endl;
+      exit(-1);
+    }
+    out = file;
+    ownOut = true;
+  }
+
+  if (format == RESULTS_CSV)
+    *out << "kind,config,seed,episode,step,action,reward,seconds\n";
+
+  current.reserve(this->bufferSize);
+
+  pthread_mutex_init(&sink_mutex, NULL);
+  pthread_cond_init(&write_cond, NULL);
+  pthread_cond_init(&written_cond, NULL);
+
+  pthread_create(&writer, NULL, writerStart, this);
+}
+
+ResultsSink::~ResultsSink() {
+  flush();
+
+  pthread_mutex_lock(&sink_mutex);
+  stopping = true;
+  pthread_cond_signal(&write_cond);
+  pthread_mutex_unlock(&sink_mutex);
+
+  pthread_join(writer, NULL);
+
+  pthread_cond_destroy(&written_cond);
+  pthread_cond_destroy(&write_cond);
+  pthread_mutex_destroy(&sink_mutex);
+
+  if (ownOut)
+    delete out;
+}
+
+
+void ResultsSink::recordStep(int config, int seed, int episode, int step, int action, float reward, float seconds){
+
+  // text only has the steps of non-episodic domains
+  if (format == RESULTS_TEXT && episode >= 0)
+    return;
+
+  result r;
+  r.kind = RESULT_STEP;
+  r.config = config;
+  r.seed = seed;
+  r.episode = episode;
+  r.step = step;
+  r.action = action;
+  r.reward = reward;
+  r.seconds = seconds;
+  record(r);
+}
+
+
+void ResultsSink::recordEpisode(int config, int seed, int episode, int steps, float reward, float seconds){
+  result r;
+  r.kind = RESULT_EPISODE;
+  r.config = config;
+  r.seed = seed;
+  r.episode = episode;
+  r.step = steps;
+  r.action = -1;
+  r.reward = reward;
+  r.seconds = seconds;
+  record(r);
+}
+
+
+void ResultsSink::record(const result &r){
+  pthread_mutex_lock(&sink_mutex);
+
+  current.push_back(r);
+
+  // text is watched as the trials run, so it goes out after every episode
+  if (current.size() >= bufferSize ||
+      (format == RESULTS_TEXT && r.kind == RESULT_EPISODE)){
+    pending.push_back(std::vector<result>());
+    pending.back().swap(current);
+    current.reserve(bufferSize);
+    nQueued++;
+    pthread_cond_signal(&write_cond);
+  }
+
+  pthread_mutex_unlock(&sink_mutex);
+}
+
+
+void ResultsSink::flush(){
+  pthread_mutex_lock(&sink_mutex);
+
+  if (current.size() > 0){
+    pending.push_back(std::vector<result>());
+    pending.back().swap(current);
+    nQueued++;
+    pthread_cond_signal(&write_cond);
+  }
+
+  // wait for the writer to catch up
+  int target = nQueued;
+  while (nWritten < target){
+    pthread_cond_wait(&written_cond, &sink_mutex);
+  }
+
+  pthread_mutex_unlock(&sink_mutex);
+}
+
+
+void ResultsSink::write(const std::vector<result> &buf){
+
+  if (format == RESULTS_BINARY){
+    out->write((const char*)&buf[0], buf.size() * sizeof(result));
+  }
+
+  // format the whole buffer first, since stderr writes out every <<
+  else {
+    std::ostringstream text;
+    for (unsigned i = 0; i < buf.size(); i++){
+      const result &r = buf[i];
+      if (format == RESULTS_CSV){
+        text << (r.kind == RESULT_STEP ? "step" : "episode") << ","
+             << r.config << "," << r.seed << "," << r.episode << ","
+             << r.step << "," << r.action << ","
+             << r.reward << "," << r.seconds << "\n";
+      } else {
+        text << r.reward << "\n";
+      }
+    }
+    *out << text.str();
+  }
+
+  out->flush();
+}
+
+
+void ResultsSink::writerLoop(){
+
+  pthread_mutex_lock(&sink_mutex);
+  while (true){
+    if (pending.size() == 0){
+      if (stopping) break;
+      pthread_cond_wait(&write_cond, &sink_mutex);
+      continue;
+    }
+
+    std::vector<result> buf;
+    buf.swap(pending.front());
+    pending.pop_front();
+
+    // write without holding the lock, so trials can keep recording
+    pthread_mutex_unlock(&sink_mutex);
+    write(buf);
+    pthread_mutex_lock(&sink_mutex);
+
+    nWritten++;
+    pthread_cond_broadcast(&written_cond);
+  }
+  pthread_mutex_unlock(&sink_mutex);
+
+}
+
+
+void* ResultsSink::writerStart(void* arg){
+  ((ResultsSink*)arg)->writerLoop();
+  return NULL;
+}
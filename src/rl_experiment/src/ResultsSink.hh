@@ -0,0 +1,117 @@
+/** \file ResultsSink.hh
+    Defines the ResultsSink class, which buffers the results of the trials
+    in memory and writes them out from its own thread.
+*/
+
+#ifndef _RESULTSSINK_HH_
+#define _RESULTSSINK_HH_
+
+#include <vector>
+#include <deque>
+#include <iostream>
+#include <pthread.h>
+
+/** Default # of results to buffer before handing them to the writer */
+#define RESULTS_BUFFER_SIZE 4096
+
+/** Formats results can be written in */
+enum resultFormats {
+  RESULTS_TEXT,   // the reward of each episode (or step), one per line
+  RESULTS_CSV,    // every field of every result, with a header line
+  RESULTS_BINARY  // the result structs, as they are in memory
+};
+
+/** Kinds of results */
+enum resultKinds {
+  RESULT_STEP,
+  RESULT_EPISODE
+};
+
+/** One step or episode of a trial */
+struct result {
+  int kind;      // RESULT_STEP or RESULT_EPISODE
+  int config;    // which set of options the trial ran with
+  int seed;      // seed of the trial
+  int episode;   // episode, -1 for steps of non-episodic domains
+  int step;      // step in the episode, or # of steps of the episode
+  int action;    // action taken, -1 for episodes
+  float reward;  // reward of the step, or sum of rewards of the episode
+  float seconds; // time the agent took to choose the action, or wall time of the episode
+};
+
+
+/** Collects the results of the trials, which may be running in several
+    threads. Results are added to a buffer in memory, and full buffers are
+    written out by a writer thread so the trials never wait on the file.
+    In text mode, only the rewards of episodes and of the steps of
+    non-episodic domains are written, as the experiment always printed
+    them, and the buffer is handed to the writer at the end of every
+    episode so they show up as they are done. */
+class ResultsSink {
+
+public:
+
+  /** Start a sink writing to the given file.
+      \param format One of resultFormats
+      \param filename File to write to, or NULL for stderr
+      \param bufferSize # of results to buffer before writing them out */
+  ResultsSink(int format, const char* filename, int bufferSize = RESULTS_BUFFER_SIZE);
+
+  /** Writes out the remaining results and stops the writer. */
+  ~ResultsSink();
+
+  /** Add the result of a step */
+  void recordStep(int config, int seed, int episode, int step, int action, float reward, float seconds);
+
+  /** Add the result of an episode */
+  void recordEpisode(int config, int seed, int episode, int steps, float reward, float seconds);
+
+  /** Write out everything recorded so far, returning once it is written */
+  void flush();
+
+private:
+
+  /** Unimplemented: sinks are not copied */
+  ResultsSink(const ResultsSink&);
+  ResultsSink& operator=(const ResultsSink&);
+
+  /** Add a result to the buffer, handing the buffer to the writer when it is full (or, in text mode, when an episode ends) */
+  void record(const result &r);
+
+  /** Write a buffer of results in our format */
+  void write(const std::vector<result> &buf);
+
+  /** Write full buffers until the sink is stopped */
+  void writerLoop();
+
+  /** Start routine of the writer thread */
+  static void* writerStart(void* arg);
+
+  const int format;
+  const unsigned bufferSize;
+
+  std::ostream* out;
+  bool ownOut;
+
+  /** Buffer results are being added to */
+  std::vector<result> current;
+
+  /** Full buffers waiting to be written */
+  std::deque<std::vector<result> > pending;
+
+  /** # of buffers handed to the writer, and # it has written */
+  int nQueued;
+  int nWritten;
+
+  bool stopping;
+  pthread_t writer;
+
+  pthread_mutex_t sink_mutex;
+  /** Signalled when a buffer is queued or the sink is stopping. */
+  pthread_cond_t write_cond;
+  /** Signalled when a buffer has been written. */
+  pthread_cond_t written_cond;
+
+};
+
+#endif
@@ -0,0 +1,243 @@
+/** \file benchmark.cc
+    Times the steps of the model free agents on Taxi and a discretized
+    Mountain Car, and the steps of the simulated domains on their own
+    and in batches.
+    Usage: agent_benchmark [# steps]
+*/
+
+#include <rl_common/Random.h>
+#include <rl_common/core.hh>
+
+#include <rl_env/taxi.hh>
+#include <rl_env/MountainCar.hh>
+#include <rl_env/CartPole.hh>
+#include <rl_env/RobotCarVel.hh>
+#include <rl_env/BatchMountainCar.hh>
+#include <rl_env/BatchCartPole.hh>
+#include <rl_env/BatchRobotCarVel.hh>
+
+#include <rl_agent/QLearner.hh>
+#include <rl_agent/Sarsa.hh>
+#include <rl_agent/Dyna.hh>
+#include <rl_agent/DiscretizationAgent.hh>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+/** Most steps in an episode before it is cut off */
+#define MAXSTEPS 1000
+
+/** # of copies in each batch environment */
+#define BATCH_SIZE 1024
+
+/** # of random actions the environments are timed with, repeated over
+    and over (a power of 2) */
+#define NUM_ACTIONS 4096
+
+int nsteps = 1000000;
+
+
+double getSeconds(){
+  struct timezone tz;
+  timeval timeT;
+  gettimeofday(&timeT, &tz);
+  return  timeT.tv_sec + (timeT.tv_usec / 1000000.0);
+}
+
+
+/** Run the agent on the environment for nsteps steps, in episodes of at
+    most MAXSTEPS steps, and print how many steps per second it took. */
+void timeAgent(const char* name, Agent* agent, Environment* e){
+
+  int episodes = 0;
+  float rsum = 0;
+  double start = getSeconds();
+
+  int steps = 0;
+  while (steps < nsteps){
+    e->reset();
+    episodes++;
+
+    int a = agent->first_action(e->sensation());
+    int epSteps = 0;
+    while (true){
+      float r = e->apply(a);
+      rsum += r;
+      steps++;
+      epSteps++;
+
+      if (e->terminal()){
+        agent->last_action(r);
+        break;
+      }
+      if (epSteps >= MAXSTEPS || steps >= nsteps){
+        break;
+      }
+      a = agent->next_action(r, e->sensation());
+    }
+  }
+
+  double elapsed = getSeconds() - start;
+  printf("%-24s steps/sec: %12.0f  (%d episodes, reward %g)\n",
+         name, steps / elapsed, episodes, rsum);
+}
+
+
+/** Pick NUM_ACTIONS random actions of the environment */
+std::vector<int> randomActions(int nact, Random &rng){
+  std::vector<int> actions(NUM_ACTIONS);
+  for (int i = 0; i < NUM_ACTIONS; i++){
+    actions[i] = rng.uniformDiscrete(0, nact-1);
+  }
+  return actions;
+}
+
+
+/** Take nsteps random actions in the environment, resetting it at the
+    end of each episode, and print how many steps per second it took. */
+void timeEnv(const char* name, Environment* e, Random &rng){
+
+  std::vector<int> acts = randomActions(e->getNumActions(), rng);
+  float rsum = 0;
+  double start = getSeconds();
+
+  e->reset();
+  for (int steps = 0; steps < nsteps; steps++){
+    rsum += e->apply(acts[steps & (NUM_ACTIONS-1)]);
+    if (e->terminal())
+      e->reset();
+  }
+
+  double elapsed = getSeconds() - start;
+  printf("%-24s steps/sec: %12.0f  (reward %g)\n",
+         name, nsteps / elapsed, rsum);
+}
+
+
+/** Take nsteps random actions in total over the copies of the batch
+    environment, resetting each copy at the end of its episodes, and
+    print how many steps per second it took. */
+void timeBatchEnv(const char* name, BatchEnvironment* e, Random &rng){
+
+  int n = e->size();
+  std::vector<int> acts = randomActions(e->getNumActions(), rng);
+  std::vector<int> actions(n);
+  std::vector<float> rewards(n);
+  bool* terminals = new bool[n];
+  float rsum = 0;
+  double start = getSeconds();
+
+  int steps = 0;
+  while (steps < nsteps){
+    for (int i = 0; i < n; i++){
+      actions[i] = acts[(steps + i) & (NUM_ACTIONS-1)];
+    }
+    e->apply(&actions[0], &rewards[0], terminals);
+    for (int i = 0; i < n; i++){
+      rsum += rewards[i];
+      if (terminals[i])
+        e->reset(i);
+    }
+    steps += n;
+  }
+
+  double elapsed = getSeconds() - start;
+  printf("%-24s steps/sec: %12.0f  (reward %g)\n",
+         name, steps / elapsed, rsum);
+
+  delete[] terminals;
+}
+
+
+int main(int argc, char **argv){
+
+  if (argc > 1) nsteps = atoi(argv[1]);
+
+  printf("%d steps per agent\n", nsteps);
+
+  const float gamma = 0.99;
+  const float alpha = 0.3;
+  const float epsilon = 0.1;
+  const float lambda = 0.1;
+  const int k = 10;
+
+  Random rng(1 + nsteps);
+
+  // taxi, with states used as is
+  Environment* taxi = new Taxi(rng, false);
+  int nact = taxi->getNumActions();
+
+  Agent* agent = new QLearner(nact, gamma, 0.0, alpha, epsilon, rng);
+  timeAgent("Taxi QLearner", agent, taxi);
+  delete agent;
+
+  agent = new Sarsa(nact, gamma, 0.0, alpha, epsilon, lambda, rng);
+  timeAgent("Taxi Sarsa", agent, taxi);
+  delete agent;
+
+  agent = new Dyna(nact, gamma, 0.0, alpha, k, epsilon, rng);
+  timeAgent("Taxi Dyna", agent, taxi);
+  delete agent;
+
+  // planning on its own thread instead
+  Dyna* dyna = new Dyna(nact, gamma, 0.0, alpha, k, epsilon, rng);
+  dyna->setBackgroundPlanning(true);
+  timeAgent("Taxi Dyna (background)", dyna, taxi);
+  printf("%-24s planning updates: %ld\n", "", dyna->getNumPlanningUpdates());
+  delete dyna;
+
+  delete taxi;
+
+  // mountain car, discretized into 10 values per feature
+  // (the discretization agent deletes the agent it wraps)
+  Environment* mcar = new MountainCar(rng, false, false, 0);
+  nact = mcar->getNumActions();
+  std::vector<float> minValues;
+  std::vector<float> maxValues;
+  mcar->getMinMaxFeatures(&minValues, &maxValues);
+
+  Agent* inner = new QLearner(nact, gamma, 0.0, alpha, epsilon, rng);
+  agent = new DiscretizationAgent(10, inner, minValues, maxValues, false);
+  timeAgent("MountainCar QLearner", agent, mcar);
+  delete agent;
+
+  inner = new Sarsa(nact, gamma, 0.0, alpha, epsilon, lambda, rng);
+  agent = new DiscretizationAgent(10, inner, minValues, maxValues, false);
+  timeAgent("MountainCar Sarsa", agent, mcar);
+  delete agent;
+
+  inner = new Dyna(nact, gamma, 0.0, alpha, k, epsilon, rng);
+  agent = new DiscretizationAgent(10, inner, minValues, maxValues, false);
+  timeAgent("MountainCar Dyna", agent, mcar);
+  delete agent;
+
+  delete mcar;
+
+  // the simulated domains on their own, then BATCH_SIZE copies at once
+  mcar = new MountainCar(rng, true, false, 0);
+  timeEnv("MountainCar", mcar, rng);
+  delete mcar;
+
+  BatchEnvironment* batch = new BatchMountainCar(BATCH_SIZE, rng, true, false);
+  timeBatchEnv("MountainCar (batch)", batch, rng);
+  delete batch;
+
+  Environment* cartpole = new CartPole(rng, true);
+  timeEnv("CartPole", cartpole, rng);
+  delete cartpole;
+
+  batch = new BatchCartPole(BATCH_SIZE, rng, true);
+  timeBatchEnv("CartPole (batch)", batch, rng);
+  delete batch;
+
+  Environment* car = new RobotCarVel(rng, true, false, false, true);
+  timeEnv("RobotCarVel", car, rng);
+  delete car;
+
+  batch = new BatchRobotCarVel(BATCH_SIZE, rng, true, false, false, true);
+  timeBatchEnv("RobotCarVel (batch)", batch, rng);
+  delete batch;
+
+  return 0;
+}
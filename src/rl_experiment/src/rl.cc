@@ -33,25 +33,182 @@
 #include <rl_agent/SavedPolicy.hh>
 #include <rl_agent/Dyna.hh>
 #include <rl_agent/Sarsa.hh>
+#include <rl_agent/TileCodingAgent.hh>
+
+#include <rl_common/ExperienceFile.hh>
+
+#include "ResultsSink.hh"
 
 
 
 #include <vector>
 #include <sstream>
+#include <fstream>
 #include <iostream>
 
 #include <getopt.h>
 #include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
 
-unsigned NUMEPISODES = 1000; //10; //200; //500; //200;
+const unsigned NUMEPISODES = 1000; //10; //200; //500; //200;
 const unsigned NUMTRIALS = 1; //30; //30; //5; //30; //30; //50
-unsigned MAXSTEPS = 1000; // per episode
+const unsigned MAXSTEPS = 1000; // per episode
 bool PRINTS = false;
 
 
+double getSeconds(){
+  struct timezone tz;
+  timeval timeT;
+  gettimeofday(&timeT, &tz);
+  return  timeT.tv_sec + (timeT.tv_usec / 1000000.0);
+}
+
+/** Options of the agent and environment of a trial */
+struct expOptions {
+  expOptions();
+
+  char* agentType;
+  char* envType;
+  float discountfactor;
+  float epsilon;
+  float alpha;
+  float initialvalue;
+  float actrate;
+  float lambda;
+  int M;
+  int modelType;
+  int exploreType;
+  int predType;
+  int plannerType;
+  int nmodels;
+  bool reltrans;
+  bool deptrans;
+  bool compress;
+  float v;
+  float n;
+  float featPct;
+  int nstates;
+  int ntilings;
+  bool qlambda;
+  int k;
+  char * filename;
+  bool stochastic;
+  int nstocks;
+  int nsectors;
+  int delay;
+  bool lag;
+  bool highvar;
+  int history;
+  int seed;
+  unsigned nepisodes;
+  char *explog;
+  char *seedlog;
+  char *modelfile;
+  int maxOutcomes;
+  float minOutcomeProb;
+  int cacheSize;
+  int expCap;
+  float minTrace;
+  int maxTraces;
+  bool replacing;
+  bool background;
+
+  // only used for the base options, not the ones of a sweep
+  int trials;
+  int threads;
+  char *sweepfile;
+  int resultFormat;
+  char *resultsfile;
+};
+
+expOptions::expOptions():
+  agentType(NULL),
+  envType(NULL),
+  discountfactor(0.99),
+  epsilon(0.1),
+  alpha(0.3),
+  initialvalue(0.0),
+  actrate(10.0),
+  lambda(0.1),
+  M(5),
+  modelType(C45TREE),
+  exploreType(GREEDY),
+  predType(BEST),
+  plannerType(PAR_ETUCT_ACTUAL),
+  nmodels(1),
+  reltrans(true),
+  deptrans(false),
+  compress(false),
+  v(0),
+  n(0),
+  featPct(0.2),
+  nstates(0),
+  ntilings(TILE_NUM_TILINGS),
+  qlambda(false), // sarsa(lambda)
+  k(1000),
+  filename(NULL),
+  stochastic(true),
+  nstocks(3),
+  nsectors(3),
+  delay(0),
+  lag(false),
+  highvar(false),
+  history(0),
+  seed(1),
+  nepisodes(NUMEPISODES),
+  explog(NULL),
+  seedlog(NULL),
+  modelfile(NULL),
+  maxOutcomes(0), // no pruning
+  minOutcomeProb(0.0),
+  cacheSize(-1), // the model's default
+  expCap(0), // no cap
+  minTrace(SARSA_MIN_TRACE),
+  maxTraces(SARSA_MAX_TRACES),
+  replacing(SARSA_REPLACING_TRACES),
+  background(DYNA_BACKGROUND_PLANNING),
+  trials(NUMTRIALS),
+  threads(0),
+  sweepfile(NULL),
+  resultFormat(RESULTS_TEXT),
+  resultsfile(NULL)
+{}
+
+
+/** A trial to run: a set of options, the seed to run them with, and
+    the rewards of each episode once it is done */
+struct trialJob {
+  const expOptions* options;
+  int config;
+  int seed;
+  std::vector<float> rewards;
+};
+
+/** Trials shared by the runner threads. Each thread takes the next one
+    nobody has started until there are none left. */
+struct trialQueue {
+  std::vector<trialJob>* jobs;
+  ResultsSink* sink;
+  unsigned next;
+  pthread_mutex_t queue_mutex;
+};
+
+void parseOptions(int argc, char **argv, expOptions *c);
+void runTrial(const expOptions &c, int config, int seed, ResultsSink *sink, std::vector<float> *rewards);
+void* runTrialsStart(void* arg);
+void runTrials(std::vector<trialJob> *jobs, int nthreads, ResultsSink *sink);
+int defaultThreads(const std::vector<expOptions> &configs);
+void printRewards(std::ostream &out,
+                  const std::vector<trialJob> &jobs,
+                  const std::vector<expOptions> &configs,
+                  const std::vector<std::string> &configArgs,
+                  int argc, char **argv);
+
+
 void displayHelp(){
   cout << "\n Call experiment --agent type --env type [options]\n";
-  cout << "Agent types: qlearner sarsa modelbased rmax texplore dyna savedpolicy\n";
+  cout << "Agent types: qlearner sarsa modelbased rmax texplore dyna savedpolicy tilecoding\n";
   cout << "Env types: taxi tworooms fourrooms energy fuelworld mcar cartpole car2to7 car7to2 carrandom stocks lightworld\n";
 
   cout << "\n Agent Options:\n";
@@ -61,18 +218,29 @@ void displayHelp(){
   cout << "--initialvalue value (initial q values)\n";
   cout << "--actrate value (action selection rate (Hz))\n";
   cout << "--lamba value (lamba for eligibility traces)\n";
+  cout << "--mintrace value (For Sarsa: drop eligibility traces that decay below value)\n";
+  cout << "--maxtraces value (For Sarsa: most eligibility traces kept at once (0 for no limit))\n";
+  cout << "--accumulating (For Sarsa: add 1 to the trace of the action taken instead of setting it to 1)\n";
   cout << "--m value (parameter for R-Max)\n";
   cout << "--k value (For Dyna: # of model based updates to do between each real world update)\n";
+  cout << "--background (For Dyna: plan on a separate thread with prioritized replay instead of k updates per step)\n";
   cout << "--history value (# steps of history to use for planning with delay)\n";
   cout << "--filename file (file to load saved policy from for savedpolicy agent)\n";
   cout << "--model type (tabular,tree,m5tree)\n";
-  cout << "--planner type (vi,pi,sweeping,uct,parallel-uct,delayed-uct,delayed-parallel-uct)\n";
+  cout << "--planner type (vi,pi,sweeping,uct,parallel-uct,delayed-uct,delayed-parallel-uct,env-uct,env-et-uct)\n";
   cout << "--explore type (unknown,greedy,epsilongreedy,variancenovelty)\n";
-  cout << "--combo type (average,best,separate)\n";
+  cout << "--combo type (average,best,separate,sampled)\n";
   cout << "--nmodels value (# of models)\n";
   cout << "--nstates value (optionally discretize domain into value # of states on each feature)\n";
+  cout << "--ntilings value (For tilecoding: # of tilings, each with nstates tiles on each feature)\n";
+  cout << "--qlambda (For tilecoding: learn with Q(lambda) instead of Sarsa(lambda))\n";
   cout << "--reltrans (learn relative transitions)\n";
   cout << "--abstrans (learn absolute transitions)\n";
+  cout << "--compress (trees keep repeated experiences as one weighted experience)\n";
+  cout << "--expcap value (most experiences each tree keeps, sampled from all it has seen (0 for no limit))\n";
+  cout << "--maxoutcomes value (most next states a tree model predicts, dropping the least likely (0 for no limit))\n";
+  cout << "--minoutcomeprob value (drop predicted next states less likely than value)\n";
+  cout << "--cachesize value (# of tree model predictions to cache (0 for none, the default))\n";
   cout << "--v value (For TEXPLORE: b/v coefficient for rewarding state-actions where models disagree)\n";
   cout << "--n value (For TEXPLORE: n coefficient for rewarding state-actions which are novel)\n";
 
@@ -88,6 +256,14 @@ void displayHelp(){
   cout << "\n--prints (turn on debug printing of actions/rewards)\n";
   cout << "--nepisodes value (# of episodes to run (1000 default)\n";
   cout << "--seed value (integer seed for random number generator)\n";
+  cout << "--trials value (# of trials to run, with seeds seed, seed+1, ...)\n";
+  cout << "--threads value (# of trials to run at once (# of processors default, a third of them for real-time planners)\n";
+  cout << "--sweep file (run the trials once for each line of file, adding the options on that line)\n";
+  cout << "--results type (text,csv,binary: format to write the results of each step and episode in)\n";
+  cout << "--resultsfile file (file to write results to (stderr default for text)\n";
+  cout << "--explog file (log the experiences of the trial to file)\n";
+  cout << "--seedlog file (seed the agent with the experiences logged in file)\n";
+  cout << "--modelfile file (start the agent from the trees in file, written by model_pretrain)\n";
 
   cout << "\n For more info, see: http://www.ros.org/wiki/rl_experiment\n";
 
@@ -95,48 +271,17 @@ void displayHelp(){
 
 }
 
+/** Parse the command line options into c. Exits on invalid or
+    conflicting options. */
+void parseOptions(int argc, char **argv, expOptions *c) {
 
-int main(int argc, char **argv) {
-
-  // default params for env and agent
-  char* agentType = NULL;
-  char* envType = NULL;
-  float discountfactor = 0.99;
-  float epsilon = 0.1;
-  float alpha = 0.3;
-  float initialvalue = 0.0;
-  float actrate = 10.0;
-  float lambda = 0.1;
-  int M = 5;
-  int modelType = C45TREE;
-  int exploreType = GREEDY;
-  int predType = BEST;
-  int plannerType = PAR_ETUCT_ACTUAL;
-  int nmodels = 1;
-  bool reltrans = true;
-  bool deptrans = false;
-  float v = 0;
-  float n = 0;
-  float featPct = 0.2;
-  int nstates = 0;
-  int k = 1000;
-  char *filename = NULL;
-  bool stochastic = true;
-  int nstocks = 3;
-  int nsectors = 3;
-  int delay = 0;
-  bool lag = false;
-  bool highvar = false;
-  int history = 0;
-  int seed = 1;
-  // change some of these parameters based on command line args
 
   // parse agent type
   bool gotAgent = false;
   for (int i = 1; i < argc-1; i++){
     if (strcmp(argv[i], "--agent") == 0){
       gotAgent = true;
-      agentType = argv[i+1];
+      c->agentType = argv[i+1];
     }
   }
   if (!gotAgent) {
@@ -145,26 +290,26 @@ int main(int argc, char **argv) {
   }
 
   // set some default options for rmax or texplore
-  if (strcmp(agentType, "rmax") == 0){
-    modelType = RMAX;
-    exploreType = EXPLORE_UNKNOWN;
-    predType = BEST;
-    plannerType = VALUE_ITERATION;
-    nmodels = 1;
-    reltrans = false;
-    M = 5;
-    history = 0;
-  } else if (strcmp(agentType, "texplore") == 0){
-    modelType = C45TREE;
-    exploreType = DIFF_AND_NOVEL_BONUS;
-    v = 0;
-    n = 0;
-    predType = AVERAGE;
-    plannerType = PAR_ETUCT_ACTUAL;
-    nmodels = 5;
-    reltrans = true;
-    M = 0;
-    history = 0;
+  if (strcmp(c->agentType, "rmax") == 0){
+    c->modelType = RMAX;
+    c->exploreType = EXPLORE_UNKNOWN;
+    c->predType = BEST;
+    c->plannerType = VALUE_ITERATION;
+    c->nmodels = 1;
+    c->reltrans = false;
+    c->M = 5;
+    c->history = 0;
+  } else if (strcmp(c->agentType, "texplore") == 0){
+    c->modelType = C45TREE;
+    c->exploreType = DIFF_AND_NOVEL_BONUS;
+    c->v = 0;
+    c->n = 0;
+    c->predType = AVERAGE;
+    c->plannerType = PAR_ETUCT_ACTUAL;
+    c->nmodels = 5;
+    c->reltrans = true;
+    c->M = 0;
+    c->history = 0;
   }
 
   // parse env type
@@ -172,7 +317,7 @@ int main(int argc, char **argv) {
   for (int i = 1; i < argc-1; i++){
     if (strcmp(argv[i], "--env") == 0){
       gotEnv = true;
-      envType = argv[i+1];
+      c->envType = argv[i+1];
     }
   }
   if (!gotEnv) {
@@ -220,7 +365,26 @@ int main(int argc, char **argv) {
     {"lag", 0, 0, 7},
     {"nolag", 0, 0, 8},
     {"highvar", 0, 0, 11},
-    {"nepisodes", 1, 0, 12}
+    {"nepisodes", 1, 0, 12},
+    {"ntilings", 1, 0, 13},
+    {"trials", 1, 0, 14},
+    {"threads", 1, 0, 15},
+    {"sweep", 1, 0, 16},
+    {"results", 1, 0, 17},
+    {"resultsfile", 1, 0, 18},
+    {"explog", 1, 0, 19},
+    {"seedlog", 1, 0, 20},
+    {"modelfile", 1, 0, 21},
+    {"maxoutcomes", 1, 0, 22},
+    {"minoutcomeprob", 1, 0, 23},
+    {"cachesize", 1, 0, 24},
+    {"compress", 0, 0, 25},
+    {"expcap", 1, 0, 26},
+    {"mintrace", 1, 0, 27},
+    {"maxtraces", 1, 0, 28},
+    {"accumulating", 0, 0, 29},
+    {"background", 0, 0, 30},
+    {"qlambda", 0, 0, 31}
 
   };
 
@@ -230,27 +394,30 @@ int main(int argc, char **argv) {
   bool bvnChanged = false;
   bool lambdaChanged = false;
 
+  // start over from the first argument each time we're called
+  optind = 0;
+
   while(-1 != (ch = getopt_long_only(argc, argv, optflags, long_options, &option_index))) {
     switch(ch) {
 
     case 'g':
-      discountfactor = std::atof(optarg);
-      cout << "discountfactor: " << discountfactor << endl;
+      c->discountfactor = std::atof(optarg);
+      cout << "discountfactor: " << c->discountfactor << endl;
       break;
 
     case 'e':
       epsilonChanged = true;
-      epsilon = std::atof(optarg);
-      cout << "epsilon: " << epsilon << endl;
+      c->epsilon = std::atof(optarg);
+      cout << "epsilon: " << c->epsilon << endl;
       break;
 
     case 'y':
       {
-        if (strcmp(agentType, "texplore") == 0 || strcmp(agentType, "modelbased") == 0){
-          history = std::atoi(optarg);
-          cout << "history: " << history << endl;
+        if (strcmp(c->agentType, "texplore") == 0 || strcmp(c->agentType, "modelbased") == 0){
+          c->history = std::atoi(optarg);
+          cout << "history: " << c->history << endl;
         } else {
-          cout << "--history is not a valid option for agent: " << agentType << endl;
+          cout << "--history is not a valid option for agent: " << c->agentType << endl;
           exit(-1);
         }
         break;
@@ -258,9 +425,9 @@ int main(int argc, char **argv) {
 
     case 'k':
       {
-        if (strcmp(agentType, "dyna") == 0){
-          k = std::atoi(optarg);
-          cout << "k: " << k << endl;
+        if (strcmp(c->agentType, "dyna") == 0){
+          c->k = std::atoi(optarg);
+          cout << "k: " << c->k << endl;
         } else {
           cout << "--k is only a valid option for the Dyna agent" << endl;
           exit(-1);
@@ -269,17 +436,17 @@ int main(int argc, char **argv) {
       }
 
     case 'f':
-      filename = optarg;
-      cout << "policy filename: " <<  filename << endl;
+      c->filename = optarg;
+      cout << "policy filename: " <<  c->filename << endl;
       break;
 
     case 'a':
       {
-        if (strcmp(agentType, "qlearner") == 0 || strcmp(agentType, "dyna") == 0 || strcmp(agentType, "sarsa") == 0){
-          alpha = std::atof(optarg);
-          cout << "alpha: " << alpha << endl;
+        if (strcmp(c->agentType, "qlearner") == 0 || strcmp(c->agentType, "dyna") == 0 || strcmp(c->agentType, "sarsa") == 0 || strcmp(c->agentType, "tilecoding") == 0){
+          c->alpha = std::atof(optarg);
+          cout << "alpha: " << c->alpha << endl;
         } else {
-          cout << "--alpha option is only valid for Q-Learning, Dyna, and Sarsa" << endl;
+          cout << "--alpha option is only valid for Q-Learning, Dyna, Sarsa, and tile coding" << endl;
           exit(-1);
         }
         break;
@@ -287,11 +454,11 @@ int main(int argc, char **argv) {
 
     case 'i':
       {
-        if (strcmp(agentType, "qlearner") == 0 || strcmp(agentType, "dyna") == 0 || strcmp(agentType, "sarsa") == 0){
-          initialvalue = std::atof(optarg);
-          cout << "initialvalue: " << initialvalue << endl;
+        if (strcmp(c->agentType, "qlearner") == 0 || strcmp(c->agentType, "dyna") == 0 || strcmp(c->agentType, "sarsa") == 0 || strcmp(c->agentType, "tilecoding") == 0){
+          c->initialvalue = std::atof(optarg);
+          cout << "initialvalue: " << c->initialvalue << endl;
         } else {
-          cout << "--initialvalue option is only valid for Q-Learning, Dyna, and Sarsa" << endl;
+          cout << "--initialvalue option is only valid for Q-Learning, Dyna, Sarsa, and tile coding" << endl;
           exit(-1);
         }
         break;
@@ -300,9 +467,9 @@ int main(int argc, char **argv) {
     case 'r':
       {
         actrateChanged = true;
-        if (strcmp(agentType, "texplore") == 0 || strcmp(agentType, "modelbased") == 0 || strcmp(agentType, "rmax") == 0){
-          actrate = std::atof(optarg);
-          cout << "actrate: " << actrate << endl;
+        if (strcmp(c->agentType, "texplore") == 0 || strcmp(c->agentType, "modelbased") == 0 || strcmp(c->agentType, "rmax") == 0){
+          c->actrate = std::atof(optarg);
+          cout << "actrate: " << c->actrate << endl;
         } else {
           cout << "Model-free methods do not require an action rate" << endl;
           exit(-1);
@@ -313,11 +480,11 @@ int main(int argc, char **argv) {
     case 'l':
       {
         lambdaChanged = true;
-        if (strcmp(agentType, "texplore") == 0 || strcmp(agentType, "modelbased") == 0 || strcmp(agentType, "rmax") == 0 || strcmp(agentType, "sarsa") == 0){
-          lambda = std::atof(optarg);
-          cout << "lambda: " << lambda << endl;
+        if (strcmp(c->agentType, "texplore") == 0 || strcmp(c->agentType, "modelbased") == 0 || strcmp(c->agentType, "rmax") == 0 || strcmp(c->agentType, "sarsa") == 0 || strcmp(c->agentType, "tilecoding") == 0){
+          c->lambda = std::atof(optarg);
+          cout << "lambda: " << c->lambda << endl;
         } else {
-          cout << "--lambda option is invalid for this agent: " << agentType << endl;
+          cout << "--lambda option is invalid for this agent: " << c->agentType << endl;
           exit(-1);
         }
         break;
@@ -326,11 +493,11 @@ int main(int argc, char **argv) {
     case 'm':
       {
         mChanged = true;
-        if (strcmp(agentType, "texplore") == 0 || strcmp(agentType, "modelbased") == 0 || strcmp(agentType, "rmax") == 0){
-          M = std::atoi(optarg);
-          cout << "M: " << M << endl;
+        if (strcmp(c->agentType, "texplore") == 0 || strcmp(c->agentType, "modelbased") == 0 || strcmp(c->agentType, "rmax") == 0){
+          c->M = std::atoi(optarg);
+          cout << "M: " << c->M << endl;
         } else {
-          cout << "--M option only useful for model-based agents, not " << agentType << endl;
+          cout << "--M option only useful for model-based agents, not " << c->agentType << endl;
           exit(-1);
         }
         break;
@@ -338,13 +505,13 @@ int main(int argc, char **argv) {
 
     case 'o':
       {
-        if (strcmp(agentType, "texplore") == 0 || strcmp(agentType, "modelbased") == 0 || strcmp(agentType, "rmax") == 0){
-          if (strcmp(optarg, "tabular") == 0) modelType = RMAX;
-          else if (strcmp(optarg, "tree") == 0) modelType = C45TREE;
-          else if (strcmp(optarg, "texplore") == 0) modelType = C45TREE;
-          else if (strcmp(optarg, "c45tree") == 0) modelType = C45TREE;
-          else if (strcmp(optarg, "m5tree") == 0) modelType = M5ALLMULTI;
-          if (strcmp(agentType, "rmax") == 0 && modelType != RMAX){
+        if (strcmp(c->agentType, "texplore") == 0 || strcmp(c->agentType, "modelbased") == 0 || strcmp(c->agentType, "rmax") == 0){
+          if (strcmp(optarg, "tabular") == 0) c->modelType = RMAX;
+          else if (strcmp(optarg, "tree") == 0) c->modelType = C45TREE;
+          else if (strcmp(optarg, "texplore") == 0) c->modelType = C45TREE;
+          else if (strcmp(optarg, "c45tree") == 0) c->modelType = C45TREE;
+          else if (strcmp(optarg, "m5tree") == 0) c->modelType = M5ALLMULTI;
+          if (strcmp(c->agentType, "rmax") == 0 && c->modelType != RMAX){
             cout << "R-Max should use tabular model" << endl;
             exit(-1);
           }
@@ -352,69 +519,74 @@ int main(int argc, char **argv) {
           cout << "Model-free methods do not need a model, --model option does nothing for this agent type" << endl;
           exit(-1);
         }
-        cout << "model: " << modelNames[modelType] << endl;
+        cout << "model: " << modelNames[c->modelType] << endl;
         break;
       }
 
     case 'x':
       {
-        if (strcmp(optarg, "unknown") == 0) exploreType = EXPLORE_UNKNOWN;
-        else if (strcmp(optarg, "greedy") == 0) exploreType = GREEDY;
-        else if (strcmp(optarg, "epsilongreedy") == 0) exploreType = EPSILONGREEDY;
-        else if (strcmp(optarg, "unvisitedstates") == 0) exploreType = UNVISITED_BONUS;
-        else if (strcmp(optarg, "unvisitedactions") == 0) exploreType = UNVISITED_ACT_BONUS;
-        else if (strcmp(optarg, "variancenovelty") == 0) exploreType = DIFF_AND_NOVEL_BONUS;
-        if (strcmp(agentType, "rmax") == 0 && exploreType != EXPLORE_UNKNOWN){
+        if (strcmp(optarg, "unknown") == 0) c->exploreType = EXPLORE_UNKNOWN;
+        else if (strcmp(optarg, "greedy") == 0) c->exploreType = GREEDY;
+        else if (strcmp(optarg, "epsilongreedy") == 0) c->exploreType = EPSILONGREEDY;
+        else if (strcmp(optarg, "unvisitedstates") == 0) c->exploreType = UNVISITED_BONUS;
+        else if (strcmp(optarg, "unvisitedactions") == 0) c->exploreType = UNVISITED_ACT_BONUS;
+        else if (strcmp(optarg, "variancenovelty") == 0) c->exploreType = DIFF_AND_NOVEL_BONUS;
+        if (strcmp(c->agentType, "rmax") == 0 && c->exploreType != EXPLORE_UNKNOWN){
           cout << "R-Max should use \"--explore unknown\" exploration" << endl;
           exit(-1);
         }
-        else if (strcmp(agentType, "texplore") != 0 && strcmp(agentType, "modelbased") != 0 && strcmp(agentType, "rmax") != 0 && (exploreType != GREEDY && exploreType != EPSILONGREEDY)) {
+        else if (strcmp(c->agentType, "texplore") != 0 && strcmp(c->agentType, "modelbased") != 0 && strcmp(c->agentType, "rmax") != 0 && (c->exploreType != GREEDY && c->exploreType != EPSILONGREEDY)) {
           cout << "Model free methods must use either greedy or epsilon-greedy exploration!" << endl;
-          exploreType = EPSILONGREEDY;
+          c->exploreType = EPSILONGREEDY;
           exit(-1);
         }
-        cout << "explore: " << exploreNames[exploreType] << endl;
+        cout << "explore: " << exploreNames[c->exploreType] << endl;
         break;
       }
 
     case 'p':
       {
-        if (strcmp(optarg, "vi") == 0) plannerType = VALUE_ITERATION;
-        else if (strcmp(optarg, "valueiteration") == 0) plannerType = VALUE_ITERATION;
-        else if (strcmp(optarg, "policyiteration") == 0) plannerType = POLICY_ITERATION;
-        else if (strcmp(optarg, "pi") == 0) plannerType = POLICY_ITERATION;
-        else if (strcmp(optarg, "sweeping") == 0) plannerType = PRI_SWEEPING;
-        else if (strcmp(optarg, "prioritizedsweeping") == 0) plannerType = PRI_SWEEPING;
-        else if (strcmp(optarg, "uct") == 0) plannerType = ET_UCT_ACTUAL;
-        else if (strcmp(optarg, "paralleluct") == 0) plannerType = PAR_ETUCT_ACTUAL;
-        else if (strcmp(optarg, "realtimeuct") == 0) plannerType = PAR_ETUCT_ACTUAL;
-        else if (strcmp(optarg, "realtime-uct") == 0) plannerType = PAR_ETUCT_ACTUAL;
-        else if (strcmp(optarg, "parallel-uct") == 0) plannerType = PAR_ETUCT_ACTUAL;
-        else if (strcmp(optarg, "delayeduct") == 0) plannerType = POMDP_ETUCT;
-        else if (strcmp(optarg, "delayed-uct") == 0) plannerType = POMDP_ETUCT;
-        else if (strcmp(optarg, "delayedparalleluct") == 0) plannerType = POMDP_PAR_ETUCT;
-        else if (strcmp(optarg, "delayed-parallel-uct") == 0) plannerType = POMDP_PAR_ETUCT;
-        if (strcmp(agentType, "texplore") != 0 && strcmp(agentType, "modelbased") != 0 && strcmp(agentType, "rmax") != 0){
+        if (strcmp(optarg, "vi") == 0) c->plannerType = VALUE_ITERATION;
+        else if (strcmp(optarg, "valueiteration") == 0) c->plannerType = VALUE_ITERATION;
+        else if (strcmp(optarg, "policyiteration") == 0) c->plannerType = POLICY_ITERATION;
+        else if (strcmp(optarg, "pi") == 0) c->plannerType = POLICY_ITERATION;
+        else if (strcmp(optarg, "sweeping") == 0) c->plannerType = PRI_SWEEPING;
+        else if (strcmp(optarg, "prioritizedsweeping") == 0) c->plannerType = PRI_SWEEPING;
+        else if (strcmp(optarg, "uct") == 0) c->plannerType = ET_UCT_ACTUAL;
+        else if (strcmp(optarg, "paralleluct") == 0) c->plannerType = PAR_ETUCT_ACTUAL;
+        else if (strcmp(optarg, "realtimeuct") == 0) c->plannerType = PAR_ETUCT_ACTUAL;
+        else if (strcmp(optarg, "realtime-uct") == 0) c->plannerType = PAR_ETUCT_ACTUAL;
+        else if (strcmp(optarg, "parallel-uct") == 0) c->plannerType = PAR_ETUCT_ACTUAL;
+        else if (strcmp(optarg, "delayeduct") == 0) c->plannerType = POMDP_ETUCT;
+        else if (strcmp(optarg, "delayed-uct") == 0) c->plannerType = POMDP_ETUCT;
+        else if (strcmp(optarg, "delayedparalleluct") == 0) c->plannerType = POMDP_PAR_ETUCT;
+        else if (strcmp(optarg, "delayed-parallel-uct") == 0) c->plannerType = POMDP_PAR_ETUCT;
+        else if (strcmp(optarg, "envuct") == 0) c->plannerType = UCT_WITH_ENV;
+        else if (strcmp(optarg, "env-uct") == 0) c->plannerType = UCT_WITH_ENV;
+        else if (strcmp(optarg, "envetuct") == 0) c->plannerType = ET_UCT_WITH_ENV;
+        else if (strcmp(optarg, "env-et-uct") == 0) c->plannerType = ET_UCT_WITH_ENV;
+        if (strcmp(c->agentType, "texplore") != 0 && strcmp(c->agentType, "modelbased") != 0 && strcmp(c->agentType, "rmax") != 0){
           cout << "Model-free methods do not require planners, --planner option does nothing with this agent" << endl;
           exit(-1);
         }
-        if (strcmp(agentType, "rmax") == 0 && plannerType != VALUE_ITERATION){
+        if (strcmp(c->agentType, "rmax") == 0 && c->plannerType != VALUE_ITERATION){
           cout << "Typical implementation of R-Max would use value iteration, but another planner type is ok" << endl;
         }
-        cout << "planner: " << plannerNames[plannerType] << endl;
+        cout << "planner: " << plannerNames[c->plannerType] << endl;
         break;
       }
 
     case 'c':
       {
-        if (strcmp(agentType, "texplore") == 0 || strcmp(agentType, "modelbased") == 0){
-          if (strcmp(optarg, "average") == 0) predType = AVERAGE;
-          else if (strcmp(optarg, "weighted") == 0) predType = WEIGHTAVG;
-          else if (strcmp(optarg, "best") == 0) predType = BEST;
-          else if (strcmp(optarg, "separate") == 0) predType = SEPARATE;
-          cout << "predType: " << comboNames[predType] << endl;
+        if (strcmp(c->agentType, "texplore") == 0 || strcmp(c->agentType, "modelbased") == 0){
+          if (strcmp(optarg, "average") == 0) c->predType = AVERAGE;
+          else if (strcmp(optarg, "weighted") == 0) c->predType = WEIGHTAVG;
+          else if (strcmp(optarg, "best") == 0) c->predType = BEST;
+          else if (strcmp(optarg, "separate") == 0) c->predType = SEPARATE;
+          else if (strcmp(optarg, "sampled") == 0) c->predType = SAMPLED;
+          cout << "predType: " << comboNames[c->predType] << endl;
         } else {
-          cout << "--combo is an invalid option for agent: " << agentType << endl;
+          cout << "--combo is an invalid option for agent: " << c->agentType << endl;
           exit(-1);
         }
         break;
@@ -422,14 +594,14 @@ int main(int argc, char **argv) {
 
     case '#':
       {
-        if (strcmp(agentType, "texplore") == 0 || strcmp(agentType, "modelbased") == 0){
-          nmodels = std::atoi(optarg);
-          cout << "nmodels: " << nmodels << endl;
+        if (strcmp(c->agentType, "texplore") == 0 || strcmp(c->agentType, "modelbased") == 0){
+          c->nmodels = std::atoi(optarg);
+          cout << "nmodels: " << c->nmodels << endl;
         } else {
-          cout << "--nmodels is an invalid option for agent: " << agentType << endl;
+          cout << "--nmodels is an invalid option for agent: " << c->agentType << endl;
           exit(-1);
         }
-        if (nmodels < 1){
+        if (c->nmodels < 1){
           cout << "nmodels must be > 0" << endl;
           exit(-1);
         }
@@ -438,11 +610,11 @@ int main(int argc, char **argv) {
 
     case 't':
       {
-        if (strcmp(agentType, "texplore") == 0 || strcmp(agentType, "modelbased") == 0){
-          reltrans = true;
-          cout << "reltrans: " << reltrans << endl;
+        if (strcmp(c->agentType, "texplore") == 0 || strcmp(c->agentType, "modelbased") == 0){
+          c->reltrans = true;
+          cout << "reltrans: " << c->reltrans << endl;
         } else {
-          cout << "--reltrans is an invalid option for agent: " << agentType << endl;
+          cout << "--reltrans is an invalid option for agent: " << c->agentType << endl;
           exit(-1);
         }
         break;
@@ -450,24 +622,24 @@ int main(int argc, char **argv) {
 
     case '0':
       {
-        if (strcmp(agentType, "texplore") == 0 || strcmp(agentType, "modelbased") == 0){
-          reltrans = false;
-          cout << "reltrans: " << reltrans << endl;
+        if (strcmp(c->agentType, "texplore") == 0 || strcmp(c->agentType, "modelbased") == 0){
+          c->reltrans = false;
+          cout << "reltrans: " << c->reltrans << endl;
         } else {
-          cout << "--abstrans is an invalid option for agent: " << agentType << endl;
+          cout << "--abstrans is an invalid option for agent: " << c->agentType << endl;
           exit(-1);
         }
         break;
       }
 
     case 's':
-      seed = std::atoi(optarg);
-      cout << "seed: " << seed << endl;
+      c->seed = std::atoi(optarg);
+      cout << "seed: " << c->seed << endl;
       break;
 
     case 'q':
       // already processed this one
-      cout << "agent: " << agentType << endl;
+      cout << "agent: " << c->agentType << endl;
       break;
 
     case 'd':
@@ -475,20 +647,20 @@ int main(int argc, char **argv) {
       break;
 
     case 'w':
-      nstates = std::atoi(optarg);
-      cout << "nstates for discretization: " << nstates << endl;
+      c->nstates = std::atoi(optarg);
+      cout << "nstates for discretization: " << c->nstates << endl;
       break;
 
     case 'v':
     case 'b':
       {
         bvnChanged = true;
-        if (strcmp(agentType, "texplore") == 0){
-          v = std::atof(optarg);
-          cout << "v coefficient (variance bonus): " << v << endl;
+        if (strcmp(c->agentType, "texplore") == 0){
+          c->v = std::atof(optarg);
+          cout << "v coefficient (variance bonus): " << c->v << endl;
         }
         else {
-          cout << "--v and --b are invalid options for agent: " << agentType << endl;
+          cout << "--v and --b are invalid options for agent: " << c->agentType << endl;
           exit(-1);
         }
         break;
@@ -497,27 +669,27 @@ int main(int argc, char **argv) {
     case 'n':
       {
         bvnChanged = true;
-        if (strcmp(agentType, "texplore") == 0){
-          n = std::atof(optarg);
-          cout << "n coefficient (novelty bonus): " << n << endl;
+        if (strcmp(c->agentType, "texplore") == 0){
+          c->n = std::atof(optarg);
+          cout << "n coefficient (novelty bonus): " << c->n << endl;
         }
         else {
-          cout << "--n is an invalid option for agent: " << agentType << endl;
+          cout << "--n is an invalid option for agent: " << c->agentType << endl;
           exit(-1);
         }
         break;
       }
 
     case 2:
-      stochastic = false;
-      cout << "stochastic: " << stochastic << endl;
+      c->stochastic = false;
+      cout << "stochastic: " << c->stochastic << endl;
       break;
 
     case 11:
       {
-        if (strcmp(envType, "fuelworld") == 0){
-          highvar = true;
-          cout << "fuel world fuel cost variation: " << highvar << endl;
+        if (strcmp(c->envType, "fuelworld") == 0){
+          c->highvar = true;
+          cout << "fuel world fuel cost variation: " << c->highvar << endl;
         } else {
           cout << "--highvar is only a valid option for the fuelworld domain." << endl;
           exit(-1);
@@ -526,15 +698,15 @@ int main(int argc, char **argv) {
       }
 
     case 3:
-      stochastic = true;
-      cout << "stochastic: " << stochastic << endl;
+      c->stochastic = true;
+      cout << "stochastic: " << c->stochastic << endl;
       break;
 
     case 4:
       {
-        if (strcmp(envType, "mcar") == 0 || strcmp(envType, "tworooms") == 0){
-          delay = std::atoi(optarg);
-          cout << "delay steps: " << delay << endl;
+        if (strcmp(c->envType, "mcar") == 0 || strcmp(c->envType, "tworooms") == 0){
+          c->delay = std::atoi(optarg);
+          cout << "delay steps: " << c->delay << endl;
         } else {
           cout << "--delay option is only valid for the mcar and tworooms domains" << endl;
           exit(-1);
@@ -544,9 +716,9 @@ int main(int argc, char **argv) {
 
     case 5:
       {
-        if (strcmp(envType, "stocks") == 0){
-          nsectors = std::atoi(optarg);
-          cout << "nsectors: " << nsectors << endl;
+        if (strcmp(c->envType, "stocks") == 0){
+          c->nsectors = std::atoi(optarg);
+          cout << "nsectors: " << c->nsectors << endl;
         } else {
           cout << "--nsectors option is only valid for the stocks domain" << endl;
           exit(-1);
@@ -556,9 +728,9 @@ int main(int argc, char **argv) {
 
     case 6:
       {
-        if (strcmp(envType, "stocks") == 0){
-          nstocks = std::atoi(optarg);
-          cout << "nstocks: " << nstocks << endl;
+        if (strcmp(c->envType, "stocks") == 0){
+          c->nstocks = std::atoi(optarg);
+          cout << "nstocks: " << c->nstocks << endl;
         } else {
           cout << "--nstocks option is only valid for the stocks domain" << endl;
           exit(-1);
@@ -568,9 +740,9 @@ int main(int argc, char **argv) {
 
     case 7:
       {
-        if (strcmp(envType, "car2to7") == 0 || strcmp(envType, "car7to2") == 0 || strcmp(envType, "carrandom") == 0){
-          lag = true;
-          cout << "lag: " << lag << endl;
+        if (strcmp(c->envType, "car2to7") == 0 || strcmp(c->envType, "car7to2") == 0 || strcmp(c->envType, "carrandom") == 0){
+          c->lag = true;
+          cout << "lag: " << c->lag << endl;
         } else {
           cout << "--lag option is only valid for car velocity tasks" << endl;
           exit(-1);
@@ -580,9 +752,9 @@ int main(int argc, char **argv) {
 
     case 8:
       {
-        if (strcmp(envType, "car2to7") == 0 || strcmp(envType, "car7to2") == 0 || strcmp(envType, "carrandom") == 0){
-          lag = false;
-          cout << "lag: " << lag << endl;
+        if (strcmp(c->envType, "car2to7") == 0 || strcmp(c->envType, "car7to2") == 0 || strcmp(c->envType, "carrandom") == 0){
+          c->lag = false;
+          cout << "lag: " << c->lag << endl;
         } else {
           cout << "--nolag option is only valid for car velocity tasks" << endl;
           exit(-1);
@@ -592,12 +764,177 @@ int main(int argc, char **argv) {
 
     case 1:
       // already processed this one
-      cout << "env: " << envType << endl;
+      cout << "env: " << c->envType << endl;
       break;
 
     case 12:
-      NUMEPISODES = std::atoi(optarg);
-      cout << "Num Episodes: " << NUMEPISODES << endl;
+      c->nepisodes = std::atoi(optarg);
+      cout << "Num Episodes: " << c->nepisodes << endl;
+      break;
+
+    case 13:
+      {
+        if (strcmp(c->agentType, "tilecoding") == 0){
+          c->ntilings = std::atoi(optarg);
+          cout << "ntilings: " << c->ntilings << endl;
+        } else {
+          cout << "--ntilings option is only valid for the tilecoding agent" << endl;
+          exit(-1);
+        }
+        break;
+      }
+
+    case 14:
+      c->trials = std::atoi(optarg);
+      cout << "trials: " << c->trials << endl;
+      break;
+
+    case 15:
+      c->threads = std::atoi(optarg);
+      cout << "threads: " << c->threads << endl;
+      break;
+
+    case 16:
+      c->sweepfile = optarg;
+      cout << "sweep: " << c->sweepfile << endl;
+      break;
+
+    case 17:
+      {
+        if (strcmp(optarg, "text") == 0) c->resultFormat = RESULTS_TEXT;
+        else if (strcmp(optarg, "csv") == 0) c->resultFormat = RESULTS_CSV;
+        else if (strcmp(optarg, "binary") == 0) c->resultFormat = RESULTS_BINARY;
+        else {
+          cout << "Invalid results format" << endl;
+          exit(-1);
+        }
+        cout << "results: " << optarg << endl;
+        break;
+      }
+
+    case 18:
+      c->resultsfile = optarg;
+      cout << "results file: " << c->resultsfile << endl;
+      break;
+
+    case 19:
+      c->explog = optarg;
+      cout << "experience log: " << c->explog << endl;
+      break;
+
+    case 20:
+      c->seedlog = optarg;
+      cout << "seed experience log: " << c->seedlog << endl;
+      break;
+
+    case 21:
+      if (strcmp(c->agentType, "texplore") == 0 || strcmp(c->agentType, "modelbased") == 0){
+        c->modelfile = optarg;
+        cout << "model file: " << c->modelfile << endl;
+      } else {
+        cout << "--modelfile is an invalid option for agent: " << c->agentType << endl;
+        exit(-1);
+      }
+      break;
+
+    case 22:
+      if (strcmp(c->agentType, "texplore") == 0 || strcmp(c->agentType, "modelbased") == 0){
+        c->maxOutcomes = std::atoi(optarg);
+        cout << "max outcomes: " << c->maxOutcomes << endl;
+      } else {
+        cout << "--maxoutcomes is an invalid option for agent: " << c->agentType << endl;
+        exit(-1);
+      }
+      break;
+
+    case 23:
+      if (strcmp(c->agentType, "texplore") == 0 || strcmp(c->agentType, "modelbased") == 0){
+        c->minOutcomeProb = std::atof(optarg);
+        cout << "min outcome prob: " << c->minOutcomeProb << endl;
+      } else {
+        cout << "--minoutcomeprob is an invalid option for agent: " << c->agentType << endl;
+        exit(-1);
+      }
+      break;
+
+    case 24:
+      if (strcmp(c->agentType, "texplore") == 0 || strcmp(c->agentType, "modelbased") == 0){
+        c->cacheSize = std::atoi(optarg);
+        cout << "cache size: " << c->cacheSize << endl;
+      } else {
+        cout << "--cachesize is an invalid option for agent: " << c->agentType << endl;
+        exit(-1);
+      }
+      break;
+
+    case 25:
+      if (strcmp(c->agentType, "texplore") == 0 || strcmp(c->agentType, "modelbased") == 0){
+        c->compress = true;
+        cout << "compress duplicate experiences" << endl;
+      } else {
+        cout << "--compress is an invalid option for agent: " << c->agentType << endl;
+        exit(-1);
+      }
+      break;
+
+    case 26:
+      if (strcmp(c->agentType, "texplore") == 0 || strcmp(c->agentType, "modelbased") == 0){
+        c->expCap = std::atoi(optarg);
+        cout << "tree experience cap: " << c->expCap << endl;
+      } else {
+        cout << "--expcap is an invalid option for agent: " << c->agentType << endl;
+        exit(-1);
+      }
+      break;
+
+    case 27:
+      if (strcmp(c->agentType, "sarsa") == 0){
+        c->minTrace = std::atof(optarg);
+        cout << "min trace: " << c->minTrace << endl;
+      } else {
+        cout << "--mintrace is only a valid option for the Sarsa agent" << endl;
+        exit(-1);
+      }
+      break;
+
+    case 28:
+      if (strcmp(c->agentType, "sarsa") == 0){
+        c->maxTraces = std::atoi(optarg);
+        cout << "max traces: " << c->maxTraces << endl;
+      } else {
+        cout << "--maxtraces is only a valid option for the Sarsa agent" << endl;
+        exit(-1);
+      }
+      break;
+
+    case 29:
+      if (strcmp(c->agentType, "sarsa") == 0){
+        c->replacing = false;
+        cout << "accumulating traces" << endl;
+      } else {
+        cout << "--accumulating is only a valid option for the Sarsa agent" << endl;
+        exit(-1);
+      }
+      break;
+
+    case 30:
+      if (strcmp(c->agentType, "dyna") == 0){
+        c->background = true;
+        cout << "background planning" << endl;
+      } else {
+        cout << "--background is only a valid option for the Dyna agent" << endl;
+        exit(-1);
+      }
+      break;
+
+    case 31:
+      if (strcmp(c->agentType, "tilecoding") == 0){
+        c->qlambda = true;
+        cout << "Q(lambda) updates" << endl;
+      } else {
+        cout << "--qlambda is only a valid option for the tilecoding agent" << endl;
+        exit(-1);
+      }
       break;
 
     case 'h':
@@ -610,151 +947,163 @@ int main(int argc, char **argv) {
   }
 
   // default back to greedy if no coefficients
-  if (exploreType == DIFF_AND_NOVEL_BONUS && v == 0 && n == 0)
-    exploreType = GREEDY;
+  if (c->exploreType == DIFF_AND_NOVEL_BONUS && c->v == 0 && c->n == 0)
+    c->exploreType = GREEDY;
 
   // check for conflicting options
   // changed epsilon but not doing epsilon greedy exploration
-  if (epsilonChanged && exploreType != EPSILONGREEDY){
+  if (epsilonChanged && c->exploreType != EPSILONGREEDY){
     cout << "No reason to change epsilon when not using epsilon-greedy exploration" << endl;
     exit(-1);
   }
 
   // set history value but not doing uct w/history planner
-  if (history > 0 && (plannerType == VALUE_ITERATION || plannerType == POLICY_ITERATION || plannerType == PRI_SWEEPING)){
+  if (c->history > 0 && (c->plannerType == VALUE_ITERATION || c->plannerType == POLICY_ITERATION || c->plannerType == PRI_SWEEPING)){
     cout << "No reason to set history higher than 0 if not using a UCT planner" << endl;
     exit(-1);
   }
 
   // set action rate but not doing real-time planner
-  if (actrateChanged && (plannerType == VALUE_ITERATION || plannerType == POLICY_ITERATION || plannerType == PRI_SWEEPING)){
+  if (actrateChanged && (c->plannerType == VALUE_ITERATION || c->plannerType == POLICY_ITERATION || c->plannerType == PRI_SWEEPING)){
     cout << "No reason to set actrate if not using a UCT planner" << endl;
     exit(-1);
   }
 
   // set lambda but not doing uct (lambda)
-  if (lambdaChanged && (strcmp(agentType, "texplore") == 0 || strcmp(agentType, "modelbased") == 0 || strcmp(agentType, "rmax") == 0) && (plannerType == VALUE_ITERATION || plannerType == POLICY_ITERATION || plannerType == PRI_SWEEPING)){
+  if (lambdaChanged && (strcmp(c->agentType, "texplore") == 0 || strcmp(c->agentType, "modelbased") == 0 || strcmp(c->agentType, "rmax") == 0) && (c->plannerType == VALUE_ITERATION || c->plannerType == POLICY_ITERATION || c->plannerType == PRI_SWEEPING)){
     cout << "No reason to set actrate if not using a UCT planner" << endl;
     exit(-1);
   }
 
   // set n/v/b but not doing that diff_novel exploration
-  if (bvnChanged && exploreType != DIFF_AND_NOVEL_BONUS){
+  if (bvnChanged && c->exploreType != DIFF_AND_NOVEL_BONUS){
     cout << "No reason to set n or v if not doing variance & novelty exploration" << endl;
     exit(-1);
   }
 
   // set combo other than best but only doing 1 model
-  if (predType != BEST && nmodels == 1){
+  if (c->predType != BEST && c->nmodels == 1){
     cout << "No reason to have model combo other than best with nmodels = 1" << endl;
     exit(-1);
   }
 
   // set M but not doing explore unknown
-  if (mChanged && exploreType != EXPLORE_UNKNOWN){
+  if (mChanged && c->exploreType != EXPLORE_UNKNOWN){
     cout << "No reason to set M if not doing R-max style Explore Unknown exploration" << endl;
     exit(-1);
   }
 
+  // csv or binary results would be mixed in with the rest on stderr
+  if (c->resultFormat != RESULTS_TEXT && c->resultsfile == NULL){
+    cout << "csv or binary results need a --resultsfile to write to" << endl;
+    exit(-1);
+  }
+
   if (PRINTS){
-    if (stochastic)
+    if (c->stochastic)
       cout << "Stohastic\n";
     else
       cout << "Deterministic\n";
   }
 
-  Random rng(1 + seed);
 
-  std::vector<int> statesPerDim;
+}
+
+
+/** Construct the environment given by the options, drawing its random
+    numbers from rng.  Domains with their own discretization or episode
+    length set statesPerDim and maxSteps; they are left alone otherwise.
+    The domain is printed if prints is set. */
+Environment* createEnvironment(const expOptions &c, Random &rng, bool prints,
+                               std::vector<int> *statesPerDim, unsigned *maxSteps) {
 
-  // Construct environment here.
   Environment* e;
 
-  if (strcmp(envType, "cartpole") == 0){
-    if (PRINTS) cout << "Environment: Cart Pole\n";
-    e = new CartPole(rng, stochastic);
+  if (strcmp(c.envType, "cartpole") == 0){
+    if (prints) cout << "Environment: Cart Pole\n";
+    e = new CartPole(rng, c.stochastic);
   }
 
-  else if (strcmp(envType, "mcar") == 0){
-    if (PRINTS) cout << "Environment: Mountain Car\n";
-    e = new MountainCar(rng, stochastic, false, delay);
+  else if (strcmp(c.envType, "mcar") == 0){
+    if (prints) cout << "Environment: Mountain Car\n";
+    e = new MountainCar(rng, c.stochastic, false, c.delay);
   }
 
   // taxi
-  else if (strcmp(envType, "taxi") == 0){
-    if (PRINTS) cout << "Environment: Taxi\n";
-    e = new Taxi(rng, stochastic);
+  else if (strcmp(c.envType, "taxi") == 0){
+    if (prints) cout << "Environment: Taxi\n";
+    e = new Taxi(rng, c.stochastic);
   }
 
   // Light World
-  else if (strcmp(envType, "lightworld") == 0){
-    if (PRINTS) cout << "Environment: Light World\n";
-    e = new LightWorld(rng, stochastic, 4);
+  else if (strcmp(c.envType, "lightworld") == 0){
+    if (prints) cout << "Environment: Light World\n";
+    e = new LightWorld(rng, c.stochastic, 4);
   }
 
   // two rooms
-  else if (strcmp(envType, "tworooms") == 0){
-    if (PRINTS) cout << "Environment: TwoRooms\n";
-    e = new TwoRooms(rng, stochastic, true, delay, false);
+  else if (strcmp(c.envType, "tworooms") == 0){
+    if (prints) cout << "Environment: TwoRooms\n";
+    e = new TwoRooms(rng, c.stochastic, true, c.delay, false);
   }
 
   // car vel, 2 to 7
-  else if (strcmp(envType, "car2to7") == 0){
-    if (PRINTS) cout << "Environment: Car Velocity 2 to 7 m/s\n";
-    e = new RobotCarVel(rng, false, true, false, lag);
-    statesPerDim.resize(4,0);
-    statesPerDim[0] = 12;
-    statesPerDim[1] = 120;
-    statesPerDim[2] = 4;
-    statesPerDim[3] = 10;
-    MAXSTEPS = 100;
+  else if (strcmp(c.envType, "car2to7") == 0){
+    if (prints) cout << "Environment: Car Velocity 2 to 7 m/s\n";
+    e = new RobotCarVel(rng, false, true, false, c.lag);
+    statesPerDim->resize(4,0);
+    (*statesPerDim)[0] = 12;
+    (*statesPerDim)[1] = 120;
+    (*statesPerDim)[2] = 4;
+    (*statesPerDim)[3] = 10;
+    *maxSteps = 100;
   }
   // car vel, 7 to 2
-  else if (strcmp(envType, "car7to2") == 0){
-    if (PRINTS) cout << "Environment: Car Velocity 7 to 2 m/s\n";
-    e = new RobotCarVel(rng, false, false, false, lag);
-    statesPerDim.resize(4,0);
-    statesPerDim[0] = 12;
-    statesPerDim[1] = 120;
-    statesPerDim[2] = 4;
-    statesPerDim[3] = 10;
-    MAXSTEPS = 100;
+  else if (strcmp(c.envType, "car7to2") == 0){
+    if (prints) cout << "Environment: Car Velocity 7 to 2 m/s\n";
+    e = new RobotCarVel(rng, false, false, false, c.lag);
+    statesPerDim->resize(4,0);
+    (*statesPerDim)[0] = 12;
+    (*statesPerDim)[1] = 120;
+    (*statesPerDim)[2] = 4;
+    (*statesPerDim)[3] = 10;
+    *maxSteps = 100;
   }
   // car vel, random vels
-  else if (strcmp(envType, "carrandom") == 0){
-    if (PRINTS) cout << "Environment: Car Velocity Random Velocities\n";
-    e = new RobotCarVel(rng, true, false, false, lag);
-    statesPerDim.resize(4,0);
-    statesPerDim[0] = 12;
-    statesPerDim[1] = 48;
-    statesPerDim[2] = 4;
-    statesPerDim[3] = 10;
-    MAXSTEPS = 100;
+  else if (strcmp(c.envType, "carrandom") == 0){
+    if (prints) cout << "Environment: Car Velocity Random Velocities\n";
+    e = new RobotCarVel(rng, true, false, false, c.lag);
+    statesPerDim->resize(4,0);
+    (*statesPerDim)[0] = 12;
+    (*statesPerDim)[1] = 48;
+    (*statesPerDim)[2] = 4;
+    (*statesPerDim)[3] = 10;
+    *maxSteps = 100;
   }
 
   // four rooms
-  else if (strcmp(envType, "fourrooms") == 0){
-    if (PRINTS) cout << "Environment: FourRooms\n";
-    e = new FourRooms(rng, stochastic, true, false);
+  else if (strcmp(c.envType, "fourrooms") == 0){
+    if (prints) cout << "Environment: FourRooms\n";
+    e = new FourRooms(rng, c.stochastic, true, false);
   }
 
   // four rooms with energy level
-  else if (strcmp(envType, "energy") == 0){
-    if (PRINTS) cout << "Environment: EnergyRooms\n";
-    e = new EnergyRooms(rng, stochastic, true, false);
+  else if (strcmp(c.envType, "energy") == 0){
+    if (prints) cout << "Environment: EnergyRooms\n";
+    e = new EnergyRooms(rng, c.stochastic, true, false);
   }
 
   // gridworld with fuel (fuel stations on top and bottom with random costs)
-  else if (strcmp(envType, "fuelworld") == 0){
-    if (PRINTS) cout << "Environment: FuelWorld\n";
-    e = new FuelRooms(rng, highvar, stochastic);
+  else if (strcmp(c.envType, "fuelworld") == 0){
+    if (prints) cout << "Environment: FuelWorld\n";
+    e = new FuelRooms(rng, c.highvar, c.stochastic);
   }
 
   // stocks
-  else if (strcmp(envType, "stocks") == 0){
-    if (PRINTS) cout << "Enironment: Stocks with " << nsectors
-                     << " sectors and " << nstocks << " stocks\n";
-    e = new Stocks(rng, stochastic, nsectors, nstocks);
+  else if (strcmp(c.envType, "stocks") == 0){
+    if (prints) cout << "Enironment: Stocks with " << c.nsectors
+                     << " sectors and " << c.nstocks << " stocks\n";
+    e = new Stocks(rng, c.stochastic, c.nsectors, c.nstocks);
   }
 
   else {
@@ -762,6 +1111,74 @@ int main(int argc, char **argv) {
     exit(-1);
   }
 
+  return e;
+}
+
+
+/** Seed the agent with the experiences of a log, handing them over a
+    chunk at a time as they are read from the mapped file. */
+void seedFromLog(Agent* agent, const char* filename){
+  ExperienceFile log;
+  if (!log.openFile(filename)){
+    std::cerr << "Could not read experience log " << filename << endl;
+    exit(-1);
+  }
+
+  const int nfeats = log.numFeatures();
+  std::vector<experience> seeds;
+  for (int ch = 0; ch < log.numChunks(); ch++){
+    int nexp = 0;
+    const float* rec = log.chunk(ch, &nexp);
+    seeds.resize(nexp);
+    for (int i = 0; i < nexp; i++){
+      ExperienceFile::getExperience(rec + i*ExperienceFile::recordSize(nfeats), nfeats, &seeds[i]);
+    }
+    agent->seedExp(seeds);
+  }
+
+  if (PRINTS) cout << "Seeded with " << log.numExperiences()
+                   << " logged experiences" << endl;
+}
+
+
+/** Add the step the environment just took to the experience log */
+void logExperience(ExperienceFile *log, const std::vector<float> &s, int a, float r, Environment *e){
+  experience exp;
+  exp.s = s;
+  exp.act = a;
+  exp.reward = r;
+  exp.next = e->sensation();
+  exp.terminal = e->terminal();
+  log->saveExperience(exp);
+}
+
+
+/** Run one trial of the given options with its own environment and
+    agent, both seeded from seed. Each step and episode is recorded in
+    the sink (if there is one), and the reward of each episode (or of
+    each step, for non-episodic domains) is added to rewards (if not
+    NULL). */
+void runTrial(const expOptions &c, int config, int seed, ResultsSink *sink, std::vector<float> *rewards) {
+
+  Random rng(1 + seed);
+
+  std::vector<int> statesPerDim;
+  unsigned maxSteps = MAXSTEPS;
+
+  // Construct environment here.
+  Environment* e = createEnvironment(c, rng, PRINTS, &statesPerDim, &maxSteps);
+
+  // planning on the true domain rolls out on a second copy of it, whose
+  // random numbers are separate from the real one's
+  Random* simRng = NULL;
+  Environment* sim = NULL;
+  if (c.plannerType == UCT_WITH_ENV || c.plannerType == ET_UCT_WITH_ENV){
+    std::vector<int> simStatesPerDim;
+    unsigned simMaxSteps = maxSteps;
+    simRng = new Random(1000 + seed);
+    sim = createEnvironment(c, *simRng, false, &simStatesPerDim, &simMaxSteps);
+  }
+
   const int numactions = e->getNumActions(); // Most agents will need this?
 
   std::vector<float> minValues;
@@ -789,10 +1206,10 @@ int main(int argc, char **argv) {
                    << ", Max Reward: " << rMax << endl;
 
   // set rmax as a bonus for certain exploration types
-  if (rMax <= 0.0 && (exploreType == TWO_MODE_PLUS_R ||
-                      exploreType == CONTINUOUS_BONUS_R ||
-                      exploreType == CONTINUOUS_BONUS ||
-                      exploreType == THRESHOLD_BONUS_R)){
+  if (rMax <= 0.0 && (c.exploreType == TWO_MODE_PLUS_R ||
+                      c.exploreType == CONTINUOUS_BONUS_R ||
+                      c.exploreType == CONTINUOUS_BONUS ||
+                      c.exploreType == THRESHOLD_BONUS_R)){
     rMax = 1.0;
   }
 
@@ -800,205 +1217,475 @@ int main(int argc, char **argv) {
   float rsum = 0;
 
   if (statesPerDim.size() == 0){
-    cout << "set statesPerDim to " << nstates << " for all dim" << endl;
-    statesPerDim.resize(minValues.size(), nstates);
+    cout << "set statesPerDim to " << c.nstates << " for all dim" << endl;
+    statesPerDim.resize(minValues.size(), c.nstates);
   }
 
-  for (unsigned j = 0; j < NUMTRIALS; ++j) {
+  // Construct agent here.
+  Agent* agent;
+
+  if (strcmp(c.agentType, "qlearner") == 0){
+    if (PRINTS) cout << "Agent: QLearner" << endl;
+    agent = new QLearner(numactions,
+                         c.discountfactor,
+                         c.initialvalue, //0.0, // initialvalue
+                         c.alpha, // alpha
+                         c.epsilon, // epsilon
+                         rng);
+  }
 
-    // Construct agent here.
-    Agent* agent;
+  else if (strcmp(c.agentType, "dyna") == 0){
+    if (PRINTS) cout << "Agent: Dyna" << endl;
+    agent = new Dyna(numactions,
+                     c.discountfactor,
+                     c.initialvalue, //0.0, // initialvalue
+                     c.alpha, // alpha
+                     c.k, // k
+                     c.epsilon, // epsilon
+                     rng);
+    ((Dyna*)agent)->setBackgroundPlanning(c.background);
+  }
 
-    if (strcmp(agentType, "qlearner") == 0){
-      if (PRINTS) cout << "Agent: QLearner" << endl;
-      agent = new QLearner(numactions,
-                           discountfactor,
-                           initialvalue, //0.0, // initialvalue
-                           alpha, // alpha
-                           epsilon, // epsilon
-                           rng);
-    }
+  else if (strcmp(c.agentType, "sarsa") == 0){
+    if (PRINTS) cout << "Agent: SARSA" << endl;
+    agent = new Sarsa(numactions,
+                      c.discountfactor,
+                      c.initialvalue, //0.0, // initialvalue
+                      c.alpha, // alpha
+                      c.epsilon, // epsilon
+                      c.lambda,
+                      rng);
+    ((Sarsa*)agent)->setTraceOptions(c.minTrace, c.maxTraces, c.replacing);
+  }
 
-    else if (strcmp(agentType, "dyna") == 0){
-      if (PRINTS) cout << "Agent: Dyna" << endl;
-      agent = new Dyna(numactions,
-                       discountfactor,
-                       initialvalue, //0.0, // initialvalue
-                       alpha, // alpha
-                       k, // k
-                       epsilon, // epsilon
-                       rng);
-    }
+  else if (strcmp(c.agentType, "tilecoding") == 0){
+    if (PRINTS) cout << "Agent: Tile Coding" << endl;
+    agent = new TileCodingAgent(numactions,
+                                c.discountfactor,
+                                c.initialvalue,
+                                c.alpha, // alpha
+                                c.epsilon, // epsilon
+                                c.lambda,
+                                (c.nstates > 0) ? c.nstates : 10, // tiles per feature
+                                c.ntilings,
+                                TILE_MEMORY_SIZE,
+                                c.qlambda,
+                                minValues, maxValues,
+                                rng);
+  }
 
-    else if (strcmp(agentType, "sarsa") == 0){
-      if (PRINTS) cout << "Agent: SARSA" << endl;
-      agent = new Sarsa(numactions,
-                        discountfactor,
-                        initialvalue, //0.0, // initialvalue
-                        alpha, // alpha
-                        epsilon, // epsilon
-                        lambda,
-                        rng);
-    }
+  else if (strcmp(c.agentType, "modelbased") == 0 || strcmp(c.agentType, "rmax") == 0 || strcmp(c.agentType, "texplore") == 0){
+    if (PRINTS) cout << "Agent: Model Based" << endl;
+    agent = new ModelBasedAgent(numactions,
+                                c.discountfactor,
+                                rMax, rRange,
+                                c.modelType,
+                                c.exploreType,
+                                c.predType,
+                                c.nmodels,
+                                c.plannerType,
+                                c.epsilon, // epsilon
+                                c.lambda,
+                                (1.0/c.actrate), //0.1, //0.1, //0.01, // max time
+                                c.M,
+                                minValues, maxValues,
+                                statesPerDim,//0,
+                                c.history, c.v, c.n,
+                                c.deptrans, c.reltrans, c.featPct, c.stochastic, episodic,
+                                c.compress, c.expCap, rng);
+    if (sim != NULL)
+      ((ModelBasedAgent*)agent)->setSimulator(e, sim);
+    if (c.modelfile != NULL)
+      ((ModelBasedAgent*)agent)->setModelFile(c.modelfile);
+    ((ModelBasedAgent*)agent)->setOutcomeLimits(c.maxOutcomes, c.minOutcomeProb);
+    if (c.cacheSize >= 0)
+      ((ModelBasedAgent*)agent)->setCacheSize(c.cacheSize);
+  }
 
-    else if (strcmp(agentType, "modelbased") == 0 || strcmp(agentType, "rmax") == 0 || strcmp(agentType, "texplore") == 0){
-      if (PRINTS) cout << "Agent: Model Based" << endl;
-      agent = new ModelBasedAgent(numactions,
-                                  discountfactor,
-                                  rMax, rRange,
-                                  modelType,
-                                  exploreType,
-                                  predType,
-                                  nmodels,
-                                  plannerType,
-                                  epsilon, // epsilon
-                                  lambda,
-                                  (1.0/actrate), //0.1, //0.1, //0.01, // max time
-                                  M,
-                                  minValues, maxValues,
-                                  statesPerDim,//0,
-                                  history, v, n,
-                                  deptrans, reltrans, featPct, stochastic, episodic,
-                                  rng);
-    }
+  else if (strcmp(c.agentType, "savedpolicy") == 0){
+    if (PRINTS) cout << "Agent: Saved Policy" << endl;
+    agent = new SavedPolicy(numactions,c.filename);
+  }
 
-    else if (strcmp(agentType, "savedpolicy") == 0){
-      if (PRINTS) cout << "Agent: Saved Policy" << endl;
-      agent = new SavedPolicy(numactions,filename);
-    }
+  else {
+    std::cerr << "ERROR: Invalid agent type" << endl;
+    exit(-1);
+  }
 
-    else {
-      std::cerr << "ERROR: Invalid agent type" << endl;
-      exit(-1);
+  // start discrete agent if we're discretizing (if nstates > 0 and not agent type 'c')
+  int totalStates = 1;
+  Agent* a2 = agent;
+  // not for model based when doing continuous model, or tile coding
+  if (c.nstates > 0 && (c.modelType != M5ALLMULTI || strcmp(c.agentType, "qlearner") == 0)
+      && strcmp(c.agentType, "tilecoding") != 0){
+    totalStates = powf(c.nstates,minValues.size());
+    if (PRINTS) cout << "Discretize with " << c.nstates << ", total: " << totalStates << endl;
+    agent = new DiscretizationAgent(c.nstates, a2,
+                                    minValues, maxValues, PRINTS);
+  }
+  else {
+    totalStates = 1;
+    for (unsigned i = 0; i < minValues.size(); i++){
+      int range = 1+maxValues[i] - minValues[i];
+      totalStates *= range;
     }
+    if (PRINTS) cout << "No discretization, total: " << totalStates << endl;
+  }
 
-    // start discrete agent if we're discretizing (if nstates > 0 and not agent type 'c')
-    int totalStates = 1;
-    Agent* a2 = agent;
-    // not for model based when doing continuous model
-    if (nstates > 0 && (modelType != M5ALLMULTI || strcmp(agentType, "qlearner") == 0)){
-      totalStates = powf(nstates,minValues.size());
-      if (PRINTS) cout << "Discretize with " << nstates << ", total: " << totalStates << endl;
-      agent = new DiscretizationAgent(nstates, a2,
-                                      minValues, maxValues, PRINTS);
-    }
-    else {
-      totalStates = 1;
-      for (unsigned i = 0; i < minValues.size(); i++){
-        int range = 1+maxValues[i] - minValues[i];
-        totalStates *= range;
+  // before we start, seed the agent with some experiences
+  std::vector<experience> seedings = e->getSeedings();
+  agent->seedExp(seedings);
+
+  if (c.seedlog != NULL)
+    seedFromLog(agent, c.seedlog);
+
+  ExperienceFile explog;
+  if (c.explog != NULL)
+    explog.initFile(c.explog, minValues.size(), true);
+
+  // STEP BY STEP DOMAIN
+  if (!episodic){
+
+    // performance tracking
+    float sum = 0;
+    int steps = 0;
+
+    int a = 0;
+    float r = 0;
+
+    //////////////////////////////////
+    // non-episodic
+    //////////////////////////////////
+    for (unsigned i = 0; i < c.nepisodes; ++i){
+
+      std::vector<float> es = e->sensation();
+      double actStart = getSeconds();
+
+      // first step
+      if (i == 0){
+
+        // first action
+        a = agent->first_action(es);
+
+      } else {
+        // next action
+        a = agent->next_action(r, es);
       }
-      if (PRINTS) cout << "No discretization, total: " << totalStates << endl;
+
+      float latency = getSeconds() - actStart;
+      r = e->apply(a);
+      if (c.explog != NULL) logExperience(&explog, es, a, r, e);
+
+      // update performance
+      sum += r;
+      ++steps;
+
+      if (sink != NULL) sink->recordStep(config, seed, -1, i, a, r, latency);
+      if (rewards != NULL) rewards->push_back(r);
+
     }
+    ///////////////////////////////////
 
-    // before we start, seed the agent with some experiences
-    std::vector<experience> seedings = e->getSeedings();
-    agent->seedExp(seedings);
+    rsum += sum;
 
-    // STEP BY STEP DOMAIN
-    if (!episodic){
+  }
+
+  // EPISODIC DOMAINS
+  else {
+
+    //////////////////////////////////
+    // episodic
+    //////////////////////////////////
+    for (unsigned i = 0; i < c.nepisodes; ++i) {
 
       // performance tracking
       float sum = 0;
       int steps = 0;
-      float trialSum = 0.0;
+      double episodeStart = getSeconds();
+
+      // first action
+      std::vector<float> es = e->sensation();
+      int a = agent->first_action(es);
+      float latency = getSeconds() - episodeStart;
+      float r = e->apply(a);
+      if (c.explog != NULL) logExperience(&explog, es, a, r, e);
+
+      // update performance
+      if (sink != NULL) sink->recordStep(config, seed, i, steps, a, r, latency);
+      sum += r;
+      ++steps;
+
+      while (!e->terminal() && steps < maxSteps) {
+
+        // perform an action
+        es = e->sensation();
+        double actStart = getSeconds();
+        a = agent->next_action(r, es);
+        latency = getSeconds() - actStart;
+        r = e->apply(a);
+        if (c.explog != NULL) logExperience(&explog, es, a, r, e);
+
+        // update performance info
+        if (sink != NULL) sink->recordStep(config, seed, i, steps, a, r, latency);
+        sum += r;
+        ++steps;
+
+      }
+
+      // terminal/last state
+      if (e->terminal()){
+        agent->last_action(r);
+      }else{
+        agent->next_action(r, e->sensation());
+      }
 
-      int a = 0;
-      float r = 0;
+      e->reset();
+      if (sink != NULL) sink->recordEpisode(config, seed, i, steps, sum, getSeconds() - episodeStart);
+      if (rewards != NULL) rewards->push_back(sum);
 
-      //////////////////////////////////
-      // non-episodic
-      //////////////////////////////////
-      for (unsigned i = 0; i < NUMEPISODES; ++i){
+      rsum += sum;
 
-        std::vector<float> es = e->sensation();
+    }
 
-        // first step
-        if (i == 0){
+  }
 
-          // first action
-          a = agent->first_action(es);
-          r = e->apply(a);
+  delete agent;
 
-        } else {
-          // next action
-          a = agent->next_action(r, es);
-          r = e->apply(a);
-        }
+  delete e;
+  delete sim;
+  delete simRng;
 
-        // update performance
-        sum += r;
-        ++steps;
+  if (PRINTS) cout << "Rsum(seed " << seed << "): " << rsum << endl;
+
+}
 
-        std::cerr << r << endl;
 
-      }
-      ///////////////////////////////////
+void* runTrialsStart(void* arg){
+  trialQueue* q = (trialQueue*)arg;
 
-      rsum += sum;
-      trialSum += sum;
-      if (PRINTS) cout << "Rsum(trial " << j << "): " << trialSum << " Avg: "
-                       << (rsum / (float)(j+1))<< endl;
+  while (true){
+    pthread_mutex_lock(&q->queue_mutex);
+    unsigned i = q->next++;
+    pthread_mutex_unlock(&q->queue_mutex);
 
+    if (i >= q->jobs->size())
+      break;
+
+    trialJob &j = (*q->jobs)[i];
+    runTrial(*j.options, j.config, j.seed, q->sink, &j.rewards);
+  }
+
+  return NULL;
+}
+
+
+/** Default # of trials to run at once: one per processor, unless a
+    config plans in real time, where each trial keeps a planning and a
+    model learning thread busy along with the one acting. */
+int defaultThreads(const std::vector<expOptions> &configs){
+  int nprocs = sysconf(_SC_NPROCESSORS_ONLN);
+
+  for (unsigned i = 0; i < configs.size(); i++){
+    const expOptions &c = configs[i];
+    bool modelBased = strcmp(c.agentType, "texplore") == 0 ||
+      strcmp(c.agentType, "modelbased") == 0 ||
+      strcmp(c.agentType, "rmax") == 0;
+    if (modelBased && (c.plannerType == PARALLEL_ET_UCT ||
+                       c.plannerType == PAR_ETUCT_ACTUAL ||
+                       c.plannerType == POMDP_PAR_ETUCT)){
+      if (nprocs < 3)
+        return 1;
+      return nprocs / 3;
     }
+  }
 
-    // EPISODIC DOMAINS
-    else {
+  return nprocs;
+}
 
-      //////////////////////////////////
-      // episodic
-      //////////////////////////////////
-      for (unsigned i = 0; i < NUMEPISODES; ++i) {
 
-        // performance tracking
-        float sum = 0;
-        int steps = 0;
+/** Run all the trials, each on the next free one of nthreads threads
+    (one per processor if nthreads is 0), recording them in the sink if
+    there is one. */
+void runTrials(std::vector<trialJob> *jobs, int nthreads, ResultsSink *sink){
 
-        // first action
-        std::vector<float> es = e->sensation();
-        int a = agent->first_action(es);
-        float r = e->apply(a);
+  if (nthreads <= 0) nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+  if (nthreads > (int)jobs->size()) nthreads = jobs->size();
+  if (nthreads < 1) nthreads = 1;
 
-        // update performance
-        sum += r;
-        ++steps;
+  trialQueue queue;
+  queue.jobs = jobs;
+  queue.sink = sink;
+  queue.next = 0;
+  pthread_mutex_init(&queue.queue_mutex, NULL);
+
+  std::vector<pthread_t> threads;
+  for (int i = 0; i < nthreads; i++){
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, runTrialsStart, &queue) != 0)
+      break;
+    threads.push_back(thread);
+  }
 
-        while (!e->terminal() && steps < MAXSTEPS) {
+  // run them here if we could not start any threads
+  if (threads.size() == 0)
+    runTrialsStart(&queue);
 
-          // perform an action
-          es = e->sensation();
-          a = agent->next_action(r, es);
-          r = e->apply(a);
+  for (unsigned i = 0; i < threads.size(); i++){
+    pthread_join(threads[i], NULL);
+  }
+  pthread_mutex_destroy(&queue.queue_mutex);
 
-          // update performance info
-          sum += r;
-          ++steps;
+}
 
-        }
 
-        // terminal/last state
-        if (e->terminal()){
-          agent->last_action(r);
-        }else{
-          agent->next_action(r, e->sensation());
-        }
+/** Print the rewards of the trials of each config to out: a line per
+    episode with the episode, the mean over the seeds, then the reward of
+    each seed. */
+void printRewards(std::ostream &out,
+                  const std::vector<trialJob> &jobs,
+                  const std::vector<expOptions> &configs,
+                  const std::vector<std::string> &configArgs,
+                  int argc, char **argv){
+
+  for (unsigned i = 0; i < configs.size(); i++){
+    std::vector<const trialJob*> trials;
+    for (unsigned j = 0; j < jobs.size(); j++){
+      if (jobs[j].options == &configs[i])
+        trials.push_back(&jobs[j]);
+    }
 
-        e->reset();
-        std::cerr << sum << endl;
+    out << "# options:";
+    for (int j = 1; j < argc; j++)
+      out << " " << argv[j];
+    out << " " << configArgs[i] << endl;
 
-        rsum += sum;
+    out << "# seeds:";
+    for (unsigned j = 0; j < trials.size(); j++)
+      out << " " << trials[j]->seed;
+    out << endl;
+
+    unsigned nepisodes = trials[0]->rewards.size();
+    for (unsigned ep = 0; ep < nepisodes; ep++){
+      float sum = 0;
+      for (unsigned j = 0; j < trials.size(); j++)
+        sum += trials[j]->rewards[ep];
+
+      out << ep << " " << (sum / (float)trials.size());
+      for (unsigned j = 0; j < trials.size(); j++)
+        out << " " << trials[j]->rewards[ep];
+      out << endl;
+    }
+
+    // blank line between configs
+    if (i < configs.size() - 1)
+      out << endl;
+  }
 
+}
+
+
+int main(int argc, char **argv) {
+
+  expOptions base;
+  parseOptions(argc, argv, &base);
+
+  // one set of options for each line of the sweep file, or just the base ones
+  std::vector<expOptions> configs;
+  std::vector<std::string> configArgs;
+
+  // the options point into these, so keep them until we're done
+  std::vector<char*> sweepStrings;
+
+  if (base.sweepfile != NULL){
+    std::ifstream sweep(base.sweepfile);
+    if (!sweep.is_open()){
+      std::cerr << "Could not open sweep file " << base.sweepfile << endl;
+      exit(-1);
+    }
+
+    std::string line;
+    while (std::getline(sweep, line)){
+      // anything after a # is a comment
+      line = line.substr(0, line.find('#'));
+      std::istringstream tokens(line);
+      std::string token;
+
+      // add the options of this line after the base ones
+      std::vector<char*> sweepArgv(argv, argv + argc);
+      while (tokens >> token){
+        sweepArgv.push_back(strdup(token.c_str()));
+        sweepStrings.push_back(sweepArgv.back());
       }
+      if ((int)sweepArgv.size() == argc) continue;
+
+      int sweepArgc = sweepArgv.size();
+      sweepArgv.push_back(NULL);
 
+      expOptions opts;
+      parseOptions(sweepArgc, &sweepArgv[0], &opts);
+      configs.push_back(opts);
+      configArgs.push_back(line);
     }
 
-    delete agent;
+    if (configs.size() == 0){
+      std::cerr << "No options in sweep file " << base.sweepfile << endl;
+      exit(-1);
+    }
+  } else {
+    configs.push_back(base);
+    configArgs.push_back("");
+  }
 
+  // a trial of each config for each seed
+  std::vector<trialJob> jobs;
+  for (unsigned i = 0; i < configs.size(); i++){
+    for (int t = 0; t < base.trials; t++){
+      trialJob job;
+      job.options = &configs[i];
+      job.config = i;
+      job.seed = configs[i].seed + t;
+      jobs.push_back(job);
+    }
   }
 
-  delete e;
+  if (jobs.size() > 1){
+    for (unsigned i = 0; i < configs.size(); i++){
+      if (configs[i].explog != NULL){
+        std::cerr << "--explog can only be used with a single trial" << endl;
+        exit(-1);
+      }
+    }
+  }
+
+  // just one trial: run it here, with its results going straight to
+  // the sink. otherwise the text results are the rewards of all the
+  // trials, printed together once they are done.
+  if (jobs.size() == 1){
+    ResultsSink sink(base.resultFormat, base.resultsfile);
+    runTrial(*jobs[0].options, jobs[0].config, jobs[0].seed, &sink, NULL);
+  } else {
+    ResultsSink* sink = NULL;
+    if (base.resultFormat != RESULTS_TEXT)
+      sink = new ResultsSink(base.resultFormat, base.resultsfile);
+
+    int nthreads = base.threads;
+    if (nthreads <= 0)
+      nthreads = defaultThreads(configs);
+    runTrials(&jobs, nthreads, sink);
+
+    if (sink != NULL){
+      delete sink;
+      printRewards(std::cerr, jobs, configs, configArgs, argc, argv);
+    } else if (base.resultsfile != NULL){
+      std::ofstream out(base.resultsfile);
+      printRewards(out, jobs, configs, configArgs, argc, argv);
+    } else {
+      printRewards(std::cerr, jobs, configs, configArgs, argc, argv);
+    }
+  }
 
-  if (PRINTS) cout << "Avg Rsum: " << (rsum / (float)NUMTRIALS) << endl;
+  for (unsigned i = 0; i < sweepStrings.size(); i++){
+    free(sweepStrings[i]);
+  }
 
 } // end main
-